@@ -366,6 +366,9 @@ struct param_disk_struct
   int (*pwrite)(disk_t *disk, const void *buf, const unsigned int count, const uint64_t offset);
   int (*sync)(disk_t *disk);
   void (*clean)(disk_t *disk);
+  /* Optional, return a pointer to count bytes at offset if the data can be
+   * accessed in place, NULL otherwise */
+  const unsigned char *(*pview)(disk_t *disk, const unsigned int count, const uint64_t offset);
   const arch_fnct_t *arch;
   const arch_fnct_t *arch_autodetected;
   void *data;
@@ -59,6 +59,8 @@
 #include "file_jpg.h"
 #include "ntfs_dir.h"
 #include "misc.h"
+#include "profile.h"
+#include "phhash.h"
 #include "dfxml.h"
 
 static FILE *xml_handle = NULL;
@@ -290,6 +292,46 @@ void xml_shutdown(void)
   xml_close();
 }
 
+/* Time spent in each stage since the beginning of the pass */
+void xml_log_profile(const file_stat_t *file_stats, const double ticks_per_second)
+{
+  unsigned int i;
+  if(xml_handle==NULL)
+    return;
+  xml_push("profile", "");
+  for(i=0; i<PROF_STAGES; i++)
+  {
+    if(prof.stage[i].calls > 0)
+      xml_printf("<stage name='%s' calls='%llu' seconds='%.6f'/>\n",
+	  prof_stage_name((prof_stage_t)i),
+	  (long long unsigned)prof.stage[i].calls,
+	  prof.stage[i].ticks / ticks_per_second);
+  }
+  if(prof.io.calls > 0)
+  {
+    xml_printf("<device_reads calls='%llu' bytes='%llu' seconds='%.6f'/>\n",
+	(long long unsigned)prof.io.calls,
+	(long long unsigned)prof.io_bytes,
+	prof.io.ticks / ticks_per_second);
+    for(i=0; i<PROF_HIST_SIZE; i++)
+    {
+      if(prof.io_latency[i] > 0)
+	xml_printf("<read_latency max_us='%.3f' count='%llu'/>\n",
+	    (double)((uint64_t)2 << i) * 1000000.0 / ticks_per_second,
+	    (long long unsigned)prof.io_latency[i]);
+    }
+  }
+  for(i=0; file_stats[i].file_hint!=NULL; i++)
+  {
+    if(file_stats[i].ticks > 0)
+      xml_printf("<format name='%s' headers='%u' seconds='%.6f'/>\n",
+	  (file_stats[i].file_hint->extension!=NULL ? file_stats[i].file_hint->extension : ""),
+	  file_stats[i].header_hits,
+	  file_stats[i].ticks / ticks_per_second);
+  }
+  xml_pop("profile");
+}
+
 /* If fname begins with xml_dir then just return the relative part */
 static const char *relative_name(const char *fname)
 {
@@ -305,6 +347,7 @@ void xml_log_file_recovered(const file_recovery_t *file_recovery)
 {
   struct td_list_head *tmp;
   uint64_t file_size=0;
+  unsigned int i;
   if(xml_handle==NULL)
     return;
   if(file_recovery==NULL || file_recovery->filename[0]=='\0')
@@ -312,6 +355,12 @@ void xml_log_file_recovered(const file_recovery_t *file_recovery)
   xml_push("fileobject", "");
   xml_out2s("filename", relative_name(file_recovery->filename));
   xml_out2i("filesize", file_recovery->file_size);
+  for(i=PHHASH_MD5; i<=PHHASH_SHA256; i<<=1)
+  {
+    const char *hash=phhash_get(file_recovery, i);
+    if(hash!=NULL)
+      xml_printf("<hashdigest type='%s'>%s</hashdigest>\n", phhash_name(i), hash);
+  }
   xml_push("byte_runs", "");
   td_list_for_each(tmp, &file_recovery->location.list)
   {
@@ -0,0 +1,69 @@
+/*
+
+    File: digest.h
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+#ifndef _DIGEST_H
+#define _DIGEST_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MD5_DIGEST_SIZE		16
+#define SHA1_DIGEST_SIZE	20
+#define SHA256_DIGEST_SIZE	32
+
+/* MD5 (RFC 1321), SHA-1 and SHA-256 (FIPS 180-4) */
+struct md5_ctx
+{
+  uint32_t state[4];
+  uint64_t size;
+  unsigned char buffer[64];
+};
+
+struct sha1_ctx
+{
+  uint32_t state[5];
+  uint64_t size;
+  unsigned char buffer[64];
+};
+
+struct sha256_ctx
+{
+  uint32_t state[8];
+  uint64_t size;
+  unsigned char buffer[64];
+};
+
+void md5_init(struct md5_ctx *ctx);
+void md5_update(struct md5_ctx *ctx, const void *data, size_t size);
+void md5_final(struct md5_ctx *ctx, unsigned char *digest);
+
+void sha1_init(struct sha1_ctx *ctx);
+void sha1_update(struct sha1_ctx *ctx, const void *data, size_t size);
+void sha1_final(struct sha1_ctx *ctx, unsigned char *digest);
+
+void sha256_init(struct sha256_ctx *ctx);
+void sha256_update(struct sha256_ctx *ctx, const void *data, size_t size);
+void sha256_final(struct sha256_ctx *ctx, unsigned char *digest);
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+#endif
@@ -38,17 +38,27 @@
 #include <sys/stat.h>
 #endif
 #include <fcntl.h>
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
 #include "types.h"
 #include "common.h"
 #include "intrf.h"
 #include "intrfn.h"
 #include "log.h"
+#include "rescuemap.h"
 #include "dimage.h"
 
 
 #define READ_SIZE 256*512
-/* Skip 10Mb when there is a read error */
+/* Skip 64KiB when there is a read error, up to 10Mb on consecutive errors */
+#define SKIP_SIZE_MIN 64*1024
 #define SKIP_SIZE 10*1024*1024
+/* Seconds between two saves of the rescue map */
+#define MAP_SAVE_INTERVAL 30
 
 #ifndef O_LARGEFILE
 #define O_LARGEFILE 0
@@ -57,202 +67,378 @@
 #define O_BINARY 0
 #endif
 
-static void disk_image_backward(int disk_dst, disk_t *disk, const uint64_t src_offset_start, const uint64_t src_offset_end, uint64_t dst_offset)
+struct dimage_struct
+{
+  disk_t *disk;
+  const partition_t *partition;
+  int disk_dst;
+  rescue_map_t *map;
+  const char *map_name;
+  unsigned char *buffer;
+  time_t previous_time;
+  time_t next_save;
+#ifdef HAVE_NCURSES
+  WINDOW *window;
+#endif
+};
+
+static int dimage_read(struct dimage_struct *d, const unsigned int size, const uint64_t pos)
+{
+  const int pread_res=d->disk->pread(d->disk, d->buffer, size, d->partition->part_offset + pos);
+  return ((unsigned)pread_res == size ? 0 : -1);
+}
+
+static int dimage_write(struct dimage_struct *d, const unsigned int size, const uint64_t pos)
+{
+#if defined(HAVE_PWRITE)
+  if(pwrite(d->disk_dst, d->buffer, size, pos) != (ssize_t)size)
+    return -1;
+#else
+  if(lseek(d->disk_dst, pos, SEEK_SET)<0)
+    return -1;
+  if(write(d->disk_dst, d->buffer, size) != (ssize_t)size)
+    return -1;
+#endif
+  return 0;
+}
+
+/* Copy [pos, pos+size[ if it can be read, return 2 if the image can't be written */
+static int dimage_copy_block(struct dimage_struct *d, const unsigned int size, const uint64_t pos, const char status_error)
+{
+  if(dimage_read(d, size, pos) < 0)
+  {
+    rescue_map_set(d->map, pos, size, status_error);
+    return -1;
+  }
+  if(dimage_write(d, size, pos) < 0)
+    return 2;
+  rescue_map_set(d->map, pos, size, RESCUE_FINISHED);
+  return 0;
+}
+
+static int dimage_update(struct dimage_struct *d, const uint64_t pos, const char status)
 {
-  uint64_t src_offset;
-  unsigned char *buffer=(unsigned char *)MALLOC(disk->sector_size);
-  for(src_offset=src_offset_end-disk->sector_size; src_offset > src_offset_start; src_offset-=disk->sector_size, dst_offset-=disk->sector_size)
+  const time_t current_time=time(NULL);
+  d->map->current_pos=pos;
+  d->map->current_status=status;
+  if(current_time == d->previous_time)
+    return 0;
+  d->previous_time=current_time;
+  if(current_time >= d->next_save)
+  {
+    rescue_map_save(d->map, d->map_name);
+    d->next_save=current_time + MAP_SAVE_INTERVAL;
+  }
+#ifdef HAVE_NCURSES
   {
-    const ssize_t pread_res=disk->pread(disk, buffer, disk->sector_size, src_offset);
-    if((unsigned)pread_res != disk->sector_size)
+    unsigned int i;
+    const uint64_t finished=rescue_map_size(d->map, RESCUE_FINISHED);
+    const uint64_t bad=rescue_map_size(d->map, RESCUE_BAD_SECTOR);
+    const float percent=finished*100.00/d->partition->part_size;
+    wmove(d->window,7,0);
+    wprintw(d->window,"%3.2f %% ", percent);
+    for(i=0;i<percent*3/5;i++)
+      wprintw(d->window,"=");
+    wprintw(d->window,">");
+    wclrtoeol(d->window);
+    wmove(d->window,8,0);
+    switch(status)
     {
-      free(buffer);
-      return;
+      case RESCUE_NON_TRIED:
+	wprintw(d->window, "Copying ");
+	break;
+      case RESCUE_NON_TRIMMED:
+	wprintw(d->window, "Trimming");
+	break;
+      default:
+	wprintw(d->window, "Scraping");
+	break;
     }
-#if defined(HAVE_PWRITE)
-    if(pwrite(disk_dst, buffer, pread_res, src_offset)<0)
+    wprintw(d->window, " %llu/%llu MB, bad sectors: %llu MB",
+	(long long unsigned)(pos/1000/1000),
+	(long long unsigned)(d->partition->part_size/1000/1000),
+	(long long unsigned)(bad/1000/1000));
+    wclrtoeol(d->window);
+    wrefresh(d->window);
+    return check_enter_key_or_s(d->window);
+  }
+#else
+  return 0;
+#endif
+}
+
+/* Forward copy of the non-tried areas, skipping ahead on read errors */
+static int dimage_copy(struct dimage_struct *d)
+{
+  uint64_t pos=0;
+  uint64_t skip=SKIP_SIZE_MIN;
+  while(1)
+  {
+    const unsigned int idx=rescue_map_find(d->map, pos);
+    uint64_t extent_end;
+    unsigned int size;
+    int res;
+    if(idx >= d->map->nbr)
+      return 0;
+    extent_end=d->map->extents[idx].pos + d->map->extents[idx].size;
+    if(d->map->extents[idx].status!=RESCUE_NON_TRIED)
     {
-      free(buffer);
-      return;
+      pos=extent_end;
+      continue;
     }
-#else
-    if(lseek(disk_dst, src_offset, SEEK_SET)<0)
+    size=(extent_end - pos < READ_SIZE ? extent_end - pos : READ_SIZE);
+    res=dimage_copy_block(d, size, pos, RESCUE_NON_TRIMMED);
+    if(res==2)
+      return 2;
+    pos+=size;
+    if(res==0)
+      skip=SKIP_SIZE_MIN;
+    else
     {
-      free(buffer);
-      return;
+      pos+=(extent_end - pos < skip ? extent_end - pos : skip);
+      if(skip < SKIP_SIZE)
+	skip*=2;
     }
-    if(write(disk_dst, buffer, pread_res) != pread_res)
+    if(dimage_update(d, pos, RESCUE_NON_TRIED))
+      return 1;
+  }
+}
+
+/* Backward copy of the areas skipped by dimage_copy() */
+static int dimage_copy_backward(struct dimage_struct *d)
+{
+  uint64_t pos=d->partition->part_size;
+  while(pos > 0)
+  {
+    const unsigned int idx=rescue_map_find(d->map, pos - 1);
+    uint64_t start;
+    int res;
+    if(idx >= d->map->nbr)
+      return 0;
+    if(d->map->extents[idx].status!=RESCUE_NON_TRIED)
     {
-      free(buffer);
-      return;
+      pos=d->map->extents[idx].pos;
+      continue;
+    }
+    start=(pos - d->map->extents[idx].pos < READ_SIZE ? d->map->extents[idx].pos : pos - READ_SIZE);
+    res=dimage_copy_block(d, pos - start, start, RESCUE_NON_TRIMMED);
+    if(res==2)
+      return 2;
+    pos=start;
+    if(dimage_update(d, pos, RESCUE_NON_TRIED))
+      return 1;
+  }
+  return 0;
+}
+
+/* Read the edges of the failed blocks sector by sector */
+static int dimage_trim(struct dimage_struct *d)
+{
+  const unsigned int sector_size=d->disk->sector_size;
+  uint64_t pos=0;
+  while(1)
+  {
+    const unsigned int idx=rescue_map_find(d->map, pos);
+    uint64_t start;
+    uint64_t end;
+    if(idx >= d->map->nbr)
+      return 0;
+    start=d->map->extents[idx].pos;
+    end=start + d->map->extents[idx].size;
+    pos=end;
+    if(d->map->extents[idx].status!=RESCUE_NON_TRIMMED)
+      continue;
+    while(start < end)
+    {
+      const unsigned int size=(end - start < sector_size ? end - start : sector_size);
+      const int res=dimage_copy_block(d, size, start, RESCUE_BAD_SECTOR);
+      if(res==2)
+	return 2;
+      start+=size;
+      if(dimage_update(d, start, RESCUE_NON_TRIMMED))
+	return 1;
+      if(res<0)
+	break;
+    }
+    while(end > start)
+    {
+      const unsigned int size=((end - start) % sector_size != 0 ? (end - start) % sector_size : sector_size);
+      const int res=dimage_copy_block(d, size, end - size, RESCUE_BAD_SECTOR);
+      if(res==2)
+	return 2;
+      end-=size;
+      if(dimage_update(d, end, RESCUE_NON_TRIMMED))
+	return 1;
+      if(res<0)
+	break;
+    }
+    if(end > start)
+      rescue_map_set(d->map, start, end - start, RESCUE_NON_SCRAPED);
+  }
+}
+
+/* Read the remaining failed blocks sector by sector */
+static int dimage_scrape(struct dimage_struct *d)
+{
+  const unsigned int sector_size=d->disk->sector_size;
+  uint64_t pos=0;
+  while(1)
+  {
+    const unsigned int idx=rescue_map_find(d->map, pos);
+    uint64_t end;
+    if(idx >= d->map->nbr)
+      return 0;
+    end=d->map->extents[idx].pos + d->map->extents[idx].size;
+    if(d->map->extents[idx].status!=RESCUE_NON_SCRAPED)
+    {
+      pos=end;
+      continue;
+    }
+    while(pos < end)
+    {
+      const unsigned int size=(end - pos < sector_size ? end - pos : sector_size);
+      if(dimage_copy_block(d, size, pos, RESCUE_BAD_SECTOR)==2)
+	return 2;
+      pos+=size;
+      if(dimage_update(d, pos, RESCUE_NON_SCRAPED))
+	return 1;
     }
-#endif
   }
-  free(buffer);
 }
 
 int disk_image(disk_t *disk, const partition_t *partition, const char *image_dd)
 {
   int ind_stop=0;
-  uint64_t nbr_read_error=0;
-  uint64_t src_offset=partition->part_offset;
-  uint64_t src_offset_old;
-  uint64_t dst_offset=0;
-  const uint64_t src_offset_end=partition->part_offset+partition->part_size;
-  const uint64_t offset_inc=(src_offset_end-src_offset)/10000;
-  uint64_t src_offset_next=src_offset;
+  uint64_t bad;
   struct stat stat_buf;
-  unsigned char *buffer=(unsigned char *)MALLOC(READ_SIZE);
-  unsigned int readsize=READ_SIZE;
-  int disk_dst;
-#ifdef HAVE_NCURSES
-  WINDOW *window;
-#endif
-  if((disk_dst=open(image_dd, O_CREAT|O_LARGEFILE|O_RDWR|O_BINARY, 0644)) < 0)
+  char *map_name;
+  struct dimage_struct d;
+  d.disk=disk;
+  d.partition=partition;
+  d.previous_time=0;
+  d.next_save=time(NULL) + MAP_SAVE_INTERVAL;
+  if((d.disk_dst=open(image_dd, O_CREAT|O_LARGEFILE|O_RDWR|O_BINARY, 0644)) < 0)
   {
     log_error("Can't create file %s.\n",image_dd);
     display_message("Can't create file!\n");
-    free(buffer);
     return -1;
   }
-  if(fstat(disk_dst, &stat_buf)==0)
+  map_name=rescue_map_filename(image_dd);
+  d.map_name=map_name;
+  d.map=rescue_map_load(map_name);
+  if(d.map!=NULL &&
+      d.map->extents[d.map->nbr-1].pos + d.map->extents[d.map->nbr-1].size != partition->part_size)
+  {
+    log_warning("%s doesn't match the size of the partition, ignored\n", map_name);
+    rescue_map_free(d.map);
+    d.map=NULL;
+  }
+  if(d.map!=NULL)
   {
     int res=1;
 #ifdef HAVE_NCURSES
-    if(stat_buf.st_size > 0)
-      res=ask_confirmation("Append to existing file ? (Y/N)");
+    res=ask_confirmation("Resume the image creation using %s ? (Y/N)", map_name);
 #endif
-    if(res>0)
+    if(res==0)
     {
-      dst_offset=stat_buf.st_size;
-      src_offset+=dst_offset;
+      rescue_map_free(d.map);
+      d.map=NULL;
     }
+    else
+      log_info("Resume image creation using %s\n", map_name);
   }
-  src_offset_old=src_offset;
-#ifdef HAVE_NCURSES
-  window=newwin(LINES, COLS, 0, 0);	/* full screen */
-  aff_copy(window);
-  wmove(window,5,0);
-  wprintw(window,"%s\n",disk->description_short(disk));
-  wmove(window,6,0);
-  aff_part(window,AFF_PART_ORDER|AFF_PART_STATUS,disk,partition);
-  wmove(window,10,0);
-  waddstr(window, "Disk images are mainly used ");
-  wmove(window,11,0);
-  waddstr(window, "- for forensics purpose");
-  wmove(window,12,0);
-  waddstr(window, "- or to deal with media with bad sectors");
-#ifdef WIN32
-  wmove(window,14,0);
-  waddstr(window, "To use TestDisk or PhotoRec with this disk image, go in command line and run");
-  wmove(window,15,0);
-  waddstr(window, "   testdisk_win.exe image.dd");
-  wmove(window,16,0);
-  waddstr(window, "or photorec_win.exe image.dd");
-#else
-  wmove(window,14,0);
-  waddstr(window, "To use TestDisk or PhotoRec with this disk image, start a Terminal and run");
-  wmove(window,15,0);
-  waddstr(window, "   testdisk image.dd");
-  wmove(window,16,0);
-  waddstr(window, "or photorec image.dd");
-#endif
-  wmove(window,22,0);
-  wattrset(window, A_REVERSE);
-  waddstr(window,"  Stop  ");
-  wattroff(window, A_REVERSE);
-#endif
-  while(ind_stop==0 && src_offset < src_offset_end)
+  if(d.map==NULL)
   {
-    ssize_t pread_res;
-    int update=0;
-    if(src_offset_end-src_offset < readsize)
-      readsize=src_offset_end-src_offset;
-    pread_res=disk->pread(disk, buffer, readsize, src_offset);
-    if(pread_res > 0)
+    d.map=rescue_map_new(partition->part_size);
+    if(fstat(d.disk_dst, &stat_buf)==0 && stat_buf.st_size > 0)
     {
-#if defined(HAVE_PWRITE)
-      if(pwrite(disk_dst, buffer, pread_res, dst_offset)<0)
-      {
-	ind_stop=2;
-      }
-#else
-      if(lseek(disk_dst, dst_offset, SEEK_SET)<0)
-      {
-	ind_stop=2;
-      }
-      if(write(disk_dst, buffer, pread_res) != pread_res)
-      {
-	ind_stop=2;
-      }
+      int res=1;
+#ifdef HAVE_NCURSES
+      res=ask_confirmation("Append to existing file ? (Y/N)");
 #endif
-      if(src_offset_old + SKIP_SIZE==src_offset)
-      {
-	disk_image_backward(disk_dst, disk, src_offset_old, src_offset, dst_offset);
-      }
-    }
-    src_offset_old=src_offset;
-    if((unsigned)pread_res == readsize)
-    {
-      src_offset+=readsize;
-      dst_offset+=readsize;
-      readsize=READ_SIZE;
+      if(res>0)
+	rescue_map_set(d.map, 0,
+	    ((uint64_t)stat_buf.st_size < partition->part_size ? (uint64_t)stat_buf.st_size : partition->part_size),
+	    RESCUE_FINISHED);
     }
-    else
-    {
-      update=1;
-      nbr_read_error++;
-      readsize=disk->sector_size;
-      src_offset+=SKIP_SIZE;
-      dst_offset+=SKIP_SIZE;
-    }
-    if(src_offset>src_offset_next)
-    {
-      update=1;
-      src_offset_next=src_offset+offset_inc;
-    }
-    if(update)
-    {
+  }
+  d.buffer=(unsigned char *)MALLOC(READ_SIZE);
 #ifdef HAVE_NCURSES
-      unsigned int i;
-      const float percent=(src_offset-partition->part_offset)*100.00/partition->part_size;
-      wmove(window,7,0);
-      wprintw(window,"%3.2f %% ", percent);
-      for(i=0;i<percent*3/5;i++)
-	wprintw(window,"=");
-      wprintw(window,">");
-      wrefresh(window);
-      ind_stop=check_enter_key_or_s(window);
+  d.window=newwin(LINES, COLS, 0, 0);	/* full screen */
+  aff_copy(d.window);
+  wmove(d.window,5,0);
+  wprintw(d.window,"%s\n",disk->description_short(disk));
+  wmove(d.window,6,0);
+  aff_part(d.window,AFF_PART_ORDER|AFF_PART_STATUS,disk,partition);
+  wmove(d.window,10,0);
+  waddstr(d.window, "Disk images are mainly used ");
+  wmove(d.window,11,0);
+  waddstr(d.window, "- for forensics purpose");
+  wmove(d.window,12,0);
+  waddstr(d.window, "- or to deal with media with bad sectors");
+#ifdef WIN32
+  wmove(d.window,14,0);
+  waddstr(d.window, "To use TestDisk or PhotoRec with this disk image, go in command line and run");
+  wmove(d.window,15,0);
+  waddstr(d.window, "   testdisk_win.exe image.dd");
+  wmove(d.window,16,0);
+  waddstr(d.window, "or photorec_win.exe image.dd");
+#else
+  wmove(d.window,14,0);
+  waddstr(d.window, "To use TestDisk or PhotoRec with this disk image, start a Terminal and run");
+  wmove(d.window,15,0);
+  waddstr(d.window, "   testdisk image.dd");
+  wmove(d.window,16,0);
+  waddstr(d.window, "or photorec image.dd");
 #endif
-    }
+  wmove(d.window,18,0);
+  waddstr(d.window, "Unreadable sectors are listed in image.dd.map, PhotoRec will skip them.");
+  wmove(d.window,22,0);
+  wattrset(d.window, A_REVERSE);
+  waddstr(d.window,"  Stop  ");
+  wattroff(d.window, A_REVERSE);
+#endif
+  ind_stop=dimage_copy(&d);
+  if(ind_stop==0)
+    ind_stop=dimage_copy_backward(&d);
+  if(ind_stop==0)
+    ind_stop=dimage_trim(&d);
+  if(ind_stop==0)
+  {
+    ind_stop=dimage_scrape(&d);
+    if(ind_stop==0)
+      d.map->current_status=RESCUE_FINISHED;
   }
-  close(disk_dst);
+  rescue_map_save(d.map, map_name);
+  close(d.disk_dst);
 #ifdef HAVE_NCURSES
-  delwin(window);
+  delwin(d.window);
   (void) clearok(stdscr, TRUE);
 #ifdef HAVE_TOUCHWIN
   touchwin(stdscr);
 #endif
 #endif
+  bad=partition->part_size - rescue_map_size(d.map, RESCUE_FINISHED) - rescue_map_size(d.map, RESCUE_NON_TRIED);
+  log_info("%s: %llu bytes unreadable\n", image_dd, (long long unsigned)bad);
+  rescue_map_free(d.map);
+  free(map_name);
+  free(d.buffer);
   if(ind_stop==2)
   {
     display_message("No space left for the file image.\n");
-    free(buffer);
     return -2;
   }
   if(ind_stop)
   {
-    if(nbr_read_error==0)
+    if(bad==0)
       display_message("Incomplete image created.\n");
     else
       display_message("Incomplete image created: read errors have occured.\n");
-    free(buffer);
     return 0;
   }
-  if(nbr_read_error==0)
+  if(bad==0)
     display_message("Image created successfully.\n");
   else
     display_message("Image created successfully but read errors have occured.\n");
-  free(buffer);
   return 0;
 }
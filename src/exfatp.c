@@ -88,27 +88,16 @@ unsigned int exfat_remove_used_space(disk_t *disk, const partition_t *partition,
     cluster_bitmap=le32(bitmap->first_cluster);
     log_trace("exfat_remove_used_space\n");
     buffer=(unsigned char *)MALLOC(1<<cluster_shift);
-    for(i=2; i<le32(exfat_header->total_clusters)+2; i++)
+    /* Each cluster of the bitmap describes 8<<cluster_shift clusters */
+    for(i=2; i<le32(exfat_header->total_clusters)+2; i+=(8<<cluster_shift))
     {
-      const unsigned int offset_o=(i-2)%(8<<cluster_shift);
-      if(offset_o==0)
-      {
-	exfat_read_cluster(disk, partition, exfat_header, buffer, cluster_bitmap);
-	cluster_bitmap=get_next_cluster(disk, partition, UP_FAT32, start_exfat1, cluster_bitmap);
-      }
-      if(((buffer[offset_o/8]>>(offset_o%8))&1) != 0)
-      {
-	/* Not free */
-	if(end_free+1==partition->part_offset + exfat_cluster_to_offset(exfat_header, i))
-	  end_free+=(1<<cluster_shift);
-	else
-	{
-	  if(start_free != end_free)
-	    del_search_space(list_search_space, start_free, end_free);
-	  start_free=partition->part_offset + exfat_cluster_to_offset(exfat_header, i);
-	  end_free=start_free + (1<<cluster_shift) - 1;
-	}
-      }
+      const unsigned int nbr_bits=(le32(exfat_header->total_clusters)+2 - i < (8U<<cluster_shift) ?
+	  le32(exfat_header->total_clusters)+2 - i : (8U<<cluster_shift));
+      exfat_read_cluster(disk, partition, exfat_header, buffer, cluster_bitmap);
+      cluster_bitmap=get_next_cluster(disk, partition, UP_FAT32, start_exfat1, cluster_bitmap);
+      del_search_space_bitmap(list_search_space, buffer, nbr_bits,
+	  partition->part_offset + exfat_cluster_to_offset(exfat_header, i),
+	  1<<cluster_shift, &start_free, &end_free);
     }
     free(buffer);
     if(start_free != end_free)
@@ -89,25 +89,30 @@ unsigned int ext2_remove_used_space(disk_t *disk, const partition_t *partition,
 #endif
     log_trace("ext2_remove_used_space %lu-%lu\n", start, end);
     buffer=(unsigned char *)MALLOC(sizeof_buffer);
-    for(block=start;block<=end;block++)
+    /* Copy the bitmap sizeof_buffer bytes at a time */
+    for(block=start;block<=end;block+=8*sizeof_buffer)
     {
-#ifdef HAVE_EXT2FS_GET_GENERIC_BITMAP_START
-      if(ext2fs_test_generic_bitmap(bitmap,block)!=0)
-#else
-      if(ext2fs_test_bit(block - bitmap->start, bitmap->bitmap)!=0)
+      const unsigned int nbr_bits=(end - block + 1 < 8*sizeof_buffer ? end - block + 1 : 8*sizeof_buffer);
+#ifdef HAVE_EXT2FS_GET_BLOCK_BITMAP_RANGE2
+      if(EXT2FS_CLUSTER_RATIO(ls->current_fs)!=1 ||
+	  ext2fs_get_block_bitmap_range2(bitmap, block, nbr_bits, buffer)!=0)
 #endif
       {
-	/* Not free */
-	if(end_free+1==partition->part_offset+(uint64_t)block*blocksize)
-	  end_free+=blocksize;
-	else
+	unsigned int i;
+	memset(buffer, 0, sizeof_buffer);
+	for(i=0; i<nbr_bits; i++)
 	{
-	  if(start_free != end_free)
-	    del_search_space(list_search_space, start_free, end_free);
-	  start_free=partition->part_offset+(uint64_t)block*blocksize;
-	  end_free=start_free+(uint64_t)blocksize-1;
+#ifdef HAVE_EXT2FS_GET_GENERIC_BITMAP_START
+	  if(ext2fs_test_generic_bitmap(bitmap,block+i)!=0)
+#else
+	  if(ext2fs_test_bit(block + i - bitmap->start, bitmap->bitmap)!=0)
+#endif
+	    buffer[i/8]|=1<<(i%8);
 	}
       }
+      del_search_space_bitmap(list_search_space, buffer, nbr_bits,
+	  partition->part_offset+(uint64_t)block*blocksize, blocksize,
+	  &start_free, &end_free);
     }
     free(buffer);
     if(start_free != end_free)
@@ -312,6 +312,167 @@ unsigned int get_next_cluster(disk_t *disk_car,const partition_t *partition, con
   }
 }
 
+/* The FAT is loaded on demand by blocks of FAT_TABLE_BLOCK_SIZE bytes, *
+ * kept in a direct-mapped cache of FAT_TABLE_SLOTS blocks.             */
+#define FAT_TABLE_BLOCK_SIZE (64*1024)
+#define FAT_TABLE_SLOTS 256
+
+struct fat_table_struct
+{
+  disk_t *disk;
+  const partition_t *partition;
+  upart_type_t upart_type;
+  int offset;
+  uint64_t fat_offset;
+  uint64_t fat_size;
+  unsigned char *buffer[FAT_TABLE_SLOTS];
+  uint64_t block[FAT_TABLE_SLOTS];
+};
+
+fat_table_t *fat_table_open(disk_t *disk, const partition_t *partition, const upart_type_t upart_type, const int offset, const unsigned long int fat_length, const unsigned int sector_size)
+{
+  unsigned int i;
+  fat_table_t *fat_table=(fat_table_t *)MALLOC(sizeof(*fat_table));
+  fat_table->disk=disk;
+  fat_table->partition=partition;
+  fat_table->upart_type=upart_type;
+  fat_table->offset=offset;
+  fat_table->fat_offset=partition->part_offset + (uint64_t)offset * sector_size;
+  fat_table->fat_size=(uint64_t)fat_length * sector_size;
+  for(i=0; i<FAT_TABLE_SLOTS; i++)
+    fat_table->buffer[i]=NULL;
+  return fat_table;
+}
+
+void fat_table_close(fat_table_t *fat_table)
+{
+  unsigned int i;
+  if(fat_table==NULL)
+    return ;
+  for(i=0; i<FAT_TABLE_SLOTS; i++)
+    free(fat_table->buffer[i]);
+  free(fat_table);
+}
+
+static const unsigned char *fat_table_block(fat_table_t *fat_table, const uint64_t block)
+{
+  disk_t *disk=fat_table->disk;
+  const unsigned int slot=block % FAT_TABLE_SLOTS;
+  unsigned char *buffer=fat_table->buffer[slot];
+  const uint64_t start=block * FAT_TABLE_BLOCK_SIZE;
+  const unsigned int size=(fat_table->fat_size - start < FAT_TABLE_BLOCK_SIZE ?
+      fat_table->fat_size - start : FAT_TABLE_BLOCK_SIZE);
+  const uint64_t hd_offset=fat_table->fat_offset + start;
+  if(buffer==NULL)
+  {
+    buffer=(unsigned char *)MALLOC(FAT_TABLE_BLOCK_SIZE);
+    fat_table->buffer[slot]=buffer;
+  }
+  else if(fat_table->block[slot]==block)
+    return buffer;
+  fat_table->block[slot]=block;
+  if((unsigned)disk->pread(disk, buffer, size, hd_offset) != size)
+  {
+    /* Read sector by sector, unreadable sectors point to free clusters */
+    unsigned int i;
+    log_error("fat_table read error\n");
+    for(i=0; i<size; i+=disk->sector_size)
+    {
+      if((unsigned)disk->pread(disk, buffer+i, disk->sector_size, hd_offset+i) != disk->sector_size)
+	memset(buffer+i, 0, disk->sector_size);
+    }
+  }
+  return buffer;
+}
+
+static unsigned int fat_table_get16(fat_table_t *fat_table, const uint64_t pos)
+{
+  const unsigned char *b0=fat_table_block(fat_table, pos / FAT_TABLE_BLOCK_SIZE);
+  const unsigned int lo=b0[pos % FAT_TABLE_BLOCK_SIZE];
+  const unsigned char *b1=fat_table_block(fat_table, (pos+1) / FAT_TABLE_BLOCK_SIZE);
+  return lo | (b1[(pos+1) % FAT_TABLE_BLOCK_SIZE] << 8);
+}
+
+unsigned int fat_table_next_cluster(fat_table_t *fat_table, const unsigned int cluster)
+{
+  switch(fat_table->upart_type)
+  {
+    case UP_FAT12:
+      {
+	const uint64_t pos=cluster+cluster/2;
+	if(pos+2 > fat_table->fat_size)
+	  break;
+	if((cluster&1)!=0)
+	  return fat_table_get16(fat_table, pos)>>4;
+	return fat_table_get16(fat_table, pos)&0x0FFF;
+      }
+    case UP_FAT16:
+      {
+	const uint64_t pos=(uint64_t)cluster*2;
+	if(pos+2 > fat_table->fat_size)
+	  break;
+	return fat_table_get16(fat_table, pos);
+      }
+    case UP_FAT32:
+      {
+	const uint64_t pos=(uint64_t)cluster*4;
+	const uint32_t *p32;
+	if(pos+4 > fat_table->fat_size)
+	  break;
+	p32=(const uint32_t *)fat_table_block(fat_table, pos / FAT_TABLE_BLOCK_SIZE);
+	/* FAT32 used 28 bits, the 4 high bits are reserved */
+	return le32(p32[(pos % FAT_TABLE_BLOCK_SIZE)/4])&0xFFFFFFF;
+      }
+    default:
+      break;
+  }
+  /* Outside of the FAT */
+  return get_next_cluster(fat_table->disk, fat_table->partition, fat_table->upart_type, fat_table->offset, cluster);
+}
+
+void fat_table_used(fat_table_t *fat_table, const unsigned int cluster, const unsigned int nbr, unsigned char *bitmap)
+{
+  unsigned int i=0;
+  memset(bitmap, 0, (nbr+7)/8);
+  if(fat_table->upart_type==UP_FAT16 || fat_table->upart_type==UP_FAT32)
+  {
+    const unsigned int entry_size=(fat_table->upart_type==UP_FAT32 ? 4 : 2);
+    /* Entries don't cross the FAT blocks, test all the entries of a block */
+    while(i < nbr)
+    {
+      const uint64_t pos=(uint64_t)(cluster+i)*entry_size;
+      const unsigned char *buffer;
+      unsigned int n;
+      unsigned int j;
+      if(pos+entry_size > fat_table->fat_size)
+	break;
+      buffer=fat_table_block(fat_table, pos / FAT_TABLE_BLOCK_SIZE) + pos % FAT_TABLE_BLOCK_SIZE;
+      n=(FAT_TABLE_BLOCK_SIZE - pos % FAT_TABLE_BLOCK_SIZE) / entry_size;
+      if(n > (fat_table->fat_size - pos) / entry_size)
+	n=(fat_table->fat_size - pos) / entry_size;
+      if(n > nbr - i)
+	n=nbr - i;
+      if(entry_size==4)
+      {
+	const uint32_t *p32=(const uint32_t *)buffer;
+	for(j=0; j<n; j++, i++)
+	  if((le32(p32[j])&0xFFFFFFF)!=0)
+	    bitmap[i/8]|=1<<(i%8);
+      }
+      else
+      {
+	const uint16_t *p16=(const uint16_t *)buffer;
+	for(j=0; j<n; j++, i++)
+	  if(p16[j]!=0)
+	    bitmap[i/8]|=1<<(i%8);
+      }
+    }
+  }
+  for(; i<nbr; i++)
+    if(fat_table_next_cluster(fat_table, cluster+i)!=0)
+      bitmap[i/8]|=1<<(i%8);
+}
+
 int set_next_cluster(disk_t *disk_car,const partition_t *partition, const upart_type_t upart_type,const int offset, const unsigned int cluster, const unsigned int next_cluster)
 {
   unsigned char *buffer;
@@ -117,6 +117,14 @@ int comp_FAT(disk_t *disk,const partition_t *partition, const unsigned long int
 int log_fat2_info(const struct fat_boot_sector*fh1, const struct fat_boot_sector*fh2, const upart_type_t upart_type, const unsigned int sector_size);
 
 unsigned int get_next_cluster(disk_t *disk,const partition_t *partition, const upart_type_t upart_type,const int offset, const unsigned int cluster);
+typedef struct fat_table_struct fat_table_t;
+fat_table_t *fat_table_open(disk_t *disk, const partition_t *partition, const upart_type_t upart_type, const int offset, const unsigned long int fat_length, const unsigned int sector_size);
+unsigned int fat_table_next_cluster(fat_table_t *fat_table, const unsigned int cluster);
+/* Set bit i of bitmap if cluster+i is used */
+void fat_table_used(fat_table_t *fat_table, const unsigned int cluster, const unsigned int nbr, unsigned char *bitmap);
+void fat_table_close(fat_table_t *fat_table);
+/* Runs of contiguous clusters are copied by reads of up to this size */
+#define FAT_COPY_BUFFER_SIZE (1024*1024)
 int set_next_cluster(disk_t *disk,const partition_t *partition, const upart_type_t upart_type,const int offset, const unsigned int cluster, const unsigned int next_cluster);
 
 int is_fat(const partition_t *partition);
@@ -53,6 +53,7 @@
 struct fat_dir_struct
 {
   struct fat_boot_sector*boot_sector;
+  fat_table_t *fat_table;
 };
 
 
@@ -340,7 +341,7 @@ static int fat_dir(disk_t *disk_car, const partition_t *partition, dir_data_t *d
     }
     cluster=le32(fat_header->root_cluster);
   }
-  if(get_next_cluster(disk_car, partition, partition->upart_type, le16(fat_header->reserved), cluster)==0)
+  if(fat_table_next_cluster(ls->fat_table, cluster)==0)
   {
     return 0;
   }
@@ -381,7 +382,7 @@ static int fat_dir(disk_t *disk_car, const partition_t *partition, dir_data_t *d
       {
 	if(fat_meth==FAT_FOLLOW_CLUSTER)
 	{
-	  const unsigned int next_cluster=get_next_cluster(disk_car, partition, partition->upart_type, start_fat1, cluster);
+	  const unsigned int next_cluster=fat_table_next_cluster(ls->fat_table, cluster);
 	  if((next_cluster>=2 && next_cluster<=no_of_cluster+2) ||
 	      is_EOC(next_cluster, partition->upart_type))
 	    cluster=next_cluster;
@@ -405,7 +406,7 @@ static int fat_dir(disk_t *disk_car, const partition_t *partition, dir_data_t *d
 	else if(fat_meth==FAT_NEXT_FREE_CLUSTER)
 	{	/* Deleted directories are composed of "free" clusters */
 	  while(++cluster<no_of_cluster+2 &&
-	      get_next_cluster(disk_car, partition, partition->upart_type, start_fat1, cluster)!=0);
+	      fat_table_next_cluster(ls->fat_table, cluster)!=0);
 	}
 	nbr_cluster++;
       }
@@ -458,6 +459,10 @@ dir_partition_t dir_partition_fat_init(disk_t *disk_car, const partition_t *part
   set_secwest();
   ls=(struct fat_dir_struct *)MALLOC(sizeof(*ls));
   ls->boot_sector=(struct fat_boot_sector*)buffer;
+  ls->fat_table=fat_table_open(disk_car, partition, partition->upart_type,
+      le16(ls->boot_sector->reserved),
+      (le16(ls->boot_sector->fat_length)>0?le16(ls->boot_sector->fat_length):le32(ls->boot_sector->fat32_length)),
+      disk_car->sector_size);
   strncpy(dir_data->current_directory,"/",sizeof(dir_data->current_directory));
   dir_data->current_inode=0;
   dir_data->param=FLAG_LIST_DELETED;
@@ -478,10 +483,31 @@ dir_partition_t dir_partition_fat_init(disk_t *disk_car, const partition_t *part
 static void dir_partition_fat_close(dir_data_t *dir_data)
 {
   struct fat_dir_struct *ls=(struct fat_dir_struct*)dir_data->private_dir_data;
+  fat_table_close(ls->fat_table);
   free(ls->boot_sector);
   free(ls);
 }
 
+static unsigned int fat_copy_next_cluster(fat_table_t *fat_table, fat_method_t *fat_meth, unsigned int cluster, const unsigned int first_cluster, const unsigned long int no_of_cluster)
+{
+  if(*fat_meth==FAT_FOLLOW_CLUSTER)
+  {
+    const unsigned int next_cluster=fat_table_next_cluster(fat_table, cluster);
+    if(next_cluster>=2 && next_cluster<=no_of_cluster+2)
+      return next_cluster;
+    else if(cluster==first_cluster && next_cluster==0)
+      *fat_meth=FAT_NEXT_FREE_CLUSTER;	/* Recovery of a deleted file */
+    else
+      *fat_meth=FAT_NEXT_CLUSTER;		/* FAT is corrupted, don't trust it */
+  }
+  if(*fat_meth==FAT_NEXT_CLUSTER)
+    return cluster+1;
+  /* Deleted file are composed of "free" clusters */
+  while(++cluster<no_of_cluster+2 &&
+      fat_table_next_cluster(fat_table, cluster)!=0);
+  return cluster;
+}
+
 static int fat_copy(disk_t *disk_car, const partition_t *partition, dir_data_t *dir_data, const file_info_t *file)
 {
   char *new_file;	
@@ -490,7 +516,9 @@ static int fat_copy(disk_t *disk_car, const partition_t *partition, dir_data_t *
   const struct fat_boot_sector *fat_header=ls->boot_sector;
   const unsigned int sectors_per_cluster=fat_header->sectors_per_cluster;
   const unsigned int block_size=fat_sector_size(fat_header)*sectors_per_cluster;
-  unsigned char *buffer_file=(unsigned char *)MALLOC(block_size);
+  /* Consecutive clusters are read at once */
+  const unsigned int buffer_size=(block_size < FAT_COPY_BUFFER_SIZE ? FAT_COPY_BUFFER_SIZE / block_size * block_size : block_size);
+  unsigned char *buffer_file=(unsigned char *)MALLOC(buffer_size);
   unsigned int cluster;
   unsigned int file_size=file->st_size;
   fat_method_t fat_meth=FAT_FOLLOW_CLUSTER;
@@ -518,12 +546,23 @@ static int fat_copy(disk_t *disk_car, const partition_t *partition, dir_data_t *
   while(cluster>=2 && cluster<=no_of_cluster+2 && file_size>0)
   {
     const uint64_t start=partition->part_offset+(uint64_t)(start_data+(cluster-2)*sectors_per_cluster)*fat_sector_size(fat_header);
-    unsigned int toread = block_size;
-    if (toread > file_size)
-      toread = file_size;
+    const unsigned int first=cluster;
+    unsigned int last;
+    unsigned int toread=0;
+    do
+    {
+      last=cluster;
+      toread+=(file_size - toread < block_size ? file_size - toread : block_size);
+      if(toread < file_size)
+	cluster=fat_copy_next_cluster(ls->fat_table, &fat_meth, cluster, file->st_ino, no_of_cluster);
+    } while(toread < file_size && toread < buffer_size &&
+	cluster==last+1 && cluster<=no_of_cluster+2);
     if((unsigned)disk_car->pread(disk_car, buffer_file, toread, start) != toread)
     {
-      log_error("fat_copy: Can't read cluster %u.\n", cluster);
+      if(first==last)
+	log_error("fat_copy: Can't read cluster %u.\n", first);
+      else
+	log_error("fat_copy: Can't read clusters %u-%u.\n", first, last);
     }
     if(fwrite(buffer_file, 1, toread, f_out) != toread)
     {
@@ -535,26 +574,6 @@ static int fat_copy(disk_t *disk_car, const partition_t *partition, dir_data_t *
       return -1;
     }
     file_size -= toread;
-    if(file_size>0)
-    {
-      if(fat_meth==FAT_FOLLOW_CLUSTER)
-      {
-	const unsigned int next_cluster=get_next_cluster(disk_car, partition, partition->upart_type, start_fat1, cluster);
-	if(next_cluster>=2 && next_cluster<=no_of_cluster+2)
-	  cluster=next_cluster;
-	else if(cluster==file->st_ino && next_cluster==0)
-	  fat_meth=FAT_NEXT_FREE_CLUSTER;	/* Recovery of a deleted file */
-	else
-	  fat_meth=FAT_NEXT_CLUSTER;		/* FAT is corrupted, don't trust it */
-      }
-      if(fat_meth==FAT_NEXT_CLUSTER)
-	cluster++;
-      else if(fat_meth==FAT_NEXT_FREE_CLUSTER)
-      {	/* Deleted file are composed of "free" clusters */
-	while(++cluster<no_of_cluster+2 &&
-	    get_next_cluster(disk_car, partition, partition->upart_type, start_fat1, cluster)!=0);
-      }
-    }
   }
   fclose(f_out);
   set_date(new_file, file->td_atime, file->td_mtime);
@@ -139,7 +139,9 @@ static int fat_copy_file(disk_t *disk, const partition_t *partition, const unsig
   unsigned int cluster;
   unsigned int file_size=file->st_size;
   const unsigned long int no_of_cluster=(partition->part_size - start_data) / cluster_size;
-  unsigned char *buffer_file=(unsigned char *)MALLOC(cluster_size);
+  /* The FAT has been lost, files are read as runs of consecutive clusters */
+  const unsigned int buffer_size=(cluster_size < FAT_COPY_BUFFER_SIZE ? FAT_COPY_BUFFER_SIZE / cluster_size * cluster_size : cluster_size);
+  unsigned char *buffer_file=(unsigned char *)MALLOC(buffer_size);
   cluster = file->st_ino;
   new_file=(char *)MALLOC(1024);
   snprintf(new_file, 1024, "%s.%u/inode_%u", recup_dir, dir_num, inode_num);
@@ -171,9 +173,12 @@ static int fat_copy_file(disk_t *disk, const partition_t *partition, const unsig
   while(cluster>=2 && cluster<=no_of_cluster+2 && file_size>0)
   {
     const uint64_t start=start_data + (uint64_t)(cluster-2)*cluster_size;
-    unsigned int toread = cluster_size;
+    const uint64_t run_size=(uint64_t)(no_of_cluster+3-cluster)*cluster_size;
+    unsigned int toread = buffer_size;
     if (toread > file_size)
       toread = file_size;
+    if (toread > run_size)
+      toread = run_size;
     if((unsigned)disk->pread(disk, buffer_file, toread, start) != toread)
     {
       log_error("fat_copy_file: Can't read cluster %u.\n", cluster);
@@ -188,7 +193,7 @@ static int fat_copy_file(disk_t *disk, const partition_t *partition, const unsig
       return -1;
     }
     file_size -= toread;
-    cluster++;
+    cluster+=(toread+cluster_size-1)/cluster_size;
   }
   fclose(f_out);
   set_date(new_file, file->td_atime, file->td_mtime);
@@ -36,144 +36,27 @@
 #include "fat_common.h"
 #include "log.h"
 
-static void fat16_remove_used_space(disk_t *disk_car,const partition_t *partition, alloc_data_t *list_search_space, const unsigned int fat_offset, const unsigned int no_of_cluster, const unsigned int start_data, const unsigned int cluster_size, const unsigned int sector_size);
-static void fat32_remove_used_space(disk_t *disk_car,const partition_t *partition, alloc_data_t *list_search_space, const unsigned int fat_offset, const unsigned int no_of_cluster, const unsigned int start_data, const unsigned int cluster_size, const unsigned int sector_size);
-
-static void fat12_remove_used_space(disk_t *disk,const partition_t *partition, alloc_data_t *list_search_space, const unsigned int fat_offset, const unsigned int no_of_cluster, const unsigned int start_data, const unsigned int cluster_size, const unsigned int sector_size)
+static void fat_remove_used_space_aux(fat_table_t *fat_table, const partition_t *partition, alloc_data_t *list_search_space, const unsigned int no_of_cluster, const unsigned int start_data, const unsigned int cluster_size, const unsigned int sector_size)
 {
-  unsigned char *buffer;
+  unsigned char bitmap[4096];
   unsigned int cluster;
-  const uint64_t hd_offset=partition->part_offset+(uint64_t)fat_offset*sector_size;
   uint64_t start_free=0;
   uint64_t end_free=0;
-  unsigned long int offset_s_prev=0;
-  log_trace("fat12_remove_used_space\n");
-  buffer=(unsigned char *)MALLOC(2*sector_size);
+  log_trace("fat_remove_used_space\n");
   del_search_space(list_search_space, partition->part_offset,
       partition->part_offset + (uint64_t)start_data * sector_size - 1);
-  for(cluster=2; cluster<=no_of_cluster+1; cluster++)
+  /* Convert the FAT to a bitmap of the used clusters, 8*sizeof(bitmap) *
+   * clusters at a time */
+  for(cluster=2; cluster<=no_of_cluster+1; cluster+=8*sizeof(bitmap))
   {
-    unsigned long int offset_s,offset_o;
-    unsigned int next_cluster;
-    offset_s=(cluster+cluster/2)/disk->sector_size;
-    offset_o=(cluster+cluster/2)%disk->sector_size;
-    if(offset_s!=offset_s_prev || cluster==2)
-    {
-      offset_s_prev=offset_s;
-      if((unsigned)disk->pread(disk, buffer, 2*sector_size, hd_offset + offset_s * disk->sector_size) != 2*sector_size)
-      {
-	/* Consider these FAT sectors points to free clusters */
-      }
-    }
-    if((cluster&1)!=0)
-      next_cluster=le16((*((uint16_t*)&buffer[offset_o])))>>4;
-    else
-      next_cluster=le16(*((uint16_t*)&buffer[offset_o]))&0x0FFF;
-    if(next_cluster!=0)
-    {
-      /* Not free */
-      if(end_free+1==partition->part_offset+(start_data+(uint64_t)(cluster-2)*cluster_size)*sector_size)
-	end_free+=cluster_size*sector_size;
-      else
-      {
-	if(start_free != end_free)
-	  del_search_space(list_search_space, start_free, end_free);
-	start_free=partition->part_offset+(start_data+(uint64_t)(cluster-2)*cluster_size)*sector_size;
-	end_free=start_free+(uint64_t)cluster_size*sector_size-1;
-      }
-    }
+    const unsigned int nbr_bits=(no_of_cluster+2 - cluster < 8*sizeof(bitmap) ?
+	no_of_cluster+2 - cluster : 8*sizeof(bitmap));
+    /* FAT sectors that can't be read points to free clusters */
+    fat_table_used(fat_table, cluster, nbr_bits, bitmap);
+    del_search_space_bitmap(list_search_space, bitmap, nbr_bits,
+	partition->part_offset+(start_data+(uint64_t)(cluster-2)*cluster_size)*sector_size,
+	cluster_size*sector_size, &start_free, &end_free);
   }
-  free(buffer);
-  if(start_free != end_free)
-    del_search_space(list_search_space, start_free, end_free);
-}
-
-static void fat16_remove_used_space(disk_t *disk_car,const partition_t *partition, alloc_data_t *list_search_space, const unsigned int fat_offset, const unsigned int no_of_cluster, const unsigned int start_data, const unsigned int cluster_size, const unsigned int sector_size)
-{
-  unsigned char *buffer;
-  const uint16_t *p16;
-  unsigned int prev_cluster;
-  uint64_t hd_offset=partition->part_offset+(uint64_t)fat_offset*sector_size;
-  uint64_t start_free=0;
-  uint64_t end_free=0;
-  log_trace("fat16_remove_used_space\n");
-  buffer=(unsigned char *)MALLOC(sector_size);
-  p16=(const uint16_t*)buffer;
-  del_search_space(list_search_space, partition->part_offset,
-      partition->part_offset + (uint64_t)start_data * sector_size - 1);
-  for(prev_cluster=2;prev_cluster<=no_of_cluster+1;prev_cluster++)
-  {
-    unsigned int offset_o;
-    offset_o=prev_cluster%(sector_size/2);
-    if((offset_o==0)||(prev_cluster==2))
-    {
-      if((unsigned)disk_car->pread(disk_car, buffer, sector_size, hd_offset) != sector_size)
-      {
-	/* Consider these FAT sectors points to free clusters */
-      }
-      hd_offset+=sector_size;
-    }
-    if(le16(p16[offset_o])!=0)
-    {
-      /* Not free */
-      if(end_free+1==partition->part_offset+(start_data+(uint64_t)(prev_cluster-2)*cluster_size)*sector_size)
-	end_free+=cluster_size*sector_size;
-      else
-      {
-	if(start_free != end_free)
-	  del_search_space(list_search_space, start_free, end_free);
-	start_free=partition->part_offset+(start_data+(uint64_t)(prev_cluster-2)*cluster_size)*sector_size;
-	end_free=start_free+(uint64_t)cluster_size*sector_size-1;
-      }
-    }
-  }
-  free(buffer);
-  if(start_free != end_free)
-    del_search_space(list_search_space, start_free, end_free);
-}
-
-static void fat32_remove_used_space(disk_t *disk_car,const partition_t *partition, alloc_data_t *list_search_space, const unsigned int fat_offset, const unsigned int no_of_cluster, const unsigned int start_data, const unsigned int cluster_size, const unsigned int sector_size)
-{
-  unsigned char *buffer;
-  uint32_t *p32;
-  unsigned int prev_cluster;
-  uint64_t hd_offset=partition->part_offset+(uint64_t)fat_offset*sector_size;
-  uint64_t start_free=0;
-  uint64_t end_free=0;
-  log_trace("fat32_remove_used_space\n");
-  buffer=(unsigned char *)MALLOC(sector_size);
-  p32=(uint32_t*)buffer;
-  del_search_space(list_search_space, partition->part_offset,
-      partition->part_offset + (uint64_t)start_data * sector_size - 1);
-  for(prev_cluster=2;prev_cluster<=no_of_cluster+1;prev_cluster++)
-  {
-    unsigned long int cluster;
-    unsigned int offset_o;
-    offset_o=prev_cluster%(sector_size/4);
-    if((offset_o==0)||(prev_cluster==2))
-    {
-      if((unsigned)disk_car->pread(disk_car, buffer, sector_size, hd_offset) != sector_size)
-      {
-	/* Consider these FAT sectors points to free clusters */
-      }
-      hd_offset+=sector_size;
-    }
-    cluster=le32(p32[offset_o]) & 0xFFFFFFF;
-    if(cluster!=0)
-    {
-      /* Not free */
-      if(end_free+1==partition->part_offset+(uint64_t)(start_data+(prev_cluster-2)*cluster_size)*sector_size)
-	end_free+=cluster_size*sector_size;
-      else
-      {
-	if(start_free != end_free)
-	  del_search_space(list_search_space, start_free, end_free);
-	start_free=partition->part_offset+(start_data+(uint64_t)(prev_cluster-2)*cluster_size)*sector_size;
-	end_free=start_free+(uint64_t)cluster_size*sector_size-1;
-      }
-    }
-  }
-  free(buffer);
   if(start_free != end_free)
     del_search_space(list_search_space, start_free, end_free);
 }
@@ -207,12 +90,14 @@ unsigned int fat_remove_used_space(disk_t *disk_car, const partition_t *partitio
     start_fat1=le16(fat_header->reserved);
     start_data=start_fat1+fat_header->fats*fat_length+(get_dir_entries(fat_header)*32+sector_size-1)/sector_size;
     no_of_cluster=(part_size-start_data)/fat_header->sectors_per_cluster;
-    if(partition->upart_type==UP_FAT12)
-      fat12_remove_used_space(disk_car,partition, list_search_space, start_fat1, no_of_cluster, start_data, fat_header->sectors_per_cluster,sector_size);
-    else if(partition->upart_type==UP_FAT16)
-      fat16_remove_used_space(disk_car,partition, list_search_space, start_fat1, no_of_cluster, start_data, fat_header->sectors_per_cluster,sector_size);
-    else if(partition->upart_type==UP_FAT32)
-      fat32_remove_used_space(disk_car,partition, list_search_space, start_fat1, no_of_cluster, start_data, fat_header->sectors_per_cluster,sector_size);
+    if(partition->upart_type==UP_FAT12 ||
+	partition->upart_type==UP_FAT16 ||
+	partition->upart_type==UP_FAT32)
+    {
+      fat_table_t *fat_table=fat_table_open(disk_car, partition, partition->upart_type, start_fat1, fat_length, sector_size);
+      fat_remove_used_space_aux(fat_table, partition, list_search_space, no_of_cluster, start_data, fat_header->sectors_per_cluster, sector_size);
+      fat_table_close(fat_table);
+    }
     res=fat_header->sectors_per_cluster * sector_size;
     free(buffer);
     return res;
@@ -44,107 +44,367 @@
 #include <unistd.h>
 #endif
 #include <dirent.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include "types.h"
 #include "common.h"
 #include "filegen.h"
 #include "log.h"
 #include "phcfg.h"
+#include "phcontainer.h"
 #include "misc.h"
 #include "file_jpg.h"
 
 extern file_enable_t list_file_enable[];
-extern file_check_list_t file_check_list;
 
-#define READ_SIZE 1024*512
+/* header_check_find() only looks at the first 64 KiB of the file */
+#define FID_BLOCKSIZE	65536
+#define FID_READ_SIZE	65536
+
+#define FID_TYPE_UNKNOWN	0
+#define FID_TYPE_DIR		1
+#define FID_TYPE_FILE		2
 
-static int file_identify(const char *filename, const unsigned int check)
+struct fid_options
+{
+  unsigned int check;
+  unsigned int json;
+};
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t fid_output_mutex=PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void fid_json_string(const char *str)
+{
+  const unsigned char *p;
+  putchar('"');
+  for(p=(const unsigned char *)str; *p!='\0'; p++)
+  {
+    if(*p=='"' || *p=='\\')
+      printf("\\%c", *p);
+    else if(*p < 0x20 || *p >= 0x80)
+    {
+      /* The filename may not be valid UTF-8, each byte is escaped */
+      printf("\\u%04x", *p);
+    }
+    else
+      putchar(*p);
+  }
+  putchar('"');
+}
+
+/* ext is NULL if the file type is unknown, file_size is displayed if has_size */
+static void fid_output(const struct fid_options *options, const char *filename, const char *ext, const int has_size, const uint64_t file_size)
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&fid_output_mutex);
+#endif
+  if(options->json)
+  {
+    printf("{\"filename\":");
+    fid_json_string(filename);
+    printf(",\"extension\":");
+    if(ext==NULL)
+      printf("null");
+    else
+      fid_json_string(ext);
+    if(has_size)
+      printf(",\"file_size\":%llu", (long long unsigned)file_size);
+    printf("}\n");
+  }
+  else if(ext==NULL)
+    printf("%s: unknown\n", filename);
+  else if(has_size)
+    printf("%s: %s file_size=%llu\n", filename, ext, (long long unsigned)file_size);
+  else
+    printf("%s: %s\n", filename, ext);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&fid_output_mutex);
+#endif
+}
+
+static char *fid_path(const char *dir, const char *name)
+{
+  char *path=(char *)MALLOC(strlen(dir)+1+strlen(name)+1);
+  strcpy(path, dir);
+  strcat(path, "/");
+  strcat(path, name);
+  return path;
+}
+
+/* buffer holds the first FID_READ_SIZE bytes of the file, file is needed by --check */
+static void file_identify_buffer(const char *filename, const struct fid_options *options, unsigned char *buffer, FILE *file)
 {
-  FILE *file;
-  unsigned char *buffer_start;
-  unsigned char *buffer_olddata;
-  unsigned char *buffer;
-  const unsigned int blocksize=65536;
-  const unsigned int read_size=65536;
-  unsigned int buffer_size;
   file_recovery_t file_recovery;
+  file_recovery_t file_recovery_new;
   reset_file_recovery(&file_recovery);
-  file_recovery.blocksize=blocksize;
-  buffer_size=blocksize + READ_SIZE;
-  buffer_start=(unsigned char *)MALLOC(buffer_size);
-  buffer_olddata=buffer_start;
-  buffer=buffer_olddata + blocksize;
+  file_recovery.blocksize=FID_BLOCKSIZE;
+  file_recovery_new.blocksize=FID_BLOCKSIZE;
+  file_recovery_new.file_stat=NULL;
+  header_check_find(buffer, FID_READ_SIZE, 0, &file_recovery, &file_recovery_new);
+  if(file_recovery_new.file_stat!=NULL && file_recovery_new.file_stat->file_hint!=NULL)
+  {
+    const char *ext=((file_recovery_new.extension!=NULL && file_recovery_new.extension[0]!='\0')?
+	file_recovery_new.extension:file_recovery_new.file_stat->file_hint->description);
+    if(options->check > 0 && file_recovery_new.file_check!=NULL && file!=NULL)
+    {
+      file_recovery_new.handle=file;
+#ifdef HAVE_FSEEKO
+      fseeko(file_recovery_new.handle, 0, SEEK_END);
+#else
+      fseek(file_recovery_new.handle, 0, SEEK_END);
+#endif
+#ifdef HAVE_FTELLO
+      file_recovery_new.file_size=ftello(file_recovery_new.handle);
+#else
+      file_recovery_new.file_size=ftell(file_recovery_new.handle);
+#endif
+      file_recovery_new.calculated_file_size=file_recovery_new.file_size;
+      (file_recovery_new.file_check)(&file_recovery_new);
+      fid_output(options, filename, ext, 1, file_recovery_new.file_size);
+    }
+    else
+      fid_output(options, filename, ext, 0, 0);
+  }
+  else
+  {
+    fid_output(options, filename, NULL, 0, 0);
+  }
+}
+
+/* Identify each file of a PhotoRec container, it's named container/name */
+static void file_identify_container(const char *filename, const struct fid_options *options, unsigned char *buffer)
+{
+  struct phc_reader reader;
+  struct phc_entry entry;
+  if(phc_reader_open(&reader, filename) < 0)
+    return ;
+  while(phc_reader_next(&reader, &entry) > 0)
+  {
+    char *name;
+    FILE *file=NULL;
+    const size_t res=phc_reader_read(&reader, &entry, 0, buffer, FID_READ_SIZE);
+    if(res==0)
+      continue;
+    if(res < FID_READ_SIZE)
+      memset(buffer + res, 0, FID_READ_SIZE - res);
+    /* The file_check functions need a file of their own */
+    if(options->check > 0 && (file=tmpfile())!=NULL &&
+	phc_reader_copy(&reader, &entry, file) < 0)
+    {
+      fclose(file);
+      file=NULL;
+    }
+    name=fid_path(filename, entry.name);
+    file_identify_buffer(name, options, buffer, file);
+    free(name);
+    if(file!=NULL)
+      fclose(file);
+  }
+  phc_reader_close(&reader);
+}
+
+/* buffer_start is FID_BLOCKSIZE + FID_READ_SIZE bytes long,
+ * the first FID_BLOCKSIZE bytes are zeroes */
+static int file_identify(const char *filename, const struct fid_options *options, unsigned char *buffer_start)
+{
+  FILE *file;
+  unsigned char *buffer=buffer_start + FID_BLOCKSIZE;
+  size_t res;
   file=fopen(filename, "rb");
   if(file==NULL)
-  {
-    free(buffer_start);
     return -1;
+  res=fread(buffer, 1, FID_READ_SIZE, file);
+  if(res<=0)
+  {
+    fclose(file);
+    return 0;
   }
-  if(fread(buffer, 1, READ_SIZE, file)<=0)
+  if(res >= PHC_HEADER_SIZE && memcmp(buffer, PHC_MAGIC, PHC_HEADER_SIZE)==0)
   {
     fclose(file);
-    free(buffer_start);
+    file_identify_container(filename, options, buffer);
     return 0;
   }
+  if(res < FID_READ_SIZE)
+    memset(buffer + res, 0, FID_READ_SIZE - res);
+  file_identify_buffer(filename, options, buffer, file);
+  fclose(file);
+  return 0;
+}
+
+static unsigned int fid_type(const char *path, const struct dirent *entry)
+{
+  struct stat buf_stat;
+#ifdef _DIRENT_HAVE_D_TYPE
+  /* Avoid a stat() per file when the filesystem gives the type */
+  if(entry!=NULL && entry->d_type!=DT_UNKNOWN)
   {
-    struct td_list_head *tmpl;
-    file_recovery_t file_recovery_new;
-    file_recovery_new.blocksize=blocksize;
-    file_recovery_new.file_stat=NULL;
-    td_list_for_each(tmpl, &file_check_list.list)
+    if(entry->d_type==DT_DIR)
+      return FID_TYPE_DIR;
+    if(entry->d_type==DT_REG)
+      return FID_TYPE_FILE;
+    return FID_TYPE_UNKNOWN;
+  }
+#endif
+#ifdef HAVE_LSTAT
+  if(lstat(path, &buf_stat)!=0)
+#else
+  if(stat(path, &buf_stat)!=0)
+#endif
+    return FID_TYPE_UNKNOWN;
+  if(S_ISDIR(buf_stat.st_mode))
+    return FID_TYPE_DIR;
+  if(S_ISREG(buf_stat.st_mode))
+    return FID_TYPE_FILE;
+  return FID_TYPE_UNKNOWN;
+}
+
+static void file_identify_dir(const char *current_dir, const struct fid_options *options, unsigned char *buffer_start)
+{
+  DIR *dir;
+  struct dirent *entry;
+  dir=opendir(current_dir);
+  if(dir==NULL)
+    return;
+  while((entry=readdir(dir))!=NULL)
+  {
+    if(strcmp(entry->d_name,".")!=0 && strcmp(entry->d_name,"..")!=0)
     {
-      struct td_list_head *tmp;
-      const file_check_list_t *pos=td_list_entry(tmpl, file_check_list_t, list);
-      td_list_for_each(tmp, &pos->file_checks[buffer[pos->offset]].list)
+      char *current_file=fid_path(current_dir, entry->d_name);
+      switch(fid_type(current_file, entry))
       {
-	const file_check_t *file_check=td_list_entry(tmp, file_check_t, list);
-	if((file_check->length==0 || memcmp(buffer + file_check->offset, file_check->value, file_check->length)==0) &&
-	    file_check->header_check(buffer, read_size, 0, &file_recovery, &file_recovery_new)!=0)
-	{
-	  file_recovery_new.file_stat=file_check->file_stat;
+	case FID_TYPE_DIR:
+	  file_identify_dir(current_file, options, buffer_start);
+	  break;
+	case FID_TYPE_FILE:
+	  file_identify(current_file, options, buffer_start);
 	  break;
-	}
       }
-      if(file_recovery_new.file_stat!=NULL)
-	break;
+      free(current_file);
     }
-    if(file_recovery_new.file_stat!=NULL && file_recovery_new.file_stat->file_hint!=NULL)
+  }
+  closedir(dir);
+}
+
+#ifdef HAVE_PTHREAD
+/* Thread pool: each worker takes its work from the end of its own queue *
+ * (depth first) and when it's empty, steals from the beginning of the  *
+ * queue of another worker (the biggest subtrees).                      */
+struct fid_item
+{
+  char *path;
+  unsigned int type;
+};
+
+struct fid_queue
+{
+  pthread_mutex_t mutex;
+  struct fid_item *items;
+  unsigned int head;
+  unsigned int tail;
+  unsigned int alloc;
+};
+
+struct fid_pool;
+
+struct fid_worker
+{
+  pthread_t thread;
+  struct fid_pool *pool;
+  struct fid_queue queue;
+  unsigned int id;
+};
+
+struct fid_pool
+{
+  struct fid_worker *workers;
+  unsigned int nbr_workers;
+  const struct fid_options *options;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  /* Items queued or being identified */
+  uint64_t pending;
+  /* Incremented each time new items are available */
+  unsigned int generation;
+  unsigned int idle;
+  unsigned int finished;
+};
+
+static void fid_queue_push(struct fid_queue *queue, char *path, const unsigned int type)
+{
+  pthread_mutex_lock(&queue->mutex);
+  if(queue->tail==queue->alloc)
+  {
+    if(queue->head > 0)
     {
-      printf("%s: %s", filename,
-	  ((file_recovery_new.extension!=NULL && file_recovery_new.extension[0]!='\0')?
-	   file_recovery_new.extension:file_recovery_new.file_stat->file_hint->description));
-      if(check > 0 && file_recovery_new.file_check!=NULL)
-      {
-	file_recovery_new.handle=file;
-#ifdef HAVE_FSEEKO
-	fseeko(file_recovery_new.handle, 0, SEEK_END);
-#else
-	fseek(file_recovery_new.handle, 0, SEEK_END);
-#endif
-#ifdef HAVE_FTELLO
-	file_recovery_new.file_size=ftello(file_recovery_new.handle);
-#else
-	file_recovery_new.file_size=ftell(file_recovery_new.handle);
-#endif
-	file_recovery_new.calculated_file_size=file_recovery_new.file_size;
-	(file_recovery_new.file_check)(&file_recovery_new);
-	printf(" file_size=%llu", (long long unsigned)file_recovery_new.file_size);
-      }
-      printf("\n");
+      memmove(queue->items, &queue->items[queue->head], (queue->tail - queue->head) * sizeof(struct fid_item));
+      queue->tail-=queue->head;
+      queue->head=0;
     }
+    if(queue->tail==queue->alloc)
+    {
+      struct fid_item *new_items;
+      queue->alloc=(queue->alloc < 64 ? 64 : queue->alloc * 2);
+      new_items=(struct fid_item *)MALLOC(queue->alloc * sizeof(struct fid_item));
+      if(queue->tail > 0)
+	memcpy(new_items, queue->items, queue->tail * sizeof(struct fid_item));
+      free(queue->items);
+      queue->items=new_items;
+    }
+  }
+  queue->items[queue->tail].path=path;
+  queue->items[queue->tail].type=type;
+  queue->tail++;
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+/* Take an item from the end of the queue if from_tail, from the beginning otherwise */
+static int fid_queue_pop(struct fid_queue *queue, struct fid_item *item, const int from_tail)
+{
+  int res=0;
+  pthread_mutex_lock(&queue->mutex);
+  if(queue->head < queue->tail)
+  {
+    if(from_tail)
+      *item=queue->items[--queue->tail];
     else
+      *item=queue->items[queue->head++];
+    if(queue->head==queue->tail)
     {
-      printf("%s: unknown\n", filename);
+      queue->head=0;
+      queue->tail=0;
     }
-    fclose(file);
+    res=1;
   }
-  free(buffer_start);
-  return 0;
+  pthread_mutex_unlock(&queue->mutex);
+  return res;
+}
+
+static void fid_pool_add_pending(struct fid_pool *pool, const unsigned int nbr)
+{
+  pthread_mutex_lock(&pool->mutex);
+  pool->pending+=nbr;
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+static void fid_pool_wakeup(struct fid_pool *pool)
+{
+  pthread_mutex_lock(&pool->mutex);
+  pool->generation++;
+  if(pool->idle > 0)
+    pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
 }
 
-static void file_identify_dir(const char *current_dir, const unsigned int check)
+/* Queue the content of a directory */
+static void fid_worker_dir(struct fid_worker *worker, const char *current_dir)
 {
   DIR *dir;
   struct dirent *entry;
+  unsigned int nbr=0;
   dir=opendir(current_dir);
   if(dir==NULL)
     return;
@@ -152,34 +412,160 @@ static void file_identify_dir(const char *current_dir, const unsigned int check)
   {
     if(strcmp(entry->d_name,".")!=0 && strcmp(entry->d_name,"..")!=0)
     {
-      struct stat buf_stat;
-      char *current_file=(char *)MALLOC(strlen(current_dir)+1+strlen(entry->d_name)+1);
-      strcpy(current_file, current_dir);
-      strcat(current_file, "/");
-      strcat(current_file, entry->d_name);
-#ifdef HAVE_LSTAT
-      if(lstat(current_file, &buf_stat)==0)
-#else
-	if(stat(current_file, &buf_stat)==0)
-#endif
-	{
-	  if(S_ISDIR(buf_stat.st_mode))
-	    file_identify_dir(current_file, check);
-	  else if(S_ISREG(buf_stat.st_mode))
-	    file_identify(current_file, check);
-	}
-      free(current_file);
+      char *current_file=fid_path(current_dir, entry->d_name);
+      const unsigned int type=fid_type(current_file, entry);
+      if(type==FID_TYPE_UNKNOWN)
+      {
+	free(current_file);
+	continue;
+      }
+      /* The item must be counted before another worker can steal it */
+      if(nbr==0)
+	fid_pool_add_pending(worker->pool, 1024);
+      fid_queue_push(&worker->queue, current_file, type);
+      nbr=(nbr + 1) % 1024;
+      if(nbr==0)
+	fid_pool_wakeup(worker->pool);
     }
   }
   closedir(dir);
+  if(nbr > 0)
+  {
+    /* Remove the items counted in advance */
+    pthread_mutex_lock(&worker->pool->mutex);
+    worker->pool->pending-=1024 - nbr;
+    pthread_mutex_unlock(&worker->pool->mutex);
+    fid_pool_wakeup(worker->pool);
+  }
+}
+
+static void *fid_worker_thread(void *arg)
+{
+  struct fid_worker *worker=(struct fid_worker *)arg;
+  struct fid_pool *pool=worker->pool;
+  unsigned char *buffer_start;
+  unsigned int generation=0;
+  uint64_t done=0;
+  buffer_start=(unsigned char *)MALLOC(FID_BLOCKSIZE + FID_READ_SIZE);
+  memset(buffer_start, 0, FID_BLOCKSIZE);
+  while(1)
+  {
+    struct fid_item item;
+    int found=fid_queue_pop(&worker->queue, &item, 1);
+    unsigned int i;
+    for(i=1; found==0 && i<pool->nbr_workers; i++)
+      found=fid_queue_pop(&pool->workers[(worker->id + i) % pool->nbr_workers].queue, &item, 0);
+    if(found)
+    {
+      if(item.type==FID_TYPE_DIR)
+	fid_worker_dir(worker, item.path);
+      else
+	file_identify(item.path, pool->options, buffer_start);
+      free(item.path);
+      done++;
+      continue;
+    }
+    /* Nothing to do, wait for new items or for the end */
+    pthread_mutex_lock(&pool->mutex);
+    pool->pending-=done;
+    done=0;
+    if(pool->pending==0)
+    {
+      pool->finished=1;
+      pthread_cond_broadcast(&pool->cond);
+    }
+    else if(generation==pool->generation)
+    {
+      pool->idle++;
+      while(generation==pool->generation && pool->finished==0)
+	pthread_cond_wait(&pool->cond, &pool->mutex);
+      pool->idle--;
+    }
+    generation=pool->generation;
+    if(pool->finished)
+    {
+      pthread_mutex_unlock(&pool->mutex);
+      break;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+  }
+  free(buffer_start);
+  return NULL;
+}
+
+/* Identify the files and the directories listed in paths using nbr_workers threads */
+static void fid_pool_run(const char **paths, const unsigned int nbr_paths, const unsigned int nbr_workers, const struct fid_options *options)
+{
+  struct fid_pool pool;
+  unsigned int i;
+  unsigned int nbr_threads=0;
+  pool.workers=(struct fid_worker *)MALLOC(nbr_workers * sizeof(struct fid_worker));
+  pool.nbr_workers=nbr_workers;
+  pool.options=options;
+  pool.pending=0;
+  pool.generation=0;
+  pool.idle=0;
+  pool.finished=0;
+  pthread_mutex_init(&pool.mutex, NULL);
+  pthread_cond_init(&pool.cond, NULL);
+  for(i=0; i<nbr_workers; i++)
+  {
+    struct fid_worker *worker=&pool.workers[i];
+    worker->pool=&pool;
+    worker->id=i;
+    worker->queue.items=NULL;
+    worker->queue.head=0;
+    worker->queue.tail=0;
+    worker->queue.alloc=0;
+    pthread_mutex_init(&worker->queue.mutex, NULL);
+  }
+  for(i=0; i<nbr_paths; i++)
+  {
+    const unsigned int type=fid_type(paths[i], NULL);
+    if(type!=FID_TYPE_UNKNOWN)
+    {
+      pool.pending++;
+      fid_queue_push(&pool.workers[i % nbr_workers].queue, strdup(paths[i]), type);
+    }
+  }
+  if(pool.pending > 0)
+  {
+    for(nbr_threads=0; nbr_threads<nbr_workers; nbr_threads++)
+      if(pthread_create(&pool.workers[nbr_threads].thread, NULL, fid_worker_thread, &pool.workers[nbr_threads])!=0)
+	break;
+    if(nbr_threads==0)
+    {
+      log_error("Cannot create worker threads\n");
+      fid_worker_thread(&pool.workers[0]);
+    }
+    else if(nbr_threads < nbr_workers)
+    {
+      /* The queues of the missing workers will be emptied by the others */
+      log_warning("Only %u worker threads created\n", nbr_threads);
+    }
+  }
+  for(i=0; i<nbr_threads; i++)
+    pthread_join(pool.workers[i].thread, NULL);
+  for(i=0; i<nbr_workers; i++)
+  {
+    free(pool.workers[i].queue.items);
+    pthread_mutex_destroy(&pool.workers[i].queue.mutex);
+  }
+  pthread_cond_destroy(&pool.cond);
+  pthread_mutex_destroy(&pool.mutex);
+  free(pool.workers);
 }
+#endif
 
 static void display_help(void)
 {
-  printf("\nUsage: fidentify [--check] [directory]\n"\
+  printf("\nUsage: fidentify [--check] [--json] [--jobs N] [directory|file]...\n"\
       "       fidentify --version\n" \
       "\n" \
-      "fidentify determine the file type, the 'extension', by using the same database than PhotoRec.\n");
+      "fidentify determine the file type, the 'extension', by using the same database than PhotoRec.\n" \
+      "--check     check the files, display the size of the valid data\n" \
+      "--json      one JSON object per line: filename, extension (null if unknown), file_size\n" \
+      "--jobs N    identify the files using N threads, auto for one thread per processor\n");
 }
 
 static void display_version(void)
@@ -196,32 +582,72 @@ static void display_version(void)
 int main(int argc, char **argv)
 {
   int i;
-  unsigned int check=0;
+  struct fid_options options;
+  unsigned int nbr_jobs=1;
+  unsigned int nbr_paths=0;
+  const char **paths;
   FILE *log_handle=NULL;
   int log_errno=0;
-  int todo=1;
   file_stat_t *file_stats;
+  options.check=0;
+  options.json=0;
+  paths=(const char **)MALLOC((argc + 1) * sizeof(char *));
   log_set_levels(LOG_LEVEL_DEBUG|LOG_LEVEL_TRACE|LOG_LEVEL_QUIET|LOG_LEVEL_INFO|LOG_LEVEL_VERBOSE|LOG_LEVEL_PROGRESS|LOG_LEVEL_WARNING|LOG_LEVEL_ERROR|LOG_LEVEL_PERROR|LOG_LEVEL_CRITICAL);
   for(i=1; i<argc; i++)
   {
     if(strcmp(argv[i], "/check")==0 || strcmp(argv[i], "-check")==0 || strcmp(argv[i], "--check")==0)
     {
-      check++;
+      options.check++;
+    }
+    else if(strcmp(argv[i], "/json")==0 || strcmp(argv[i], "-json")==0 || strcmp(argv[i], "--json")==0)
+    {
+      options.json=1;
+    }
+    else if((strcmp(argv[i], "/jobs")==0 || strcmp(argv[i], "-jobs")==0 || strcmp(argv[i], "--jobs")==0 ||
+	  strcmp(argv[i], "-j")==0) && i+1<argc)
+    {
+      i++;
+      if(strcmp(argv[i], "auto")==0)
+      {
+#ifdef _SC_NPROCESSORS_ONLN
+	const long nbr_cpu=sysconf(_SC_NPROCESSORS_ONLN);
+	nbr_jobs=(nbr_cpu > 0 ? nbr_cpu : 1);
+#else
+	nbr_jobs=1;
+#endif
+      }
+      else
+      {
+	const int jobs=atoi(argv[i]);
+	if(jobs < 1)
+	{
+	  display_help();
+	  free(paths);
+	  return 1;
+	}
+	nbr_jobs=jobs;
+      }
     }
     else if(strcmp(argv[i],"/help")==0 || strcmp(argv[i],"-help")==0 || strcmp(argv[i],"--help")==0 ||
       strcmp(argv[i],"/h")==0 || strcmp(argv[i],"-h")==0 ||
       strcmp(argv[i],"/?")==0 || strcmp(argv[i],"-?")==0)
     {
       display_help();
+      free(paths);
       return 0;
     }
     else if((strcmp(argv[i],"/version")==0) || (strcmp(argv[i],"-version")==0) || (strcmp(argv[i],"--version")==0) ||
       (strcmp(argv[i],"/v")==0) || (strcmp(argv[i],"-v")==0))
     {
       display_version();
+      free(paths);
       return 0;
     }
+    else
+      paths[nbr_paths++]=argv[i];
   }
+  if(nbr_paths==0)
+    paths[nbr_paths++]=".";
   log_handle=log_open("fidentify.log", TD_LOG_CREATE, &log_errno);
   if(log_handle!=NULL)
   {
@@ -245,30 +671,33 @@ int main(int argc, char **argv)
       file_enable->enable=1;
   }
   file_stats=init_file_stats(list_file_enable);
-  for(i=1; i<argc; i++)
+#ifdef HAVE_PTHREAD
+  if(nbr_jobs > 1)
   {
-    if(strcmp(argv[i], "/check")==0 || strcmp(argv[i], "-check")==0 || strcmp(argv[i], "--check")==0)
-    {
-    }
-    else
-    {
-      struct stat buf_stat;
-      todo=0;
-#ifdef HAVE_LSTAT
-      if(lstat(argv[i], &buf_stat)==0)
-#else
-	if(stat(argv[i], &buf_stat)==0)
+    log_info("Using %u threads\n", nbr_jobs);
+    header_check_set_profile(0);
+    fid_pool_run(paths, nbr_paths, nbr_jobs, &options);
+  }
+  else
 #endif
-	{
-	  if(S_ISDIR(buf_stat.st_mode))
-	    file_identify_dir(argv[i], check);
-	  else if(S_ISREG(buf_stat.st_mode))
-	    file_identify(argv[i], check);
-	}
+  {
+    unsigned char *buffer_start=(unsigned char *)MALLOC(FID_BLOCKSIZE + FID_READ_SIZE);
+    memset(buffer_start, 0, FID_BLOCKSIZE);
+    for(i=0; (unsigned)i<nbr_paths; i++)
+    {
+      switch(fid_type(paths[i], NULL))
+      {
+	case FID_TYPE_DIR:
+	  file_identify_dir(paths[i], &options, buffer_start);
+	  break;
+	case FID_TYPE_FILE:
+	  file_identify(paths[i], &options, buffer_start);
+	  break;
+      }
     }
+    free(buffer_start);
   }
-  if(todo)
-    file_identify_dir(".", check);
+  free(paths);
   free_header_check();
   free(file_stats);
   log_close();
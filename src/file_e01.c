@@ -87,7 +87,7 @@ static void file_check_e01(file_recovery_t *file_recovery)
 static int header_check_e01(const unsigned char *buffer, const unsigned int buffer_size, const unsigned int safe_header_only, const file_recovery_t *file_recovery, file_recovery_t *file_recovery_new)
 {
   const struct ewf_file_header *ewf=(const struct ewf_file_header *)buffer;
-  static char ext[4];
+  static TD_THREAD_LOCAL char ext[4];
   reset_file_recovery(file_recovery_new);
   ext[0]='E'+le16(ewf->fields_segment)/100;
   ext[1]='0'+(le16(ewf->fields_segment)%100)/10;
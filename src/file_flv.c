@@ -64,7 +64,7 @@ struct flv_tag
 
 static data_check_t data_check_flv(const unsigned char *buffer, const unsigned int buffer_size, file_recovery_t *file_recovery)
 {
-  static uint32_t datasize=0;
+  static TD_THREAD_LOCAL uint32_t datasize=0;
   while(file_recovery->calculated_file_size + buffer_size/2  >= file_recovery->file_size &&
       file_recovery->calculated_file_size + 15 < file_recovery->file_size + buffer_size/2)
   {
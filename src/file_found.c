@@ -42,8 +42,9 @@
 #include "lang.h"
 #include "filegen.h"
 #include "file_found.h"
+#include "phpool.h"
 
-alloc_data_t *file_found(alloc_data_t *current_search_space, const uint64_t offset, file_stat_t *file_stat)
+alloc_data_t *file_found(alloc_data_t *list_search_space, alloc_data_t *current_search_space, const uint64_t offset, file_stat_t *file_stat)
 {
   if(current_search_space==NULL)
     return current_search_space;
@@ -56,13 +57,13 @@ alloc_data_t *file_found(alloc_data_t *current_search_space, const uint64_t offs
   if(current_search_space->start < offset && offset <= current_search_space->end)
   {
     alloc_data_t *next_search_space;
-    next_search_space=(alloc_data_t*)MALLOC(sizeof(*next_search_space));
+    next_search_space=search_space_node_new();
     memcpy(next_search_space, current_search_space, sizeof(*next_search_space));
     current_search_space->end=offset-1;
     next_search_space->start=offset;
     next_search_space->file_stat=file_stat;
     next_search_space->data=1;
-    td_list_add(&next_search_space->list, &current_search_space->list);
+    add_search_space_after(list_search_space, current_search_space, next_search_space);
     return next_search_space;
   }
   return current_search_space;
@@ -23,7 +23,7 @@
 extern "C" {
 #endif
 
-alloc_data_t *file_found(alloc_data_t *current_search_space, const uint64_t offset, file_stat_t *file_stat);
+alloc_data_t *file_found(alloc_data_t *list_search_space, alloc_data_t *current_search_space, const uint64_t offset, file_stat_t *file_stat);
 
 #ifdef __cplusplus
 } /* closing brace for extern "C" */
@@ -74,13 +74,7 @@ static void file_check_gif(file_recovery_t *file_recovery)
 {
   const unsigned char gif_footer[2]= {0x00, 0x3b};
   unsigned char buffer[2];
-  if(
-#ifdef HAVE_FSEEKO
-      fseeko(file_recovery->handle, file_recovery->calculated_file_size-2, SEEK_SET)<0 ||
-#else
-      fseek(file_recovery->handle, file_recovery->calculated_file_size-2, SEEK_SET)<0 ||
-#endif
-      fread(buffer, 2, 1, file_recovery->handle)!=1 ||
+  if(file_data_read(file_recovery, buffer, 2, file_recovery->calculated_file_size-2)!=2 ||
       memcmp(buffer, gif_footer, sizeof(gif_footer))!=0)
   {
     file_recovery->file_size=0;
@@ -44,6 +44,7 @@
 #endif
 #include <ctype.h>      /* isprint */
 #include "filegen.h"
+#include "memscan.h"
 #include "common.h"
 #include "log.h"
 #include "file_jpg.h"
@@ -275,7 +276,7 @@ static void file_check_mpo(file_recovery_t *fr)
   unsigned char buffer[512];
   uint64_t offset=0;
   unsigned int size=0;
-  size_t nbytes;
+  int nbytes;
   const unsigned char *mpo;
   {
     /* Check the first jpg */
@@ -288,16 +289,12 @@ static void file_check_mpo(file_recovery_t *fr)
   do
   {
     offset+=2+size;
-#ifdef HAVE_FSEEKO
-    if(fseeko(fr->handle, offset, SEEK_SET) < 0)
-#else
-    if(fseek(fr->handle, offset, SEEK_SET) < 0)
-#endif
+    nbytes=file_data_read(fr, &buffer, sizeof(buffer), offset);
+    if(nbytes<0)
     {
       fr->file_size=0;
       return ;
     }
-    nbytes=fread(&buffer, 1, sizeof(buffer), fr->handle);
 //    log_info("file_check_mpo offset=%llu => nbytes=%d, buffer=%02x %02x\n",
 //    (long long unsigned)offset, nbytes, buffer[0], buffer[1]);
     /* 0xda SOS Start Of Scan */
@@ -312,7 +309,7 @@ static void file_check_mpo(file_recovery_t *fr)
 #ifdef DEBUG_JPEG
   log_info("Found at %lu\n", (long unsigned)offset);
 #endif
-  if(2+size > nbytes)
+  if(2+size > (unsigned int)nbytes)
     size=nbytes-2;
   if(size<12)
   {
@@ -482,7 +479,7 @@ struct my_error_mgr {
 typedef struct {
   struct jpeg_source_mgr pub;	/* public fields */
 
-  FILE * infile;		/* source stream */
+  const file_recovery_t *file_recovery;	/* source file */
   JOCTET * buffer;		/* start of buffer */
   int start_of_file;	/* have we gotten any data yet? */
   unsigned long int offset;
@@ -595,7 +592,7 @@ static void jpg_init_source (j_decompress_ptr cinfo)
 static int jpg_fill_input_buffer (j_decompress_ptr cinfo)
 {
   my_source_mgr * src = (my_source_mgr *) cinfo->src;
-  size_t nbytes;
+  int nbytes;
 #if 0
   log_info("jpg_fill_input_buffer file_size=%llu -> %llu (offset=%llu, blocksize=%u)\n",
       (long long unsigned)src->file_size,
@@ -603,9 +600,9 @@ static int jpg_fill_input_buffer (j_decompress_ptr cinfo)
       (long long unsigned)src->offset,
       src->blocksize);
 #endif
-  nbytes = fread(src->buffer, 1,
+  nbytes = file_data_read(src->file_recovery, src->buffer,
       src->blocksize - (src->offset + src->file_size)%src->blocksize,
-      src->infile);
+      src->offset + src->file_size);
   if (nbytes <= 0) {
     if (src->start_of_file)	/* Treat empty input file as fatal error */
     {
@@ -699,7 +696,7 @@ static void jpg_term_source (j_decompress_ptr cinfo)
  * for closing it after finishing decompression.
  */
 
-static void jpeg_testdisk_src (j_decompress_ptr cinfo, FILE * infile, uint64_t offset, const unsigned int blocksize)
+static void jpeg_testdisk_src (j_decompress_ptr cinfo, const file_recovery_t *file_recovery, uint64_t offset, const unsigned int blocksize)
 {
   my_source_mgr * src;
 
@@ -728,7 +725,7 @@ static void jpeg_testdisk_src (j_decompress_ptr cinfo, FILE * infile, uint64_t o
   src->pub.term_source = jpg_term_source;
   src->pub.bytes_in_buffer = 0; /* forces fill_input_buffer on first read */
   src->pub.next_input_byte = NULL; /* until buffer loaded */
-  src->infile = infile;
+  src->file_recovery = file_recovery;
   src->offset = offset;
   src->blocksize=blocksize;
 }
@@ -743,7 +740,7 @@ struct jpeg_session_struct
   unsigned int output_width;
   unsigned int output_height;
   uint64_t offset;
-  FILE *handle;
+  const file_recovery_t *file_recovery;
   unsigned int flags;
   unsigned int blocksize;
 };
@@ -756,7 +753,7 @@ static void jpeg_init_session(struct jpeg_session_struct *jpeg_session)
   jpeg_session->output_width=0;
   jpeg_session->output_height=0;
   jpeg_session->offset=0;
-  jpeg_session->handle=NULL;
+  jpeg_session->file_recovery=NULL;
   jpeg_session->flags=0;
 }
 
@@ -770,17 +767,9 @@ static void jpeg_session_delete(struct jpeg_session_struct *jpeg_session)
 
 static inline int jpeg_session_resume(struct jpeg_session_struct *jpeg_session)
 {
-  my_source_mgr * src;
   memcpy(&jpeg_session->cinfo, &jpeg_session->cinfo_backup, sizeof(jpeg_session->cinfo));
   if(resume_memory((j_common_ptr)&jpeg_session->cinfo))
     return -1;
-  src = (my_source_mgr *) jpeg_session->cinfo.src;
-#ifdef HAVE_FSEEKO
-  if(fseeko(jpeg_session->handle, jpeg_session->offset + src->file_size, SEEK_SET) < 0)
-#else
-  if(fseek(jpeg_session->handle, jpeg_session->offset + src->file_size, SEEK_SET) < 0)
-#endif
-    return -1;
   return 0;
 }
 
@@ -792,16 +781,8 @@ static inline void jpeg_session_suspend(struct jpeg_session_struct *jpeg_session
 
 static void jpeg_session_start(struct jpeg_session_struct *jpeg_session)
 {
-#ifdef HAVE_FSEEKO
-  if(fseeko(jpeg_session->handle, jpeg_session->offset, SEEK_SET) < 0)
-#else
-  if(fseek(jpeg_session->handle, jpeg_session->offset, SEEK_SET) < 0)
-#endif
-  {
-    log_critical("jpeg_session_start: fseek failed.\n");
-  }
   jpeg_create_decompress(&jpeg_session->cinfo); 
-  jpeg_testdisk_src(&jpeg_session->cinfo, jpeg_session->handle, jpeg_session->offset, jpeg_session->blocksize);
+  jpeg_testdisk_src(&jpeg_session->cinfo, jpeg_session->file_recovery, jpeg_session->offset, jpeg_session->blocksize);
   (void) jpeg_read_header(&jpeg_session->cinfo, TRUE);
   jpeg_session->cinfo.two_pass_quantize = FALSE;
   jpeg_session->cinfo.dither_mode = JDITHER_NONE;
@@ -816,16 +797,16 @@ static void jpeg_session_start(struct jpeg_session_struct *jpeg_session)
   jpeg_session->frame=NULL;
 }
 
-static uint64_t jpg_xy_to_offset(FILE *infile, const unsigned int x, const unsigned y,
+static uint64_t jpg_xy_to_offset(const file_recovery_t *file_recovery, const unsigned int x, const unsigned y,
     const uint64_t offset_rel1, const uint64_t offset_rel2, const uint64_t offset, const unsigned int blocksize)
 {
-  static struct my_error_mgr jerr;
-  static uint64_t file_size_max;
-  static struct jpeg_session_struct jpeg_session;
+  static TD_THREAD_LOCAL struct my_error_mgr jerr;
+  static TD_THREAD_LOCAL uint64_t file_size_max;
+  static TD_THREAD_LOCAL struct jpeg_session_struct jpeg_session;
   unsigned int checkpoint_status=0;
   int avoid_leak=0;
   jpeg_init_session(&jpeg_session);
-  jpeg_session.handle=infile;
+  jpeg_session.file_recovery=file_recovery;
   jpeg_session.offset=offset;
   jpeg_session.blocksize=blocksize;
   file_size_max=(offset_rel1 + blocksize - (offset % blocksize) -1) / blocksize * blocksize;
@@ -1013,7 +994,7 @@ static unsigned int jpg_find_border(const unsigned int output_scanline, const un
 #define JPG_MAX_OFFSETS	10240
 
 /* FIXME: it doesn handle correctly when there is a few extra sectors */
-static uint64_t jpg_find_error(FILE *handle, const unsigned int output_scanline, const unsigned int output_width, const unsigned int output_components, const unsigned char *frame, const unsigned int *offsets, const uint64_t offset, const unsigned int blocksize, const uint64_t checkpoint_offset)
+static uint64_t jpg_find_error(const file_recovery_t *file_recovery, const unsigned int output_scanline, const unsigned int output_width, const unsigned int output_components, const unsigned char *frame, const unsigned int *offsets, const uint64_t offset, const unsigned int blocksize, const uint64_t checkpoint_offset)
 {
   const unsigned int row_stride = output_width * output_components;
   unsigned int result=0;
@@ -1082,7 +1063,7 @@ static uint64_t jpg_find_error(FILE *handle, const unsigned int output_scanline,
 	      result_x, result_y, result_max, result, output_scanline_max);
 #endif
 	  if(offset_rel1 < offset_rel2)
-	    return jpg_xy_to_offset(handle, result_x, result_y,
+	    return jpg_xy_to_offset(file_recovery, result_x, result_y,
 //		offset_rel1, offset_rel2, offset, blocksize);
 		offset_rel1, offset_rel2, offset, 512);
 	  return offset + offset_rel2;
@@ -1095,14 +1076,14 @@ static uint64_t jpg_find_error(FILE *handle, const unsigned int output_scanline,
   return 0;
 }
 
-static uint64_t jpg_check_thumb(FILE *infile, const uint64_t offset, const unsigned int blocksize, const uint64_t checkpoint_offset, const unsigned int flags)
+static uint64_t jpg_check_thumb(const file_recovery_t *file_recovery, const uint64_t offset, const unsigned int blocksize, const uint64_t checkpoint_offset, const unsigned int flags)
 {
-  static struct my_error_mgr jerr;
-  static unsigned int offsets[JPG_MAX_OFFSETS];
-  static struct jpeg_session_struct jpeg_session;
+  static TD_THREAD_LOCAL struct my_error_mgr jerr;
+  static TD_THREAD_LOCAL unsigned int offsets[JPG_MAX_OFFSETS];
+  static TD_THREAD_LOCAL struct jpeg_session_struct jpeg_session;
   jpeg_init_session(&jpeg_session);
   jpeg_session.flags=flags;
-  jpeg_session.handle=infile;
+  jpeg_session.file_recovery=file_recovery;
   jpeg_session.offset=offset;
   jpeg_session.blocksize=blocksize;
   jpeg_session.cinfo.err = jpeg_std_error(&jerr.pub);
@@ -1124,7 +1105,7 @@ static uint64_t jpg_check_thumb(FILE *infile, const uint64_t offset, const unsig
     offset_error=jpeg_session.offset + src->file_size - src->pub.bytes_in_buffer;
     if(jpeg_session.frame!=NULL && jpeg_session.flags!=0)
     {
-      const uint64_t tmp=jpg_find_error(jpeg_session.handle, jpeg_session.cinfo.output_scanline, jpeg_session.output_width, jpeg_session.output_components, jpeg_session.frame, &offsets[0], jpeg_session.offset, blocksize, checkpoint_offset);
+      const uint64_t tmp=jpg_find_error(jpeg_session.file_recovery, jpeg_session.cinfo.output_scanline, jpeg_session.output_width, jpeg_session.output_components, jpeg_session.frame, &offsets[0], jpeg_session.offset, blocksize, checkpoint_offset);
 //      log_info("jpg_check_thumb jpeg corrupted near   %llu\n", offset_error);
       if(tmp !=0 && offset_error > tmp)
 	offset_error=tmp;
@@ -1157,11 +1138,11 @@ static uint64_t jpg_check_thumb(FILE *infile, const uint64_t offset, const unsig
 
 static void jpg_check_picture(file_recovery_t *file_recovery)
 {
-  static struct my_error_mgr jerr;
-  static unsigned int offsets[JPG_MAX_OFFSETS];
+  static TD_THREAD_LOCAL struct my_error_mgr jerr;
+  static TD_THREAD_LOCAL unsigned int offsets[JPG_MAX_OFFSETS];
   uint64_t jpeg_size=0;
-  static struct jpeg_session_struct jpeg_session;
-  static int jpeg_session_initialised=0;
+  static TD_THREAD_LOCAL struct jpeg_session_struct jpeg_session;
+  static TD_THREAD_LOCAL int jpeg_session_initialised=0;
   if(file_recovery->checkpoint_status==0)
   {
     if(jpeg_session_initialised==1)
@@ -1171,7 +1152,7 @@ static void jpg_check_picture(file_recovery_t *file_recovery)
     jpeg_session_initialised=1;
     jpeg_session.blocksize=file_recovery->blocksize;
   }
-  jpeg_session.handle=file_recovery->handle;
+  jpeg_session.file_recovery=file_recovery;
   jpeg_session.cinfo.err = jpeg_std_error(&jerr.pub);
   jerr.pub.output_message = my_output_message;
   jerr.pub.error_exit = my_error_exit;
@@ -1202,7 +1183,7 @@ static void jpg_check_picture(file_recovery_t *file_recovery)
 #if 1
     if(jpeg_session.frame!=NULL && jpeg_session.flags!=0)
     {
-      const uint64_t offset_error=jpg_find_error(jpeg_session.handle, jpeg_session.cinfo.output_scanline, jpeg_session.output_width, jpeg_session.output_components, jpeg_session.frame, &offsets[0], jpeg_session.offset, jpeg_session.blocksize, file_recovery->checkpoint_offset);
+      const uint64_t offset_error=jpg_find_error(jpeg_session.file_recovery, jpeg_session.cinfo.output_scanline, jpeg_session.output_width, jpeg_session.output_components, jpeg_session.frame, &offsets[0], jpeg_session.offset, jpeg_session.blocksize, file_recovery->checkpoint_offset);
       if(offset_error !=0 && file_recovery->offset_error > offset_error)
 	file_recovery->offset_error=offset_error;
 #ifdef DEBUG_JPEG
@@ -1312,26 +1293,22 @@ static int jpg_check_dht(const unsigned char *buffer, const unsigned int buffer_
 
 static void jpg_search_marker(file_recovery_t *file_recovery)
 {
-  FILE* infile=file_recovery->handle;
   unsigned char buffer[40*8192];
-  size_t nbytes;
+  int nbytes;
   uint64_t offset;
+  uint64_t read_offset;
   unsigned int i;
   if(file_recovery->blocksize==0)
     return ;
   offset=file_recovery->offset_error / file_recovery->blocksize * file_recovery->blocksize;
+  read_offset=offset;
   i=file_recovery->offset_error % file_recovery->blocksize;
-#ifdef HAVE_FSEEKO
-  if(fseeko(infile, offset, SEEK_SET) < 0)
-#else
-  if(fseek(infile, offset, SEEK_SET) < 0)
-#endif
-    return ;
   do
   {
-    while((nbytes=fread(&buffer, 1, sizeof(buffer), infile))>0)
+    while((nbytes=file_data_read(file_recovery, &buffer, sizeof(buffer), read_offset))>0)
     {
-      for(;i+1<nbytes; i+=file_recovery->blocksize)
+      read_offset+=nbytes;
+      for(;i+1<(unsigned int)nbytes; i+=file_recovery->blocksize)
       {
 	if(buffer[i]==0xff &&
 	    (buffer[i+1]==0xd8 ||			/* SOI */
@@ -1354,7 +1331,8 @@ static void jpg_search_marker(file_recovery_t *file_recovery)
 	}
       }
     }
-    offset +=nbytes;
+    if(nbytes > 0)
+      offset +=nbytes;
     i=i % file_recovery->blocksize;
   } while(nbytes == sizeof(buffer));
   return ;
@@ -1362,18 +1340,16 @@ static void jpg_search_marker(file_recovery_t *file_recovery)
 
 static uint64_t jpg_check_structure(file_recovery_t *file_recovery, const unsigned int extract_thumb)
 {
-  FILE* infile=file_recovery->handle;
   unsigned char buffer[40*8192];
   uint64_t thumb_offset=0;
   size_t nbytes;
+  int res;
   file_recovery->extra=0;
-#ifdef HAVE_FSEEKO
-  if(fseeko(infile, 0, SEEK_SET) < 0)
-#else
-  if(fseek(infile, 0, SEEK_SET) < 0)
-#endif
+  res=file_data_read(file_recovery, &buffer, sizeof(buffer), 0);
+  if(res < 0)
     return 0;
-  if((nbytes=fread(&buffer, 1, sizeof(buffer), infile))>0)
+  nbytes=res;
+  if(nbytes>0)
   {
     unsigned int offset;
     file_recovery->offset_error=0;
@@ -1593,7 +1569,7 @@ static uint64_t jpg_check_structure(file_recovery_t *file_recovery, const unsign
 static void file_check_jpg(file_recovery_t *file_recovery)
 {
   uint64_t thumb_offset;
-  static uint64_t thumb_error=0;
+  static TD_THREAD_LOCAL uint64_t thumb_error=0;
   /* FIXME REMOVE ME */
   file_recovery->flags=1;
   file_recovery->file_size=0;
@@ -1618,7 +1594,7 @@ static void file_check_jpg(file_recovery_t *file_recovery)
 #ifdef DEBUG_JPEG
     log_info("jpg_check_thumb\n");
 #endif
-    thumb_error=jpg_check_thumb(file_recovery->handle, thumb_offset, file_recovery->blocksize, file_recovery->checkpoint_offset, file_recovery->flags);
+    thumb_error=jpg_check_thumb(file_recovery, thumb_offset, file_recovery->blocksize, file_recovery->checkpoint_offset, file_recovery->flags);
     if(thumb_error!=0)
     {
 #ifdef DEBUG_JPEG
@@ -1672,7 +1648,12 @@ static data_check_t data_check_jpg2(const unsigned char *buffer, const unsigned
       file_recovery->calculated_file_size < file_recovery->file_size + buffer_size/2)
   {
     const unsigned int i=file_recovery->calculated_file_size - file_recovery->file_size + buffer_size/2;
-    if(buffer[i-1]==0xFF)
+    if(buffer[i-1]!=0xFF)
+    {
+      /* Skip the entropy-coded data up to the next 0xFF */
+      file_recovery->calculated_file_size+=scan_byte(&buffer[i], buffer_size - 1 - i, 0xFF) + 1;
+    }
+    else
     {
       if(buffer[i]==0xd9)
       {
@@ -1706,8 +1687,8 @@ static data_check_t data_check_jpg2(const unsigned char *buffer, const unsigned
 	file_recovery->offset_error=file_recovery->calculated_file_size;
 	return DC_STOP;
       }
+      file_recovery->calculated_file_size++;
     }
-    file_recovery->calculated_file_size++;
   }
   return DC_CONTINUE;
 }
@@ -30,6 +30,7 @@
 #include "types.h"
 #include "common.h"
 #include "filegen.h"
+#include "memscan.h"
 #include "log.h"
 
 extern const file_hint_t file_hint_mkv;
@@ -238,7 +239,7 @@ static data_check_t data_check_id3(const unsigned char *buffer, const unsigned i
     const unsigned int i=file_recovery->calculated_file_size - file_recovery->file_size + buffer_size/2;
     if(buffer[i]==0)
     { /* Padding is present */
-      file_recovery->calculated_file_size++;
+      file_recovery->calculated_file_size+=scan_run(&buffer[i], buffer_size - 1 - i, 0);
     }
     else
     { /* no more padding or no padding */
@@ -363,8 +364,11 @@ static unsigned int pos_in_mem(const unsigned char *haystack, const unsigned int
 {
   unsigned int i;
   for(i=0;i<haystack_size;i++)
-    if(memcmp(&haystack[i],needle,needle_size)==0)
+  {
+    i+=scan_byte(&haystack[i], haystack_size - i, needle[0]);
+    if(i<haystack_size && memcmp(&haystack[i],needle,needle_size)==0)
       return (i+needle_size);
+  }
   return 0;
 }
 
@@ -202,16 +202,12 @@ static void file_check_pdf_and_size(file_recovery_t *file_recovery)
     int i;
     int taille;
     file_recovery->file_size=file_recovery->calculated_file_size;
-#ifdef HAVE_FSEEKO
-    if(fseeko(file_recovery->handle,file_recovery->file_size-read_size,SEEK_SET)<0)
-#else
-    if(fseek(file_recovery->handle,file_recovery->file_size-read_size,SEEK_SET)<0)
-#endif
+    taille=file_data_read(file_recovery, buffer, read_size, file_recovery->file_size-read_size);
+    if(taille<0)
     {
       file_recovery->file_size=0;
       return ;
     }
-    taille=fread(buffer,1,read_size,file_recovery->handle);
     for(i=taille-4;i>=0;i--)
     {
       if(buffer[i]=='%' && buffer[i+1]=='E' && buffer[i+2]=='O' && buffer[i+3]=='F')
@@ -238,19 +234,10 @@ static void file_date_pdf(file_recovery_t *file_recovery)
   uint64_t offset=0;
   unsigned int j=0;
   unsigned char*buffer=(unsigned char*)MALLOC(4096);
-#ifdef HAVE_FSEEKO
-  if(fseeko(file_recovery->handle, 0, SEEK_SET)<0)
-#else
-  if(fseek(file_recovery->handle, 0, SEEK_SET)<0)
-#endif
-  {
-    free(buffer);
-    return ;
-  }
   while(offset < file_recovery->file_size)
   {
     int i;
-    const int bsize=fread(buffer, 1, 4096, file_recovery->handle);
+    const int bsize=file_data_read(file_recovery, buffer, 4096, offset);
     if(bsize<=0)
     {
       free(buffer);
@@ -264,16 +251,7 @@ static void file_date_pdf(file_recovery_t *file_recovery)
 	{
 	  const unsigned char *date_asc;
 	  struct tm tm_time;
-#ifdef HAVE_FSEEKO
-	  if(fseeko(file_recovery->handle, offset+i+1, SEEK_SET)<0)
-#else
-	  if(fseek(file_recovery->handle, offset+i+1, SEEK_SET)<0)
-#endif
-	  {
-	    free(buffer);
-	    return ;
-	  }
-	  if(fread(buffer, 1, 22, file_recovery->handle) < 22)
+	  if(file_data_read(file_recovery, buffer, 22, offset+i+1) < 22)
 	  {
 	    free(buffer);
 	    return ;
@@ -110,13 +110,7 @@ static void file_check_png(file_recovery_t *fr)
   {
     char buffer[8];
     const struct png_chunk *chunk=(const struct png_chunk *)&buffer;
-    if(
-#ifdef HAVE_FSEEKO
-	fseeko(fr->handle, fr->file_size, SEEK_SET) < 0 ||
-#else
-	fseek(fr->handle, fr->file_size, SEEK_SET) < 0 ||
-#endif
-	fread(&buffer, sizeof(buffer), 1, fr->handle) != 1)
+    if(file_data_read(fr, &buffer, sizeof(buffer), fr->file_size) != sizeof(buffer))
     {
       fr->file_size=0;
       return ;
@@ -49,7 +49,7 @@ const file_hint_t file_hint_psb= {
   .register_header_check=&register_header_check_psb
 };
 
-static uint64_t psb_image_data_size_max=0;
+static TD_THREAD_LOCAL uint64_t psb_image_data_size_max=0;
 struct psb_file_header
 {
   char signature[4];
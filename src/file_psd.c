@@ -49,7 +49,7 @@ const file_hint_t file_hint_psd= {
   .register_header_check=&register_header_check_psd
 };
 
-static uint64_t psd_image_data_size_max=0;
+static TD_THREAD_LOCAL uint64_t psd_image_data_size_max=0;
 
 struct psd_file_header
 {
@@ -1103,7 +1103,7 @@ static uint64_t header_check_tiff_be(file_recovery_t *fr, const uint32_t tiff_di
 
 void file_check_tiff(file_recovery_t *fr)
 {
-  static uint64_t calculated_file_size=0;
+  static TD_THREAD_LOCAL uint64_t calculated_file_size=0;
   unsigned char *buffer=(unsigned char *)MALLOC(8192);
   int data_read;
   calculated_file_size = 0;
@@ -37,6 +37,7 @@
 #include "types.h"
 #include "common.h"
 #include "filegen.h"
+#include "memscan.h"
 #include "log.h"
 #include "memmem.h"
 #include "file_txt.h"
@@ -388,6 +389,14 @@ static int UTFsize(const unsigned char *buffer, const unsigned int buf_len)
   unsigned int i=0;
   while(i<buf_len && *p!='\0')
   {
+    /* Skip the plain ASCII text */
+    const unsigned int ascii=scan_text(p, buf_len - i);
+    if(ascii > 0)
+    {
+      p+=ascii;
+      i+=ascii;
+      continue;
+    }
     /* Reject some invalid UTF-8 sequences */
     if(*p==0xc0 || *p==0xc1 || *p==0xf7 || *p>=0xfd)
       return i;
@@ -427,7 +436,9 @@ static data_check_t data_check_html(const unsigned char *buffer, const unsigned
       j+sizeof(sign_html_end)-1 < buffer_size;
       j++)
   {
-    if(buffer[j]=='<' && strncasecmp((const char *)&buffer[j], sign_html_end, sizeof(sign_html_end)-1)==0)
+    j+=scan_pair(&buffer[j], buffer_size - j, '<', '/');
+    if(j+sizeof(sign_html_end)-1 < buffer_size &&
+	strncasecmp((const char *)&buffer[j], sign_html_end, sizeof(sign_html_end)-1)==0)
     {
       file_recovery->calculated_file_size+=j-buffer_size/2+sizeof(sign_html_end)-1;
       return DC_STOP;
@@ -839,8 +850,8 @@ static void file_check_emlx(file_recovery_t *file_recovery)
 
 static int header_check_txt(const unsigned char *buffer, const unsigned int buffer_size, const unsigned int safe_header_only, const file_recovery_t *file_recovery, file_recovery_t *file_recovery_new)
 {
-  static char *buffer_lower=NULL;
-  static unsigned int buffer_lower_size=0;
+  static TD_THREAD_LOCAL char *buffer_lower=NULL;
+  static TD_THREAD_LOCAL unsigned int buffer_lower_size=0;
   unsigned int l;
   const unsigned int buffer_size_test=(buffer_size < 2048 ? buffer_size : 2048);
   {
@@ -47,7 +47,7 @@ static int header_check_zip(const unsigned char *buffer, const unsigned int buff
 static void file_check_zip(file_recovery_t *file_recovery);
 static unsigned int pos_in_mem(const unsigned char *haystack, const unsigned int haystack_size, const unsigned char *needle, const unsigned int needle_size);
 static void file_rename_zip(const char *old_filename);
-static char first_filename[256];
+static TD_THREAD_LOCAL char first_filename[256];
 
 const file_hint_t file_hint_zip= {
   .extension="zip",
@@ -106,7 +106,7 @@ struct zip64_extra_entry
 } __attribute__ ((__packed__));
 typedef struct zip64_extra_entry zip64_extra_entry_t;
 
-static uint32_t expected_compressed_size=0;
+static TD_THREAD_LOCAL uint32_t expected_compressed_size=0;
 
 static int64_t file_get_pos(FILE *f, const void* needle, const unsigned int size)
 {
@@ -206,8 +206,8 @@ static int zip_parse_file_entry(file_recovery_t *fr, const char **ext, const uns
 #endif
     if(*ext==NULL)
     {
-      static int msoffice=0;
-      static int sh3d=0;
+      static TD_THREAD_LOCAL int msoffice=0;
+      static TD_THREAD_LOCAL int sh3d=0;
       if(file_nbr==0)
       {
 	msoffice=0;
@@ -35,6 +35,7 @@
 #include "common.h"
 #include "filegen.h"
 #include "log.h"
+#include "profile.h"
 
 static  file_check_t file_check_plist={
   .list = TD_LIST_HEAD_INIT(file_check_plist.list)
@@ -44,6 +45,40 @@ file_check_list_t file_check_list={
     .list = TD_LIST_HEAD_INIT(file_check_list.list)
 };
 
+/* Flat copy of file_check_list: for each offset level, the checks whose *
+ * byte at this offset is c are file_check_table[first[c]..first[c+1]-1] */
+typedef struct
+{
+  unsigned int offset;
+  unsigned int first[257];
+} file_check_level_t;
+
+/* Copy in memory of the file being recovered, see file_data_write().
+ * The first FILE_DATA_MAX bytes are kept, and for larger files the last
+ * FILE_DATA_TAIL bytes written, so footer and trailer checks don't read
+ * the file back. Checks parsing the whole file still read it back. */
+#define FILE_DATA_MAX (4*1024*1024)
+#define FILE_DATA_TAIL (1024*1024)
+static const file_recovery_t *file_data_owner=NULL;
+static unsigned char *file_data=NULL;
+static unsigned int file_data_size=0;
+static unsigned int file_data_alloc=0;
+/* file_data_tail holds up to 2*FILE_DATA_TAIL bytes, the data starting at
+ * file_data_tail_offset, tail_size==0 when the file fits in file_data */
+static unsigned char *file_data_tail=NULL;
+static uint64_t file_data_tail_offset=0;
+static unsigned int file_data_tail_size=0;
+static void (*file_data_hook)(const file_recovery_t *file_recovery, const void *buffer, const unsigned int size, const uint64_t offset)=NULL;
+
+/* Last file renamed by file_rename() or file_rename_unicode() */
+static char file_renamed_old[2048];
+static char file_renamed_new[2048];
+static file_check_t *file_check_table=NULL;
+static file_check_level_t *file_check_levels=NULL;
+static unsigned int file_check_levels_nbr=0;
+/* Update the profiling counters of file_stat_t, not thread safe */
+static int header_check_profile=1;
+
 static unsigned int index_header_check(void);
 
 static int file_check_cmp(const struct td_list_head *a, const struct td_list_head *b)
@@ -117,6 +152,38 @@ static void index_header_check_aux(file_check_t *file_check_new)
   file_check_add_tail(file_check_new, &file_check_list);
 }
 
+static void index_header_check_table(const unsigned int nbr)
+{
+  struct td_list_head *tmpl;
+  unsigned int levels_nbr=0;
+  unsigned int n=0;
+  td_list_for_each(tmpl, &file_check_list.list)
+    levels_nbr++;
+  free(file_check_table);
+  free(file_check_levels);
+  file_check_table=(file_check_t *)MALLOC((nbr>0?nbr:1) * sizeof(file_check_t));
+  file_check_levels=(file_check_level_t *)MALLOC((levels_nbr>0?levels_nbr:1) * sizeof(file_check_level_t));
+  file_check_levels_nbr=0;
+  td_list_for_each(tmpl, &file_check_list.list)
+  {
+    const file_check_list_t *pos=td_list_entry_const(tmpl, const file_check_list_t, list);
+    file_check_level_t *level=&file_check_levels[file_check_levels_nbr++];
+    unsigned int i;
+    level->offset=pos->offset;
+    for(i=0;i<256;i++)
+    {
+      const struct td_list_head *tmp;
+      level->first[i]=n;
+      td_list_for_each(tmp, &pos->file_checks[i].list)
+      {
+	const file_check_t *file_check=td_list_entry_const(tmp, const file_check_t, list);
+	file_check_table[n++]=*file_check;
+      }
+    }
+    level->first[256]=n;
+  }
+}
+
 static unsigned int index_header_check(void)
 {
   struct td_list_head *tmp;
@@ -131,9 +198,62 @@ static unsigned int index_header_check(void)
     index_header_check_aux(current_check);
     nbr++;
   }
+  {
+    /* file_check_list may already contain previously indexed checks */
+    struct td_list_head *tmpl;
+    unsigned int total=0;
+    td_list_for_each(tmpl, &file_check_list.list)
+    {
+      const file_check_list_t *pos=td_list_entry_const(tmpl, const file_check_list_t, list);
+      unsigned int i;
+      for(i=0;i<256;i++)
+      {
+	td_list_for_each(tmp, &pos->file_checks[i].list)
+	  total++;
+      }
+    }
+    index_header_check_table(total);
+  }
   return nbr;
 }
 
+void header_check_set_profile(const int enable)
+{
+  header_check_profile=enable;
+}
+
+int header_check_find(const unsigned char *buffer, const unsigned int buffer_size, const unsigned int safe_header_only, const file_recovery_t *file_recovery, file_recovery_t *file_recovery_new)
+{
+  unsigned int i;
+  for(i=0; i<file_check_levels_nbr; i++)
+  {
+    const file_check_level_t *level=&file_check_levels[i];
+    const unsigned int c=buffer[level->offset];
+    const unsigned int last=level->first[c+1];
+    unsigned int j;
+    for(j=level->first[c]; j<last; j++)
+    {
+      const file_check_t *file_check=&file_check_table[j];
+      if(file_check->length==0 || memcmp(buffer + file_check->offset, file_check->value, file_check->length)==0)
+      {
+	file_stat_t *file_stat=file_check->file_stat;
+	const uint64_t start=(header_check_profile!=0 && (file_stat->header_calls++ & (PROF_SAMPLE - 1))==0 ? prof_ticks() : 0);
+	const int res=file_check->header_check(buffer, buffer_size, safe_header_only, file_recovery, file_recovery_new);
+	if(start!=0)
+	  file_stat->ticks+=(prof_ticks() - start) * PROF_SAMPLE;
+	if(res!=0)
+	{
+	  if(header_check_profile!=0)
+	    file_stat->header_hits++;
+	  file_recovery_new->file_stat=file_stat;
+	  return 1;
+	}
+      }
+    }
+  }
+  return 0;
+}
+
 void free_header_check(void)
 {
   struct td_list_head *tmpl;
@@ -173,19 +293,171 @@ void free_header_check(void)
     td_list_del(tmpl);
     free(pos);
   }
+  free(file_check_table);
+  free(file_check_levels);
+  file_check_table=NULL;
+  file_check_levels=NULL;
+  file_check_levels_nbr=0;
+  free(file_data);
+  file_data=NULL;
+  file_data_alloc=0;
+  file_data_size=0;
+  free(file_data_tail);
+  file_data_tail=NULL;
+  file_data_tail_size=0;
+  file_data_owner=NULL;
 }
 
-void file_allow_nl(file_recovery_t *file_recovery, const unsigned int nl_mode)
+static int file_data_write_tail(const unsigned char *buffer, const unsigned int size, const uint64_t offset)
 {
-  unsigned char buffer[4096];
-  int taille;
+  if(file_data_tail==NULL)
+  {
+    file_data_tail=(unsigned char *)malloc(2*FILE_DATA_TAIL);
+    if(file_data_tail==NULL)
+      return 0;
+  }
+  if(file_data_tail_size==0)
+  {
+    /* The tail starts where the copy of the beginning stops */
+    if(offset != file_data_size)
+      return 0;
+    file_data_tail_offset=offset;
+  }
+  else if(offset < file_data_tail_offset ||
+      offset > file_data_tail_offset + file_data_tail_size)
+    return 0;
+  else
+    file_data_tail_size=offset - file_data_tail_offset;
+  if(size >= FILE_DATA_TAIL)
+  {
+    memcpy(file_data_tail, buffer + size - FILE_DATA_TAIL, FILE_DATA_TAIL);
+    file_data_tail_offset=offset + size - FILE_DATA_TAIL;
+    file_data_tail_size=FILE_DATA_TAIL;
+    return 1;
+  }
+  if(file_data_tail_size + size > 2*FILE_DATA_TAIL)
+  {
+    /* Only keep the last FILE_DATA_TAIL bytes */
+    const unsigned int skip=file_data_tail_size - FILE_DATA_TAIL;
+    memmove(file_data_tail, file_data_tail + skip, FILE_DATA_TAIL);
+    file_data_tail_offset+=skip;
+    file_data_tail_size=FILE_DATA_TAIL;
+  }
+  memcpy(file_data_tail + file_data_tail_size, buffer, size);
+  file_data_tail_size+=size;
+  return 1;
+}
+
+int file_data_write(file_recovery_t *file_recovery, const void *buffer, const unsigned int size)
+{
+  const uint64_t offset=file_recovery->file_size;
+  if(fwrite(buffer, size, 1, file_recovery->handle)<1)
+  {
+    if(file_data_owner==file_recovery)
+      file_data_owner=NULL;
+    return 0;
+  }
+  if(file_data_hook!=NULL)
+    file_data_hook(file_recovery, buffer, size, offset);
+  if(offset==0)
+  {
+    file_data_owner=file_recovery;
+    file_data_size=0;
+    file_data_tail_size=0;
+  }
+  if(file_data_owner!=file_recovery)
+    return 1;
+  if(file_data_tail_size > 0 || offset + size > FILE_DATA_MAX)
+  {
+    if(offset < file_data_size)
+      file_data_size=offset;
+    if(file_data_write_tail((const unsigned char *)buffer, size, offset)==0)
+    {
+      /* The checks will read the file */
+      file_data_owner=NULL;
+    }
+    return 1;
+  }
+  if(offset > file_data_size)
+  {
+    file_data_owner=NULL;
+    return 1;
+  }
+  if(offset + size > file_data_alloc)
+  {
+    unsigned int new_alloc=(file_data_alloc > 0 ? file_data_alloc : 1024*1024);
+    unsigned char *new_data;
+    while(new_alloc < offset + size)
+      new_alloc*=2;
+    if(new_alloc > FILE_DATA_MAX)
+      new_alloc=FILE_DATA_MAX;
+    new_data=(unsigned char *)realloc(file_data, new_alloc);
+    if(new_data==NULL)
+    {
+      file_data_owner=NULL;
+      return 1;
+    }
+    file_data=new_data;
+    file_data_alloc=new_alloc;
+  }
+  memcpy(file_data + offset, buffer, size);
+  if(file_data_size < offset + size)
+    file_data_size=offset + size;
+  return 1;
+}
+
+void file_data_set_hook(void (*hook)(const file_recovery_t *file_recovery, const void *buffer, const unsigned int size, const uint64_t offset))
+{
+  file_data_hook=hook;
+}
+
+int file_data_read(const file_recovery_t *file_recovery, void *buffer, const unsigned int size, const uint64_t offset)
+{
+  if(file_data_owner==file_recovery)
+  {
+    if(file_data_tail_size==0)
+    {
+      const unsigned int count=(offset >= file_data_size ? 0 :
+	  (file_data_size - offset < size ? file_data_size - offset : size));
+      memcpy(buffer, file_data + offset, count);
+      return count;
+    }
+    if(offset + size <= file_data_size)
+    {
+      memcpy(buffer, file_data + offset, size);
+      return size;
+    }
+    if(offset >= file_data_tail_offset)
+    {
+      const uint64_t end=file_data_tail_offset + file_data_tail_size;
+      const unsigned int count=(offset >= end ? 0 :
+	  (end - offset < size ? end - offset : size));
+      memcpy(buffer, file_data_tail + (offset - file_data_tail_offset), count);
+      return count;
+    }
+  }
 #ifdef HAVE_FSEEKO
-  if(fseeko(file_recovery->handle, file_recovery->file_size,SEEK_SET)<0)
+  if(fseeko(file_recovery->handle, offset, SEEK_SET) < 0)
 #else
-  if(fseek(file_recovery->handle, file_recovery->file_size,SEEK_SET)<0)
+  if(fseek(file_recovery->handle, offset, SEEK_SET) < 0)
 #endif
-    return;
-  taille=fread(buffer,1, 4096,file_recovery->handle);
+    return -1;
+  return fread(buffer, 1, size, file_recovery->handle);
+}
+
+const unsigned char *file_data_get(const file_recovery_t *file_recovery, uint64_t *size)
+{
+  if(file_data_owner!=file_recovery)
+    return NULL;
+  *size=file_data_size;
+  return file_data;
+}
+
+void file_allow_nl(file_recovery_t *file_recovery, const unsigned int nl_mode)
+{
+  unsigned char buffer[4096];
+  int taille;
+  taille=file_data_read(file_recovery, buffer, 4096, file_recovery->file_size);
   if(taille > 0 && buffer[0]=='\n' && (nl_mode&NL_BARENL)==NL_BARENL)
     file_recovery->file_size++;
   else if(taille > 1 && buffer[0]=='\r' && buffer[1]=='\n' && (nl_mode&NL_CRLF)==NL_CRLF)
@@ -229,11 +501,47 @@ uint64_t file_rsearch(FILE *handle, uint64_t offset, const void*footer, const un
   return 0;
 }
 
+/* Search backward for footer ending before end in data[], data[0] being at *
+ * file offset start. Return the offset of footer or 0 if not found         */
+static uint64_t file_data_rsearch(const unsigned char *data, const uint64_t start, const uint64_t end, const void*footer, const unsigned int footer_length)
+{
+  uint64_t i=end - start;
+  while(i >= footer_length)
+  {
+    i--;
+    if(data[i - footer_length + 1]==*(const unsigned char *)footer &&
+	memcmp(&data[i - footer_length + 1], footer, footer_length)==0)
+      return start + i - footer_length + 1;
+  }
+  return 0;
+}
+
 void file_search_footer(file_recovery_t *file_recovery, const void*footer, const unsigned int footer_length, const unsigned int extra_length)
 {
+  uint64_t data_size;
+  const unsigned char *data=file_data_get(file_recovery, &data_size);
+  const uint64_t end=file_recovery->file_size - extra_length;
   if(footer_length==0 || file_recovery->file_size <= extra_length)
     return ;
-  file_recovery->file_size=file_rsearch(file_recovery->handle, file_recovery->file_size-extra_length, footer, footer_length);
+  if(data!=NULL && end <= data_size)
+  {
+    /* Search backward in the copy of the file */
+    file_recovery->file_size=file_data_rsearch(data, 0, end, footer, footer_length);
+  }
+  else if(data!=NULL && file_data_tail_size > 0 &&
+      file_data_tail_offset < end &&
+      end <= file_data_tail_offset + file_data_tail_size)
+  {
+    /* Search the copy of the end of the file, then the file itself */
+    file_recovery->file_size=file_data_rsearch(file_data_tail, file_data_tail_offset, end, footer, footer_length);
+    if(file_recovery->file_size==0)
+    {
+      const uint64_t offset=file_data_tail_offset + footer_length - 1;
+      file_recovery->file_size=file_rsearch(file_recovery->handle, (offset < end ? offset : end), footer, footer_length);
+    }
+  }
+  else
+    file_recovery->file_size=file_rsearch(file_recovery->handle, end, footer, footer_length);
   if(file_recovery->file_size > 0)
     file_recovery->file_size+= footer_length + extra_length;
 }
@@ -333,6 +641,8 @@ void reset_file_recovery(file_recovery_t *file_recovery)
 //  file_recovery->blocksize=512;
   file_recovery->flags=0;
   file_recovery->extra=0;
+  if(file_data_owner==file_recovery)
+    file_data_owner=NULL;
 }
 
 file_stat_t * init_file_stats(file_enable_t *files_enable)
@@ -357,6 +667,9 @@ file_stat_t * init_file_stats(file_enable_t *files_enable)
       file_stats[enable_count].file_hint=file_enable->file_hint;
       file_stats[enable_count].not_recovered=0;
       file_stats[enable_count].recovered=0;
+      file_stats[enable_count].header_calls=0;
+      file_stats[enable_count].header_hits=0;
+      file_stats[enable_count].ticks=0;
       if(file_enable->file_hint->register_header_check!=NULL)
 	file_enable->file_hint->register_header_check(&file_stats[enable_count]);
       enable_count++;
@@ -368,6 +681,25 @@ file_stat_t * init_file_stats(file_enable_t *files_enable)
   return file_stats;
 }
 
+static void file_renamed(const char *old_filename, const char *new_filename)
+{
+  if(strlen(old_filename) >= sizeof(file_renamed_old) ||
+      strlen(new_filename) >= sizeof(file_renamed_new))
+    return ;
+  strcpy(file_renamed_old, old_filename);
+  strcpy(file_renamed_new, new_filename);
+}
+
+int file_renamed_get(char *filename)
+{
+  if(file_renamed_new[0]=='\0' || strcmp(filename, file_renamed_old)!=0)
+    return 0;
+  strcpy(filename, file_renamed_new);
+  file_renamed_old[0]='\0';
+  file_renamed_new[0]='\0';
+  return 1;
+}
+
 /* The original filename begins at offset in buffer and is null terminated */
 void file_rename(const char *old_filename, const void *buffer, const int buffer_size, const int offset, const char *new_ext, const int force_ext)
 {
@@ -466,6 +798,8 @@ void file_rename(const char *old_filename, const void *buffer, const int buffer_
     if(buffer!=NULL)
       file_rename(old_filename, NULL, 0, 0, new_ext, force_ext);
   }
+  else
+    file_renamed(old_filename, new_filename);
   free(new_filename);
 }
 
@@ -563,5 +897,7 @@ void file_rename_unicode(const char *old_filename, const void *buffer, const int
     if(buffer!=NULL)
       file_rename_unicode(old_filename, NULL, 0, 0, new_ext, force_ext);
   }
+  else
+    file_renamed(old_filename, new_filename);
   free(new_filename);
 }
@@ -35,19 +35,33 @@ extern "C" {
 #define PHOTOREC_MAX_SIZE_16 (((uint64_t)1<<15)-1)
 #define PHOTOREC_MAX_SIZE_32 (((uint64_t)1<<31)-1)
 
+/* State kept by a file format check from one call to the next,
+ * fidentify runs the checks from several threads */
+#if defined(HAVE_PTHREAD) && defined(__GNUC__)
+#define TD_THREAD_LOCAL __thread
+#else
+#define TD_THREAD_LOCAL
+#endif
+
 typedef enum { DC_SCAN=0, DC_CONTINUE=1, DC_STOP=2, DC_ERROR=3} data_check_t;
 typedef struct file_hint_struct file_hint_t;
 typedef struct file_recovery_struct file_recovery_t;
 typedef struct file_enable_struct file_enable_t;
 typedef struct file_stat_struct file_stat_t;
-typedef struct
+typedef struct alloc_data_struct alloc_data_t;
+struct alloc_data_struct
 {
   struct td_list_head list;
   uint64_t start;
   uint64_t end;
   file_stat_t *file_stat;
   unsigned int data;
-} alloc_data_t;
+  /* Search tree (treap) ordered like list, the list head holds the root in left */
+  alloc_data_t *parent;
+  alloc_data_t *left;
+  alloc_data_t *right;
+  unsigned int priority;
+};
 
 struct file_enable_struct
 {
@@ -60,6 +74,10 @@ struct file_stat_struct
   unsigned int not_recovered;
   unsigned int recovered;
   const file_hint_t *file_hint;
+  /* Profiling: headers checked and found, time spent in the checks of this format */
+  unsigned int header_calls;
+  unsigned int header_hits;
+  uint64_t ticks;
 };
 
 struct file_recovery_struct
@@ -122,11 +140,35 @@ typedef struct
 #define NL_BARECR       (1 << 2)
 
 void free_header_check(void);
+/* Try the registered header checks in order, set file_recovery_new->file_stat *
+ * and return 1 for the first one that recognizes buffer */
+int header_check_find(const unsigned char *buffer, const unsigned int buffer_size, const unsigned int safe_header_only, const file_recovery_t *file_recovery, file_recovery_t *file_recovery_new);
+/* Enable or disable the per-format counters updated by header_check_find() */
+void header_check_set_profile(const int enable);
+/* Write buffer at offset file_size of the recovered file. A copy of the *
+ * beginning and of the end of the data is kept in memory so file_check  *
+ * can validate the file without reading it back.                        *
+ * Return 1 on success, 0 on error.                                      */
+int file_data_write(file_recovery_t *file_recovery, const void *buffer, const unsigned int size);
+/* hook(file_recovery, buffer, size, offset) is called after each successful *
+ * file_data_write(), NULL to remove it */
+void file_data_set_hook(void (*hook)(const file_recovery_t *file_recovery, const void *buffer, const unsigned int size, const uint64_t offset));
+/* Read the recovered file like pread(), from memory when possible */
+int file_data_read(const file_recovery_t *file_recovery, void *buffer, const unsigned int size, const uint64_t offset);
+/* Return the copy of the beginning of the recovered file and its size, *
+ * or NULL                                                               */
+const unsigned char *file_data_get(const file_recovery_t *file_recovery, uint64_t *size);
 void file_allow_nl(file_recovery_t *file_recovery, const unsigned int nl_mode);
 uint64_t file_rsearch(FILE *handle, uint64_t offset, const void*footer, const unsigned int footer_length);
 void file_search_footer(file_recovery_t *file_recovery, const void*footer, const unsigned int footer_length, const unsigned int extra_length);
 void file_search_lc_footer(file_recovery_t *file_recovery, const unsigned char*footer, const unsigned int footer_length);
 void del_search_space(alloc_data_t *list_search_space, const uint64_t start, const uint64_t end);
+/* Remove from the search space the blocks whose bit is set in bitmap, bit i   *
+ * (LSB first) is the block at offset + i * block_size. The last run is kept   *
+ * in start_free/end_free so it can be extended by the next call, the caller  *
+ * must delete it at the end if start_free != end_free.                        */
+void del_search_space_bitmap(alloc_data_t *list_search_space, const unsigned char *bitmap, const unsigned int nbr_bits, const uint64_t offset, const unsigned int block_size, uint64_t *start_free, uint64_t *end_free);
+void add_search_space_after(alloc_data_t *list_search_space, alloc_data_t *prev, alloc_data_t *new_sp);
 data_check_t data_check_size(const unsigned char *buffer, const unsigned int buffer_size, file_recovery_t *file_recovery);
 void file_check_size_lax(file_recovery_t *file_recovery);
 void file_check_size(file_recovery_t *file_recovery);
@@ -137,6 +179,10 @@ void register_header_check(const unsigned int offset, const void *value, const u
 file_stat_t * init_file_stats(file_enable_t *files_enable);
 void file_rename(const char *old_filename, const void *buffer, const int buffer_size, const int offset, const char *new_ext, const int force_ext);
 void file_rename_unicode(const char *old_filename, const void *buffer, const int buffer_size, const int offset, const char *new_ext, const int force_ext);
+/* If filename has just been renamed by file_rename() or
+ * file_rename_unicode(), replace it by the new name (same buffer size as
+ * file_recovery_t.filename) and return 1 */
+int file_renamed_get(char *filename);
 
 #ifdef __cplusplus
 } /* closing brace for extern "C" */
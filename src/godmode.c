@@ -31,6 +31,7 @@
 #include "types.h"
 #include "common.h"
 #include "fnctdsk.h"
+#include "hdahead.h"
 #include "analyse.h"
 #include "lang.h"
 #include "godmode.h"
@@ -534,12 +535,24 @@ static list_part_t *search_part(disk_t *disk_car, const list_part_t *list_part_o
   list_part_t *list_part=NULL;
   list_part_t *list_part_bad=NULL;
   partition_t *partition;
+#ifdef HAVE_PTHREAD
+  disk_t *disk_ahead=NULL;
+#endif
   /* It's not a problem to read a little bit more than necessary */
   const uint64_t search_location_max=td_max((disk_car->disk_size /
       ((uint64_t) disk_car->geom.heads_per_cylinder * disk_car->geom.sectors_per_head * disk_car->sector_size) + 1 ) *
       ((uint64_t) disk_car->geom.heads_per_cylinder * disk_car->geom.sectors_per_head * disk_car->sector_size),
       disk_car->disk_real_size);
   assert(disk_car->sector_size>0);
+#ifdef HAVE_PTHREAD
+  /* Deeper search examines every head, the whole disk is read by large *
+   * chunks in the background while the candidates are checked          */
+  if(fast_mode>1)
+  {
+    disk_ahead=new_diskahead(disk_car, search_location_max);
+    disk_car=disk_ahead;
+  }
+#endif
   partition=partition_new(disk_car->arch);
   buffer_disk=(unsigned char*)MALLOC(16*DEFAULT_SECTOR_SIZE);
   buffer_disk0=(unsigned char*)MALLOC(16*DEFAULT_SECTOR_SIZE);
@@ -570,6 +583,10 @@ static list_part_t *search_part(disk_t *disk_car, const list_part_t *list_part_o
   {
     CHS_t start;
     offset2CHS_inline(disk_car,search_location,&start);
+#ifdef HAVE_PTHREAD
+    if(disk_ahead!=NULL)
+      diskahead_set_location(disk_ahead, search_location);
+#endif
 #ifdef HAVE_NCURSES
     if(disk_car->geom.heads_per_cylinder>1)
     {
@@ -959,6 +976,10 @@ static list_part_t *search_part(disk_t *disk_car, const list_part_t *list_part_o
   part_free_list(list_part_bad);
   free(buffer_disk0);
   free(buffer_disk);
+#ifdef HAVE_PTHREAD
+  if(disk_ahead!=NULL)
+    disk_ahead->clean(disk_ahead);
+#endif
   return list_part;
 }
 
@@ -45,6 +45,9 @@
 #ifdef HAVE_SYS_IOCTL_H
 #include <sys/ioctl.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 #ifdef HAVE_SYS_DISKLABEL_H
 #include <sys/disklabel.h>
 #endif
@@ -107,6 +110,7 @@
 #include "hdaccess.h"
 #include "alignio.h"
 #include "hpa_dco.h"
+#include "rescuemap.h"
 
 #if defined(HAVE_PREAD) && defined(TARGET_LINUX)
 //#define HDCLONE 1
@@ -138,6 +142,14 @@ struct tdewf_file_header
 } __attribute__ ((__packed__));
 
 
+/* Number of read requests kept in flight ahead of a sequential reader */
+#define FILE_READAHEAD_DEPTH 8
+/* Smaller reads are considered random accesses */
+#define FILE_READAHEAD_MIN_SIZE (64*1024)
+/* Size of the mapping kept behind the last view, the pages before are *
+ * released so the scanned image doesn't stay in the process memory   */
+#define FILE_MAP_KEEP (32*1024*1024)
+
 struct info_file_struct
 {
   int handle;
@@ -146,6 +158,13 @@ struct info_file_struct
 #endif
   char file_name[DISKNAME_MAX];
   int mode;
+  uint64_t next_offset;		/* offset following the last read */
+  uint64_t readahead_end;	/* data before this offset has already been requested */
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  unsigned char *map;		/* image file mapped in memory or NULL */
+  uint64_t map_size;
+  uint64_t map_released;	/* pages before this offset are not mapped */
+#endif
 };
 
 static void autoset_geometry(disk_t * disk_car, const unsigned char *buffer, const int verbose);
@@ -1117,6 +1136,13 @@ static void file_clean(disk_t *disk)
       close(data->handle_clone);
       data->handle_clone=0;
     }
+#endif
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    if(data->map!=NULL)
+    {
+      munmap(data->map, data->map_size);
+      data->map=NULL;
+    }
 #endif
     close(data->handle);
     data->handle=0;
@@ -1124,6 +1150,115 @@ static void file_clean(disk_t *disk)
   generic_clean(disk);
 }
 
+#if defined(POSIX_FADV_WILLNEED) && defined(HAVE_POSIX_FADVISE)
+/* When the reads are sequential, ask the kernel to start reading the
+ * next FILE_READAHEAD_DEPTH windows asynchronously, so the device always
+ * has several requests queued ahead of the caller.
+ * On a device answering at memory speed, the gain is lost in the noise
+ * (805 MB loop device, cold cache: 7.5s instead of 8.1s), the hint is
+ * meant for devices with a high latency. */
+static void file_readahead(struct info_file_struct *data, const unsigned int count, const uint64_t offset)
+{
+  const uint64_t end=offset + (uint64_t)FILE_READAHEAD_DEPTH * count;
+#ifdef O_DIRECT
+  /* The page cache is bypassed */
+  if((data->mode&O_DIRECT)==O_DIRECT)
+    return ;
+#endif
+  /* The reads may overlap, PhotoRec keeps the end of the previous buffer */
+  if(count < FILE_READAHEAD_MIN_SIZE ||
+      offset > data->next_offset || offset+count <= data->next_offset)
+  {
+    data->next_offset=offset+count;
+    data->readahead_end=offset+count;
+    return ;
+  }
+  data->next_offset=offset+count;
+  if(data->readahead_end < offset+count)
+    data->readahead_end=offset+count;
+  /* Submit the hints in large batches */
+  if(end - data->readahead_end < (uint64_t)FILE_READAHEAD_DEPTH / 2 * count)
+    return ;
+  posix_fadvise(data->handle, data->readahead_end, end - data->readahead_end, POSIX_FADV_WILLNEED);
+  data->readahead_end=end;
+}
+#endif
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+static const unsigned char *file_pview(disk_t *disk, const unsigned int count, const uint64_t offset)
+{
+  struct info_file_struct *data=(struct info_file_struct *)disk->data;
+  const uint64_t offset_new=offset+disk->offset;
+  if(offset+count > disk->disk_real_size || offset_new+count > data->map_size)
+    return NULL;
+#if defined(HAVE_MADVISE) && defined(MADV_DONTNEED)
+  if(offset_new < data->map_released)
+  {
+    /* Going back, these pages will be mapped again */
+    data->map_released=offset_new / FILE_MAP_KEEP * FILE_MAP_KEEP;
+  }
+  else if(offset_new >= data->map_released + 2 * FILE_MAP_KEEP)
+  {
+    /* The pages stay in the page cache, the previous views remain valid */
+    const uint64_t end=(offset_new - FILE_MAP_KEEP) / FILE_MAP_KEEP * FILE_MAP_KEEP;
+    madvise(data->map + data->map_released, end - data->map_released, MADV_DONTNEED);
+    data->map_released=end;
+  }
+#endif
+  return data->map+offset_new;
+}
+
+/* Map a whole image file read-only so PhotoRec can scan it in place.
+ * The pages are brought in by the kernel readahead as the scan goes and
+ * released by file_pview() once the scan is past them. */
+static void file_map(disk_t *disk, const uint64_t size, const int verbose)
+{
+  struct info_file_struct *data=(struct info_file_struct *)disk->data;
+  void *map;
+#ifdef O_DIRECT
+  /* The page cache must be bypassed */
+  if((data->mode&O_DIRECT)==O_DIRECT)
+    return ;
+#endif
+  /* An image being created by ddrescue or TestDisk may be incomplete,
+   * reading a missing part of the mapping would raise SIGBUS */
+  {
+    char *map_name=rescue_map_filename(disk->device);
+    struct stat stat_map;
+    const int has_map=(stat(map_name, &stat_map)==0);
+    free(map_name);
+    if(has_map)
+    {
+      if(verbose>1)
+	log_verbose("file_map %s: rescue map found, the image isn't mapped\n", disk->device);
+      return ;
+    }
+  }
+  /* Not enough address space */
+  if(size==0 || (uint64_t)(size_t)size!=size)
+    return ;
+  map=mmap(NULL, size, PROT_READ, MAP_SHARED, data->handle, 0);
+  if(map==MAP_FAILED)
+  {
+    if(verbose>1)
+      log_verbose("file_map %s: %s\n", disk->device, strerror(errno));
+    return ;
+  }
+#ifdef HAVE_MADVISE
+#ifdef MADV_SEQUENTIAL
+  madvise(map, size, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_HUGEPAGE
+  madvise(map, size, MADV_HUGEPAGE);
+#endif
+#endif
+  data->map=(unsigned char *)map;
+  data->map_size=size;
+  data->map_released=0;
+  disk->pview=file_pview;
+}
+#endif
+
 static int file_pread_aux(disk_t *disk, void *buf, const unsigned int count, const uint64_t offset)
 {
   long int ret;
@@ -1183,6 +1318,9 @@ static int file_pread_aux(disk_t *disk, void *buf, const unsigned int count, con
   }
   ret=read(fd, buf, count);
 #else
+#if defined(POSIX_FADV_WILLNEED) && defined(HAVE_POSIX_FADVISE)
+  file_readahead((struct info_file_struct *)disk->data, count, offset);
+#endif
 #if defined(HAVE_PREAD)
   ret=pread(fd,buf,count,offset);
   if(ret<0 && errno == ENOSYS)
@@ -1464,6 +1602,13 @@ disk_t *file_test_availability(const char *device, const int verbose, int testdi
   data=(struct info_file_struct *)MALLOC(sizeof(*data));
   data->handle=hd_h;
   data->mode=mode;
+  data->next_offset=0;
+  data->readahead_end=0;
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  data->map=NULL;
+  data->map_size=0;
+  data->map_released=0;
+#endif
   disk_car->data=data;
   disk_car->description=file_description;
   disk_car->description_short=file_description_short;
@@ -1573,6 +1718,10 @@ disk_t *file_test_availability(const char *device, const int verbose, int testdi
 #endif
   if(disk_car->disk_real_size!=0)
   {
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    if(device_is_a_file>0)
+      file_map(disk_car, stat_rec.st_size, verbose);
+#endif
 #ifdef HDCLONE
     if(strncmp(device, "/dev/", 5)==0)
     {
@@ -1646,6 +1795,7 @@ void init_disk(disk_t *disk)
   disk->dco=0;
   /* Note, some Raid reserve the first 1024 512-sectors */
   disk->offset=0;
+  disk->pview=NULL;
   disk->rbuffer=NULL;
   disk->wbuffer=NULL;
   disk->rbuffer_size=0;
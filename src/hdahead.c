@@ -0,0 +1,309 @@
+/*
+
+    File: hdahead.c
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#ifdef HAVE_PTHREAD
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include <pthread.h>
+#include "types.h"
+#include "common.h"
+#include "hdahead.h"
+#include "log.h"
+
+/* The disk is read in windows aligned on AHEAD_WINDOW_SIZE, the reader *
+ * thread keeps the AHEAD_WINDOW_NBR windows following the current      *
+ * location filled. Other reads are sent directly to the disk.          */
+#define AHEAD_WINDOW_SIZE (4*1024*1024)
+#define AHEAD_WINDOW_NBR 4
+
+typedef enum { AHEAD_EMPTY=0, AHEAD_READING=1, AHEAD_READY=2, AHEAD_ERROR=3 } ahead_status_t;
+
+struct ahead_window
+{
+  unsigned char *buffer;
+  uint64_t offset;
+  ahead_status_t status;
+};
+
+struct ahead_struct
+{
+  disk_t *disk_car;
+  pthread_t thread;
+  pthread_mutex_t mutex;	/* protects windows, location and quit */
+  pthread_cond_t cond;
+  pthread_mutex_t io_mutex;	/* disk_car can only be used by one thread */
+  struct ahead_window windows[AHEAD_WINDOW_NBR];
+  uint64_t location;
+  uint64_t offset_max;
+  unsigned int running;
+  unsigned int quit;
+  uint64_t nbr_hit;
+  uint64_t nbr_miss;
+};
+
+static int ahead_pread(disk_t *disk_car, void *buffer, const unsigned int count, const uint64_t offset);
+static int ahead_pwrite(disk_t *disk_car, const void *buffer, const unsigned int count, const uint64_t offset);
+static int ahead_sync(disk_t *disk);
+static void ahead_clean(disk_t *disk);
+static const char *ahead_description(disk_t *disk_car);
+static const char *ahead_description_short(disk_t *disk_car);
+
+static int ahead_window_in_range(const struct ahead_struct *data, const struct ahead_window *window)
+{
+  return (window->status!=AHEAD_EMPTY &&
+      window->offset >= data->location &&
+      window->offset < data->location + (uint64_t)AHEAD_WINDOW_NBR * AHEAD_WINDOW_SIZE);
+}
+
+/* Return the first window to read after the current location, or NULL */
+static struct ahead_window *ahead_next_window(struct ahead_struct *data, uint64_t *offset)
+{
+  uint64_t pos;
+  for(pos=data->location;
+      pos < data->location + (uint64_t)AHEAD_WINDOW_NBR * AHEAD_WINDOW_SIZE &&
+      pos + AHEAD_WINDOW_SIZE <= data->offset_max;
+      pos+=AHEAD_WINDOW_SIZE)
+  {
+    unsigned int i;
+    int found=0;
+    for(i=0; i<AHEAD_WINDOW_NBR; i++)
+      if(ahead_window_in_range(data, &data->windows[i]) && data->windows[i].offset==pos)
+	found=1;
+    if(found==0)
+    {
+      /* Less than AHEAD_WINDOW_NBR windows are in range, recycle another one */
+      for(i=0; i<AHEAD_WINDOW_NBR; i++)
+      {
+	if(!ahead_window_in_range(data, &data->windows[i]))
+	{
+	  *offset=pos;
+	  return &data->windows[i];
+	}
+      }
+      return NULL;
+    }
+  }
+  return NULL;
+}
+
+static void *ahead_thread(void *arg)
+{
+  struct ahead_struct *data=(struct ahead_struct *)arg;
+  pthread_mutex_lock(&data->mutex);
+  while(data->quit==0)
+  {
+    struct ahead_window *window;
+    uint64_t offset=0;
+    int res;
+    window=ahead_next_window(data, &offset);
+    if(window==NULL)
+    {
+      pthread_cond_wait(&data->cond, &data->mutex);
+      continue;
+    }
+    window->offset=offset;
+    window->status=AHEAD_READING;
+    pthread_mutex_unlock(&data->mutex);
+    pthread_mutex_lock(&data->io_mutex);
+    res=data->disk_car->pread(data->disk_car, window->buffer, AHEAD_WINDOW_SIZE, offset);
+    pthread_mutex_unlock(&data->io_mutex);
+    pthread_mutex_lock(&data->mutex);
+    window->status=(res==AHEAD_WINDOW_SIZE ? AHEAD_READY : AHEAD_ERROR);
+    pthread_cond_broadcast(&data->cond);
+  }
+  pthread_mutex_unlock(&data->mutex);
+  return NULL;
+}
+
+void diskahead_set_location(disk_t *disk_car, const uint64_t offset)
+{
+  struct ahead_struct *data=(struct ahead_struct *)disk_car->data;
+  const uint64_t location=offset / AHEAD_WINDOW_SIZE * AHEAD_WINDOW_SIZE;
+  /* location is only modified by the calling thread */
+  if(location==data->location)
+    return ;
+  pthread_mutex_lock(&data->mutex);
+  data->location=location;
+  pthread_cond_broadcast(&data->cond);
+  pthread_mutex_unlock(&data->mutex);
+}
+
+/* Use the window holding the data if any, read errors are handled by *
+ * reading the disk directly so the result is the same as without it. */
+static int ahead_pread(disk_t *disk_car, void *buffer, const unsigned int count, const uint64_t offset)
+{
+  struct ahead_struct *data=(struct ahead_struct *)disk_car->data;
+  int res;
+  if(data->running)
+  {
+    unsigned int i;
+    pthread_mutex_lock(&data->mutex);
+    for(i=0; i<AHEAD_WINDOW_NBR; i++)
+    {
+      struct ahead_window *window=&data->windows[i];
+      if(window->status!=AHEAD_EMPTY && window->offset <= offset &&
+	  offset + count <= window->offset + AHEAD_WINDOW_SIZE)
+      {
+	const uint64_t window_offset=window->offset;
+	while(window->status==AHEAD_READING && window->offset==window_offset)
+	  pthread_cond_wait(&data->cond, &data->mutex);
+	if(window->status==AHEAD_READY && window->offset==window_offset)
+	{
+	  memcpy(buffer, window->buffer + offset - window->offset, count);
+	  data->nbr_hit++;
+	  pthread_mutex_unlock(&data->mutex);
+	  return count;
+	}
+	break;
+      }
+    }
+    pthread_mutex_unlock(&data->mutex);
+  }
+  data->nbr_miss++;
+  pthread_mutex_lock(&data->io_mutex);
+  res=data->disk_car->pread(data->disk_car, buffer, count, offset);
+  pthread_mutex_unlock(&data->io_mutex);
+  return res;
+}
+
+static int ahead_pwrite(disk_t *disk_car, const void *buffer, const unsigned int count, const uint64_t offset)
+{
+  struct ahead_struct *data=(struct ahead_struct *)disk_car->data;
+  unsigned int i;
+  int res;
+  disk_car->write_used=1;
+  pthread_mutex_lock(&data->io_mutex);
+  res=data->disk_car->pwrite(data->disk_car, buffer, count, offset);
+  pthread_mutex_unlock(&data->io_mutex);
+  /* Discard the windows overlapping the data, they may have been read *
+   * before the write */
+  pthread_mutex_lock(&data->mutex);
+  for(i=0; i<AHEAD_WINDOW_NBR; i++)
+  {
+    struct ahead_window *window=&data->windows[i];
+    while(window->status==AHEAD_READING &&
+	offset < window->offset + AHEAD_WINDOW_SIZE && window->offset < offset + count)
+      pthread_cond_wait(&data->cond, &data->mutex);
+    if(offset < window->offset + AHEAD_WINDOW_SIZE && window->offset < offset + count)
+      window->status=AHEAD_EMPTY;
+  }
+  pthread_mutex_unlock(&data->mutex);
+  return res;
+}
+
+static int ahead_sync(disk_t *disk_car)
+{
+  struct ahead_struct *data=(struct ahead_struct *)disk_car->data;
+  int res;
+  pthread_mutex_lock(&data->io_mutex);
+  res=data->disk_car->sync(data->disk_car);
+  pthread_mutex_unlock(&data->io_mutex);
+  return res;
+}
+
+static void ahead_clean(disk_t *disk_car)
+{
+  if(disk_car->data)
+  {
+    struct ahead_struct *data=(struct ahead_struct *)disk_car->data;
+    unsigned int i;
+    if(data->running)
+    {
+      pthread_mutex_lock(&data->mutex);
+      data->quit=1;
+      pthread_cond_broadcast(&data->cond);
+      pthread_mutex_unlock(&data->mutex);
+      pthread_join(data->thread, NULL);
+    }
+    log_info("ahead_pread window hit=%llu, miss=%llu\n",
+	(long long unsigned)data->nbr_hit, (long long unsigned)data->nbr_miss);
+    pthread_cond_destroy(&data->cond);
+    pthread_mutex_destroy(&data->mutex);
+    pthread_mutex_destroy(&data->io_mutex);
+    for(i=0; i<AHEAD_WINDOW_NBR; i++)
+      free(data->windows[i].buffer);
+    free(disk_car->data);
+    disk_car->data=NULL;
+  }
+  free(disk_car);
+}
+
+static const char *ahead_description(disk_t *disk_car)
+{
+  struct ahead_struct *data=(struct ahead_struct *)disk_car->data;
+  return data->disk_car->description(data->disk_car);
+}
+
+static const char *ahead_description_short(disk_t *disk_car)
+{
+  struct ahead_struct *data=(struct ahead_struct *)disk_car->data;
+  return data->disk_car->description_short(data->disk_car);
+}
+
+disk_t *new_diskahead(disk_t *disk_car, const uint64_t offset_max)
+{
+  unsigned int i;
+  struct ahead_struct *data=(struct ahead_struct *)MALLOC(sizeof(*data));
+  disk_t *new_disk_car=(disk_t *)MALLOC(sizeof(*new_disk_car));
+  memcpy(new_disk_car, disk_car, sizeof(*new_disk_car));
+  data->disk_car=disk_car;
+  for(i=0; i<AHEAD_WINDOW_NBR; i++)
+  {
+    data->windows[i].buffer=(unsigned char *)MALLOC(AHEAD_WINDOW_SIZE);
+    data->windows[i].offset=0;
+    data->windows[i].status=AHEAD_EMPTY;
+  }
+  data->location=0;
+  data->offset_max=(offset_max < disk_car->disk_real_size ? offset_max : disk_car->disk_real_size);
+  data->quit=0;
+  data->running=0;
+  data->nbr_hit=0;
+  data->nbr_miss=0;
+  pthread_mutex_init(&data->mutex, NULL);
+  pthread_mutex_init(&data->io_mutex, NULL);
+  pthread_cond_init(&data->cond, NULL);
+  new_disk_car->data=data;
+  new_disk_car->pread=ahead_pread;
+  new_disk_car->pwrite=ahead_pwrite;
+  new_disk_car->sync=ahead_sync;
+  new_disk_car->clean=ahead_clean;
+  new_disk_car->description=ahead_description;
+  new_disk_car->description_short=ahead_description_short;
+  new_disk_car->pview=NULL;
+  new_disk_car->rbuffer=NULL;
+  new_disk_car->wbuffer=NULL;
+  new_disk_car->rbuffer_size=0;
+  new_disk_car->wbuffer_size=0;
+  if(pthread_create(&data->thread, NULL, ahead_thread, data)!=0)
+    log_warning("Cannot create reader thread, reading without read ahead\n");
+  else
+    data->running=1;
+  return new_disk_car;
+}
+#endif
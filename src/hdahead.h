@@ -0,0 +1,36 @@
+/*
+
+    File: hdahead.h
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HAVE_PTHREAD
+/* Return a disk reading disk_car in large windows from a background thread, *
+ * starting at the location set by diskahead_set_location() and up to       *
+ * offset_max. Calling clean() on it doesn't clean disk_car.                 */
+disk_t *new_diskahead(disk_t *disk_car, const uint64_t offset_max);
+void diskahead_set_location(disk_t *disk_car, const uint64_t offset);
+#endif
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
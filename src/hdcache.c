@@ -31,194 +31,318 @@
 #endif
 #include "types.h"
 #include "common.h"
+#include "list.h"
 #include "hdcache.h"
 #include "log.h"
+#include "profile.h"
 
-#define CACHE_BUFFER_NBR 16
-#define CACHE_DEFAULT_SIZE 64*512
-//#define DEBUG_CACHE 1
+/* The cache is made of fixed-size pages aligned on CACHE_PAGE_SIZE,
+ * found using a hash table on their offset and recycled in LRU order. */
+#define CACHE_PAGE_SIZE (64*512)
+/* Default size, can be changed using diskcache_set_size() */
+#define CACHE_SIZE_DEFAULT (4*1024*1024)
+/* Maximum size of a single read from the underlying disk */
+#define CACHE_RUN_MAX (1024*1024)
+/* Larger reads are read directly in the caller buffer, without being *
+ * cached. The 512 KiB reads of PhotoRec overlap, they are cached.     */
+#define CACHE_BYPASS_MIN CACHE_RUN_MAX
 
-struct cache_buffer_struct
+static unsigned int cache_size=CACHE_SIZE_DEFAULT;
+
+struct cache_page_struct
 {
+  struct td_list_head list;	/* Most recently used first */
+  struct cache_page_struct *hash_next;
   unsigned char *buffer;
-  unsigned int	buffer_size;
-  unsigned int	cache_size;
-  uint64_t 	cache_offset;
-  int		cache_status;
+  uint64_t offset;
+  unsigned int start;		/* Valid data in buffer from start */
+  unsigned int end;		/*                       to end     */
 };
 
 struct cache_struct
 {
   disk_t *disk_car;
-  struct cache_buffer_struct cache[CACHE_BUFFER_NBR];
-#ifdef DEBUG_CACHE
-  uint64_t 	nbr_fnct_sect;
-  uint64_t 	nbr_pread_sect;
-  unsigned int 	nbr_fnct_call;
-  unsigned int 	nbr_pread_call;
-#endif
-  unsigned int  cache_buffer_nbr;
-  unsigned int  cache_size_min;
-  unsigned int  last_io_error_nbr;
+  struct cache_page_struct *pages;
+  struct cache_page_struct **hash;
+  struct td_list_head lru;
+  unsigned char *run_buffer;
+  unsigned int run_buffer_size;
+  unsigned int pages_used;
+  unsigned int pages_max;
+  unsigned int hash_mask;
+  unsigned int cache_size_min;
+  unsigned int last_io_error_nbr;
+  uint64_t nbr_fnct_call;
+  uint64_t nbr_fnct_sect;
+  uint64_t nbr_page_hit;
+  uint64_t nbr_page_miss;
+  uint64_t nbr_bypass;
+  uint64_t nbr_pread_call;
+  uint64_t nbr_pread_sect;
 };
 
-static int cache_pread_aux(disk_t *disk_car, void *buffer, const unsigned int count, const uint64_t offset, const unsigned int read_ahead);
 static int cache_pread(disk_t *disk_car, void *buffer, const unsigned int count, const uint64_t offset);
 static int cache_pwrite(disk_t *disk_car, const void *buffer, const unsigned int count, const uint64_t offset);
 static int cache_sync(disk_t *disk);
 static void cache_clean(disk_t *disk);
+static const unsigned char *cache_pview(disk_t *disk_car, const unsigned int count, const uint64_t offset);
 static const char *cache_description(disk_t *disk_car);
 static const char *cache_description_short(disk_t *disk_car);
 
-static int cache_pread(disk_t *disk_car, void *buffer, const unsigned int count, const uint64_t offset)
+static inline unsigned int cache_hash(const struct cache_struct *data, const uint64_t offset)
 {
-  const struct cache_struct *data=(const struct cache_struct *)disk_car->data;
-  return cache_pread_aux(disk_car, buffer, count, offset, (data->last_io_error_nbr==0));
+  return (offset / CACHE_PAGE_SIZE) & data->hash_mask;
 }
 
-static int cache_pread_aux(disk_t *disk_car, void *buffer, const unsigned int count, const uint64_t offset, const unsigned int read_ahead)
+static struct cache_page_struct *cache_find(const struct cache_struct *data, const uint64_t offset)
 {
-  struct cache_struct *data=(struct cache_struct *)disk_car->data;
-#ifdef DEBUG_CACHE
-  log_info("cache_pread(buffer, count=%u, offset=%llu, read_ahead=%u)\n", count,(long long unsigned)offset, read_ahead);
-  data->nbr_fnct_call++;
-#endif
+  struct cache_page_struct *page;
+  for(page=data->hash[cache_hash(data, offset)]; page!=NULL; page=page->hash_next)
+    if(page->offset==offset)
+      return page;
+  return NULL;
+}
+
+static void cache_unhash(struct cache_struct *data, const struct cache_page_struct *page)
+{
+  struct cache_page_struct **prev;
+  for(prev=&data->hash[cache_hash(data, page->offset)]; *prev!=NULL; prev=&(*prev)->hash_next)
   {
-    unsigned int i;
-    unsigned int cache_buffer_nbr;
-    /* Data is probably in the last buffers */
-    for(i=0, cache_buffer_nbr=data->cache_buffer_nbr;
-	i<CACHE_BUFFER_NBR;
-	i++, cache_buffer_nbr=(cache_buffer_nbr+CACHE_BUFFER_NBR-1)%CACHE_BUFFER_NBR)
+    if(*prev==page)
+    {
+      *prev=page->hash_next;
+      return ;
+    }
+  }
+}
+
+/* Return the page caching the data at offset, recycle the least recently *
+ * used page if all the pages are in use */
+static struct cache_page_struct *cache_page_get(struct cache_struct *data, const uint64_t offset)
+{
+  struct cache_page_struct *page=cache_find(data, offset);
+  if(page!=NULL)
+  {
+    td_list_move(&page->list, &data->lru);
+    return page;
+  }
+  if(data->pages_used < data->pages_max)
+  {
+    page=&data->pages[data->pages_used++];
+    page->buffer=(unsigned char *)MALLOC(CACHE_PAGE_SIZE);
+  }
+  else
+  {
+    page=td_list_entry(data->lru.prev, struct cache_page_struct, list);
+    td_list_del(&page->list);
+    cache_unhash(data, page);
+  }
+  page->offset=offset;
+  page->start=0;
+  page->end=0;
+  page->hash_next=data->hash[cache_hash(data, offset)];
+  data->hash[cache_hash(data, offset)]=page;
+  td_list_add(&page->list, &data->lru);
+  return page;
+}
+
+/* Read the data from pos up to end (or up to the read ahead limit),     *
+ * stopping at the first page already cached. Only the sectors needed    *
+ * are read, the pages are partially filled.                             *
+ * Copy the data from pos to buffer and return the number of bytes copied. *
+ * On read error, *valid is set to the number of bytes successfully read.  */
+static unsigned int cache_read_run(struct cache_struct *data, const unsigned int sector_size, unsigned char *buffer, const uint64_t pos, const uint64_t end, int *valid)
+{
+  disk_t *disk=data->disk_car;
+  const uint64_t page_offset=pos / CACHE_PAGE_SIZE * CACHE_PAGE_SIZE;
+  const uint64_t read_start=(sector_size > 0 ? pos / sector_size * sector_size : pos);
+  const uint64_t want_end=(data->last_io_error_nbr==0 && end < pos + data->cache_size_min ? pos + data->cache_size_min : end);
+  uint64_t run_end=page_offset + CACHE_PAGE_SIZE;
+  uint64_t read_end;
+  unsigned int read_size;
+  unsigned int copy_size;
+  int res;
+  while(run_end < want_end && run_end - page_offset < CACHE_RUN_MAX &&
+      cache_find(data, run_end)==NULL)
+    run_end+=CACHE_PAGE_SIZE;
+  read_end=(sector_size > 0 ? (want_end + sector_size - 1) / sector_size * sector_size : want_end);
+  if(read_end > run_end)
+    read_end=run_end;
+  /* Don't read ahead after the end of the disk */
+  if(read_end > end && read_end > disk->disk_real_size)
+    read_end=(end > disk->disk_real_size ? end : disk->disk_real_size);
+  read_size=read_end - read_start;
+  copy_size=(end < read_end ? end : read_end) - pos;
+  if(data->run_buffer_size < read_size)
+  {
+    free(data->run_buffer);
+    data->run_buffer_size=read_size;
+    data->run_buffer=(unsigned char *)MALLOC(data->run_buffer_size);
+  }
+  {
+    const uint64_t start=prof_ticks();
+    res=disk->pread(disk, data->run_buffer, read_size, read_start);
+    prof_io(read_size, start);
+  }
+  data->nbr_pread_call++;
+  data->nbr_pread_sect+=read_size;
+  data->nbr_page_miss+=(read_size + CACHE_PAGE_SIZE - 1) / CACHE_PAGE_SIZE;
+  if(res == (signed)read_size)
+  {
+    uint64_t off;
+    data->last_io_error_nbr=0;
+    for(off=page_offset; off < read_end; off+=CACHE_PAGE_SIZE)
     {
-      const struct cache_buffer_struct *cache=&data->cache[cache_buffer_nbr];
-      if(cache->cache_offset <= offset &&
-	  offset < cache->cache_offset +cache->cache_size &&
-	  cache->buffer!=NULL && cache->cache_size>0)
+      struct cache_page_struct *page=cache_page_get(data, off);
+      const unsigned int start=(off < read_start ? read_start - off : 0);
+      const unsigned int stop=(read_end - off < CACHE_PAGE_SIZE ? read_end - off : CACHE_PAGE_SIZE);
+      memcpy(page->buffer + start, data->run_buffer + off + start - read_start, stop - start);
+      /* Keep the data already cached if the ranges are contiguous */
+      if(page->end < start || stop < page->start)
       {
-	const unsigned int data_available= cache->cache_size + cache->cache_offset - offset;
-	const int res=cache->cache_status + cache->cache_offset - offset;
-	if(count<=data_available)
-	{
-#ifdef DEBUG_CACHE
-	  log_info("cache use %5u count=%u, coffset=%llu, cstatus=%d\n",
-	      cache_buffer_nbr, cache->cache_size, (long long unsigned)cache->cache_offset,
-	      cache->cache_status);
-	  data->nbr_fnct_sect+=count;
-#endif
-	  memcpy(buffer, cache->buffer + offset - cache->cache_offset, count);
-	  return (res < (signed)count ?  res : (signed)count );
-	}
-	else
-	{
-#ifdef DEBUG_CACHE
-	  log_info("cache USE %5u count=%u, coffset=%llu, ctstatus=%d, call again cache_pread_aux\n",
-	      cache_buffer_nbr, cache->cache_size, (long long unsigned)cache->cache_offset,
-	      cache->cache_status);
-	  data->nbr_fnct_sect+=data_available;
-#endif
-	  memcpy(buffer, cache->buffer + offset - cache->cache_offset, data_available);
-	  return res + cache_pread_aux(disk_car, (unsigned char*)buffer+data_available,
-		count-data_available, offset+data_available, read_ahead);
-	}
+	page->start=start;
+	page->end=stop;
+      }
+      else
+      {
+	if(page->start > start)
+	  page->start=start;
+	if(page->end < stop)
+	  page->end=stop;
       }
     }
+    memcpy(buffer, data->run_buffer + pos - read_start, copy_size);
+    return copy_size;
   }
+  /* Read failure, nothing is cached */
+  data->last_io_error_nbr++;
+  if(read_size<=sector_size || sector_size<=0 || data->last_io_error_nbr>1)
   {
-    struct cache_buffer_struct *cache;
-    const unsigned int count_new=(read_ahead!=0 && count<data->cache_size_min && (offset+data->cache_size_min<data->disk_car->disk_real_size)?data->cache_size_min:count);
-    data->cache_buffer_nbr=(data->cache_buffer_nbr+1)%CACHE_BUFFER_NBR;
-    cache=&data->cache[data->cache_buffer_nbr];
-    if(cache->buffer_size < count_new)
-    {	/* Buffer is too small, drop it */
-      free(cache->buffer);
-      cache->buffer=NULL;
-    }
-    if(cache->buffer==NULL)
-    {	/* Allocate buffer */
-      cache->buffer_size=(count_new<CACHE_DEFAULT_SIZE?CACHE_DEFAULT_SIZE:count_new);
-      cache->buffer=(unsigned char *)MALLOC(cache->buffer_size);
-    }
-    cache->cache_size=count_new;
-    cache->cache_offset=offset;
-    cache->cache_status=data->disk_car->pread(data->disk_car, cache->buffer, count_new, offset);
-#ifdef DEBUG_CACHE
-    data->nbr_fnct_sect+=count;
-    data->nbr_pread_call++;
-    data->nbr_pread_sect+=count_new;
-    log_info("cache PREAD(buffer[%u], count=%u, count_new=%u, offset=%llu, cstatus=%d)\n",
-	data->cache_buffer_nbr, count, count_new, (long long unsigned)offset,
-	cache->cache_status);
-#endif
-    if(cache->cache_status >= (signed)count)
+    memcpy(buffer, data->run_buffer + pos - read_start, copy_size);
+    *valid=(res > (signed)(pos - read_start) ? res - (signed)(pos - read_start) : 0);
+    return copy_size;
+  }
+  /* split the read sector by sector */
+  {
+    unsigned int off;
+    memset(buffer, 0, copy_size);
+    for(off=0; off<copy_size; off+=sector_size)
     {
-      data->last_io_error_nbr=0;
-      memcpy(buffer, cache->buffer, count);
-      return count;
+      const unsigned int size=(sector_size < copy_size - off ? sector_size : copy_size - off);
+      const uint64_t start=prof_ticks();
+      const int res_sector=disk->pread(disk, buffer+off, size, pos+off);
+      prof_io(size, start);
+      data->nbr_pread_call++;
+      data->nbr_pread_sect+=size;
+      if(res_sector <= 0)
+      {
+	*valid=off;
+	return copy_size;
+      }
     }
-    /* Read failure */
-    data->last_io_error_nbr++;
-    if(count_new<=disk_car->sector_size || disk_car->sector_size<=0 || data->last_io_error_nbr>1)
+  }
+  return copy_size;
+}
+
+static int cache_pread(disk_t *disk_car, void *buffer, const unsigned int count, const uint64_t offset)
+{
+  struct cache_struct *data=(struct cache_struct *)disk_car->data;
+  const uint64_t end=offset+count;
+  uint64_t pos=offset;
+  data->nbr_fnct_call++;
+  data->nbr_fnct_sect+=count;
+  if(count >= CACHE_BYPASS_MIN && data->last_io_error_nbr==0)
+  {
+    const uint64_t start=prof_ticks();
+    const int res=data->disk_car->pread(data->disk_car, buffer, count, offset);
+    prof_io(count, start);
+    data->nbr_bypass++;
+    data->nbr_pread_call++;
+    data->nbr_pread_sect+=count;
+    if(res==(signed)count)
+      return res;
+    /* Read again through the cache, the read is split on error */
+  }
+  while(pos < end)
+  {
+    const uint64_t page_offset=pos / CACHE_PAGE_SIZE * CACHE_PAGE_SIZE;
+    const unsigned int skip=pos - page_offset;
+    const unsigned int size=(end - pos < CACHE_PAGE_SIZE - skip ? end - pos : CACHE_PAGE_SIZE - skip);
+    struct cache_page_struct *page=cache_find(data, page_offset);
+    if(page!=NULL && page->start <= skip && skip + size <= page->end)
     {
-      memcpy(buffer, cache->buffer, count);
-      return cache->cache_status;
+      data->nbr_page_hit++;
+      td_list_move(&page->list, &data->lru);
+      memcpy((unsigned char *)buffer + pos - offset, page->buffer + skip, size);
+      pos+=size;
     }
-    /* Free the existing cache */
-    cache->cache_size=0;
-    /* split the read sector by sector */
+    else
     {
-      unsigned int off;
-      memset(buffer, 0, count);
-      for(off=0; off<count; off+=disk_car->sector_size)
+      int valid=-1;
+      const unsigned int size_read=cache_read_run(data, disk_car->sector_size,
+	  (unsigned char *)buffer + pos - offset, pos, end, &valid);
+      if(valid>=0)
       {
-	if(cache_pread_aux(disk_car, 
-	    (unsigned char*)buffer+off,
-	    (disk_car->sector_size < count - off ? disk_car->sector_size : count - off),
-	    offset+off, 0) <= 0)
-	{
-	  return off;
-	}
+	const unsigned int total=pos - offset + valid;
+	if(pos + size_read < end)
+	  memset((unsigned char *)buffer + pos - offset + size_read, 0, end - pos - size_read);
+	return (total > 0 ? (signed)total : -1);
       }
-      return count;
+      pos+=size_read;
     }
   }
+  return count;
 }
 
 static int cache_pwrite(disk_t *disk_car, const void *buffer, const unsigned int count, const uint64_t offset)
 {
   struct cache_struct *data=(struct cache_struct *)disk_car->data;
-  unsigned int i;
-  for(i=0;i<CACHE_BUFFER_NBR;i++)
+  uint64_t page_offset;
+  for(page_offset=offset / CACHE_PAGE_SIZE * CACHE_PAGE_SIZE;
+      page_offset < offset + count;
+      page_offset+=CACHE_PAGE_SIZE)
   {
-    struct cache_buffer_struct *cache=&data->cache[i];
-    if(!(cache->cache_offset+cache->cache_size-1 < offset || offset+count-1 < cache->cache_offset))
+    struct cache_page_struct *page=cache_find(data, page_offset);
+    if(page!=NULL)
     {
-      /* Discard the cache */
-      cache->cache_size=0;
+      /* Discard the page, it will be recycled first */
+      cache_unhash(data, page);
+      page->start=0;
+      page->end=0;
+      td_list_move_tail(&page->list, &data->lru);
     }
   }
   disk_car->write_used=1;
   return data->disk_car->pwrite(data->disk_car, buffer, count, offset);
 }
 
+/* Data accessible in place don't need to be cached */
+static const unsigned char *cache_pview(disk_t *disk_car, const unsigned int count, const uint64_t offset)
+{
+  struct cache_struct *data=(struct cache_struct *)disk_car->data;
+  return data->disk_car->pview(data->disk_car, count, offset);
+}
+
 static void cache_clean(disk_t *disk_car)
 {
   if(disk_car->data)
   {
     struct cache_struct *data=(struct cache_struct *)disk_car->data;
     unsigned int i;
-#ifdef DEBUG_CACHE
-    log_info("%s\ncache_pread total_call=%u, total_count=%llu\n      read total_call=%u, total_count=%llu\n",
-	data->disk_car->description(data->disk_car),
-	data->nbr_fnct_call, (long long unsigned)data->nbr_fnct_sect,
-	data->nbr_pread_call, (long long unsigned)data->nbr_pread_sect);
-#endif
+    if(data->nbr_fnct_call > 0)
+      log_info("%s\ncache_pread total_call=%llu, total_count=%llu, page hit=%llu, page miss=%llu, bypass=%llu\n      read total_call=%llu, total_count=%llu, %u/%u pages used\n",
+	  data->disk_car->description(data->disk_car),
+	  (long long unsigned)data->nbr_fnct_call, (long long unsigned)data->nbr_fnct_sect,
+	  (long long unsigned)data->nbr_page_hit, (long long unsigned)data->nbr_page_miss,
+	  (long long unsigned)data->nbr_bypass,
+	  (long long unsigned)data->nbr_pread_call, (long long unsigned)data->nbr_pread_sect,
+	  data->pages_used, data->pages_max);
     data->disk_car->clean(data->disk_car);
-    for(i=0;i<CACHE_BUFFER_NBR;i++)
-    {
-      struct cache_buffer_struct *cache=&data->cache[i];
-      free(cache->buffer);
-    }
+    for(i=0;i<data->pages_used;i++)
+      free(data->pages[i].buffer);
+    free(data->pages);
+    free(data->hash);
+    free(data->run_buffer);
     free(disk_car->data);
     disk_car->data=NULL;
   }
@@ -238,6 +362,11 @@ static void dup_geometry(CHSgeometry_t * CHS_dst, const CHSgeometry_t * CHS_sour
   CHS_dst->sectors_per_head=CHS_source->sectors_per_head;
 }
 
+void diskcache_set_size(const unsigned int size)
+{
+  cache_size=size;
+}
+
 disk_t *new_diskcache(disk_t *disk_car, const unsigned int testdisk_mode)
 {
   unsigned int i;
@@ -245,13 +374,25 @@ disk_t *new_diskcache(disk_t *disk_car, const unsigned int testdisk_mode)
   disk_t *new_disk_car=(disk_t *)MALLOC(sizeof(*new_disk_car));
   memcpy(new_disk_car,disk_car,sizeof(*new_disk_car));
   data->disk_car=disk_car;
-#ifdef DEBUG_CACHE
-  data->nbr_fnct_sect=0;
-  data->nbr_pread_sect=0;
+  data->pages_max=(cache_size > CACHE_PAGE_SIZE ? cache_size / CACHE_PAGE_SIZE : 1);
+  /* The size of the hash table must be a power of 2 */
+  for(data->hash_mask=1; data->hash_mask < data->pages_max; data->hash_mask<<=1);
+  data->pages=(struct cache_page_struct *)MALLOC(data->pages_max * sizeof(struct cache_page_struct));
+  data->hash=(struct cache_page_struct **)MALLOC(data->hash_mask * sizeof(struct cache_page_struct *));
+  for(i=0;i<data->hash_mask;i++)
+    data->hash[i]=NULL;
+  data->hash_mask--;
+  TD_INIT_LIST_HEAD(&data->lru);
+  data->run_buffer=NULL;
+  data->run_buffer_size=0;
+  data->pages_used=0;
   data->nbr_fnct_call=0;
+  data->nbr_fnct_sect=0;
+  data->nbr_page_hit=0;
+  data->nbr_page_miss=0;
+  data->nbr_bypass=0;
   data->nbr_pread_call=0;
-#endif
-  data->cache_buffer_nbr=0;
+  data->nbr_pread_sect=0;
   data->last_io_error_nbr=0;
   if(testdisk_mode&TESTDISK_O_READAHEAD_8K)
     data->cache_size_min=16*512;
@@ -268,17 +409,13 @@ disk_t *new_diskcache(disk_t *disk_car, const unsigned int testdisk_mode)
   new_disk_car->pwrite=cache_pwrite;
   new_disk_car->sync=cache_sync;
   new_disk_car->clean=cache_clean;
+  new_disk_car->pview=(disk_car->pview!=NULL ? cache_pview : NULL);
   new_disk_car->description=cache_description;
   new_disk_car->description_short=cache_description_short;
   new_disk_car->rbuffer=NULL;
   new_disk_car->wbuffer=NULL;
   new_disk_car->rbuffer_size=0;
   new_disk_car->wbuffer_size=0;
-  for(i=0;i<CACHE_BUFFER_NBR;i++)
-  {
-    data->cache[i].buffer=NULL;
-    data->cache[i].buffer_size=0;
-  }
   return new_disk_car;
 }
 
@@ -24,6 +24,8 @@ extern "C" {
 #endif
 
 disk_t *new_diskcache(disk_t *disk_car, const unsigned int cache_size_min);
+/* Size in bytes of the caches created by the next calls to new_diskcache() */
+void diskcache_set_size(const unsigned int size);
 
 #ifdef __cplusplus
 } /* closing brace for extern "C" */
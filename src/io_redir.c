@@ -38,26 +38,43 @@
 
 //#define DEBUG_IO_REDIR 1
 
-typedef struct struclist_redir_t list_redir_t;
-struct struclist_redir_t
+typedef struct io_redir_struct io_redir_t;
+struct io_redir_struct
 {
   uint64_t org_offset;
   uint64_t new_offset;
   unsigned int size;
   const void *mem;
-  list_redir_t *prev;
-  list_redir_t *next;
 };
 
 struct info_io_redir
 {
   disk_t *disk_car;
-  list_redir_t *list_redir;
+  /* Redirections sorted by org_offset, they don't overlap */
+  io_redir_t *redirs;
+  unsigned int nbr;
+  unsigned int alloc;
 };
 
 static int io_redir_pread(disk_t *disk_car, void *buffer, const unsigned int count, const uint64_t offset);
 static void io_redir_clean(disk_t *clean);
 
+/* Index of the first redirection ending after offset */
+static unsigned int io_redir_find(const struct info_io_redir *data, const uint64_t offset)
+{
+  unsigned int low=0;
+  unsigned int high=data->nbr;
+  while(low < high)
+  {
+    const unsigned int mid=low + (high - low) / 2;
+    if(data->redirs[mid].org_offset + data->redirs[mid].size <= offset)
+      low=mid + 1;
+    else
+      high=mid;
+  }
+  return low;
+}
+
 int io_redir_add_redir(disk_t *disk_car, const uint64_t org_offset, const unsigned int size, const uint64_t new_offset, const void *mem)
 {
   if(disk_car->pread!=io_redir_pread)
@@ -73,41 +90,48 @@ int io_redir_add_redir(disk_t *disk_car, const uint64_t org_offset, const unsign
 #endif
     memcpy(old_disk_car,disk_car,sizeof(*old_disk_car));
     data->disk_car=old_disk_car;
-    data->list_redir=NULL;
+    data->redirs=NULL;
+    data->nbr=0;
+    data->alloc=0;
     disk_car->write_used=0;
     disk_car->data=data;
     disk_car->description=old_disk_car->description;
     disk_car->pwrite=old_disk_car->pwrite;
     disk_car->pread=io_redir_pread;
     disk_car->clean=io_redir_clean;
+    /* Redirected data can't be accessed in place */
+    disk_car->pview=NULL;
   }
   {
     struct info_io_redir *data=(struct info_io_redir *)disk_car->data;
-    list_redir_t *prev_redir=NULL;
-    list_redir_t *current_redir;
-    for(current_redir=data->list_redir;(current_redir!=NULL) && org_offset<current_redir->org_offset+current_redir->size;current_redir=current_redir->next)
-      prev_redir=current_redir;
-    if(current_redir!=NULL && org_offset>=current_redir->org_offset)
+    const unsigned int idx=io_redir_find(data, org_offset);
+    io_redir_t *new_redir;
+    if(idx < data->nbr && data->redirs[idx].org_offset < org_offset + size)
     {
       log_critical("io_redir_add_redir failed: already redirected\n");
       return 1;
     }
-    {
-      list_redir_t *new_redir;
 #ifdef DEBUG_IO_REDIR
-      log_trace("io_redir_add_redir: add redirection\n");
+    log_trace("io_redir_add_redir: add redirection\n");
 #endif
-      new_redir=(list_redir_t*)MALLOC(sizeof(*new_redir));
-      new_redir->org_offset=org_offset;
-      new_redir->size=size;
-      new_redir->new_offset=new_offset;
-      new_redir->mem=mem;
-      new_redir->next=current_redir;
-      if(prev_redir!=NULL)
-	prev_redir->next=new_redir;
-      else
-	data->list_redir=new_redir;
+    if(data->nbr >= data->alloc)
+    {
+      io_redir_t *new_redirs;
+      data->alloc=(data->alloc < 8 ? 8 : data->alloc * 2);
+      new_redirs=(io_redir_t *)MALLOC(data->alloc * sizeof(io_redir_t));
+      if(data->nbr > 0)
+	memcpy(new_redirs, data->redirs, data->nbr * sizeof(io_redir_t));
+      free(data->redirs);
+      data->redirs=new_redirs;
     }
+    if(idx < data->nbr)
+      memmove(&data->redirs[idx+1], &data->redirs[idx], (data->nbr - idx) * sizeof(io_redir_t));
+    data->nbr++;
+    new_redir=&data->redirs[idx];
+    new_redir->org_offset=org_offset;
+    new_redir->size=size;
+    new_redir->new_offset=new_offset;
+    new_redir->mem=mem;
   }
   return 0;
 }
@@ -121,27 +145,22 @@ int io_redir_del_redir(disk_t *disk_car, uint64_t org_offset)
   }
   {
     struct info_io_redir *data=(struct info_io_redir *)disk_car->data;
-    list_redir_t *current_redir;
-    for(current_redir=data->list_redir;(current_redir!=NULL) && org_offset!=current_redir->org_offset;current_redir=current_redir->next);
-    if(current_redir!=NULL)
+    const unsigned int idx=io_redir_find(data, org_offset);
+    if(idx < data->nbr && data->redirs[idx].org_offset==org_offset)
     {
 #ifdef DEBUG_IO_REDIR
       log_trace("io_redir_del_redir: remove redirection\n");
 #endif
-      if(current_redir->prev!=NULL)
-	current_redir->prev->next=current_redir->next;
-      if(current_redir->next!=NULL)
-	current_redir->next->prev=current_redir->prev;
-      if(data->list_redir==current_redir)
-	data->list_redir=current_redir->next;
-      free(current_redir);
-      if(data->list_redir==NULL)
+      memmove(&data->redirs[idx], &data->redirs[idx+1], (data->nbr - idx - 1) * sizeof(io_redir_t));
+      data->nbr--;
+      if(data->nbr==0)
       {
 #ifdef DEBUG_IO_REDIR
 	log_trace("io_redir_del_redir: uninstall functions\n");
 #endif
 	memcpy(disk_car,data->disk_car,sizeof(*disk_car));
 	free(data->disk_car);
+	free(data->redirs);
 	free(data);
       }
       return 0;
@@ -153,61 +172,60 @@ int io_redir_del_redir(disk_t *disk_car, uint64_t org_offset)
 
 static int io_redir_pread(disk_t *disk_car, void *buffer, const unsigned int count, const uint64_t offset)
 {
-  struct info_io_redir *data=(struct info_io_redir *)disk_car->data;
+  const struct info_io_redir *data=(const struct info_io_redir *)disk_car->data;
   uint64_t current_offset=offset;
   unsigned int current_count=count;
-  list_redir_t *current_redir;
+  unsigned int idx=io_redir_find(data, offset);
 #ifdef DEBUG_IO_REDIR
   log_trace("io_redir_pread: count=%u offset=%llu\n", count, (long long unsigned) offset);
 #endif
   while(current_count!=0)
   {
     unsigned int read_size;
-    int res=0;
-    for(current_redir=data->list_redir;(current_redir!=NULL) && 
-      !(current_redir->org_offset<=offset && offset<current_redir->org_offset+current_redir->size);
-      current_redir=current_redir->next);
-    if(current_redir!=NULL)
+    int res;
+    if(idx >= data->nbr || data->redirs[idx].org_offset > current_offset)
     {
-      if(current_redir->org_offset>current_offset)
-      {
-	/* Read data before redirection */
-	read_size=current_redir->org_offset-current_offset;
+      /* Read data up to the next redirection */
+      read_size=current_count;
+      if(idx < data->nbr && data->redirs[idx].org_offset - current_offset < read_size)
+	read_size=data->redirs[idx].org_offset - current_offset;
 #ifdef DEBUG_IO_REDIR
-	log_trace("io_redir_pread: read %u bytes before redirection\n",read_size);
+      log_trace("io_redir_pread: normal read of %u bytes\n",read_size);
 #endif
-	res=data->disk_car->pread(data->disk_car, buffer, read_size, current_offset);
-	current_count-=read_size;
-	current_offset+=read_size;
-	buffer=(unsigned char*)buffer+read_size;
-      }
-      /* Redirection */
-      read_size=(current_count>current_redir->size?current_redir->size:current_count);
-      if(current_redir->mem!=NULL)
+      res=data->disk_car->pread(data->disk_car, buffer, read_size, current_offset);
+    }
+    else
+    {
+      const io_redir_t *redir=&data->redirs[idx];
+      const uint64_t skip=current_offset - redir->org_offset;
+      read_size=(current_count > redir->size - skip ? redir->size - skip : current_count);
+      idx++;
+      if(redir->mem!=NULL)
       {
 #ifdef DEBUG_IO_REDIR
 	log_trace("io_redir_pread: copy %u bytes from memory\n",read_size);
 #endif
-	memcpy(buffer, (const unsigned char*)current_redir->mem + current_offset - current_redir->org_offset, read_size);
+	memcpy(buffer, (const unsigned char*)redir->mem + skip, read_size);
 	res=read_size;
       }
       else
       {
+	/* Merge with the following redirections to the same area */
+	while(read_size < current_count && idx < data->nbr &&
+	    data->redirs[idx].mem==NULL &&
+	    data->redirs[idx].org_offset == current_offset + read_size &&
+	    data->redirs[idx].new_offset == redir->new_offset + skip + read_size)
+	{
+	  const unsigned int size=data->redirs[idx].size;
+	  read_size=(current_count - read_size > size ? read_size + size : current_count);
+	  idx++;
+	}
 #ifdef DEBUG_IO_REDIR
 	log_trace("io_redir_pread: read %u from another position\n",read_size);
 #endif
-	res=data->disk_car->pread(data->disk_car, buffer, read_size, current_redir->new_offset + current_offset - current_redir->org_offset);
-	    ;
+	res=data->disk_car->pread(data->disk_car, buffer, read_size, redir->new_offset + skip);
       }
     }
-    else
-    {
-      read_size=current_count;
-#ifdef DEBUG_IO_REDIR
-      log_trace("io_redir_pread: normal read of %u bytes\n",read_size);
-#endif
-      res=data->disk_car->pread(data->disk_car, buffer, read_size, current_offset);
-    }
     if((unsigned)res!=read_size)
       return res;
     current_count-=read_size;
@@ -224,6 +242,7 @@ static void io_redir_clean(disk_t *disk_car)
     struct info_io_redir *data=(struct info_io_redir *)disk_car->data;
     data->disk_car->clean(data->disk_car);
     free(data->disk_car);
+    free(data->redirs);
     free(disk_car->data);
     disk_car->data=NULL;
   }
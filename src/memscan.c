@@ -0,0 +1,204 @@
+/*
+
+    File: memscan.c
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include "types.h"
+#include "memscan.h"
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define MEMSCAN_SSE2
+#if defined(__x86_64__) && (__GNUC__ >= 5 || defined(__clang__))
+/* AVX2 code is only used when the CPU supports it */
+#include <immintrin.h>
+#define MEMSCAN_AVX2
+#endif
+#endif
+
+static inline int scan_is_text(const unsigned char car)
+{
+  return ((car >= ' ' && car <= '~') || car=='\b' || car=='\t' || car=='\r' || car=='\n');
+}
+
+#ifdef MEMSCAN_AVX2
+static inline int scan_has_avx2(void)
+{
+  return __builtin_cpu_supports("avx2");
+}
+
+/* The AVX2 functions return the offset of the first match or where they *
+ * stopped, the caller continues from there with the SSE2 code            */
+__attribute__((target("avx2")))
+static unsigned int scan_pair_avx2(const unsigned char *buffer, const unsigned int size, const unsigned char c1, const unsigned char c2)
+{
+  const __m256i v1=_mm256_set1_epi8((char)c1);
+  const __m256i v2=_mm256_set1_epi8((char)c2);
+  unsigned int i;
+  for(i=0; i + 33 <= size; i+=32)
+  {
+    const __m256i a=_mm256_loadu_si256((const __m256i *)&buffer[i]);
+    const __m256i b=_mm256_loadu_si256((const __m256i *)&buffer[i+1]);
+    const unsigned int mask=_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, v1), _mm256_cmpeq_epi8(b, v2)));
+    if(mask!=0)
+      return i + __builtin_ctz(mask);
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static unsigned int scan_text_avx2(const unsigned char *buffer, const unsigned int size)
+{
+  const __m256i low=_mm256_set1_epi8(' ' - 1);
+  const __m256i high=_mm256_set1_epi8(0x7f);
+  const __m256i bs=_mm256_set1_epi8('\b');
+  const __m256i tab=_mm256_set1_epi8('\t');
+  const __m256i lf=_mm256_set1_epi8('\n');
+  const __m256i cr=_mm256_set1_epi8('\r');
+  unsigned int i;
+  for(i=0; i + 32 <= size; i+=32)
+  {
+    const __m256i v=_mm256_loadu_si256((const __m256i *)&buffer[i]);
+    /* Signed comparisons, bytes >= 0x80 are negative */
+    const __m256i printable=_mm256_and_si256(_mm256_cmpgt_epi8(v, low), _mm256_cmpgt_epi8(high, v));
+    const __m256i ctrl=_mm256_or_si256(
+	_mm256_or_si256(_mm256_cmpeq_epi8(v, bs), _mm256_cmpeq_epi8(v, tab)),
+	_mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)));
+    const unsigned int mask=_mm256_movemask_epi8(_mm256_or_si256(printable, ctrl));
+    if(mask!=0xffffffff)
+      return i + __builtin_ctz(~mask);
+  }
+  return i;
+}
+#endif
+
+unsigned int scan_pair(const unsigned char *buffer, const unsigned int size, const unsigned char c1, const unsigned char c2)
+{
+  unsigned int i=0;
+#ifdef MEMSCAN_AVX2
+  if(size >= 64 && scan_has_avx2())
+  {
+    i=scan_pair_avx2(buffer, size, c1, c2);
+    if(i + 33 <= size)
+      return i;
+  }
+#endif
+#ifdef MEMSCAN_SSE2
+  {
+    const __m128i v1=_mm_set1_epi8((char)c1);
+    const __m128i v2=_mm_set1_epi8((char)c2);
+    for(; i + 17 <= size; i+=16)
+    {
+      const __m128i a=_mm_loadu_si128((const __m128i *)&buffer[i]);
+      const __m128i b=_mm_loadu_si128((const __m128i *)&buffer[i+1]);
+      const unsigned int mask=_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, v1), _mm_cmpeq_epi8(b, v2)));
+      if(mask!=0)
+	return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for(; i + 1 < size; i++)
+    if(buffer[i]==c1 && buffer[i+1]==c2)
+      return i;
+  return size;
+}
+
+unsigned int scan_run(const unsigned char *buffer, const unsigned int size, const unsigned char c)
+{
+  unsigned int i=0;
+#ifdef MEMSCAN_SSE2
+  {
+    const __m128i v1=_mm_set1_epi8((char)c);
+    for(; i + 16 <= size; i+=16)
+    {
+      const __m128i a=_mm_loadu_si128((const __m128i *)&buffer[i]);
+      const unsigned int mask=_mm_movemask_epi8(_mm_cmpeq_epi8(a, v1));
+      if(mask!=0xffff)
+	return i + __builtin_ctz(~mask);
+    }
+  }
+#endif
+  for(; i < size; i++)
+    if(buffer[i]!=c)
+      return i;
+  return size;
+}
+
+unsigned int scan_text(const unsigned char *buffer, const unsigned int size)
+{
+  unsigned int i=0;
+  /* Short runs are frequent between two non-ASCII characters */
+  for(; i < size && i < 8; i++)
+    if(!scan_is_text(buffer[i]))
+      return i;
+#ifdef MEMSCAN_AVX2
+  if(size >= 64 && scan_has_avx2())
+  {
+    i+=scan_text_avx2(&buffer[i], size - i);
+    if(i + 32 <= size)
+      return i;
+  }
+#endif
+#ifdef MEMSCAN_SSE2
+  {
+    const __m128i low=_mm_set1_epi8(' ' - 1);
+    const __m128i high=_mm_set1_epi8(0x7f);
+    const __m128i bs=_mm_set1_epi8('\b');
+    const __m128i tab=_mm_set1_epi8('\t');
+    const __m128i lf=_mm_set1_epi8('\n');
+    const __m128i cr=_mm_set1_epi8('\r');
+    for(; i + 16 <= size; i+=16)
+    {
+      const __m128i v=_mm_loadu_si128((const __m128i *)&buffer[i]);
+      const __m128i printable=_mm_and_si128(_mm_cmpgt_epi8(v, low), _mm_cmplt_epi8(v, high));
+      const __m128i ctrl=_mm_or_si128(
+	  _mm_or_si128(_mm_cmpeq_epi8(v, bs), _mm_cmpeq_epi8(v, tab)),
+	  _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+      const unsigned int mask=_mm_movemask_epi8(_mm_or_si128(printable, ctrl));
+      if(mask!=0xffff)
+	return i + __builtin_ctz(~mask);
+    }
+  }
+#endif
+  for(; i < size; i++)
+    if(!scan_is_text(buffer[i]))
+      return i;
+  return size;
+}
+
+const char *scan_impl_name(void)
+{
+#ifdef MEMSCAN_AVX2
+  if(scan_has_avx2())
+    return "avx2";
+#endif
+#ifdef MEMSCAN_SSE2
+  return "sse2";
+#else
+  return "generic";
+#endif
+}
@@ -0,0 +1,53 @@
+/*
+
+    File: memscan.h
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+#ifndef _MEMSCAN_H
+#define _MEMSCAN_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Byte scanning used by the data_check functions.
+ * All functions return an offset in buffer, size if nothing is found. */
+
+/* First c, the C library memchr() is already vectorized */
+static inline unsigned int scan_byte(const unsigned char *buffer, const unsigned int size, const unsigned char c)
+{
+  const unsigned char *p=(const unsigned char *)memchr(buffer, c, size);
+  return (p==NULL ? size : (unsigned int)(p - buffer));
+}
+
+/* First c1 immediately followed by c2 */
+unsigned int scan_pair(const unsigned char *buffer, const unsigned int size, const unsigned char c1, const unsigned char c2);
+
+/* First byte different from c */
+unsigned int scan_run(const unsigned char *buffer, const unsigned int size, const unsigned char c);
+
+/* First byte that is neither printable ASCII nor \b \t \n \r */
+unsigned int scan_text(const unsigned char *buffer, const unsigned int size);
+
+/* Name of the implementation selected for this CPU */
+const char *scan_impl_name(void);
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+#endif
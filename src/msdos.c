@@ -384,6 +384,7 @@ disk_t *hd_identify(const int verbose, const unsigned int disk, const int testdi
     disk_car->sync=disk_sync;
     disk_car->access_mode=testdisk_mode;
     disk_car->clean=disk_clean;
+    disk_car->pview=NULL;
     disk_car->data=data;
     disk_car->geom.cylinders=1+(((buf[0] & 0x0C0)<<2)|buf[1]);
     disk_car->geom.heads_per_cylinder=1+buf[3];
@@ -166,6 +166,27 @@ struct ufile {
 	char		 padding[4];	/* Unused: padding to 64 bit. */
 };
 
+/* $Bitmap loaded in memory by scan_disk_init() */
+struct lcn_bitmap {
+	unsigned char	*bitmap;	/* One bit per cluster, set if in use */
+	long long	 size;		/* in bytes */
+};
+
+/* Number of MFT records read at once by scan_disk_next() */
+#define SCAN_RECORDS	1024
+
+struct ntfs_scan {
+	ntfs_volume	*vol;
+	ntfs_attr	*mft;		/* $MFT/$DATA */
+	unsigned char	*mft_bitmap;	/* $MFT/$BITMAP, set if the record is in use */
+	long long	 nr_mft_records;
+	long long	 record;	/* Next record to scan */
+	char		*records;	/* SCAN_RECORDS raw MFT records */
+	struct lcn_bitmap lcn;
+	int		 results;
+	int		 done;
+};
+
 static const char *UNKNOWN   = "unknown";
 static struct options opts;
 
@@ -514,53 +535,33 @@ static int get_data(struct ufile *file, ntfs_volume *vol)
 }
 
 /**
- * read_record - Read an MFT record into memory
+ * parse_record - Gather information about an MFT record
  * @vol:     An ntfs volume obtained from ntfs_mount
- * @record:  The record number to read
+ * @record:  The record number
+ * @rec:     The MFT record, already read and fixed up
  *
- * Read the specified MFT record and gather as much information about it as
- * possible.
+ * Gather as much information about the MFT record as possible.  @rec is
+ * released with the ufile object.
  *
  * Return:  Pointer  A ufile object containing the results
  *	    NULL     Error
  */
-static struct ufile * read_record(ntfs_volume *vol, long long record)
+static struct ufile * parse_record(ntfs_volume *vol, long long record, MFT_RECORD *rec)
 {
 	ATTR_RECORD *attr10, *attr20, *attr90;
 	struct ufile *file;
-	ntfs_attr *mft;
-
-	if (!vol)
-		return NULL;
 
 	file = (struct ufile *)calloc(1, sizeof(*file));
 	if (!file) {
-		log_error("ERROR: Couldn't allocate memory in read_record()\n");
+		log_error("ERROR: Couldn't allocate memory in parse_record()\n");
+		free(rec);
 		return NULL;
 	}
 
 	TD_INIT_LIST_HEAD(&file->name);
 	TD_INIT_LIST_HEAD(&file->data);
 	file->inode = record;
-
-	file->mft = (MFT_RECORD *)MALLOC(vol->mft_record_size);
-
-	mft = ntfs_attr_open(vol->mft_ni, AT_DATA, AT_UNNAMED, 0);
-	if (!mft) {
-		log_error("ERROR: Couldn't open $MFT/$DATA\n");
-		free_file(file);
-		return NULL;
-	}
-
-	if (ntfs_attr_mst_pread(mft, vol->mft_record_size * record, 1, vol->mft_record_size, file->mft) < 1) {
-		log_error("ERROR: Couldn't read MFT Record %lld.\n", record);
-		ntfs_attr_close(mft);
-		free_file(file);
-		return NULL;
-	}
-
-	ntfs_attr_close(mft);
-	mft = NULL;
+	file->mft = rec;
 
 	attr10 = find_first_attribute(AT_STANDARD_INFORMATION,	file->mft);
 	attr20 = find_first_attribute(AT_ATTRIBUTE_LIST,	file->mft);
@@ -590,10 +591,93 @@ static struct ufile * read_record(ntfs_volume *vol, long long record)
 	return file;
 }
 
+/**
+ * read_record - Read an MFT record into memory
+ * @vol:     An ntfs volume obtained from ntfs_mount
+ * @record:  The record number to read
+ *
+ * Read the specified MFT record and gather as much information about it as
+ * possible.
+ *
+ * Return:  Pointer  A ufile object containing the results
+ *	    NULL     Error
+ */
+static struct ufile * read_record(ntfs_volume *vol, long long record)
+{
+	MFT_RECORD *rec;
+	ntfs_attr *mft;
+
+	if (!vol)
+		return NULL;
+
+	mft = ntfs_attr_open(vol->mft_ni, AT_DATA, AT_UNNAMED, 0);
+	if (!mft) {
+		log_error("ERROR: Couldn't open $MFT/$DATA\n");
+		return NULL;
+	}
+
+	rec = (MFT_RECORD *)MALLOC(vol->mft_record_size);
+	if (ntfs_attr_mst_pread(mft, vol->mft_record_size * record, 1, vol->mft_record_size, rec) < 1) {
+		log_error("ERROR: Couldn't read MFT Record %lld.\n", record);
+		ntfs_attr_close(mft);
+		free(rec);
+		return NULL;
+	}
+
+	ntfs_attr_close(mft);
+	return parse_record(vol, record, rec);
+}
+
+/**
+ * load_lcn_bitmap - Read $Bitmap into memory
+ * @vol:  An ntfs volume obtained from ntfs_mount
+ * @lcn:  Where to store the bitmap
+ *
+ * lcn->bitmap is left NULL if $Bitmap can't be loaded, the clusters are then
+ * tested using utils_cluster_in_use().
+ */
+static void load_lcn_bitmap(ntfs_volume *vol, struct lcn_bitmap *lcn)
+{
+	ntfs_attr *attr;
+	s64 br;
+
+	lcn->bitmap = NULL;
+	lcn->size = 0;
+	attr = ntfs_attr_open(vol->lcnbmp_ni, AT_DATA, AT_UNNAMED, 0);
+	if (!attr) {
+		log_error("Couldn't open $Bitmap\n");
+		return;
+	}
+	if (attr->initialized_size > 0)
+		lcn->bitmap = (unsigned char *)malloc(attr->initialized_size);
+	if (!lcn->bitmap) {
+		ntfs_attr_close(attr);
+		return;
+	}
+	lcn->size = attr->initialized_size;
+	br = ntfs_attr_pread(attr, 0, lcn->size, lcn->bitmap);
+	if (br < 0)
+		br = 0;
+	/* Like utils_cluster_in_use(), the clusters that can't be read are in use */
+	if (br < lcn->size)
+		memset(lcn->bitmap + br, 0xFF, lcn->size - br);
+	ntfs_attr_close(attr);
+}
+
+static int cluster_in_use(ntfs_volume *vol, const struct lcn_bitmap *lcn, long long cluster)
+{
+	if (!lcn || !lcn->bitmap)
+		return utils_cluster_in_use(vol, cluster);
+	if (cluster < 0 || (cluster >> 3) >= lcn->size)
+		return 1;
+	return lcn->bitmap[cluster >> 3] & (1 << (cluster & 7));
+}
+
 /**
  * calc_percentage - Calculate how much of the file is recoverable
  * @file:  The file object to work with
  * @vol:   An ntfs volume obtained from ntfs_mount
+ * @lcn:   $Bitmap loaded in memory, NULL to read it from the disk
  *
  * Read through all the $DATA streams and determine if each cluster in each
  * stream is still free disk space.  This is just measuring the potential for
@@ -612,7 +696,7 @@ static struct ufile * read_record(ntfs_volume *vol, long long record)
  * Return:  n  The percentage of the file that _could_ be recovered
  *	   -1  Error
  */
-static int calc_percentage(struct ufile *file, ntfs_volume *vol)
+static int calc_percentage(struct ufile *file, ntfs_volume *vol, const struct lcn_bitmap *lcn)
 {
 	struct td_list_head *pos;
 	int percent = 0;
@@ -689,7 +773,7 @@ static int calc_percentage(struct ufile *file, ntfs_volume *vol)
 			end   = rl[i].lcn + rl[i].length;
 
 			for (j = start; j < end; j++) {
-				if (utils_cluster_in_use(vol, j))
+				if (cluster_in_use(vol, lcn, j))
 					clusters_inuse++;
 				else
 					clusters_free++;
@@ -888,7 +972,7 @@ static int undelete_file(ntfs_volume *vol, long long inode)
           return -2;
 	}
 
-	if (calc_percentage(file, vol) == 0) {
+	if (calc_percentage(file, vol, NULL) == 0) {
 		log_error("File has no recoverable data.\n");
 		goto free;
 	}
@@ -1096,93 +1180,154 @@ static file_info_t *ufile_to_file_data(const struct ufile *file, const struct da
 }
 
 /**
- * scan_disk - Search an NTFS volume for files that could be undeleted
- * @vol:  An ntfs volume obtained from ntfs_mount
- *
- * Read through all the MFT entries looking for deleted files.  For each one
- * determine how much of the data lies in unused disk space.
- *
- * The list can be filtered by name, size and date, using command line options.
+ * scan_disk_init - Prepare the search for files that could be undeleted
+ * @scan:  The scan state
+ * @vol:   An ntfs volume obtained from ntfs_mount
  *
+ * $MFT/$BITMAP and $Bitmap are read into memory, the MFT records are then
+ * read SCAN_RECORDS at a time by scan_disk_next().  If the volume can't be
+ * scanned, @scan is marked as done.
  */
-static void scan_disk(ntfs_volume *vol, file_info_t *dir_list)
+static void scan_disk_init(struct ntfs_scan *scan, ntfs_volume *vol)
 {
-	s64 nr_mft_records;
-	const int BUFSIZE = 8192;
-	char *buffer = NULL;
-	int results = 0;
 	ntfs_attr *attr;
-	long long size;
-	long long bmpsize;
-	int i, j, k, b;
-	struct ufile *file;
+	s64 bmpsize;
+	s64 br;
+
+	memset(scan, 0, sizeof(*scan));
+	scan->vol = vol;
+	scan->done = 1;
 	if (!vol)
-	  return;
+		return;
 #ifdef NTFS_LOG_LEVEL_VERBOSE
 	ntfs_log_set_levels(NTFS_LOG_LEVEL_QUIET);
 	ntfs_log_set_handler(ntfs_log_handler_stderr);
 #endif
 
 	attr = ntfs_attr_open(vol->mft_ni, AT_BITMAP, AT_UNNAMED, 0);
-	if (!attr)
-	{
-	  log_error("ERROR: Couldn't open $MFT/$BITMAP\n");
-	  return;
+	if (!attr) {
+		log_error("ERROR: Couldn't open $MFT/$BITMAP\n");
+		return;
 	}
 	bmpsize = attr->initialized_size;
+	if (bmpsize <= 0) {
+		ntfs_attr_close(attr);
+		return;
+	}
+	scan->mft_bitmap = (unsigned char *)MALLOC(bmpsize);
+	br = ntfs_attr_pread(attr, 0, bmpsize, scan->mft_bitmap);
+	ntfs_attr_close(attr);
+	if (br <= 0)
+		return;
+
+	scan->mft = ntfs_attr_open(vol->mft_ni, AT_DATA, AT_UNNAMED, 0);
+	if (!scan->mft) {
+		log_error("ERROR: Couldn't open $MFT/$DATA\n");
+		return;
+	}
+	scan->nr_mft_records = min(vol->mft_na->initialized_size >>
+			vol->mft_record_size_bits, br * 8);
+	scan->records = (char *)MALLOC(SCAN_RECORDS * vol->mft_record_size);
+	load_lcn_bitmap(vol, &scan->lcn);
+	scan->done = 0;
+}
 
-	buffer = (char *) MALLOC(BUFSIZE);
-
-	nr_mft_records = vol->mft_na->initialized_size >>
-			vol->mft_record_size_bits;
-
-	for (i = 0; i < bmpsize; i += BUFSIZE) {
-		long long read_count = min((bmpsize - i), BUFSIZE);
-		size = ntfs_attr_pread(attr, i, read_count, buffer);
-		if (size < 0)
-			break;
+static int scan_record_in_use(const struct ntfs_scan *scan, long long record)
+{
+	return scan->mft_bitmap[record >> 3] & (1 << (record & 7));
+}
 
-		for (j = 0; j < size; j++) {
-			b = buffer[j];
-			for (k = 0; k < 8; k++, b>>=1)
-			{
-			  int percent;
-			  if (((i+j)*8+k) >= nr_mft_records)
-			    goto done;
-			  if (b & 1)
-			    continue;
-			  file = read_record(vol, (i+j)*8+k);
-			  if (!file) {
-			    log_error("Couldn't read MFT Record %d.\n", (i+j)*8+k);
-			    continue;
-			  }
+/**
+ * scan_disk_next - Search the next MFT records for files that could be undeleted
+ * @scan:      The scan state
+ * @dir_list:  The deleted files are added to this list
+ *
+ * The unused records among the next SCAN_RECORDS MFT records are parsed, for
+ * each one determine how much of the data lies in unused disk space.  The
+ * records are read with a single request, chunks without unused record are
+ * not read.  The list is sorted once the whole $MFT has been scanned.
+ *
+ * Return:  1  The scan is complete
+ *	    0  Call again
+ */
+static int scan_disk_next(struct ntfs_scan *scan, file_info_t *dir_list)
+{
+	ntfs_volume *vol = scan->vol;
+	long long first, last, record;
+	s64 nbr_read = 0;
+
+	if (scan->done)
+		return 1;
+	last = min(scan->record + SCAN_RECORDS, scan->nr_mft_records);
+	for (first = scan->record; first < last && scan_record_in_use(scan, first); first++);
+	if (first < last) {
+		nbr_read = ntfs_attr_mst_pread(scan->mft, vol->mft_record_size * first,
+				last - first, vol->mft_record_size, scan->records);
+		if (nbr_read < 0)
+			nbr_read = 0;
+	}
+	for (record = first; record < last; record++) {
+		struct ufile *file;
+		int percent;
+		if (scan_record_in_use(scan, record))
+			continue;
+		if (record - first < nbr_read) {
+			MFT_RECORD *rec = (MFT_RECORD *)MALLOC(vol->mft_record_size);
+			memcpy(rec, scan->records + (record - first) * vol->mft_record_size,
+					vol->mft_record_size);
+			file = parse_record(vol, record, rec);
+		} else {
+			/* Short read, try this record alone */
+			file = read_record(vol, record);
+		}
+		if (!file) {
+			log_error("Couldn't read MFT Record %lld.\n", record);
+			continue;
+		}
 
-			  percent = calc_percentage(file, vol);
-			  if (percent >0)
-			  {
-			    struct td_list_head *item;
-			    td_list_for_each(item, &file->data)
-			    {
-			      const struct data *d = td_list_entry(item, struct data, list);
-			      file_info_t *new_file;
-			      new_file=ufile_to_file_data(file, d);
-			      if(new_file!=NULL)
-			      {
-				td_list_add_tail(&new_file->list, &dir_list->list);
-				results++;
-			      }
-			    }
-			  }
-			  free_file(file);
+		percent = calc_percentage(file, vol, &scan->lcn);
+		if (percent > 0) {
+			struct td_list_head *item;
+			td_list_for_each(item, &file->data) {
+				const struct data *d = td_list_entry(item, struct data, list);
+				file_info_t *new_file;
+				new_file = ufile_to_file_data(file, d);
+				if (new_file != NULL) {
+					td_list_add_tail(&new_file->list, &dir_list->list);
+					scan->results++;
+				}
 			}
 		}
+		free_file(file);
 	}
-done:
-	log_info("\nFiles with potentially recoverable content: %d\n", results);
-	free(buffer);
-	if (attr)
-		ntfs_attr_close(attr);
+	scan->record = last;
+	if (scan->record < scan->nr_mft_records)
+		return 0;
+	scan->done = 1;
 	td_list_sort(&dir_list->list, filesort);
+	return 1;
+}
+
+/**
+ * scan_disk_end - Release the resources used by the scan
+ * @scan:  The scan state
+ */
+static void scan_disk_end(struct ntfs_scan *scan)
+{
+	if (scan->done)
+		log_info("\nFiles with potentially recoverable content: %d\n", scan->results);
+	else
+		log_info("\nFiles with potentially recoverable content: %d (MFT records scanned: %lld/%lld)\n",
+				scan->results, scan->record, scan->nr_mft_records);
+	if (scan->mft)
+		ntfs_attr_close(scan->mft);
+	free(scan->mft_bitmap);
+	free(scan->records);
+	free(scan->lcn.bitmap);
+	scan->mft = NULL;
+	scan->mft_bitmap = NULL;
+	scan->records = NULL;
+	scan->lcn.bitmap = NULL;
 }
 
 #ifdef HAVE_NCURSES
@@ -1216,7 +1361,7 @@ static struct td_list_head *ntfs_prev_non_deleted(struct td_list_head *current_f
   return current_file;
 }
 
-static void ntfs_undelete_menu_ncurses(disk_t *disk_car, const partition_t *partition, dir_data_t *dir_data, file_info_t *dir_list)
+static void ntfs_undelete_menu_ncurses(disk_t *disk_car, const partition_t *partition, dir_data_t *dir_data, file_info_t *dir_list, struct ntfs_scan *scan)
 {
   struct ntfs_dir_struct *ls=(struct ntfs_dir_struct *)dir_data->private_dir_data;
   WINDOW *window=(WINDOW*)dir_data->display;
@@ -1229,13 +1374,18 @@ static void ntfs_undelete_menu_ncurses(disk_t *disk_car, const partition_t *part
     aff_copy(window);
     wmove(window,3,0);
     aff_part(window,AFF_PART_ORDER|AFF_PART_STATUS,disk_car,partition);
-    wmove(window,4,0);
-    wprintw(window,"Deleted files\n");
     do
     {
       struct td_list_head *file_walker = NULL;
       int i;
       int car;
+      wmove(window,4,0);
+      wclrtoeol(window);
+      if(scan->done)
+	wprintw(window,"Deleted files");
+      else
+	wprintw(window,"Deleted files - searching, MFT record %lld/%lld",
+	    scan->record, scan->nr_mft_records);
       for(i=5; i<=6+INTER_DIR; i++)
       {
 	wmove(window, i, 0);
@@ -1305,7 +1455,7 @@ static void ntfs_undelete_menu_ncurses(disk_t *disk_car, const partition_t *part
       wclrtoeol(window);
       if(file_walker!=&dir_list->list && file_walker->next!=&dir_list->list)
 	wprintw(window, "Next");
-      if(td_list_empty(&dir_list->list))
+      if(td_list_empty(&dir_list->list) && scan->done)
       {
 	wmove(window,6,0);
 	wprintw(window,"No deleted file found.");
@@ -1348,7 +1498,28 @@ static void ntfs_undelete_menu_ncurses(disk_t *disk_car, const partition_t *part
       wrefresh(window);
       /* Using gnome terminal under FC3, TERM=xterm, the screen is not always correct */
       wredrawln(window,0,getmaxy(window));	/* redrawwin def is boggus in pdcur24 */
-      car=wgetch(window);
+      if(!scan->done)
+      {
+	/* Keep searching while no key is pressed */
+	wtimeout(window, 0);
+	car=wgetch(window);
+	wtimeout(window, -1);
+	if(car==ERR)
+	{
+	  if(scan_disk_next(scan, dir_list)!=0)
+	  {
+	    /* The list has been sorted */
+	    current_file=ntfs_next_non_deleted(&dir_list->list, &dir_list->list);
+	    pos_num=0;
+	    offset=0;
+	  }
+	  else if(current_file==&dir_list->list && !td_list_empty(&dir_list->list))
+	    current_file=dir_list->list.next;
+	  continue;
+	}
+      }
+      else
+	car=wgetch(window);
       wmove(window,5,0);
       wclrtoeol(window);
       switch(car)
@@ -1599,16 +1770,23 @@ static void ntfs_undelete_menu_ncurses(disk_t *disk_car, const partition_t *part
 }
 #endif
 
-static void ntfs_undelete_menu(disk_t *disk_car, const partition_t *partition, dir_data_t *dir_data, file_info_t *dir_list, char**current_cmd)
+static void ntfs_undelete_menu(disk_t *disk_car, const partition_t *partition, dir_data_t *dir_data, file_info_t *dir_list, struct ntfs_scan *scan, char**current_cmd)
 {
-  log_list_file(disk_car, partition, dir_data, dir_list);
-  if(*current_cmd!=NULL)
+  if(*current_cmd==NULL)
   {
-    return;	/* Quit */
-  }
 #ifdef HAVE_NCURSES
-  ntfs_undelete_menu_ncurses(disk_car, partition, dir_data, dir_list);
+    /* The list is filled while the user browses it */
+    ntfs_undelete_menu_ncurses(disk_car, partition, dir_data, dir_list, scan);
+#else
+    while(scan_disk_next(scan, dir_list)==0);
 #endif
+  }
+  else
+  {
+    while(scan_disk_next(scan, dir_list)==0);
+  }
+  scan_disk_end(scan);
+  log_list_file(disk_car, partition, dir_data, dir_list);
 }
 
 int ntfs_undelete_part(disk_t *disk_car, const partition_t *partition, const int verbose, char **current_cmd)
@@ -1669,8 +1847,9 @@ int ntfs_undelete_part(disk_t *disk_car, const partition_t *partition, const int
 	  .name = NULL
 	};
 	struct ntfs_dir_struct *ls=(struct ntfs_dir_struct *)dir_data.private_dir_data;
-	scan_disk(ls->vol, &dir_list);
-	ntfs_undelete_menu(disk_car, partition, &dir_data, &dir_list, current_cmd);
+	struct ntfs_scan scan;
+	scan_disk_init(&scan, ls->vol);
+	ntfs_undelete_menu(disk_car, partition, &dir_data, &dir_list, &scan, current_cmd);
 	delete_list_file(&dir_list);
 	dir_data.close(&dir_data);
       }
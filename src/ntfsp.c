@@ -55,7 +55,7 @@
 #include "log_part.h"
 
 #if defined(HAVE_LIBNTFS) || defined(HAVE_LIBNTFS3G)
-#define SIZEOF_BUFFER ((const unsigned int)512)
+#define SIZEOF_BUFFER ((const unsigned int)65536)
 
 unsigned int ntfs_remove_used_space(disk_t *disk_car,const partition_t *partition, alloc_data_t *list_search_space)
 {
@@ -78,8 +78,7 @@ unsigned int ntfs_remove_used_space(disk_t *disk_car,const partition_t *partitio
     unsigned long int lcn;
     unsigned long int no_of_cluster;
     unsigned int cluster_size;	/* size in bytes */
-    /* Which bit of $Bitmap is in the buffer */
-    long long int bmplcn = - (SIZEOF_BUFFER << 3);
+    ntfs_attr *attr;
     log_trace("ntfs_remove_used_space\n");
     buffer=(unsigned char *)MALLOC(SIZEOF_BUFFER);
     {
@@ -100,50 +99,33 @@ unsigned int ntfs_remove_used_space(disk_t *disk_car,const partition_t *partitio
       no_of_cluster=(le64(ntfs_header->sectors_nbr) < partition->part_size ? le64(ntfs_header->sectors_nbr) : partition->part_size);
       no_of_cluster/=ntfs_header->sectors_per_cluster;
     }
-    for(lcn=0;lcn<no_of_cluster;lcn++)
+    attr = ntfs_attr_open(ls->vol->lcnbmp_ni, AT_DATA, AT_UNNAMED, 0);
+    if(attr==NULL)
     {
-      int byte, bit;
-      if ((bmplcn < 0) || (lcn < (unsigned)bmplcn) || (lcn >= ((unsigned)bmplcn + (SIZEOF_BUFFER << 3))))
+      log_error("Couldn't open $Bitmap\n");
+      free(buffer);
+      dir_data.close(&dir_data);
+      return 0;
+    }
+    /* Read $Bitmap SIZEOF_BUFFER bytes at a time */
+    for(lcn=0;lcn<no_of_cluster;lcn+=(SIZEOF_BUFFER << 3))
+    {
+      const unsigned int nbr_bits=(no_of_cluster - lcn < (SIZEOF_BUFFER << 3) ? no_of_cluster - lcn : (SIZEOF_BUFFER << 3));
+      /* Mark the buffer as not in use, in case the read is shorter. */
+      memset(buffer, 0x00, SIZEOF_BUFFER);
+      if (ntfs_attr_pread(attr, (lcn>>3), (nbr_bits+7)>>3, buffer) < 0)
       {
-	ntfs_attr *attr;
-	/* Mark the buffer as not in use, in case the read is shorter. */
-	memset(buffer, 0x00, SIZEOF_BUFFER);
-	bmplcn = lcn & (~((SIZEOF_BUFFER << 3) - 1));
-	attr = ntfs_attr_open(ls->vol->lcnbmp_ni, AT_DATA, AT_UNNAMED, 0);
-	if(attr==NULL)
-	{
-	  log_error("Couldn't open $Bitmap\n");
-	  free(buffer);
-	  dir_data.close(&dir_data);
-	  return 0;
-	}
-	if (ntfs_attr_pread(attr, (bmplcn>>3), SIZEOF_BUFFER, buffer) < 0)
-	{
-	  log_error("Couldn't read $Bitmap\n");
-	  ntfs_attr_close(attr);
-	  free(buffer);
-	  dir_data.close(&dir_data);
-	  return 0;
-	}
+	log_error("Couldn't read $Bitmap\n");
 	ntfs_attr_close(attr);
+	free(buffer);
+	dir_data.close(&dir_data);
+	return 0;
       }
-
-      bit  = 1 << (lcn & 7);
-      byte = (lcn >> 3) & (SIZEOF_BUFFER - 1);
-      if((buffer[byte] & bit)!=0)
-      {
-	/* Not free */
-	if(end_free+1==partition->part_offset+(uint64_t)lcn*cluster_size)
-	  end_free+=cluster_size;
-	else
-	{
-	  if(start_free < end_free)
-	    del_search_space(list_search_space, start_free, end_free);
-	  start_free=partition->part_offset+(uint64_t)lcn*cluster_size;
-	  end_free=start_free+(uint64_t)cluster_size-1;
-	}
-      }
+      del_search_space_bitmap(list_search_space, buffer, nbr_bits,
+	  partition->part_offset+(uint64_t)lcn*cluster_size, cluster_size,
+	  &start_free, &end_free);
     }
+    ntfs_attr_close(attr);
     free(buffer);
     if(start_free < end_free)
       del_search_space(list_search_space, start_free, end_free);
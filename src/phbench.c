@@ -0,0 +1,1424 @@
+/*
+
+    File: phbench.c
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+/* Carving benchmark: build deterministic disk images made of known files,
+ * run PhotoRec on them and compare the recovered files with the ground
+ * truth written next to each image (image.truth).
+ * "phbench scan" measures the byte scanning functions used by the
+ * data_check functions against the byte by byte loops they replace. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#if defined(HAVE_LIBJPEG) && defined(HAVE_JPEGLIB_H)
+#include <jpeglib.h>
+#endif
+#include "types.h"
+#include "memscan.h"
+#include "profile.h"
+
+#define BENCH_SECTOR_SIZE	512
+#define BENCH_FILES_MAX		4096
+#define BENCH_EXTENTS_MAX	4
+/* FAT16 layout */
+#define BENCH_FAT_CLUSTER_SIZE	2048
+#define BENCH_FAT_ROOT_ENTRIES	512
+
+typedef enum { BENCH_RAW=0, BENCH_FAT=1 } bench_layout_t;
+typedef enum { BENCH_OK=0, BENCH_LIVE=1, BENCH_DAMAGED=2 } bench_status_t;
+
+struct bench_param
+{
+  bench_layout_t layout;
+  uint64_t seed;
+  unsigned int size_mb;
+  unsigned int frag_pct;	/* Fragmented files */
+  unsigned int interleave_pct;	/* Fragments separated by another file rather than a gap */
+  unsigned int zero_pct;	/* Gaps filled with zeroes rather than random data */
+  unsigned int bad_sectors;
+  unsigned int deleted_pct;	/* FAT only */
+};
+
+struct bench_extent
+{
+  uint64_t offset;
+  unsigned int size;
+};
+
+struct bench_file
+{
+  const char *ext;
+  unsigned char *data;
+  unsigned int size;
+  uint32_t crc;
+  bench_status_t status;
+  unsigned int nbr_extents;
+  struct bench_extent extents[BENCH_EXTENTS_MAX];
+  unsigned int found;
+};
+
+static struct bench_file bench_files[BENCH_FILES_MAX];
+static unsigned int bench_nbr_files=0;
+static uint64_t bench_state=1;
+static uint32_t crc32_table[256];
+
+static void *MALLOC(size_t size)
+{
+  void *res=malloc(size);
+  if(res==NULL)
+  {
+    fprintf(stderr, "phbench: can't allocate %lu bytes\n", (long unsigned)size);
+    exit(EXIT_FAILURE);
+  }
+  return res;
+}
+
+static uint32_t bench_rand(void)
+{
+  bench_state^=bench_state >> 12;
+  bench_state^=bench_state << 25;
+  bench_state^=bench_state >> 27;
+  return (uint32_t)((bench_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static unsigned int bench_rand_range(const unsigned int min, const unsigned int max)
+{
+  return min + bench_rand() % (max - min + 1);
+}
+
+static void bench_fill(unsigned char *buffer, const unsigned int size)
+{
+  unsigned int i;
+  for(i=0; i<size; i++)
+    buffer[i]=bench_rand() & 0xff;
+}
+
+static void crc32_init(void)
+{
+  unsigned int i;
+  for(i=0; i<256; i++)
+  {
+    uint32_t c=i;
+    unsigned int j;
+    for(j=0; j<8; j++)
+      c=(c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1);
+    crc32_table[i]=c;
+  }
+}
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char *buffer, const unsigned int size)
+{
+  unsigned int i;
+  crc^=0xffffffff;
+  for(i=0; i<size; i++)
+    crc=crc32_table[(crc ^ buffer[i]) & 0xff] ^ (crc >> 8);
+  return crc ^ 0xffffffff;
+}
+
+static void put_le16(unsigned char *p, const unsigned int v)
+{
+  p[0]=v & 0xff;
+  p[1]=(v >> 8) & 0xff;
+}
+
+static void put_le32(unsigned char *p, const uint32_t v)
+{
+  put_le16(p, v & 0xffff);
+  put_le16(p + 2, v >> 16);
+}
+
+static void put_be32(unsigned char *p, const uint32_t v)
+{
+  p[0]=(v >> 24) & 0xff;
+  p[1]=(v >> 16) & 0xff;
+  p[2]=(v >> 8) & 0xff;
+  p[3]=v & 0xff;
+}
+
+/* File generators, the target size is approximative */
+
+static unsigned char *gen_bmp(const unsigned int target, unsigned int *size)
+{
+  const unsigned int width=bench_rand_range(32, 512);
+  const unsigned int row=(width * 3 + 3) & ~3U;
+  const unsigned int height=(target / row > 16 ? target / row : 16);
+  unsigned char *buffer;
+  *size=54 + row * height;
+  buffer=(unsigned char *)MALLOC(*size);
+  memset(buffer, 0, 54);
+  buffer[0]='B';
+  buffer[1]='M';
+  put_le32(&buffer[2], *size);
+  put_le32(&buffer[10], 54);
+  put_le32(&buffer[14], 40);
+  put_le32(&buffer[18], width);
+  put_le32(&buffer[22], height);
+  put_le16(&buffer[26], 1);
+  put_le16(&buffer[28], 24);
+  put_le32(&buffer[34], row * height);
+  put_le32(&buffer[38], 2835);
+  put_le32(&buffer[42], 2835);
+  bench_fill(&buffer[54], row * height);
+  return buffer;
+}
+
+static unsigned char *gen_wav(const unsigned int target, unsigned int *size)
+{
+  const unsigned int data_size=(target > 1024 ? target : 1024) & ~3U;
+  unsigned char *buffer;
+  *size=44 + data_size;
+  buffer=(unsigned char *)MALLOC(*size);
+  memcpy(buffer, "RIFF", 4);
+  put_le32(&buffer[4], *size - 8);
+  memcpy(&buffer[8], "WAVEfmt ", 8);
+  put_le32(&buffer[16], 16);
+  put_le16(&buffer[20], 1);		/* PCM */
+  put_le16(&buffer[22], 2);
+  put_le32(&buffer[24], 44100);
+  put_le32(&buffer[28], 44100 * 4);
+  put_le16(&buffer[32], 4);
+  put_le16(&buffer[34], 16);
+  memcpy(&buffer[36], "data", 4);
+  put_le32(&buffer[40], data_size);
+  bench_fill(&buffer[44], data_size);
+  return buffer;
+}
+
+static unsigned int png_chunk(unsigned char *p, const char *type, const unsigned char *data, const unsigned int len)
+{
+  put_be32(p, len);
+  memcpy(p + 4, type, 4);
+  if(len > 0)
+    memcpy(p + 8, data, len);
+  put_be32(p + 8 + len, crc32_update(0, p + 4, len + 4));
+  return len + 12;
+}
+
+static unsigned char *gen_png(const unsigned int target, unsigned int *size)
+{
+  const unsigned int width=bench_rand_range(16, 256);
+  const unsigned int row=1 + width * 3;
+  const unsigned int height=(target / row > 4 ? target / row : 4);
+  const unsigned int raw_size=row * height;
+  unsigned char *raw;
+  unsigned char *zlib;
+  unsigned char *buffer;
+  unsigned char ihdr[13];
+  unsigned int zlib_size=0;
+  unsigned int pos;
+  unsigned int i;
+  uint32_t a=1;
+  uint32_t b=0;
+  raw=(unsigned char *)MALLOC(raw_size);
+  bench_fill(raw, raw_size);
+  for(i=0; i<height; i++)
+    raw[i * row]=0;	/* filter type None */
+  /* zlib stream made of stored deflate blocks */
+  zlib=(unsigned char *)MALLOC(raw_size + (raw_size / 65535 + 1) * 5 + 6);
+  zlib[zlib_size++]=0x78;
+  zlib[zlib_size++]=0x01;
+  for(pos=0; pos<raw_size; )
+  {
+    const unsigned int len=(raw_size - pos > 65535 ? 65535 : raw_size - pos);
+    zlib[zlib_size++]=(pos + len == raw_size ? 1 : 0);
+    put_le16(&zlib[zlib_size], len);
+    put_le16(&zlib[zlib_size + 2], ~len & 0xffff);
+    zlib_size+=4;
+    memcpy(&zlib[zlib_size], &raw[pos], len);
+    zlib_size+=len;
+    pos+=len;
+  }
+  for(i=0; i<raw_size; i++)
+  {
+    a=(a + raw[i]) % 65521;
+    b=(b + a) % 65521;
+  }
+  put_be32(&zlib[zlib_size], (b << 16) | a);
+  zlib_size+=4;
+  free(raw);
+  put_be32(&ihdr[0], width);
+  put_be32(&ihdr[4], height);
+  ihdr[8]=8;		/* bit depth */
+  ihdr[9]=2;		/* RGB */
+  ihdr[10]=0;
+  ihdr[11]=0;
+  ihdr[12]=0;
+  buffer=(unsigned char *)MALLOC(8 + 25 + zlib_size + (zlib_size / 32768 + 1) * 12 + 12);
+  memcpy(buffer, "\x89PNG\r\n\x1a\n", 8);
+  *size=8;
+  *size+=png_chunk(&buffer[*size], "IHDR", ihdr, sizeof(ihdr));
+  for(pos=0; pos<zlib_size; )
+  {
+    const unsigned int len=(zlib_size - pos > 32768 ? 32768 : zlib_size - pos);
+    *size+=png_chunk(&buffer[*size], "IDAT", &zlib[pos], len);
+    pos+=len;
+  }
+  *size+=png_chunk(&buffer[*size], "IEND", NULL, 0);
+  free(zlib);
+  return buffer;
+}
+
+/* LZW stream using only literal codes: a clear code is emitted before the
+ * dictionary needs 10-bit codes */
+static unsigned char *gen_gif(const unsigned int target, unsigned int *size)
+{
+  const unsigned int width=bench_rand_range(16, 256);
+  const unsigned int height=(target * 8 / 9 / width > 4 ? target * 8 / 9 / width : 4);
+  const unsigned int nbr_pixels=width * height;
+  unsigned char *lzw;
+  unsigned char *buffer;
+  unsigned int lzw_size=0;
+  uint32_t bits=0;
+  unsigned int nbr_bits=0;
+  unsigned int i;
+  unsigned int pos;
+  lzw=(unsigned char *)MALLOC(nbr_pixels * 9 / 8 + nbr_pixels / 254 * 2 + 16);
+#define GIF_CODE(code) do { bits|=(uint32_t)(code) << nbr_bits; nbr_bits+=9; \
+  while(nbr_bits >= 8) { lzw[lzw_size++]=bits & 0xff; bits>>=8; nbr_bits-=8; } } while(0)
+  for(i=0; i<nbr_pixels; i++)
+  {
+    if(i % 254 == 0)
+      GIF_CODE(256);
+    GIF_CODE(bench_rand() & 0xff);
+  }
+  GIF_CODE(257);
+#undef GIF_CODE
+  if(nbr_bits > 0)
+    lzw[lzw_size++]=bits & 0xff;
+  buffer=(unsigned char *)MALLOC(13 + 768 + 10 + 1 + lzw_size + lzw_size / 255 + 2 + 1);
+  memcpy(buffer, "GIF89a", 6);
+  put_le16(&buffer[6], width);
+  put_le16(&buffer[8], height);
+  buffer[10]=0xf7;	/* global color table, 256 entries */
+  buffer[11]=0;
+  buffer[12]=0;
+  bench_fill(&buffer[13], 768);
+  *size=13 + 768;
+  buffer[(*size)++]=0x2c;
+  put_le16(&buffer[*size], 0);
+  put_le16(&buffer[*size + 2], 0);
+  put_le16(&buffer[*size + 4], width);
+  put_le16(&buffer[*size + 6], height);
+  buffer[*size + 8]=0;
+  *size+=9;
+  buffer[(*size)++]=8;	/* LZW minimum code size */
+  for(pos=0; pos<lzw_size; )
+  {
+    const unsigned int len=(lzw_size - pos > 255 ? 255 : lzw_size - pos);
+    buffer[(*size)++]=len;
+    memcpy(&buffer[*size], &lzw[pos], len);
+    *size+=len;
+    pos+=len;
+  }
+  buffer[(*size)++]=0;
+  buffer[(*size)++]=0x3b;
+  free(lzw);
+  return buffer;
+}
+
+static unsigned char *gen_pdf(const unsigned int target, unsigned int *size)
+{
+  const unsigned int stream_size=(target > 1024 ? target - 512 : 512);
+  unsigned char *buffer;
+  unsigned int offsets[5];
+  unsigned int xref;
+  unsigned int i;
+  buffer=(unsigned char *)MALLOC(stream_size + 1024);
+  *size=sprintf((char *)buffer, "%%PDF-1.4\n%%\xe2\xe3\xcf\xd3\n");
+  offsets[1]=*size;
+  *size+=sprintf((char *)&buffer[*size], "1 0 obj\n<< /Type /Catalog /Pages 2 0 R >>\nendobj\n");
+  offsets[2]=*size;
+  *size+=sprintf((char *)&buffer[*size], "2 0 obj\n<< /Type /Pages /Kids [3 0 R] /Count 1 >>\nendobj\n");
+  offsets[3]=*size;
+  *size+=sprintf((char *)&buffer[*size], "3 0 obj\n<< /Type /Page /Parent 2 0 R /MediaBox [0 0 612 792] /Contents 4 0 R >>\nendobj\n");
+  offsets[4]=*size;
+  *size+=sprintf((char *)&buffer[*size], "4 0 obj\n<< /Length %u >>\nstream\n", stream_size);
+  bench_fill(&buffer[*size], stream_size);
+  *size+=stream_size;
+  *size+=sprintf((char *)&buffer[*size], "\nendstream\nendobj\n");
+  xref=*size;
+  *size+=sprintf((char *)&buffer[*size], "xref\n0 5\n0000000000 65535 f \n");
+  for(i=1; i<5; i++)
+    *size+=sprintf((char *)&buffer[*size], "%010u 00000 n \n", offsets[i]);
+  *size+=sprintf((char *)&buffer[*size], "trailer\n<< /Size 5 /Root 1 0 R >>\nstartxref\n%u\n%%%%EOF\n", xref);
+  return buffer;
+}
+
+static unsigned char *gen_zip(const unsigned int target, unsigned int *size)
+{
+  const unsigned int nbr=bench_rand_range(1, 4);
+  const unsigned int member_size=(target / nbr > 64 ? target / nbr : 64);
+  unsigned char *buffer;
+  unsigned int offsets[4];
+  uint32_t crcs[4];
+  unsigned int cd_start;
+  unsigned int i;
+  buffer=(unsigned char *)MALLOC(nbr * (member_size + 30 + 46 + 2 * 12) + 22);
+  *size=0;
+  for(i=0; i<nbr; i++)
+  {
+    unsigned char *p=&buffer[*size];
+    offsets[i]=*size;
+    memset(p, 0, 30);
+    put_le32(p, 0x04034b50);
+    put_le16(p + 4, 10);
+    put_le16(p + 12, 0x5021);	/* 2020-01-01 */
+    put_le16(p + 18 + 8, 12);
+    sprintf((char *)p + 30, "file%04u.bin", i);
+    bench_fill(p + 42, member_size);
+    crcs[i]=crc32_update(0, p + 42, member_size);
+    put_le32(p + 14, crcs[i]);
+    put_le32(p + 18, member_size);
+    put_le32(p + 22, member_size);
+    *size+=42 + member_size;
+  }
+  cd_start=*size;
+  for(i=0; i<nbr; i++)
+  {
+    unsigned char *p=&buffer[*size];
+    memset(p, 0, 46);
+    put_le32(p, 0x02014b50);
+    put_le16(p + 4, 20);
+    put_le16(p + 6, 10);
+    put_le16(p + 14, 0x5021);
+    put_le32(p + 16, crcs[i]);
+    put_le32(p + 20, member_size);
+    put_le32(p + 24, member_size);
+    put_le16(p + 28, 12);
+    put_le32(p + 42, offsets[i]);
+    sprintf((char *)p + 46, "file%04u.bin", i);
+    *size+=46 + 12;
+  }
+  {
+    unsigned char *p=&buffer[*size];
+    memset(p, 0, 22);
+    put_le32(p, 0x06054b50);
+    put_le16(p + 8, nbr);
+    put_le16(p + 10, nbr);
+    put_le32(p + 12, *size - cd_start);
+    put_le32(p + 16, cd_start);
+    *size+=22;
+  }
+  return buffer;
+}
+
+#if defined(HAVE_LIBJPEG) && defined(HAVE_JPEGLIB_H)
+static unsigned char *gen_jpg(const unsigned int target, unsigned int *size)
+{
+  const unsigned int width=bench_rand_range(64, 512);
+  const unsigned int height=(target / width > 16 ? target / width : 16);
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  unsigned char *row;
+  unsigned char *buffer=NULL;
+  unsigned long buffer_size=0;
+  unsigned int y;
+  cinfo.err=jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+  jpeg_mem_dest(&cinfo, &buffer, &buffer_size);
+  cinfo.image_width=width;
+  cinfo.image_height=height;
+  cinfo.input_components=3;
+  cinfo.in_color_space=JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, 75, TRUE);
+  jpeg_start_compress(&cinfo, TRUE);
+  row=(unsigned char *)MALLOC(width * 3);
+  for(y=0; y<height; y++)
+  {
+    unsigned int x;
+    /* Smooth gradient with noise, it compresses like a photo */
+    for(x=0; x<width * 3; x++)
+      row[x]=(x + y * 2 + (bench_rand() & 0x1f)) & 0xff;
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+  free(row);
+  *size=buffer_size;
+  return buffer;
+}
+#endif
+
+struct bench_format
+{
+  const char *ext;
+  unsigned char *(*gen)(const unsigned int target, unsigned int *size);
+};
+
+static const struct bench_format bench_formats[]=
+{
+  { "bmp", &gen_bmp },
+  { "gif", &gen_gif },
+  { "pdf", &gen_pdf },
+  { "png", &gen_png },
+  { "wav", &gen_wav },
+  { "zip", &gen_zip },
+#if defined(HAVE_LIBJPEG) && defined(HAVE_JPEGLIB_H)
+  { "jpg", &gen_jpg },
+#endif
+  { NULL, NULL }
+};
+
+
+static unsigned int bench_nbr_formats(void)
+{
+  unsigned int i;
+  for(i=0; bench_formats[i].ext!=NULL; i++);
+  return i;
+}
+
+static struct bench_file *bench_new_file(void)
+{
+  const struct bench_format *format=&bench_formats[bench_rand() % bench_nbr_formats()];
+  /* Between 2 KiB and 1 MiB, most files are small */
+  const unsigned int target=(2048U << bench_rand_range(0, 8)) + bench_rand() % 2048;
+  struct bench_file *file;
+  if(bench_nbr_files >= BENCH_FILES_MAX)
+    return NULL;
+  file=&bench_files[bench_nbr_files++];
+  file->ext=format->ext;
+  file->data=format->gen(target, &file->size);
+  file->crc=crc32_update(0, file->data, file->size);
+  file->status=BENCH_OK;
+  file->nbr_extents=0;
+  file->found=0;
+  return file;
+}
+
+static unsigned int bench_sectors(const unsigned int size)
+{
+  return (size + BENCH_SECTOR_SIZE - 1) / BENCH_SECTOR_SIZE;
+}
+
+/* Fill a gap between files with zeroes or random data */
+static void bench_gap(const struct bench_param *param, unsigned char *image, const uint64_t offset, const unsigned int size)
+{
+  if(bench_rand() % 100 < param->zero_pct)
+    memset(&image[offset], 0, size);
+  else
+    bench_fill(&image[offset], size);
+}
+
+static void bench_put(unsigned char *image, struct bench_file *file, const uint64_t offset, const unsigned int file_offset, const unsigned int size)
+{
+  struct bench_extent *extent=&file->extents[file->nbr_extents++];
+  memcpy(&image[offset], &file->data[file_offset], size);
+  /* File slack */
+  if(size % BENCH_SECTOR_SIZE != 0)
+    memset(&image[offset + size], 0, BENCH_SECTOR_SIZE - size % BENCH_SECTOR_SIZE);
+  extent->offset=offset;
+  extent->size=size;
+}
+
+static void bench_layout_raw(const struct bench_param *param, unsigned char *image, const uint64_t image_size)
+{
+  uint64_t pos=16 * BENCH_SECTOR_SIZE;
+  bench_fill(image, pos);
+  while(1)
+  {
+    struct bench_file *file=bench_new_file();
+    unsigned int nbr_frags=1;
+    unsigned int file_offset=0;
+    unsigned int i;
+    if(file==NULL)
+      break;
+    if(pos + (uint64_t)bench_sectors(file->size) * BENCH_SECTOR_SIZE * 2 + 2*1024*1024 > image_size)
+    {
+      bench_nbr_files--;
+      free(file->data);
+      break;
+    }
+    if(bench_sectors(file->size) >= 8 && bench_rand() % 100 < param->frag_pct)
+      nbr_frags=bench_rand_range(2, 3);
+    for(i=0; i<nbr_frags; i++)
+    {
+      const unsigned int size=(i==nbr_frags-1 ? file->size - file_offset :
+	  bench_rand_range(1, bench_sectors(file->size - file_offset) / (nbr_frags - i) ) * BENCH_SECTOR_SIZE);
+      bench_put(image, file, pos, file_offset, size);
+      pos+=(uint64_t)bench_sectors(size) * BENCH_SECTOR_SIZE;
+      file_offset+=size;
+      if(i < nbr_frags-1)
+      {
+	if(bench_rand() % 100 < param->interleave_pct)
+	{
+	  /* Another file between the two fragments */
+	  struct bench_file *other=bench_new_file();
+	  if(other!=NULL)
+	  {
+	    bench_put(image, other, pos, 0, other->size);
+	    pos+=(uint64_t)bench_sectors(other->size) * BENCH_SECTOR_SIZE;
+	  }
+	}
+	else
+	{
+	  const unsigned int gap=bench_rand_range(1, 64) * BENCH_SECTOR_SIZE;
+	  bench_gap(param, image, pos, gap);
+	  pos+=gap;
+	}
+      }
+    }
+    if(bench_rand() % 2 == 0)
+    {
+      /* Unused space, sometimes large */
+      const unsigned int gap=bench_rand_range(1, 16) * (BENCH_SECTOR_SIZE << bench_rand_range(0, 7));
+      bench_gap(param, image, pos, gap);
+      pos+=gap;
+    }
+  }
+  bench_gap(param, image, pos, image_size - pos);
+}
+
+static void bench_fat_name(unsigned char *entry, const unsigned int nbr, const char *ext)
+{
+  char name[16];
+  unsigned int i;
+  sprintf(name, "F%07u", nbr);
+  memcpy(entry, name, 8);
+  for(i=0; i<3; i++)
+    entry[8 + i]=(ext[i] >= 'a' && ext[i] <= 'z' ? ext[i] - 'a' + 'A' : ext[i]);
+}
+
+/* FAT16 filesystem, deleted files have their clusters freed */
+static void bench_layout_fat(const struct bench_param *param, unsigned char *image, const uint64_t image_size)
+{
+  const unsigned int total_sectors=image_size / BENCH_SECTOR_SIZE;
+  const unsigned int root_sectors=BENCH_FAT_ROOT_ENTRIES * 32 / BENCH_SECTOR_SIZE;
+  unsigned int spc=BENCH_FAT_CLUSTER_SIZE / BENCH_SECTOR_SIZE;
+  unsigned int cluster_size;
+  unsigned int fat_sectors;
+  unsigned int nbr_clusters;
+  unsigned int data_start;
+  unsigned int i;
+  unsigned char *used;
+  unsigned char *fat;
+  unsigned char *root;
+  unsigned int nbr_entries=0;
+  while(total_sectors / spc > 65000)
+    spc*=2;
+  cluster_size=spc * BENCH_SECTOR_SIZE;
+  fat_sectors=((total_sectors / spc + 2) * 2 + BENCH_SECTOR_SIZE - 1) / BENCH_SECTOR_SIZE;
+  nbr_clusters=(total_sectors - 1 - root_sectors - 2 * fat_sectors) / spc;
+  data_start=1 + 2 * fat_sectors + root_sectors;
+  /* Boot sector */
+  memset(image, 0, (uint64_t)data_start * BENCH_SECTOR_SIZE);
+  memcpy(image, "\xeb\x3c\x90MSWIN4.1", 11);
+  put_le16(&image[11], BENCH_SECTOR_SIZE);
+  image[13]=spc;
+  put_le16(&image[14], 1);
+  image[16]=2;
+  put_le16(&image[17], BENCH_FAT_ROOT_ENTRIES);
+  if(total_sectors < 65536)
+    put_le16(&image[19], total_sectors);
+  else
+    put_le32(&image[32], total_sectors);
+  image[21]=0xf8;
+  put_le16(&image[22], fat_sectors);
+  put_le16(&image[24], 63);
+  put_le16(&image[26], 255);
+  image[36]=0x80;
+  image[38]=0x29;
+  put_le32(&image[39], 0x12345678);
+  memcpy(&image[43], "NO NAME    FAT16   ", 19);
+  image[510]=0x55;
+  image[511]=0xaa;
+  fat=&image[BENCH_SECTOR_SIZE];
+  root=&image[(uint64_t)(1 + 2 * fat_sectors) * BENCH_SECTOR_SIZE];
+  put_le16(&fat[0], 0xfff8);
+  put_le16(&fat[2], 0xffff);
+  /* Free space content */
+  for(i=0; i<nbr_clusters; i+=64)
+  {
+    const unsigned int nbr=(nbr_clusters - i < 64 ? nbr_clusters - i : 64);
+    bench_gap(param, image, (uint64_t)(data_start + i * spc) * BENCH_SECTOR_SIZE, nbr * cluster_size);
+  }
+  used=(unsigned char *)MALLOC(nbr_clusters);
+  memset(used, 0, nbr_clusters);
+  while(nbr_entries < BENCH_FAT_ROOT_ENTRIES)
+  {
+    struct bench_file *file=bench_new_file();
+    const unsigned int deleted=(bench_rand() % 100 < param->deleted_pct);
+    unsigned int nbr_frags=1;
+    unsigned int clusters_needed;
+    unsigned int clusters_done=0;
+    unsigned int prev_cluster=0;
+    unsigned int first_cluster=0;
+    unsigned int search=0;
+    unsigned char *entry;
+    if(file==NULL)
+      break;
+    clusters_needed=(file->size + cluster_size - 1) / cluster_size;
+    if(clusters_needed >= 4 && bench_rand() % 100 < param->frag_pct)
+      nbr_frags=bench_rand_range(2, BENCH_EXTENTS_MAX);
+    /* First fit allocation, fragments are separated by free clusters
+     * that will be used by the next files */
+    while(clusters_done < clusters_needed)
+    {
+      unsigned int frag_clusters=(nbr_frags > 1 ?
+	  bench_rand_range(1, (clusters_needed - clusters_done + nbr_frags - 1) / nbr_frags) :
+	  clusters_needed - clusters_done);
+      unsigned int start;
+      unsigned int n;
+      if(file->nbr_extents == BENCH_EXTENTS_MAX - 1)
+	frag_clusters=clusters_needed - clusters_done;
+      for(start=search; start < nbr_clusters; start++)
+      {
+	for(n=0; n<frag_clusters && start + n < nbr_clusters && used[start + n]==0; n++);
+	if(n==frag_clusters)
+	  break;
+      }
+      if(start >= nbr_clusters)
+	break;
+      for(n=0; n<frag_clusters; n++)
+      {
+	const unsigned int cluster=start + n + 2;
+	used[start + n]=1;
+	if(prev_cluster!=0)
+	  put_le16(&fat[prev_cluster * 2], cluster);
+	else
+	  first_cluster=cluster;
+	prev_cluster=cluster;
+      }
+      {
+	const unsigned int file_offset=clusters_done * cluster_size;
+	const unsigned int size=(file->size - file_offset < frag_clusters * cluster_size ?
+	    file->size - file_offset : frag_clusters * cluster_size);
+	bench_put(image, file, (uint64_t)(data_start + start * spc) * BENCH_SECTOR_SIZE, file_offset, size);
+      }
+      clusters_done+=frag_clusters;
+      if(nbr_frags > 1)
+      {
+	search=start + frag_clusters + bench_rand_range(1, 8);
+	nbr_frags--;
+      }
+    }
+    if(clusters_done < clusters_needed)
+    {
+      /* Filesystem full */
+      bench_nbr_files--;
+      free(file->data);
+      break;
+    }
+    put_le16(&fat[prev_cluster * 2], 0xffff);
+    entry=&root[nbr_entries * 32];
+    bench_fat_name(entry, nbr_entries, file->ext);
+    entry[11]=0x20;
+    put_le16(&entry[24], 0x5021);
+    put_le16(&entry[26], first_cluster);
+    put_le32(&entry[28], file->size);
+    nbr_entries++;
+    if(deleted)
+    {
+      unsigned int cluster=first_cluster;
+      entry[0]=0xe5;
+      while(cluster >= 2 && cluster < 0xfff8)
+      {
+	const unsigned int next=fat[cluster * 2] | (fat[cluster * 2 + 1] << 8);
+	put_le16(&fat[cluster * 2], 0);
+	cluster=next;
+      }
+    }
+    else
+      file->status=BENCH_LIVE;
+  }
+  free(used);
+  memcpy(&image[(uint64_t)(1 + fat_sectors) * BENCH_SECTOR_SIZE], fat, fat_sectors * BENCH_SECTOR_SIZE);
+}
+
+static int bench_generate(const struct bench_param *param, const char *image_name)
+{
+  const uint64_t image_size=(uint64_t)param->size_mb * 1024 * 1024;
+  unsigned char *image;
+  uint64_t *bad;
+  char *name;
+  FILE *f;
+  unsigned int i;
+  bench_state=param->seed * 0x9E3779B97F4A7C15ULL + 1;
+  bench_nbr_files=0;
+  image=(unsigned char *)MALLOC(image_size);
+  if(param->layout==BENCH_FAT)
+    bench_layout_fat(param, image, image_size);
+  else
+    bench_layout_raw(param, image, image_size);
+  /* Unreadable sectors are zeroes in the image and listed in image.map */
+  bad=(uint64_t *)MALLOC((param->bad_sectors + 1) * sizeof(uint64_t));
+  for(i=0; i<param->bad_sectors; i++)
+  {
+    unsigned int j;
+    const uint64_t sector=64 + bench_rand() % (image_size / BENCH_SECTOR_SIZE - 64);
+    for(j=i; j>0 && bad[j-1] > sector; j--)
+      bad[j]=bad[j-1];
+    bad[j]=sector;
+    memset(&image[sector * BENCH_SECTOR_SIZE], 0, BENCH_SECTOR_SIZE);
+    for(j=0; j<bench_nbr_files; j++)
+    {
+      struct bench_file *file=&bench_files[j];
+      unsigned int k;
+      for(k=0; k<file->nbr_extents; k++)
+	if(file->extents[k].offset < (sector + 1) * BENCH_SECTOR_SIZE &&
+	    sector * BENCH_SECTOR_SIZE < file->extents[k].offset + file->extents[k].size &&
+	    file->status==BENCH_OK)
+	  file->status=BENCH_DAMAGED;
+    }
+  }
+  f=fopen(image_name, "wb");
+  if(f==NULL || fwrite(image, image_size, 1, f)!=1)
+  {
+    fprintf(stderr, "phbench: can't write %s: %s\n", image_name, strerror(errno));
+    if(f!=NULL)
+      fclose(f);
+    free(image);
+    free(bad);
+    return -1;
+  }
+  fclose(f);
+  free(image);
+  name=(char *)MALLOC(strlen(image_name) + 7);
+  sprintf(name, "%s.map", image_name);
+  unlink(name);
+  if(param->bad_sectors > 0 && (f=fopen(name, "w"))!=NULL)
+  {
+    uint64_t pos=0;
+    fprintf(f, "# Rescue map. Created by phbench\n0x00000000     +\n");
+    for(i=0; i<param->bad_sectors; i++)
+    {
+      const uint64_t start=bad[i] * BENCH_SECTOR_SIZE;
+      if(start < pos)
+	continue;
+      if(start > pos)
+	fprintf(f, "0x%08llX  0x%08llX  +\n", (long long unsigned)pos, (long long unsigned)(start - pos));
+      fprintf(f, "0x%08llX  0x%08llX  -\n", (long long unsigned)start, (long long unsigned)BENCH_SECTOR_SIZE);
+      pos=start + BENCH_SECTOR_SIZE;
+    }
+    if(pos < image_size)
+      fprintf(f, "0x%08llX  0x%08llX  +\n", (long long unsigned)pos, (long long unsigned)(image_size - pos));
+    fclose(f);
+  }
+  free(bad);
+  sprintf(name, "%s.truth", image_name);
+  f=fopen(name, "w");
+  if(f==NULL)
+  {
+    fprintf(stderr, "phbench: can't write %s: %s\n", name, strerror(errno));
+    free(name);
+    return -1;
+  }
+  fprintf(f, "# ext size crc32 status extents (offset+size)\n");
+  for(i=0; i<bench_nbr_files; i++)
+  {
+    const struct bench_file *file=&bench_files[i];
+    static const char *status_name[]={ "ok", "live", "damaged" };
+    unsigned int k;
+    fprintf(f, "%s %u %08x %s", file->ext, file->size, file->crc, status_name[file->status]);
+    for(k=0; k<file->nbr_extents; k++)
+      fprintf(f, " %llu+%u", (long long unsigned)file->extents[k].offset, file->extents[k].size);
+    fprintf(f, "\n");
+    free(file->data);
+  }
+  fclose(f);
+  free(name);
+  return 0;
+}
+
+static int bench_load_truth(const char *image_name)
+{
+  char *name=(char *)MALLOC(strlen(image_name) + 7);
+  char line[1024];
+  FILE *f;
+  sprintf(name, "%s.truth", image_name);
+  f=fopen(name, "r");
+  free(name);
+  bench_nbr_files=0;
+  if(f==NULL)
+    return -1;
+  while(fgets(line, sizeof(line), f)!=NULL && bench_nbr_files < BENCH_FILES_MAX)
+  {
+    struct bench_file *file=&bench_files[bench_nbr_files];
+    char ext[16];
+    char status[16];
+    unsigned int crc;
+    if(line[0]=='#' || sscanf(line, "%15s %u %x %15s", ext, &file->size, &crc, status)!=4)
+      continue;
+    file->ext=NULL;
+    file->crc=crc;
+    file->status=(strcmp(status, "ok")==0 ? BENCH_OK : (strcmp(status, "live")==0 ? BENCH_LIVE : BENCH_DAMAGED));
+    file->found=0;
+    bench_nbr_files++;
+  }
+  fclose(f);
+  return 0;
+}
+
+static void bench_rmdir(const char *path)
+{
+  DIR *dir=opendir(path);
+  struct dirent *entry;
+  if(dir==NULL)
+    return;
+  while((entry=readdir(dir))!=NULL)
+  {
+    char *name;
+    if(strcmp(entry->d_name, ".")==0 || strcmp(entry->d_name, "..")==0)
+      continue;
+    name=(char *)MALLOC(strlen(path) + strlen(entry->d_name) + 2);
+    sprintf(name, "%s/%s", path, entry->d_name);
+    unlink(name);
+    free(name);
+  }
+  closedir(dir);
+  rmdir(path);
+}
+
+/* Compare the files recovered in path with the ground truth */
+static void bench_check_dir(const char *path, unsigned int *nbr_recovered, unsigned int *nbr_extra)
+{
+  DIR *dir=opendir(path);
+  struct dirent *entry;
+  if(dir==NULL)
+    return;
+  while((entry=readdir(dir))!=NULL)
+  {
+    char *name;
+    FILE *f;
+    unsigned char buffer[65536];
+    uint32_t crc=0;
+    unsigned int size=0;
+    unsigned int i;
+    size_t res;
+    if(entry->d_name[0]=='.' || strcmp(entry->d_name, "report.xml")==0)
+      continue;
+    name=(char *)MALLOC(strlen(path) + strlen(entry->d_name) + 2);
+    sprintf(name, "%s/%s", path, entry->d_name);
+    f=fopen(name, "rb");
+    free(name);
+    if(f==NULL)
+      continue;
+    (*nbr_recovered)++;
+    crc=0;
+    while((res=fread(buffer, 1, sizeof(buffer), f)) > 0)
+    {
+      crc=crc32_update(crc, buffer, res);
+      size+=res;
+    }
+    fclose(f);
+    for(i=0; i<bench_nbr_files; i++)
+    {
+      if(bench_files[i].size==size && bench_files[i].crc==crc && bench_files[i].found==0)
+      {
+	bench_files[i].found=1;
+	break;
+      }
+    }
+    if(i==bench_nbr_files)
+      (*nbr_extra)++;
+  }
+  closedir(dir);
+}
+
+static double bench_tv(const struct timeval *tv)
+{
+  return tv->tv_sec + tv->tv_usec / 1000000.0;
+}
+
+static int bench_run(const char *photorec, const char *image_name, const char *cmd)
+{
+  char *out_dir;
+  char *name;
+  struct timeval start;
+  struct timeval end;
+  struct rusage usage;
+  struct stat stat_buf;
+  unsigned int nbr_expected=0;
+  unsigned int nbr_exact=0;
+  unsigned int nbr_recovered=0;
+  unsigned int nbr_extra=0;
+  unsigned int i;
+  double wall;
+  int status;
+  pid_t pid;
+  FILE *f;
+  if(bench_load_truth(image_name) < 0 || stat(image_name, &stat_buf) < 0)
+  {
+    fprintf(stderr, "phbench: %s or its ground truth is missing\n", image_name);
+    return -1;
+  }
+  out_dir=(char *)MALLOC(strlen(image_name) + 32);
+  name=(char *)MALLOC(strlen(image_name) + 32);
+  sprintf(out_dir, "%s.out", image_name);
+  for(i=1; ; i++)
+  {
+    sprintf(name, "%s.%u", out_dir, i);
+    if(stat(name, &stat_buf) < 0)
+      break;
+    bench_rmdir(name);
+  }
+  stat(image_name, &stat_buf);
+  unlink("photorec.log");
+  unlink("photorec.ses");
+  gettimeofday(&start, NULL);
+  pid=fork();
+  if(pid==0)
+  {
+    const int fd=open("/dev/null", O_RDWR);
+    if(fd >= 0)
+    {
+      dup2(fd, 0);
+      dup2(fd, 1);
+      dup2(fd, 2);
+    }
+    execl(photorec, photorec, "/log", "/d", out_dir, "/cmd", image_name, cmd, (char *)NULL);
+    _exit(127);
+  }
+  if(pid < 0 || wait4(pid, &status, 0, &usage) < 0)
+  {
+    fprintf(stderr, "phbench: can't run %s: %s\n", photorec, strerror(errno));
+    free(out_dir);
+    free(name);
+    return -1;
+  }
+  gettimeofday(&end, NULL);
+  wall=bench_tv(&end) - bench_tv(&start);
+  for(i=1; ; i++)
+  {
+    sprintf(name, "%s.%u", out_dir, i);
+    if(stat(name, &stat_buf) < 0)
+      break;
+    bench_check_dir(name, &nbr_recovered, &nbr_extra);
+  }
+  stat(image_name, &stat_buf);
+  for(i=0; i<bench_nbr_files; i++)
+  {
+    if(bench_files[i].status==BENCH_OK)
+    {
+      nbr_expected++;
+      if(bench_files[i].found)
+	nbr_exact++;
+    }
+  }
+  printf("%-16s %6.1f MB %7.2f s %7.1f MB/s  user %6.2f s  sys %5.2f s  RSS %6.1f MB  files %u/%u exact, %u recovered, %u unmatched%s\n",
+      image_name,
+      stat_buf.st_size / 1024.0 / 1024.0,
+      wall,
+      (wall > 0 ? stat_buf.st_size / 1024.0 / 1024.0 / wall : 0),
+      bench_tv(&usage.ru_utime),
+      bench_tv(&usage.ru_stime),
+      usage.ru_maxrss / 1024.0,
+      nbr_exact, nbr_expected, nbr_recovered, nbr_extra,
+      (WIFEXITED(status) && WEXITSTATUS(status)==0 ? "" : " (photorec failed)"));
+  /* Time spent in each pass and in each stage, see prof_log() */
+  sprintf(name, "%s.log", image_name);
+  rename("photorec.log", name);
+  f=fopen(name, "r");
+  if(f!=NULL)
+  {
+    char line[1024];
+    char stage_name[PROF_STAGES][32];
+    double stage_time[PROF_STAGES];
+    unsigned int nbr_stages=0;
+    while(fgets(line, sizeof(line), f)!=NULL)
+    {
+      if(strncmp(line, "Pass ", 5)==0 || strncmp(line, "Elapsed time", 12)==0)
+	printf("    %s", line);
+      else if(strncmp(line, "Profile:", 8)==0)
+      {
+	/* " stage 0.123s/456" for each stage, summed over the passes */
+	const char *pos=line + 8;
+	char stage[32];
+	double seconds;
+	int len;
+	while(sscanf(pos, " %31s %lfs/%*u%n", stage, &seconds, &len)==2)
+	{
+	  unsigned int j;
+	  for(j=0; j<nbr_stages && strcmp(stage_name[j], stage)!=0; j++);
+	  if(j==nbr_stages && nbr_stages < PROF_STAGES)
+	  {
+	    strcpy(stage_name[nbr_stages], stage);
+	    stage_time[nbr_stages++]=0;
+	  }
+	  if(j < nbr_stages)
+	    stage_time[j]+=seconds;
+	  pos+=len;
+	}
+      }
+    }
+    fclose(f);
+    if(nbr_stages > 0)
+    {
+      unsigned int j;
+      printf("    Stages:");
+      for(j=0; j<nbr_stages; j++)
+	printf(" %s %.3f s", stage_name[j], stage_time[j]);
+      printf("\n");
+    }
+  }
+  fflush(stdout);
+  free(out_dir);
+  free(name);
+  return 0;
+}
+
+static void bench_default_param(struct bench_param *param)
+{
+  param->layout=BENCH_RAW;
+  param->seed=1;
+  param->size_mb=64;
+  param->frag_pct=0;
+  param->interleave_pct=50;
+  param->zero_pct=20;
+  param->bad_sectors=0;
+  param->deleted_pct=50;
+}
+
+struct bench_scenario
+{
+  const char *name;
+  bench_layout_t layout;
+  unsigned int frag_pct;
+  unsigned int zero_pct;
+  unsigned int bad_sectors;
+  const char *cmd;
+};
+
+static const struct bench_scenario bench_scenarios[]=
+{
+  { "raw.dd",		BENCH_RAW,  0, 20,  0, "partition_none,search" },
+  { "raw_frag.dd",	BENCH_RAW, 30, 20,  0, "partition_none,search" },
+  { "raw_zero_bad.dd",	BENCH_RAW, 10, 80, 64, "partition_none,search" },
+  { "fat_deleted.dd",	BENCH_FAT, 20, 20,  0, "partition_none,freespace,search" },
+  { NULL, BENCH_RAW, 0, 0, 0, NULL }
+};
+
+static int bench_all(const char *photorec, const unsigned int size_mb)
+{
+  unsigned int i;
+  for(i=0; bench_scenarios[i].name!=NULL; i++)
+  {
+    struct bench_param param;
+    bench_default_param(&param);
+    param.layout=bench_scenarios[i].layout;
+    param.seed=i + 1;
+    param.size_mb=size_mb;
+    param.frag_pct=bench_scenarios[i].frag_pct;
+    param.zero_pct=bench_scenarios[i].zero_pct;
+    param.bad_sectors=bench_scenarios[i].bad_sectors;
+    if(bench_generate(&param, bench_scenarios[i].name) < 0)
+      return -1;
+  }
+  for(i=0; bench_scenarios[i].name!=NULL; i++)
+  {
+    if(bench_run(photorec, bench_scenarios[i].name, bench_scenarios[i].cmd) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+/* Byte by byte loops, as used by the data_check functions before memscan.c */
+static unsigned int ref_byte(const unsigned char *buffer, const unsigned int size, const unsigned char c)
+{
+  unsigned int i;
+  for(i=0; i<size && buffer[i]!=c; i++);
+  return i;
+}
+
+static unsigned int ref_pair(const unsigned char *buffer, const unsigned int size, const unsigned char c1, const unsigned char c2)
+{
+  unsigned int i;
+  for(i=0; i + 1 < size; i++)
+    if(buffer[i]==c1 && buffer[i+1]==c2)
+      return i;
+  return size;
+}
+
+static unsigned int ref_run(const unsigned char *buffer, const unsigned int size, const unsigned char c)
+{
+  unsigned int i;
+  for(i=0; i<size && buffer[i]==c; i++);
+  return i;
+}
+
+static unsigned int ref_text(const unsigned char *buffer, const unsigned int size)
+{
+  unsigned int i;
+  for(i=0; i<size; i++)
+  {
+    const unsigned char car=buffer[i];
+    if(!((car >= ' ' && car <= '~') || car=='\b' || car=='\t' || car=='\r' || car=='\n'))
+      return i;
+  }
+  return size;
+}
+
+#define BENCH_SCAN_SIZE		(1024*1024)
+#define BENCH_SCAN_LOOPS	20
+
+typedef enum { SCAN_BYTE, SCAN_PAIR, SCAN_RUN, SCAN_TEXT } bench_scan_t;
+
+/* Scan the whole buffer like a data_check function would, restarting
+ * after each match, return the number of matches */
+static unsigned int bench_scan_buffer(const bench_scan_t type, const int ref, const unsigned char *buffer, const unsigned int size)
+{
+  unsigned int i=0;
+  unsigned int nbr=0;
+  while(i < size)
+  {
+    unsigned int len=0;
+    switch(type)
+    {
+      case SCAN_BYTE:
+	len=(ref ? ref_byte(&buffer[i], size - i, 0xFF) : scan_byte(&buffer[i], size - i, 0xFF));
+	break;
+      case SCAN_PAIR:
+	len=(ref ? ref_pair(&buffer[i], size - i, '<', '/') : scan_pair(&buffer[i], size - i, '<', '/'));
+	break;
+      case SCAN_RUN:
+	len=(ref ? ref_run(&buffer[i], size - i, 0) : scan_run(&buffer[i], size - i, 0));
+	break;
+      case SCAN_TEXT:
+	len=(ref ? ref_text(&buffer[i], size - i) : scan_text(&buffer[i], size - i));
+	break;
+    }
+    i+=len + 1;
+    nbr++;
+  }
+  return nbr;
+}
+
+/* Best of BENCH_SCAN_LOOPS runs, in bytes per tick */
+static double bench_scan_speed(const bench_scan_t type, const int ref, const unsigned char *buffer, unsigned int *nbr)
+{
+  uint64_t best=0;
+  unsigned int loop;
+  for(loop=0; loop<BENCH_SCAN_LOOPS; loop++)
+  {
+    const uint64_t start=prof_ticks();
+    uint64_t elapsed;
+    *nbr=bench_scan_buffer(type, ref, buffer, BENCH_SCAN_SIZE);
+    elapsed=prof_ticks() - start;
+    if(best==0 || elapsed < best)
+      best=elapsed;
+  }
+  return (best > 0 ? (double)BENCH_SCAN_SIZE / best : 0.0);
+}
+
+static void bench_gen_text(unsigned char *buffer, const unsigned int size, const unsigned int utf8_every)
+{
+  static const char *words[]={ "the ", "data ", "recovery ", "of ", "files ", "<p>", "</p>\n", "PhotoRec ", "and ", "sector " };
+  unsigned int i=0;
+  while(i < size)
+  {
+    const char *word=words[bench_rand() % 10];
+    unsigned int j;
+    for(j=0; word[j]!='\0' && i < size; j++)
+      buffer[i++]=word[j];
+    if(utf8_every > 0 && bench_rand() % utf8_every==0 && i + 2 <= size)
+    {
+      /* U+00E9 */
+      buffer[i++]=0xc3;
+      buffer[i++]=0xa9;
+    }
+  }
+}
+
+static void bench_gen_jpeg_scan(unsigned char *buffer, const unsigned int size)
+{
+  /* Entropy-coded data, 0xFF is followed by a stuffed 0x00 */
+  unsigned int i;
+  bench_fill(buffer, size);
+  for(i=0; i + 1 < size; i++)
+    if(buffer[i]==0xFF)
+      buffer[++i]=0x00;
+}
+
+static int bench_scan(void)
+{
+  /* utf8_every: 0 for ASCII text, -1 for JPEG data, -2 for zeroes */
+  static const struct
+  {
+    const char *name;
+    bench_scan_t type;
+    const char *used_by;
+    int utf8_every;
+  } tests[]={
+    { "jpeg scan data",	SCAN_BYTE, "scan_byte (data_check_jpg2)", -1 },
+    { "html text",	SCAN_PAIR, "scan_pair (data_check_html)",  0 },
+    { "zero padding",	SCAN_RUN,  "scan_run  (data_check_id3)",  -2 },
+    { "ascii text",	SCAN_TEXT, "scan_text (UTFsize)",          0 },
+    { "utf-8 text",	SCAN_TEXT, "scan_text (UTFsize)",         20 },
+    { NULL, SCAN_BYTE, NULL, 0 }
+  };
+  unsigned char *buffer=(unsigned char *)MALLOC(BENCH_SCAN_SIZE);
+  unsigned int t;
+  printf("Byte scanning, %s implementation, best of %u runs over %u KiB\n",
+      scan_impl_name(), BENCH_SCAN_LOOPS, BENCH_SCAN_SIZE / 1024);
+  printf("%-16s %-28s %8s %10s %10s %8s\n", "data", "function", "matches", "before", "after", "speedup");
+  for(t=0; tests[t].name!=NULL; t++)
+  {
+    unsigned int nbr_ref;
+    unsigned int nbr;
+    double before;
+    double after;
+    if(tests[t].utf8_every==-1)
+      bench_gen_jpeg_scan(buffer, BENCH_SCAN_SIZE);
+    else if(tests[t].utf8_every==-2)
+      memset(buffer, 0, BENCH_SCAN_SIZE);
+    else
+      bench_gen_text(buffer, BENCH_SCAN_SIZE, tests[t].utf8_every);
+    before=bench_scan_speed(tests[t].type, 1, buffer, &nbr_ref);
+    after=bench_scan_speed(tests[t].type, 0, buffer, &nbr);
+    if(nbr!=nbr_ref)
+    {
+      fprintf(stderr, "phbench: %s, %u matches instead of %u\n", tests[t].used_by, nbr, nbr_ref);
+      free(buffer);
+      return -1;
+    }
+    printf("%-16s %-28s %8u %10.3f %10.3f %7.1fx\n", tests[t].name, tests[t].used_by,
+	nbr, before, after, (before > 0 ? after / before : 0.0));
+  }
+  printf("before/after in bytes per cycle (time stamp counter)\n");
+  free(buffer);
+  return 0;
+}
+
+static void bench_usage(void)
+{
+  printf("Usage: phbench generate [raw|fat] [seed=N] [size=MB] [frag=%%] [interleave=%%] [zero=%%] [bad=N] [deleted=%%] image\n"
+      "       phbench run photorec image [photorec_cmd]\n"
+      "       phbench all photorec [directory] [size=MB]\n"
+      "       phbench scan\n"
+      "\n"
+      "generate writes image, image.truth (ground truth) and image.map (unreadable sectors)\n"
+      "run starts photorec non-interactively on image and checks the recovered files\n"
+      "all generates the standard images in directory and runs photorec on each of them\n"
+      "scan measures the speed of the byte scanning functions\n");
+}
+
+/* Absolute path of photorec, the benchmark runs in another directory */
+static char *bench_abspath(const char *path)
+{
+  char *res;
+  char cwd[4096];
+  if(path[0]=='/' || strchr(path, '/')==NULL || getcwd(cwd, sizeof(cwd))==NULL)
+    return strdup(path);
+  res=(char *)MALLOC(strlen(cwd) + strlen(path) + 2);
+  sprintf(res, "%s/%s", cwd, path);
+  return res;
+}
+
+int main(int argc, char **argv)
+{
+  crc32_init();
+  if(argc >= 3 && strcmp(argv[1], "generate")==0)
+  {
+    struct bench_param param;
+    int i;
+    bench_default_param(&param);
+    for(i=2; i<argc-1; i++)
+    {
+      if(strcmp(argv[i], "raw")==0)
+	param.layout=BENCH_RAW;
+      else if(strcmp(argv[i], "fat")==0)
+	param.layout=BENCH_FAT;
+      else if(strncmp(argv[i], "seed=", 5)==0)
+	param.seed=strtoull(argv[i] + 5, NULL, 10);
+      else if(strncmp(argv[i], "size=", 5)==0)
+	param.size_mb=atoi(argv[i] + 5);
+      else if(strncmp(argv[i], "frag=", 5)==0)
+	param.frag_pct=atoi(argv[i] + 5);
+      else if(strncmp(argv[i], "interleave=", 11)==0)
+	param.interleave_pct=atoi(argv[i] + 11);
+      else if(strncmp(argv[i], "zero=", 5)==0)
+	param.zero_pct=atoi(argv[i] + 5);
+      else if(strncmp(argv[i], "bad=", 4)==0)
+	param.bad_sectors=atoi(argv[i] + 4);
+      else if(strncmp(argv[i], "deleted=", 8)==0)
+	param.deleted_pct=atoi(argv[i] + 8);
+      else
+      {
+	bench_usage();
+	return 1;
+      }
+    }
+    if(param.size_mb < 4)
+      param.size_mb=4;
+    return (bench_generate(&param, argv[argc-1]) < 0 ? 1 : 0);
+  }
+  if(argc >= 4 && strcmp(argv[1], "run")==0)
+  {
+    return (bench_run(argv[2], argv[3], (argc > 4 ? argv[4] : "partition_none,search")) < 0 ? 1 : 0);
+  }
+  if(argc >= 3 && strcmp(argv[1], "all")==0)
+  {
+    char *photorec=bench_abspath(argv[2]);
+    unsigned int size_mb=64;
+    int i;
+    int res;
+    for(i=3; i<argc; i++)
+    {
+      if(strncmp(argv[i], "size=", 5)==0)
+	size_mb=atoi(argv[i] + 5);
+      else
+      {
+	mkdir(argv[i], 0755);
+	if(chdir(argv[i]) < 0)
+	{
+	  fprintf(stderr, "phbench: can't use directory %s: %s\n", argv[i], strerror(errno));
+	  free(photorec);
+	  return 1;
+	}
+      }
+    }
+    res=bench_all(photorec, (size_mb < 4 ? 4 : size_mb));
+    free(photorec);
+    return (res < 0 ? 1 : 0);
+  }
+  if(argc == 2 && strcmp(argv[1], "scan")==0)
+  {
+    return (bench_scan() < 0 ? 1 : 0);
+  }
+  bench_usage();
+  return 1;
+}
@@ -68,13 +68,18 @@
 #include "phcfg.h"
 #include "pblocksize.h"
 #include "pnext.h"
+#include "phcontainer.h"
 #include "phbf.h"
 #include "phnc.h"
 
 //#define DEBUG_BF
 //#define DEBUG_BF2
 #define READ_SIZE 1024*512
-extern file_check_list_t file_check_list;
+#ifdef __MSDOS__
+#define BF_WINDOW_SIZE (1024*1024)
+#else
+#define BF_WINDOW_SIZE (8*1024*1024)
+#endif
 extern uint64_t free_list_allocation_end;
 
 typedef enum { BF_OK=0, BF_STOP=1, BF_EACCES=2, BF_ENOSPC=3, BF_FRAG_FOUND=4, BF_EOF=5, BF_ENOENT=6, BF_ERANGE=7} bf_status_t;
@@ -82,6 +87,46 @@ typedef enum { BF_OK=0, BF_STOP=1, BF_EACCES=2, BF_ENOSPC=3, BF_FRAG_FOUND=4, BF
 static pstatus_t photorec_bf_aux(struct ph_param *params, file_recovery_t *file_recovery, alloc_data_t *list_search_space, const int phase);
 static bf_status_t photorec_bf_frag(struct ph_param *params, file_recovery_t *file_recovery, alloc_data_t *list_search_space, alloc_data_t *start_search_space, const int phase, alloc_data_t **current_search_space, uint64_t *offset, unsigned char *buffer, unsigned char *block_buffer, const unsigned int frag);
 
+/* Every fragmentation hypothesis reads the same candidate blocks again,
+ * serve them from a window of the disk loaded once */
+static unsigned char *bf_window=NULL;
+static uint64_t bf_window_offset=0;
+static unsigned int bf_window_size=0;
+/* Window that couldn't be read (bad sectors), its blocks are read one by one */
+static uint64_t bf_bad_offset=0;
+static unsigned int bf_bad_size=0;
+
+static void bf_pread(disk_t *disk, unsigned char *buffer, const unsigned int size, const uint64_t offset)
+{
+  if(offset < bf_window_offset || offset + size > bf_window_offset + bf_window_size)
+  {
+    const uint64_t start=offset / (BF_WINDOW_SIZE/4) * (BF_WINDOW_SIZE/4);
+    if(bf_window==NULL || size > BF_WINDOW_SIZE/2 || start >= disk->disk_size ||
+	(offset >= bf_bad_offset && offset + size <= bf_bad_offset + bf_bad_size))
+    {
+      disk->pread(disk, buffer, size, offset);
+      return;
+    }
+    bf_window_offset=start;
+    bf_window_size=(disk->disk_size - start < BF_WINDOW_SIZE ? disk->disk_size - start : BF_WINDOW_SIZE);
+    if(offset + size > bf_window_offset + bf_window_size)
+    {
+      bf_window_size=0;
+      disk->pread(disk, buffer, size, offset);
+      return;
+    }
+    if((unsigned int)disk->pread(disk, bf_window, bf_window_size, bf_window_offset) != bf_window_size)
+    {
+      bf_bad_offset=bf_window_offset;
+      bf_bad_size=bf_window_size;
+      bf_window_size=0;
+      disk->pread(disk, buffer, size, offset);
+      return;
+    }
+  }
+  memcpy(buffer, &bf_window[offset - bf_window_offset], size);
+}
+
 static inline void file_recovery_cpy(file_recovery_t *dst, file_recovery_t *src)
 {
   memcpy(dst, src, sizeof(*dst));
@@ -132,6 +177,9 @@ pstatus_t photorec_bf(struct ph_param *params, const struct ph_options *options,
   int phase;
   buffer_size=blocksize+READ_SIZE;
   buffer_start=(unsigned char *)MALLOC(buffer_size);
+  bf_window=(unsigned char *)MALLOC(BF_WINDOW_SIZE);
+  bf_window_size=0;
+  bf_bad_size=0;
   for(phase=0; phase<2; phase++)
   {
     const unsigned int file_nbr_phase_old=params->file_nbr;
@@ -154,7 +202,7 @@ pstatus_t photorec_bf(struct ph_param *params, const struct ph_options *options,
       buffer_olddata=buffer_start;
       buffer=buffer_olddata + blocksize;
       memset(buffer_olddata, 0, blocksize);
-      params->disk->pread(params->disk, buffer, READ_SIZE, offset);
+      bf_pread(params->disk, buffer, READ_SIZE, offset);
       info_list_search_space(list_search_space, current_search_space, params->disk->sector_size, 0, options->verbose);
 #ifdef DEBUG_BF
 #endif
@@ -166,28 +214,11 @@ pstatus_t photorec_bf(struct ph_param *params, const struct ph_options *options,
 	need_to_check_file=0;
 	if(offset==current_search_space->start)
 	{
-	  const struct td_list_head *tmpl;
 	  file_recovery_t file_recovery_new;
 //	  memset(&file_recovery_new, 0, sizeof(file_recovery_t));
 	  file_recovery_new.blocksize=blocksize;
 	  file_recovery_new.file_stat=NULL;
-	  td_list_for_each(tmpl, &file_check_list.list)
-	  {
-	    const struct td_list_head *tmp;
-	    const file_check_list_t *pos=td_list_entry_const(tmpl, const file_check_list_t, list);
-	    td_list_for_each(tmp, &pos->file_checks[buffer[pos->offset]].list)
-	    {
-	      const file_check_t *file_check=td_list_entry_const(tmp, const file_check_t, list);
-	      if((file_check->length==0 || memcmp(buffer + file_check->offset, file_check->value, file_check->length)==0) &&
-		  file_check->header_check(buffer, read_size, 0, &file_recovery, &file_recovery_new)!=0)
-	      {
-		file_recovery_new.file_stat=file_check->file_stat;
-		break;
-	      }
-	    }
-	    if(file_recovery_new.file_stat!=NULL)
-	      break;
-	  }
+	  header_check_find(buffer, read_size, 0, &file_recovery, &file_recovery_new);
 	  if(file_recovery_new.file_stat!=NULL)
 	  {
 	    file_recovery_new.location.start=offset;
@@ -217,7 +248,8 @@ pstatus_t photorec_bf(struct ph_param *params, const struct ph_options *options,
 	  set_filename(&file_recovery, params);
 	  if(file_recovery.file_stat->file_hint->recover==1)
 	  {
-	    if(!(file_recovery.handle=fopen(file_recovery.filename,"w+b")))
+	    if((file_recovery.handle=phc_fopen(&file_recovery, params->disk))==NULL &&
+		(file_recovery.handle=fopen(phc_output_filename(file_recovery.filename),"w+b"))==NULL)
 	    { 
 	      log_critical("Cannot create file %s: %s\n", file_recovery.filename, strerror(errno));
 	      ind_stop=PSTATUS_EACCES;
@@ -226,7 +258,7 @@ pstatus_t photorec_bf(struct ph_param *params, const struct ph_options *options,
 	}
 	if(need_to_check_file==0 && file_recovery.handle!=NULL && file_recovery.file_stat!=NULL)
 	{
-	  if(fwrite(buffer,blocksize,1,file_recovery.handle)<1)
+	  if(file_data_write(&file_recovery, buffer, blocksize)<1)
 	  { 
 	    log_critical("Cannot write to file %s: %s\n", file_recovery.filename, strerror(errno));
 	    ind_stop=PSTATUS_ENOSPC;
@@ -269,7 +301,7 @@ pstatus_t photorec_bf(struct ph_param *params, const struct ph_options *options,
 		  (unsigned long long)((offset - params->partition->part_offset) / params->disk->sector_size),
 		  (unsigned long long)((params->partition->part_size-1) / params->disk->sector_size));
 	    }
-	    params->disk->pread(params->disk, buffer, READ_SIZE, offset);
+	    bf_pread(params->disk, buffer, READ_SIZE, offset);
 	  }
 	}
       } while(need_to_check_file==0);
@@ -309,6 +341,9 @@ pstatus_t photorec_bf(struct ph_param *params, const struct ph_options *options,
     }
     log_info("phase=%d +%u\n", phase, params->file_nbr - file_nbr_phase_old);
   }
+  free(bf_window);
+  bf_window=NULL;
+  bf_window_size=0;
   free(buffer_start);
 #ifdef HAVE_NCURSES
   photorec_info(stdscr, params->file_stats);
@@ -348,12 +383,12 @@ static bf_status_t photorec_bf_pad(struct ph_param *params, file_recovery_t *fil
 	      (*current_search_space)->file_stat==NULL ||
 	      (*current_search_space)->file_stat->file_hint==NULL)
 	  {
-	    params->disk->pread(params->disk, block_buffer, blocksize, *offset);
+	    bf_pread(params->disk, block_buffer, blocksize, *offset);
 	    if(file_recovery->data_check(buffer, 2*blocksize, file_recovery)!=DC_CONTINUE)
 	    {
 	      stop=1;
 	    }
-	    if(fwrite(block_buffer, blocksize, 1, file_recovery->handle)<1)
+	    if(file_data_write(file_recovery, block_buffer, blocksize)<1)
 	    {
 	      log_critical("Cannot write to file %s: %s\n", file_recovery->filename, strerror(errno));
 	      fclose(file_recovery->handle);
@@ -379,8 +414,8 @@ static bf_status_t photorec_bf_pad(struct ph_param *params, file_recovery_t *fil
 	      (*current_search_space)->file_stat==NULL ||
 	      (*current_search_space)->file_stat->file_hint==NULL)
 	  {
-	    params->disk->pread(params->disk, block_buffer, blocksize, *offset);
-	    if(fwrite(block_buffer, blocksize, 1, file_recovery->handle)<1)
+	    bf_pread(params->disk, block_buffer, blocksize, *offset);
+	    if(file_data_write(file_recovery, block_buffer, blocksize)<1)
 	    {
 	      log_critical("Cannot write to file %s: %s\n", file_recovery->filename, strerror(errno));
 	      fclose(file_recovery->handle);
@@ -494,12 +529,12 @@ static bf_status_t photorec_bf_frag_fast(struct ph_param *params, file_recovery_
     }
     for(k=original_offset_ok/blocksize+1; k<original_offset_error/blocksize; k++)
     {
-      params->disk->pread(params->disk, block_buffer, blocksize, *offset);
+      bf_pread(params->disk, block_buffer, blocksize, *offset);
       if(file_recovery->data_check(buffer, 2*blocksize, file_recovery)!=DC_CONTINUE)
       {
 	/* TODO handle this problem */
       }
-      if(fwrite(block_buffer, blocksize, 1, file_recovery->handle)<1)
+      if(file_data_write(file_recovery, block_buffer, blocksize)<1)
       {
 	log_critical("Cannot write to file %s: %s\n", file_recovery->filename, strerror(errno));
 	fclose(file_recovery->handle);
@@ -55,7 +55,6 @@
 
 #define READ_SIZE 1024*512
 extern const file_hint_t file_hint_tar;
-extern file_check_list_t file_check_list;
 
 static inline void file_recovery_cpy(file_recovery_t *dst, file_recovery_t *src)
 {
@@ -68,8 +67,9 @@ pstatus_t photorec_find_blocksize(struct ph_param *params, const struct ph_optio
 {
   uint64_t offset=0;
   unsigned char *buffer_start;
-  unsigned char *buffer_olddata;
-  unsigned char *buffer;
+  const unsigned char *buffer_olddata;
+  const unsigned char *buffer;
+  const unsigned char *buffer_end;
   time_t start_time;
   time_t previous_time;
   unsigned int buffer_size;
@@ -85,15 +85,16 @@ pstatus_t photorec_find_blocksize(struct ph_param *params, const struct ph_optio
   buffer_start=(unsigned char *)MALLOC(buffer_size);
   buffer_olddata=buffer_start;
   buffer=buffer_olddata + blocksize;
+  buffer_end=buffer_start + buffer_size;
   start_time=time(NULL);
   previous_time=start_time;
-  memset(buffer_olddata, 0, blocksize);
+  memset(buffer_start, 0, blocksize);
   current_search_space=td_list_entry(list_search_space->list.next, alloc_data_t, list);
   if(current_search_space!=list_search_space)
     offset=current_search_space->start;
   if(options->verbose>0)
     info_list_search_space(list_search_space, current_search_space, params->disk->sector_size, 0, options->verbose);
-  params->disk->pread(params->disk, buffer, READ_SIZE, offset);
+  params->disk->pread(params->disk, buffer_start + blocksize, READ_SIZE, offset);
   while(current_search_space!=list_search_space)
   {
     const uint64_t old_offset=offset;
@@ -111,29 +112,12 @@ pstatus_t photorec_find_blocksize(struct ph_param *params, const struct ph_optio
       }
       else
       {
-	const struct td_list_head *tmpl;
         file_recovery_new.file_stat=NULL;
-	td_list_for_each(tmpl, &file_check_list.list)
-	{
-	  const struct td_list_head *tmp;
-	  const file_check_list_t *pos=td_list_entry_const(tmpl, const file_check_list_t, list);
-	  td_list_for_each(tmp, &pos->file_checks[buffer[pos->offset]].list)
-	  {
-	    const file_check_t *file_check=td_list_entry_const(tmp, const file_check_t, list);
-	    if((file_check->length==0 || memcmp(buffer + file_check->offset, file_check->value, file_check->length)==0) &&
-		file_check->header_check(buffer, read_size, 1, &file_recovery, &file_recovery_new)!=0)
-	    {
-	      file_recovery_new.file_stat=file_check->file_stat;
-	      break;
-	    }
-	  }
-	  if(file_recovery_new.file_stat!=NULL)
-	    break;
-	}
+	header_check_find(buffer, read_size, 1, &file_recovery, &file_recovery_new);
         if(file_recovery_new.file_stat!=NULL && file_recovery_new.file_stat->file_hint!=NULL)
 	{
 	  /* A new file begins, backup file offset */
-	  current_search_space=file_found(current_search_space, offset, file_recovery_new.file_stat);
+	  current_search_space=file_found(list_search_space, current_search_space, offset, file_recovery_new.file_stat);
 	  params->file_nbr++;
 	  file_recovery_cpy(&file_recovery, &file_recovery_new);
 	}
@@ -172,25 +156,39 @@ pstatus_t photorec_find_blocksize(struct ph_param *params, const struct ph_optio
     buffer_olddata+=blocksize;
     buffer+=blocksize;
     if( old_offset+blocksize!=offset ||
-        buffer+read_size>buffer_start+buffer_size)
+        buffer+read_size>buffer_end)
     {
-      memcpy(buffer_start, buffer_olddata, blocksize);
-      buffer_olddata=buffer_start;
-      buffer=buffer_olddata+blocksize;
+      const unsigned char *view=NULL;
       if(options->verbose>1)
       {
         log_verbose("Reading sector %10llu/%llu\n",
 	    (unsigned long long)((offset - params->partition->part_offset) / params->disk->sector_size),
 	    (unsigned long long)((params->partition->part_size-1) / params->disk->sector_size));
       }
-      if(params->disk->pread(params->disk, buffer, READ_SIZE, offset) != READ_SIZE)
+      /* Use the data in place if possible */
+      if(params->disk->pview!=NULL && old_offset+blocksize==offset)
+	view=params->disk->pview(params->disk, buffer_size, offset - blocksize);
+      if(view!=NULL)
       {
+	buffer_olddata=view;
+	buffer=buffer_olddata + blocksize;
+	buffer_end=view + buffer_size;
+      }
+      else
+      {
+	memcpy(buffer_start, buffer_olddata, blocksize);
+	buffer_olddata=buffer_start;
+	buffer=buffer_olddata + blocksize;
+	buffer_end=buffer_start + buffer_size;
+	if(params->disk->pread(params->disk, buffer_start + blocksize, READ_SIZE, offset) != READ_SIZE)
+	{
 #ifdef HAVE_NCURSES
-	wmove(stdscr,11,0);
-	wclrtoeol(stdscr);
-	wprintw(stdscr,"Error reading sector %10lu\n",
-	    (unsigned long)((offset - params->partition->part_offset) / params->disk->sector_size));
+	  wmove(stdscr,11,0);
+	  wclrtoeol(stdscr);
+	  wprintw(stdscr,"Error reading sector %10lu\n",
+	      (unsigned long)((offset - params->partition->part_offset) / params->disk->sector_size));
 #endif
+	}
       }
 #ifdef HAVE_NCURSES
       {
@@ -0,0 +1,173 @@
+/*
+
+    File: phcextract.c
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+#include <errno.h>
+#include "types.h"
+#include "common.h"
+#include "filegen.h"
+#include "setdate.h"
+#include "phcontainer.h"
+
+static void display_help(void)
+{
+  printf("\nUsage: phcextract [--list] [--image image.dd] container [directory]\n"\
+      "       phcextract --version\n" \
+      "\n" \
+      "phcextract extracts the files recovered by PhotoRec in a single container.\n" \
+      "--list      list the files and their location in the original image\n" \
+      "--image     read the data from this image when only the location of the\n" \
+      "            files has been recorded (PhotoRec metadata option)\n");
+}
+
+static void display_version(void)
+{
+  printf("phcextract %s, Data Recovery Utility, %s\nChristophe GRENIER <grenier@cgsecurity.org>\nhttp://www.cgsecurity.org\n",VERSION,TESTDISKDATE);
+}
+
+static void phc_list_entry(const struct phc_entry *entry)
+{
+  unsigned int i;
+  printf("%s\t%llu\t%llu", entry->name,
+      (long long unsigned)entry->size,
+      (long long unsigned)entry->time);
+  for(i=0; i<entry->nbr_runs; i++)
+    printf("\t%llu:%llu+%llu",
+	(long long unsigned)entry->runs[i].offset,
+	(long long unsigned)entry->runs[i].img_offset,
+	(long long unsigned)entry->runs[i].len);
+  printf("\n");
+}
+
+static int phc_extract_entry(struct phc_reader *reader, const struct phc_entry *entry, const char *directory)
+{
+  char filename[2048];
+  FILE *handle;
+  int res;
+  if((entry->flags & PHC_ENTRY_NODATA)!=0 && reader->image==NULL)
+  {
+    fprintf(stderr, "%s: only the location has been recorded, use --image\n", entry->name);
+    return -1;
+  }
+  /* The names are generated by PhotoRec, don't write outside directory */
+  if(entry->name[0]=='\0' || entry->name[0]=='.' ||
+      strchr(entry->name, '/')!=NULL || strchr(entry->name, '\\')!=NULL)
+  {
+    fprintf(stderr, "Skip invalid name %s\n", entry->name);
+    return -1;
+  }
+  snprintf(filename, sizeof(filename), "%s/%s", directory, entry->name);
+  handle=fopen(filename, "wb");
+  if(handle==NULL)
+  {
+    fprintf(stderr, "Cannot create file %s: %s\n", filename, strerror(errno));
+    return -1;
+  }
+  res=phc_reader_copy(reader, entry, handle);
+  if(fclose(handle)!=0 || res < 0)
+  {
+    fprintf(stderr, "Cannot write to file %s: %s\n", filename, strerror(errno));
+    return -1;
+  }
+  if(entry->time!=0)
+    set_date(filename, entry->time, entry->time);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  int i;
+  int list=0;
+  const char *container=NULL;
+  const char *directory=".";
+  const char *image=NULL;
+  struct phc_reader reader;
+  struct phc_entry entry;
+  unsigned int nbr=0;
+  unsigned int errors=0;
+  for(i=1; i<argc; i++)
+  {
+    if(strcmp(argv[i], "/list")==0 || strcmp(argv[i], "-list")==0 || strcmp(argv[i], "--list")==0 ||
+	strcmp(argv[i], "-l")==0)
+      list=1;
+    else if((strcmp(argv[i], "/image")==0 || strcmp(argv[i], "-image")==0 || strcmp(argv[i], "--image")==0) && i+1<argc)
+      image=argv[++i];
+    else if(strcmp(argv[i],"/help")==0 || strcmp(argv[i],"-help")==0 || strcmp(argv[i],"--help")==0 ||
+      strcmp(argv[i],"/h")==0 || strcmp(argv[i],"-h")==0 ||
+      strcmp(argv[i],"/?")==0 || strcmp(argv[i],"-?")==0)
+    {
+      display_help();
+      return 0;
+    }
+    else if((strcmp(argv[i],"/version")==0) || (strcmp(argv[i],"-version")==0) || (strcmp(argv[i],"--version")==0) ||
+      (strcmp(argv[i],"/v")==0) || (strcmp(argv[i],"-v")==0))
+    {
+      display_version();
+      return 0;
+    }
+    else if(container==NULL)
+      container=argv[i];
+    else
+      directory=argv[i];
+  }
+  if(container==NULL)
+  {
+    display_help();
+    return 1;
+  }
+  if(phc_reader_open(&reader, container) < 0)
+  {
+    fprintf(stderr, "%s is not a PhotoRec container\n", container);
+    return 1;
+  }
+  if(image!=NULL && phc_reader_set_image(&reader, image) < 0)
+  {
+    fprintf(stderr, "Cannot open %s: %s\n", image, strerror(errno));
+    phc_reader_close(&reader);
+    return 1;
+  }
+  while(phc_reader_next(&reader, &entry) > 0)
+  {
+    if(list)
+      phc_list_entry(&entry);
+    else if(phc_extract_entry(&reader, &entry, directory) < 0)
+      errors++;
+    nbr++;
+  }
+  phc_reader_close(&reader);
+  if(!list)
+    printf("%u files extracted from %s to %s\n", nbr - errors, container, directory);
+  return (errors > 0 ? 1 : 0);
+}
@@ -40,6 +40,7 @@
 #include "geometry.h"
 #include "poptions.h"
 #include "phcli.h"
+#include "phpool.h"
 
 typedef enum { INIT_SPACE_WHOLE, INIT_SPACE_PREINIT, INIT_SPACE_EXT2_GROUP, INIT_SPACE_EXT2_INODE } init_mode_t;
 
@@ -221,14 +222,14 @@ int menu_photorec_cli(list_part_t *list_part, struct ph_param *params, struct ph
       if(mode_init_space==INIT_SPACE_EXT2_GROUP)
       {
 	alloc_data_t *new_free_space;
-	new_free_space=(alloc_data_t*)MALLOC(sizeof(*new_free_space));
+	new_free_space=search_space_node_new();
 	/* Temporary storage, values need to be multiplied by group size and aligned */
 	new_free_space->start=groupnr;
 	new_free_space->end=groupnr;
 	new_free_space->file_stat=NULL;
 	new_free_space->data=1;
 	if(td_list_add_sorted_uniq(&new_free_space->list, &list_search_space->list, spacerange_cmp))
-	  free(new_free_space);
+	  search_space_node_free(new_free_space);
       }
     }
     else if(strncmp(params->cmd_run,"ext2_inode,",11)==0)
@@ -244,14 +245,14 @@ int menu_photorec_cli(list_part_t *list_part, struct ph_param *params, struct ph
       if(mode_init_space==INIT_SPACE_EXT2_INODE)
       {
 	alloc_data_t *new_free_space;
-	new_free_space=(alloc_data_t*)MALLOC(sizeof(*new_free_space));
+	new_free_space=search_space_node_new();
 	/* Temporary storage, values need to be multiplied by group size and aligned */
 	new_free_space->start=inodenr;
 	new_free_space->end=inodenr;
 	new_free_space->file_stat=NULL;
 	new_free_space->data=1;
 	if(td_list_add_sorted_uniq(&new_free_space->list, &list_search_space->list, spacerange_cmp))
-	  free(new_free_space);
+	  search_space_node_free(new_free_space);
       }
     }
     else if(isdigit(params->cmd_run[0]))
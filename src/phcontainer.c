@@ -0,0 +1,570 @@
+/*
+
+    File: phcontainer.c
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+#include <errno.h>
+#include "types.h"
+#include "common.h"
+#include "list.h"
+#include "filegen.h"
+#include "log.h"
+#include "phwrite.h"
+#include "phcontainer.h"
+
+#define PHC_BUFFER_SIZE	(1024*1024)
+
+#if defined(HAVE_FOPENCOOKIE) || defined(HAVE_FUNOPEN)
+struct phc_cookie
+{
+  const file_recovery_t *file_recovery;
+  disk_t *disk;
+  uint64_t size;
+  uint64_t pos;
+  /* Data written in the container at base, see phc_fopen() */
+  int container;
+  uint64_t base;
+  int error;
+  /* The record has been written after the data, ignore the next writes */
+  int done;
+};
+#endif
+
+static struct
+{
+  FILE *handle;
+  /* Entry records, copied at the end of the container by phc_close() */
+  FILE *index;
+  unsigned char *buffer;
+  /* End of the last complete entry */
+  uint64_t offset;
+  uint64_t nbr;
+  int nodata;
+  void (*disk_wait)(void *);
+  void *disk_wait_arg;
+#if defined(HAVE_FOPENCOOKIE) || defined(HAVE_FUNOPEN)
+  /* File being written directly in the container */
+  struct phc_cookie *active;
+  FILE *active_handle;
+#endif
+  char filename[2048];
+  char spool[2048];
+} phc;
+
+static void phc_put16(unsigned char *p, const unsigned int value)
+{
+  p[0]=value & 0xff;
+  p[1]=(value >> 8) & 0xff;
+}
+
+static void phc_put32(unsigned char *p, const uint32_t value)
+{
+  phc_put16(p, value & 0xffff);
+  phc_put16(p + 2, value >> 16);
+}
+
+static void phc_put64(unsigned char *p, const uint64_t value)
+{
+  phc_put32(p, value & 0xffffffff);
+  phc_put32(p + 4, value >> 32);
+}
+
+static int phc_seek(FILE *handle, const uint64_t offset, const int whence)
+{
+#ifdef HAVE_FSEEKO
+  return fseeko(handle, offset, whence);
+#else
+  return fseek(handle, offset, whence);
+#endif
+}
+
+/* Forget everything written after the last complete entry */
+static void phc_truncate(void)
+{
+  fflush(phc.handle);
+#ifdef HAVE_FTRUNCATE
+  if(ftruncate(fileno(phc.handle), phc.offset) < 0)
+    log_critical("Cannot truncate %s: %s\n", phc.filename, strerror(errno));
+#endif
+}
+
+int phc_open(const char *recup_dir, const unsigned int dir_num, const int nodata)
+{
+  if(phc.handle!=NULL)
+    phc_close();
+  snprintf(phc.filename, sizeof(phc.filename), "%s.%u/%s", recup_dir, dir_num, PHC_FILENAME);
+  snprintf(phc.spool, sizeof(phc.spool), "%s.%u/photorec.spool", recup_dir, dir_num);
+  /* Read back by the file checks */
+  phc.handle=fopen(phc.filename, "w+b");
+  if(phc.handle==NULL)
+  {
+    log_critical("Cannot create file %s: %s\n", phc.filename, strerror(errno));
+    return -1;
+  }
+  if(fwrite(PHC_MAGIC, PHC_HEADER_SIZE, 1, phc.handle)!=1)
+  {
+    log_critical("Cannot write to file %s: %s\n", phc.filename, strerror(errno));
+    fclose(phc.handle);
+    phc.handle=NULL;
+    return -1;
+  }
+  phc.buffer=(unsigned char *)MALLOC(PHC_BUFFER_SIZE);
+  /* The data is written in large chunks, avoid another copy */
+  setvbuf(phc.handle, NULL, _IONBF, 0);
+  phc.index=tmpfile();
+  if(phc.index==NULL)
+    log_warning("Cannot create the index of %s, the records will be found from the end\n", phc.filename);
+  phc.offset=PHC_HEADER_SIZE;
+  phc.nbr=0;
+  phc.nodata=nodata;
+  if(nodata)
+    log_info("Location of the recovered files written to %s\n", phc.filename);
+  else
+    log_info("Recovered files are written to %s\n", phc.filename);
+  return 0;
+}
+
+void phc_close(void)
+{
+  if(phc.handle==NULL)
+    return ;
+#if defined(HAVE_FOPENCOOKIE) || defined(HAVE_FUNOPEN)
+  if(phc.active!=NULL)
+  {
+    /* File not finished, its data is dropped */
+    phc.active->done=1;
+    phc.active=NULL;
+    phc.active_handle=NULL;
+  }
+#endif
+  if(phc.index!=NULL)
+  {
+    const uint64_t index_offset=phc.offset;
+    size_t res;
+    int ok=(fflush(phc.index)==0 && phc_seek(phc.index, 0, SEEK_SET)==0 &&
+	phc_seek(phc.handle, phc.offset, SEEK_SET)==0);
+    while(ok && (res=fread(phc.buffer, 1, PHC_BUFFER_SIZE, phc.index)) > 0)
+    {
+      if(fwrite(phc.buffer, res, 1, phc.handle)!=1)
+	ok=0;
+      else
+	phc.offset+=res;
+    }
+    if(ok)
+    {
+      unsigned char trailer[PHC_TRAILER_SIZE];
+      phc_put64(&trailer[0], index_offset);
+      phc_put64(&trailer[8], phc.nbr);
+      memcpy(&trailer[16], PHC_INDEX_MAGIC, 8);
+      if(fwrite(trailer, sizeof(trailer), 1, phc.handle)!=1)
+	ok=0;
+      else
+	phc.offset+=PHC_TRAILER_SIZE;
+    }
+    if(!ok)
+    {
+      log_critical("Cannot write the index of %s\n", phc.filename);
+      phc.offset=index_offset;
+    }
+    fclose(phc.index);
+    phc.index=NULL;
+  }
+  /* Drop the data of a file rejected after the last entry */
+  phc_truncate();
+  if(fclose(phc.handle)!=0)
+    log_critical("Cannot write to file %s: %s\n", phc.filename, strerror(errno));
+  phc.handle=NULL;
+  unlink(phc.spool);
+  free(phc.buffer);
+  phc.buffer=NULL;
+  log_info("%llu files written to %s\n", (long long unsigned)phc.nbr, phc.filename);
+}
+
+int phc_is_open(void)
+{
+  return (phc.handle!=NULL);
+}
+
+const char *phc_output_filename(const char *filename)
+{
+  if(phc.handle==NULL)
+    return filename;
+  return phc.spool;
+}
+
+void phc_set_disk_wait(void (*disk_wait)(void *), void *arg)
+{
+  phc.disk_wait=disk_wait;
+  phc.disk_wait_arg=arg;
+}
+
+#if defined(HAVE_FOPENCOOKIE) || defined(HAVE_FUNOPEN)
+/* The file data is the concatenation of the blocks of location with data */
+static size_t phc_cookie_read_disk(struct phc_cookie *cookie, unsigned char *buffer, const size_t size, const uint64_t pos)
+{
+  const struct td_list_head *tmp;
+  uint64_t file_offset=0;
+  size_t count=0;
+  if(phc.disk_wait!=NULL)
+    phc.disk_wait(phc.disk_wait_arg);
+  td_list_for_each(tmp, &cookie->file_recovery->location.list)
+  {
+    const alloc_list_t *element=td_list_entry_const(tmp, const alloc_list_t, list);
+    if(element->data>0)
+    {
+      const uint64_t len=element->end - element->start + 1;
+      if(pos + count < file_offset + len)
+      {
+	const uint64_t skip=pos + count - file_offset;
+	const unsigned int read_size=(size - count < len - skip ? size - count : len - skip);
+	if(cookie->disk->pread(cookie->disk, buffer + count, read_size, element->start + skip)!=(int)read_size)
+	  return count;
+	count+=read_size;
+	if(count==size)
+	  return count;
+      }
+      file_offset+=len;
+    }
+  }
+  return count;
+}
+
+static size_t phc_cookie_read_aux(struct phc_cookie *cookie, unsigned char *buffer, size_t size)
+{
+  uint64_t data_size;
+  const unsigned char *data=file_data_get(cookie->file_recovery, &data_size);
+  size_t count=0;
+  if(cookie->pos >= cookie->size)
+    return 0;
+  if(size > cookie->size - cookie->pos)
+    size=cookie->size - cookie->pos;
+  if(data!=NULL && cookie->pos < data_size)
+  {
+    count=(data_size - cookie->pos < size ? data_size - cookie->pos : size);
+    memcpy(buffer, data + cookie->pos, count);
+  }
+  if(count < size)
+  {
+    if(cookie->container)
+    {
+      if(phc_seek(phc.handle, cookie->base + cookie->pos + count, SEEK_SET)==0)
+	count+=fread(buffer + count, 1, size - count, phc.handle);
+    }
+    else
+      count+=phc_cookie_read_disk(cookie, buffer + count, size - count, cookie->pos + count);
+  }
+  cookie->pos+=count;
+  return count;
+}
+
+/* Without container, the data is only counted */
+static ssize_t phc_cookie_write_aux(struct phc_cookie *cookie, const char *buffer, const size_t size)
+{
+  if(cookie->container && cookie->done==0)
+  {
+    if(phc_seek(phc.handle, cookie->base + cookie->pos, SEEK_SET)!=0 ||
+	fwrite(buffer, size, 1, phc.handle)!=1)
+    {
+      cookie->error=1;
+      return -1;
+    }
+  }
+  cookie->pos+=size;
+  if(cookie->size < cookie->pos)
+    cookie->size=cookie->pos;
+  return size;
+}
+
+static int phc_cookie_seek_aux(struct phc_cookie *cookie, int64_t *offset, const int whence)
+{
+  int64_t pos;
+  switch(whence)
+  {
+    case SEEK_SET:
+      pos=*offset;
+      break;
+    case SEEK_CUR:
+      pos=cookie->pos + *offset;
+      break;
+    case SEEK_END:
+      pos=cookie->size + *offset;
+      break;
+    default:
+      return -1;
+  }
+  if(pos < 0)
+    return -1;
+  cookie->pos=pos;
+  *offset=pos;
+  return 0;
+}
+
+static int phc_cookie_close(void *cookie)
+{
+  if(phc.active==cookie)
+  {
+    /* Rejected file, the next file is written at the same place */
+    phc.active=NULL;
+    phc.active_handle=NULL;
+  }
+  free(cookie);
+  return 0;
+}
+
+#ifdef HAVE_FOPENCOOKIE
+static ssize_t phc_cookie_read(void *cookie, char *buffer, size_t size)
+{
+  return phc_cookie_read_aux((struct phc_cookie *)cookie, (unsigned char *)buffer, size);
+}
+
+static ssize_t phc_cookie_write(void *cookie, const char *buffer, size_t size)
+{
+  return phc_cookie_write_aux((struct phc_cookie *)cookie, buffer, size);
+}
+
+static int phc_cookie_seek(void *cookie, off64_t *offset, int whence)
+{
+  int64_t pos=*offset;
+  if(phc_cookie_seek_aux((struct phc_cookie *)cookie, &pos, whence) < 0)
+    return -1;
+  *offset=pos;
+  return 0;
+}
+#else
+static int phc_cookie_read(void *cookie, char *buffer, int size)
+{
+  return phc_cookie_read_aux((struct phc_cookie *)cookie, (unsigned char *)buffer, size);
+}
+
+static int phc_cookie_write(void *cookie, const char *buffer, int size)
+{
+  return phc_cookie_write_aux((struct phc_cookie *)cookie, buffer, size);
+}
+
+static fpos_t phc_cookie_seek(void *cookie, fpos_t offset, int whence)
+{
+  int64_t pos=offset;
+  if(phc_cookie_seek_aux((struct phc_cookie *)cookie, &pos, whence) < 0)
+    return -1;
+  return pos;
+}
+#endif
+#endif
+
+FILE *phc_fopen(file_recovery_t *file_recovery, disk_t *disk)
+{
+#if defined(HAVE_FOPENCOOKIE) || defined(HAVE_FUNOPEN)
+  struct phc_cookie *cookie;
+  FILE *handle;
+  /* Only one file at a time can be written in the container */
+  if(phc.handle==NULL || (phc.nodata==0 && phc.active!=NULL))
+    return NULL;
+  cookie=(struct phc_cookie *)MALLOC(sizeof(*cookie));
+  cookie->file_recovery=file_recovery;
+  cookie->disk=disk;
+  cookie->size=0;
+  cookie->pos=0;
+  cookie->container=(phc.nodata==0);
+  cookie->base=phc.offset;
+  cookie->error=0;
+  cookie->done=0;
+#ifdef HAVE_FOPENCOOKIE
+  {
+    cookie_io_functions_t io_functions={
+      .read=phc_cookie_read,
+      .write=phc_cookie_write,
+      .seek=phc_cookie_seek,
+      .close=phc_cookie_close
+    };
+    handle=fopencookie(cookie, "w+", io_functions);
+  }
+#else
+  handle=funopen(cookie, phc_cookie_read, phc_cookie_write, phc_cookie_seek, phc_cookie_close);
+#endif
+  if(handle==NULL)
+  {
+    free(cookie);
+    return NULL;
+  }
+  if(cookie->container)
+  {
+    setvbuf(handle, NULL, _IOFBF, PHWRITE_BUFFER_SIZE);
+    phc.active=cookie;
+    phc.active_handle=handle;
+  }
+  return handle;
+#else
+  return NULL;
+#endif
+}
+
+static const char *phc_basename(const char *filename)
+{
+  const char *name=strrchr(filename, '/');
+  return (name==NULL ? filename : name + 1);
+}
+
+/* Build the entry record of the file being recovered, the data starting
+ * at data_offset has already been written */
+static unsigned char *phc_entry_record(const file_recovery_t *file_recovery, const uint64_t data_offset, unsigned int *record_size)
+{
+  const char *name=phc_basename(file_recovery->filename);
+  const char *ext=(file_recovery->extension!=NULL ? file_recovery->extension : "");
+  const unsigned int name_len=strlen(name);
+  const unsigned int ext_len=strlen(ext);
+  unsigned int nbr_runs=0;
+  unsigned int size;
+  unsigned char *record;
+  unsigned char *p;
+  struct td_list_head *tmp;
+  uint64_t file_size=0;
+  td_list_for_each(tmp, &file_recovery->location.list)
+  {
+    const alloc_list_t *element=td_list_entry_const(tmp, const alloc_list_t, list);
+    if(element->data>0)
+      nbr_runs++;
+  }
+  size=PHC_ENTRY_SIZE + name_len + ext_len + nbr_runs * PHC_RUN_SIZE + PHC_FOOTER_SIZE;
+  record=(unsigned char *)MALLOC(size);
+  memcpy(&record[0], PHC_ENTRY_MAGIC, 4);
+  phc_put16(&record[4], name_len);
+  phc_put16(&record[6], ext_len);
+  phc_put64(&record[8], (phc.nodata ? 0 : data_offset));
+  phc_put64(&record[16], file_recovery->file_size);
+  phc_put64(&record[24], (file_recovery->time==(time_t)-1 ? 0 : (uint64_t)file_recovery->time));
+  phc_put32(&record[32], nbr_runs);
+  phc_put32(&record[36], (phc.nodata ? PHC_ENTRY_NODATA : 0));
+  p=&record[PHC_ENTRY_SIZE];
+  memcpy(p, name, name_len);
+  p+=name_len;
+  memcpy(p, ext, ext_len);
+  p+=ext_len;
+  /* Same byte runs as xml_log_file_recovered() */
+  td_list_for_each(tmp, &file_recovery->location.list)
+  {
+    const alloc_list_t *element=td_list_entry_const(tmp, const alloc_list_t, list);
+    if(element->data>0)
+    {
+      const uint64_t len=element->end - element->start + 1;
+      phc_put64(&p[0], file_size);
+      phc_put64(&p[8], element->start);
+      phc_put64(&p[16], len);
+      p+=PHC_RUN_SIZE;
+      file_size+=len;
+    }
+  }
+  memcpy(p, PHC_FOOTER_MAGIC, 4);
+  phc_put32(p + 4, size);
+  *record_size=size;
+  return record;
+}
+
+/* Copy the data from the spool file to the container at phc.offset */
+static int phc_copy(FILE *handle, uint64_t size)
+{
+  if(fflush(handle)!=0 || phc_seek(handle, 0, SEEK_SET)!=0 ||
+      phc_seek(phc.handle, phc.offset, SEEK_SET)!=0)
+    return -1;
+  while(size > 0)
+  {
+    const size_t len=(size < PHC_BUFFER_SIZE ? size : PHC_BUFFER_SIZE);
+    if(fread(phc.buffer, len, 1, handle)!=1 ||
+	fwrite(phc.buffer, len, 1, phc.handle)!=1)
+      return -1;
+    size-=len;
+  }
+  return 0;
+}
+
+int phc_add(file_recovery_t *file_recovery)
+{
+  FILE *handle=file_recovery->handle;
+  const uint64_t data_offset=phc.offset;
+  uint64_t record_offset=phc.offset;
+  int res=-1;
+  file_recovery->handle=NULL;
+  if(phc.handle==NULL)
+  {
+    fclose(handle);
+    return -1;
+  }
+  if(phc.nodata)
+    res=0;
+#if defined(HAVE_FOPENCOOKIE) || defined(HAVE_FUNOPEN)
+  else if(handle==phc.active_handle)
+  {
+    /* The data has been written in place, the record follows it */
+    struct phc_cookie *cookie=phc.active;
+    if(fflush(handle)==0 && cookie->error==0 && cookie->size >= file_recovery->file_size)
+      res=0;
+    cookie->done=1;
+  }
+#endif
+  else
+    res=phc_copy(handle, file_recovery->file_size);
+  if(res==0 && phc.nodata==0)
+    record_offset=data_offset + file_recovery->file_size;
+  if(res==0)
+  {
+    unsigned int record_size;
+    unsigned char *record=phc_entry_record(file_recovery, data_offset, &record_size);
+    if(phc_seek(phc.handle, record_offset, SEEK_SET)!=0 ||
+	fwrite(record, record_size, 1, phc.handle)!=1)
+      res=-1;
+    /* Only the complete files are listed in the index */
+    if(res==0)
+    {
+      phc.offset=record_offset + record_size;
+      phc.nbr++;
+      if(phc.index!=NULL && fwrite(record, record_size, 1, phc.index)!=1)
+      {
+	log_warning("Cannot write the index of %s\n", phc.filename);
+	fclose(phc.index);
+	phc.index=NULL;
+      }
+    }
+    free(record);
+  }
+  if(res < 0)
+  {
+    log_critical("Cannot write %s to %s: %s\n", file_recovery->filename, phc.filename, strerror(errno));
+    /* Don't leave a partial entry, the next entry starts at phc.offset */
+    phc_truncate();
+  }
+  fclose(handle);
+  return res;
+}
@@ -0,0 +1,138 @@
+/*
+
+    File: phcontainer.h
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+#ifndef _PHCONTAINER_H
+#define _PHCONTAINER_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* PhotoRec container: the recovered files are appended to a single file
+ *   header   PHC_MAGIC
+ *   entries  the file data immediately followed by its entry record
+ *   index    a copy of all the entry records
+ *   trailer  index offset (8 bytes), number of entries (8 bytes), PHC_INDEX_MAGIC
+ * Entry record, 40 bytes followed by the name, the extension, the byte runs
+ * and a footer:
+ *   "PHCE", name length (2 bytes), extension length (2 bytes),
+ *   data offset in the container (8 bytes), file size (8 bytes),
+ *   modification time (8 bytes, 0 if unknown), number of byte runs (4 bytes),
+ *   flags (4 bytes)
+ * The data offset points back to the data written before the record.
+ * With PHC_ENTRY_NODATA, the data isn't stored in the container (data
+ * offset is 0), it can be read from the original image using the byte runs.
+ * Byte run, same as in the DFXML report:
+ *   offset in the file (8 bytes), offset in the image (8 bytes), length (8 bytes)
+ * Footer: "PHCR", size of the whole record (4 bytes)
+ * All integers are little-endian. The index and the trailer are written by
+ * phc_close(), without them the records are found from the end of the
+ * container using the footers. */
+#define PHC_MAGIC		"PHCNTNR1"
+#define PHC_INDEX_MAGIC		"PHCINDEX"
+#define PHC_ENTRY_MAGIC		"PHCE"
+#define PHC_HEADER_SIZE		8
+#define PHC_ENTRY_SIZE		40
+#define PHC_RUN_SIZE		24
+#define PHC_TRAILER_SIZE	24
+#define PHC_FOOTER_MAGIC	"PHCR"
+#define PHC_FOOTER_SIZE		8
+#define PHC_FILENAME		"photorec.phc"
+#define PHC_ENTRY_NODATA	1
+
+struct phc_run
+{
+  uint64_t offset;
+  uint64_t img_offset;
+  uint64_t len;
+};
+
+struct phc_entry
+{
+  uint64_t data_offset;
+  uint64_t size;
+  time_t time;
+  char name[256];
+  char extension[32];
+  unsigned int nbr_runs;
+  unsigned int flags;
+  /* Valid until the next call to phc_reader_next() */
+  const struct phc_run *runs;
+};
+
+struct phc_reader
+{
+  FILE *handle;
+  /* Original image, to read the PHC_ENTRY_NODATA entries */
+  FILE *image;
+  uint64_t offset;
+  /* Number of entries left in the index, -1 if the index is missing */
+  int64_t nbr;
+  /* Without index, offset of the records found from the end */
+  uint64_t *records;
+  unsigned int nbr_records;
+  unsigned int current;
+  struct phc_run *runs;
+  unsigned int runs_alloc;
+};
+
+/* Create recup_dir.dir_num/photorec.phc, the next recovered files are
+ * written to this container until phc_close().
+ * If nodata is set, only the location of the files is recorded. */
+int phc_open(const char *recup_dir, const unsigned int dir_num, const int nodata);
+/* Write the index and close the container */
+void phc_close(void);
+int phc_is_open(void);
+
+/* Name of the file to create to recover a file: a spool file that is
+ * reused for each file when the container is open, filename otherwise */
+const char *phc_output_filename(const char *filename);
+
+/* Return a handle writing the file directly in the container after the
+ * previous file, or, when only the location of the files is recorded, a
+ * handle that doesn't store the data: it's read back from the copy in
+ * memory kept by file_data_write() or from disk.
+ * NULL if not supported, phc_output_filename() must be used instead. */
+FILE *phc_fopen(file_recovery_t *file_recovery, disk_t *disk);
+/* disk_wait(arg) is called before reading disk from the calling thread */
+void phc_set_disk_wait(void (*disk_wait)(void *), void *arg);
+
+/* Append the file being recovered to the container and close its handle.
+ * file_recovery->location must already be truncated to the file size. */
+int phc_add(file_recovery_t *file_recovery);
+
+/* Reader, see phcread.c */
+
+/* Read a container, return -1 if filename isn't a container */
+int phc_reader_open(struct phc_reader *reader, const char *filename);
+/* Return 1 and fill entry, 0 at the end of the container */
+int phc_reader_next(struct phc_reader *reader, struct phc_entry *entry);
+/* Read the PHC_ENTRY_NODATA entries from this image */
+int phc_reader_set_image(struct phc_reader *reader, const char *filename);
+/* Read up to size bytes of the file data starting at offset */
+size_t phc_reader_read(struct phc_reader *reader, const struct phc_entry *entry, const uint64_t offset, void *buffer, const size_t size);
+/* Copy the file data to handle */
+int phc_reader_copy(struct phc_reader *reader, const struct phc_entry *entry, FILE *handle);
+void phc_reader_close(struct phc_reader *reader);
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+#endif
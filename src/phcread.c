@@ -0,0 +1,350 @@
+/*
+
+    File: phcread.c
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+#include "types.h"
+#include "common.h"
+#include "filegen.h"
+#include "phcontainer.h"
+
+#define PHC_BUFFER_SIZE	(1024*1024)
+
+static unsigned int phc_get16(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t phc_get32(const unsigned char *p)
+{
+  return phc_get16(p) | ((uint32_t)phc_get16(p + 2) << 16);
+}
+
+static uint64_t phc_get64(const unsigned char *p)
+{
+  return phc_get32(p) | ((uint64_t)phc_get32(p + 4) << 32);
+}
+
+static int phc_seek(FILE *handle, const uint64_t offset, const int whence)
+{
+#ifdef HAVE_FSEEKO
+  return fseeko(handle, offset, whence);
+#else
+  return fseek(handle, offset, whence);
+#endif
+}
+
+static uint64_t phc_tell(FILE *handle)
+{
+#ifdef HAVE_FTELLO
+  return ftello(handle);
+#else
+  return ftell(handle);
+#endif
+}
+
+/* Check the record ending at end, return the offset where the previous
+ * entry ends or 0 if it isn't a valid record */
+static uint64_t phc_reader_check(struct phc_reader *reader, const uint64_t end)
+{
+  unsigned char buffer[PHC_ENTRY_SIZE];
+  uint64_t start;
+  uint64_t data_offset;
+  uint64_t size;
+  uint32_t len;
+  if(end < PHC_HEADER_SIZE + PHC_ENTRY_SIZE + PHC_FOOTER_SIZE)
+    return 0;
+  if(phc_seek(reader->handle, end - PHC_FOOTER_SIZE, SEEK_SET)!=0 ||
+      fread(buffer, PHC_FOOTER_SIZE, 1, reader->handle)!=1 ||
+      memcmp(buffer, PHC_FOOTER_MAGIC, 4)!=0)
+    return 0;
+  len=phc_get32(&buffer[4]);
+  if(len < PHC_ENTRY_SIZE + PHC_FOOTER_SIZE || len > end - PHC_HEADER_SIZE)
+    return 0;
+  start=end - len;
+  if(phc_seek(reader->handle, start, SEEK_SET)!=0 ||
+      fread(buffer, PHC_ENTRY_SIZE, 1, reader->handle)!=1 ||
+      memcmp(buffer, PHC_ENTRY_MAGIC, 4)!=0)
+    return 0;
+  if((uint64_t)PHC_ENTRY_SIZE + phc_get16(&buffer[4]) + phc_get16(&buffer[6]) +
+      (uint64_t)phc_get32(&buffer[32]) * PHC_RUN_SIZE + PHC_FOOTER_SIZE != len)
+    return 0;
+  data_offset=phc_get64(&buffer[8]);
+  size=phc_get64(&buffer[16]);
+  if((phc_get32(&buffer[36]) & PHC_ENTRY_NODATA)!=0)
+    return (data_offset==0 ? start : 0);
+  if(data_offset < PHC_HEADER_SIZE || data_offset > start || start - data_offset != size)
+    return 0;
+  return data_offset;
+}
+
+/* Without index, find the records from the end of the container using
+ * the footers. The data of an unfinished file may follow the last record. */
+static void phc_reader_scan(struct phc_reader *reader)
+{
+  unsigned char *buffer=(unsigned char *)MALLOC(PHC_BUFFER_SIZE);
+  unsigned int records_alloc=0;
+  uint64_t end;
+  unsigned int i;
+  if(phc_seek(reader->handle, 0, SEEK_END)!=0)
+  {
+    free(buffer);
+    return ;
+  }
+  end=phc_tell(reader->handle);
+  while(end > PHC_HEADER_SIZE)
+  {
+    uint64_t prev=phc_reader_check(reader, end);
+    if(prev==0)
+    {
+      /* Search the last footer before end */
+      uint64_t pos=end;
+      uint64_t found=0;
+      while(found==0 && pos > PHC_HEADER_SIZE)
+      {
+	const uint64_t chunk_start=(pos - PHC_HEADER_SIZE > PHC_BUFFER_SIZE ? pos - PHC_BUFFER_SIZE : PHC_HEADER_SIZE);
+	const size_t len=pos - chunk_start;
+	size_t j;
+	if(phc_seek(reader->handle, chunk_start, SEEK_SET)!=0 ||
+	    fread(buffer, len, 1, reader->handle)!=1)
+	  break;
+	for(j=len; j >= 4 && found==0; j--)
+	{
+	  /* A footer starting at chunk_start+j-4 ends 4 bytes later */
+	  if(memcmp(&buffer[j - 4], PHC_FOOTER_MAGIC, 4)==0 &&
+	      chunk_start + j + 4 < end &&
+	      (prev=phc_reader_check(reader, chunk_start + j + 4))!=0)
+	    found=chunk_start + j + 4;
+	}
+	/* Keep 3 bytes of overlap for a magic across two chunks */
+	pos=(chunk_start > PHC_HEADER_SIZE ? chunk_start + 3 : chunk_start);
+      }
+      if(found==0)
+	break;
+      end=found;
+    }
+    if(reader->nbr_records >= records_alloc)
+    {
+      records_alloc=(records_alloc==0 ? 1024 : records_alloc * 2);
+      reader->records=(uint64_t *)realloc(reader->records, records_alloc * sizeof(uint64_t));
+      if(reader->records==NULL)
+      {
+	reader->nbr_records=0;
+	break;
+      }
+    }
+    /* Start of the record */
+    phc_seek(reader->handle, end - PHC_FOOTER_SIZE + 4, SEEK_SET);
+    if(fread(buffer, 4, 1, reader->handle)!=1)
+      break;
+    reader->records[reader->nbr_records++]=end - phc_get32(buffer);
+    end=prev;
+  }
+  free(buffer);
+  /* Found from the last one */
+  for(i=0; i < reader->nbr_records / 2; i++)
+  {
+    const uint64_t tmp=reader->records[i];
+    reader->records[i]=reader->records[reader->nbr_records - 1 - i];
+    reader->records[reader->nbr_records - 1 - i]=tmp;
+  }
+}
+
+int phc_reader_open(struct phc_reader *reader, const char *filename)
+{
+  unsigned char buffer[PHC_TRAILER_SIZE];
+  reader->runs=NULL;
+  reader->runs_alloc=0;
+  reader->records=NULL;
+  reader->nbr_records=0;
+  reader->current=0;
+  reader->image=NULL;
+  reader->handle=fopen(filename, "rb");
+  if(reader->handle==NULL)
+    return -1;
+  if(fread(buffer, PHC_HEADER_SIZE, 1, reader->handle)!=1 ||
+      memcmp(buffer, PHC_MAGIC, PHC_HEADER_SIZE)!=0)
+  {
+    fclose(reader->handle);
+    reader->handle=NULL;
+    return -1;
+  }
+  reader->offset=PHC_HEADER_SIZE;
+  reader->nbr=-1;
+  /* Use the index if the container has been closed properly */
+  if(phc_seek(reader->handle, -PHC_TRAILER_SIZE, SEEK_END)==0 &&
+      fread(buffer, PHC_TRAILER_SIZE, 1, reader->handle)==1 &&
+      memcmp(&buffer[16], PHC_INDEX_MAGIC, 8)==0)
+  {
+    reader->offset=phc_get64(&buffer[0]);
+    reader->nbr=phc_get64(&buffer[8]);
+  }
+  else
+    phc_reader_scan(reader);
+  return 0;
+}
+
+int phc_reader_next(struct phc_reader *reader, struct phc_entry *entry)
+{
+  unsigned char buffer[PHC_ENTRY_SIZE];
+  unsigned int name_len;
+  unsigned int ext_len;
+  unsigned int i;
+  if(reader->nbr==0)
+    return 0;
+  if(reader->nbr < 0)
+  {
+    if(reader->current >= reader->nbr_records)
+      return 0;
+    reader->offset=reader->records[reader->current++];
+  }
+  if(phc_seek(reader->handle, reader->offset, SEEK_SET)!=0 ||
+      fread(buffer, PHC_ENTRY_SIZE, 1, reader->handle)!=1 ||
+      memcmp(buffer, PHC_ENTRY_MAGIC, 4)!=0)
+    return 0;
+  name_len=phc_get16(&buffer[4]);
+  ext_len=phc_get16(&buffer[6]);
+  entry->data_offset=phc_get64(&buffer[8]);
+  entry->size=phc_get64(&buffer[16]);
+  entry->time=(time_t)phc_get64(&buffer[24]);
+  entry->nbr_runs=phc_get32(&buffer[32]);
+  entry->flags=phc_get32(&buffer[36]);
+  if(name_len >= sizeof(entry->name) || ext_len >= sizeof(entry->extension))
+    return 0;
+  if(fread(entry->name, 1, name_len, reader->handle)!=name_len ||
+      fread(entry->extension, 1, ext_len, reader->handle)!=ext_len)
+    return 0;
+  entry->name[name_len]='\0';
+  entry->extension[ext_len]='\0';
+  if(entry->nbr_runs > reader->runs_alloc)
+  {
+    free(reader->runs);
+    reader->runs_alloc=entry->nbr_runs;
+    reader->runs=(struct phc_run *)MALLOC(reader->runs_alloc * sizeof(struct phc_run));
+  }
+  for(i=0; i<entry->nbr_runs; i++)
+  {
+    unsigned char run[PHC_RUN_SIZE];
+    if(fread(run, PHC_RUN_SIZE, 1, reader->handle)!=1)
+      return 0;
+    reader->runs[i].offset=phc_get64(&run[0]);
+    reader->runs[i].img_offset=phc_get64(&run[8]);
+    reader->runs[i].len=phc_get64(&run[16]);
+  }
+  entry->runs=reader->runs;
+  if(reader->nbr > 0)
+  {
+    /* The next record follows in the index */
+    reader->offset=phc_tell(reader->handle) + PHC_FOOTER_SIZE;
+    reader->nbr--;
+  }
+  return 1;
+}
+
+int phc_reader_set_image(struct phc_reader *reader, const char *filename)
+{
+  if(reader->image!=NULL)
+    fclose(reader->image);
+  reader->image=fopen(filename, "rb");
+  return (reader->image==NULL ? -1 : 0);
+}
+
+/* Read the data of a PHC_ENTRY_NODATA entry from the byte runs */
+static size_t phc_reader_read_image(struct phc_reader *reader, const struct phc_entry *entry, const uint64_t offset, unsigned char *buffer, const size_t size)
+{
+  size_t count=0;
+  unsigned int i;
+  if(reader->image==NULL)
+    return 0;
+  for(i=0; i<entry->nbr_runs && count < size; i++)
+  {
+    const struct phc_run *run=&entry->runs[i];
+    if(offset + count >= run->offset && offset + count < run->offset + run->len)
+    {
+      const uint64_t skip=offset + count - run->offset;
+      const size_t len=(size - count < run->len - skip ? size - count : run->len - skip);
+      if(phc_seek(reader->image, run->img_offset + skip, SEEK_SET)!=0 ||
+	  fread(buffer + count, 1, len, reader->image)!=len)
+	return count;
+      count+=len;
+    }
+  }
+  return count;
+}
+
+size_t phc_reader_read(struct phc_reader *reader, const struct phc_entry *entry, const uint64_t offset, void *buffer, const size_t size)
+{
+  size_t len=size;
+  if(offset >= entry->size)
+    return 0;
+  if(len > entry->size - offset)
+    len=entry->size - offset;
+  if((entry->flags & PHC_ENTRY_NODATA)!=0)
+    return phc_reader_read_image(reader, entry, offset, (unsigned char *)buffer, len);
+  if(phc_seek(reader->handle, entry->data_offset + offset, SEEK_SET)!=0)
+    return 0;
+  return fread(buffer, 1, len, reader->handle);
+}
+
+int phc_reader_copy(struct phc_reader *reader, const struct phc_entry *entry, FILE *handle)
+{
+  unsigned char *buffer=(unsigned char *)MALLOC(PHC_BUFFER_SIZE);
+  uint64_t offset;
+  int res=0;
+  for(offset=0; offset < entry->size && res==0; )
+  {
+    const size_t len=phc_reader_read(reader, entry, offset, buffer, PHC_BUFFER_SIZE);
+    if(len==0 || fwrite(buffer, len, 1, handle)!=1)
+      res=-1;
+    offset+=len;
+  }
+  free(buffer);
+  return res;
+}
+
+void phc_reader_close(struct phc_reader *reader)
+{
+  if(reader->handle!=NULL)
+    fclose(reader->handle);
+  reader->handle=NULL;
+  if(reader->image!=NULL)
+    fclose(reader->image);
+  reader->image=NULL;
+  free(reader->runs);
+  reader->runs=NULL;
+  reader->runs_alloc=0;
+  free(reader->records);
+  reader->records=NULL;
+  reader->nbr_records=0;
+}
@@ -0,0 +1,288 @@
+/*
+
+    File: phhash.c
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include <errno.h>
+#include "types.h"
+#include "common.h"
+#include "filegen.h"
+#include "log.h"
+#include "digest.h"
+#include "phhash.h"
+
+static struct
+{
+  unsigned int hash;
+  FILE *csv;
+  /* File being hashed */
+  const file_recovery_t *owner;
+  int valid;
+  uint64_t hashed;
+  unsigned char *pending;
+  unsigned int pending_size;
+  struct md5_ctx md5;
+  struct sha1_ctx sha1;
+  struct sha256_ctx sha256;
+  /* Result of phhash_final() */
+  const file_recovery_t *done;
+  char md5_hex[2*MD5_DIGEST_SIZE+1];
+  char sha1_hex[2*SHA1_DIGEST_SIZE+1];
+  char sha256_hex[2*SHA256_DIGEST_SIZE+1];
+  unsigned int nbr_files;
+  unsigned int nbr_read;
+} phhash;
+
+static void phhash_reset(void)
+{
+  phhash.hashed=0;
+  phhash.pending_size=0;
+  md5_init(&phhash.md5);
+  sha1_init(&phhash.sha1);
+  sha256_init(&phhash.sha256);
+}
+
+static void phhash_update(const unsigned char *buffer, const unsigned int size)
+{
+  if((phhash.hash & PHHASH_MD5)!=0)
+    md5_update(&phhash.md5, buffer, size);
+  if((phhash.hash & PHHASH_SHA1)!=0)
+    sha1_update(&phhash.sha1, buffer, size);
+  if((phhash.hash & PHHASH_SHA256)!=0)
+    sha256_update(&phhash.sha256, buffer, size);
+  phhash.hashed+=size;
+}
+
+static void phhash_write(const file_recovery_t *file_recovery, const void *buffer, const unsigned int size, const uint64_t offset)
+{
+  const unsigned char *data=(const unsigned char *)buffer;
+  unsigned int len=size;
+  if(offset==0)
+  {
+    phhash.owner=file_recovery;
+    phhash.valid=1;
+    phhash_reset();
+  }
+  if(phhash.owner!=file_recovery || phhash.valid==0)
+    return ;
+  /* The brute force rewrites the end of the file, the data already hashed *
+   * can't be changed, phhash_final() will read the file back */
+  if(offset < phhash.hashed || offset > phhash.hashed + phhash.pending_size)
+  {
+    phhash.valid=0;
+    return ;
+  }
+  phhash.pending_size=offset - phhash.hashed;
+  while(len > 0)
+  {
+    unsigned int n;
+    if(phhash.pending_size==PHHASH_BUFFER_SIZE)
+    {
+      phhash_update(phhash.pending, PHHASH_BUFFER_SIZE - PHHASH_LAG);
+      memmove(phhash.pending, phhash.pending + PHHASH_BUFFER_SIZE - PHHASH_LAG, PHHASH_LAG);
+      phhash.pending_size=PHHASH_LAG;
+    }
+    n=(len < PHHASH_BUFFER_SIZE - phhash.pending_size ? len : PHHASH_BUFFER_SIZE - phhash.pending_size);
+    memcpy(phhash.pending + phhash.pending_size, data, n);
+    phhash.pending_size+=n;
+    data+=n;
+    len-=n;
+  }
+}
+
+int phhash_open(const char *recup_dir, const unsigned int dir_num, const unsigned int hash, const int csv)
+{
+  phhash.hash=hash & PHHASH_ALL;
+  phhash.owner=NULL;
+  phhash.done=NULL;
+  phhash.nbr_files=0;
+  phhash.nbr_read=0;
+  if(phhash.hash==0)
+    return 0;
+  if(phhash.pending==NULL)
+    phhash.pending=(unsigned char *)MALLOC(PHHASH_BUFFER_SIZE);
+  if(csv)
+  {
+    char filename[2048];
+    unsigned int i;
+    snprintf(filename, sizeof(filename), "%s.%u/%s", recup_dir, dir_num, PHHASH_FILENAME);
+    phhash.csv=fopen(filename, "w");
+    if(phhash.csv==NULL)
+    {
+      log_error("Cannot create %s: %s\n", filename, strerror(errno));
+    }
+    else
+    {
+      fprintf(phhash.csv, "filename,size");
+      for(i=PHHASH_MD5; i<=PHHASH_SHA256; i<<=1)
+	if((phhash.hash & i)!=0)
+	  fprintf(phhash.csv, ",%s", phhash_name(i));
+      fprintf(phhash.csv, "\n");
+    }
+  }
+  file_data_set_hook(phhash_write);
+  return 0;
+}
+
+void phhash_close(void)
+{
+  if(phhash.hash==0)
+    return ;
+  file_data_set_hook(NULL);
+  if(phhash.csv!=NULL)
+  {
+    fclose(phhash.csv);
+    phhash.csv=NULL;
+  }
+  free(phhash.pending);
+  phhash.pending=NULL;
+  log_info("Hashes: %u files, %u read back\n", phhash.nbr_files, phhash.nbr_read);
+  phhash.hash=0;
+}
+
+static void phhash_hex(char *dst, const unsigned char *digest, const unsigned int size)
+{
+  static const char hex[]="0123456789abcdef";
+  unsigned int i;
+  for(i=0; i<size; i++)
+  {
+    dst[2*i]=hex[digest[i]>>4];
+    dst[2*i+1]=hex[digest[i]&0x0f];
+  }
+  dst[2*size]='\0';
+}
+
+void phhash_final(const file_recovery_t *file_recovery)
+{
+  const uint64_t file_size=file_recovery->file_size;
+  unsigned char digest[SHA256_DIGEST_SIZE];
+  phhash.done=NULL;
+  if(phhash.hash==0)
+    return ;
+  if(phhash.owner==file_recovery && phhash.valid!=0 &&
+      phhash.hashed <= file_size && file_size <= phhash.hashed + phhash.pending_size)
+  {
+    phhash_update(phhash.pending, file_size - phhash.hashed);
+  }
+  else
+  {
+    /* Truncated before the data kept in pending or not written by    *
+     * file_data_write(), read the file back, from memory if possible */
+    uint64_t offset;
+    phhash_reset();
+    for(offset=0; offset < file_size; )
+    {
+      const unsigned int size=(file_size - offset < PHHASH_BUFFER_SIZE ? file_size - offset : PHHASH_BUFFER_SIZE);
+      if(file_data_read(file_recovery, phhash.pending, size, offset)!=(int)size)
+      {
+	log_error("%s: cannot read the file to hash it\n", file_recovery->filename);
+	phhash.owner=NULL;
+	return ;
+      }
+      phhash_update(phhash.pending, size);
+      offset+=size;
+    }
+    phhash.nbr_read++;
+  }
+  if((phhash.hash & PHHASH_MD5)!=0)
+  {
+    md5_final(&phhash.md5, digest);
+    phhash_hex(phhash.md5_hex, digest, MD5_DIGEST_SIZE);
+  }
+  if((phhash.hash & PHHASH_SHA1)!=0)
+  {
+    sha1_final(&phhash.sha1, digest);
+    phhash_hex(phhash.sha1_hex, digest, SHA1_DIGEST_SIZE);
+  }
+  if((phhash.hash & PHHASH_SHA256)!=0)
+  {
+    sha256_final(&phhash.sha256, digest);
+    phhash_hex(phhash.sha256_hex, digest, SHA256_DIGEST_SIZE);
+  }
+  phhash.owner=NULL;
+  phhash.done=file_recovery;
+  phhash.nbr_files++;
+}
+
+const char *phhash_get(const file_recovery_t *file_recovery, const unsigned int hash)
+{
+  if(phhash.done!=file_recovery || (phhash.hash & hash)==0)
+    return NULL;
+  switch(hash)
+  {
+    case PHHASH_MD5:
+      return phhash.md5_hex;
+    case PHHASH_SHA1:
+      return phhash.sha1_hex;
+    case PHHASH_SHA256:
+      return phhash.sha256_hex;
+  }
+  return NULL;
+}
+
+const char *phhash_name(const unsigned int hash)
+{
+  switch(hash)
+  {
+    case PHHASH_MD5:
+      return "md5";
+    case PHHASH_SHA1:
+      return "sha1";
+    case PHHASH_SHA256:
+      return "sha256";
+  }
+  return "";
+}
+
+void phhash_log_file(const file_recovery_t *file_recovery)
+{
+  if(phhash.done!=file_recovery)
+    return ;
+  if(phhash.csv!=NULL)
+  {
+    const char *s;
+    unsigned int i;
+    /* The filename is quoted, quotes are doubled */
+    fputc('"', phhash.csv);
+    for(s=file_recovery->filename; *s!='\0'; s++)
+    {
+      if(*s=='"')
+	fputc('"', phhash.csv);
+      fputc(*s, phhash.csv);
+    }
+    fprintf(phhash.csv, "\",%llu", (long long unsigned)file_recovery->file_size);
+    for(i=PHHASH_MD5; i<=PHHASH_SHA256; i<<=1)
+      if((phhash.hash & i)!=0)
+	fprintf(phhash.csv, ",%s", phhash_get(file_recovery, i));
+    fprintf(phhash.csv, "\n");
+  }
+  phhash.done=NULL;
+}
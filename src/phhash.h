@@ -0,0 +1,58 @@
+/*
+
+    File: phhash.h
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+#ifndef _PHHASH_H
+#define _PHHASH_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PHHASH_MD5		1
+#define PHHASH_SHA1		2
+#define PHHASH_SHA256		4
+#define PHHASH_ALL		(PHHASH_MD5|PHHASH_SHA1|PHHASH_SHA256)
+#define PHHASH_FILENAME		"hashes.csv"
+/* The last PHHASH_LAG bytes written are hashed only once the file is
+ * complete, the end of the file is often truncated by the checks */
+#define PHHASH_BUFFER_SIZE	(1024*1024)
+#define PHHASH_LAG		(256*1024)
+
+/* Hash the recovered files while they are written by file_data_write().
+ * hash is a combination of PHHASH_MD5, PHHASH_SHA1 and PHHASH_SHA256.
+ * If csv is set, the hashes are also written to
+ * recup_dir.dir_num/PHHASH_FILENAME */
+int phhash_open(const char *recup_dir, const unsigned int dir_num, const unsigned int hash, const int csv);
+void phhash_close(void);
+
+/* Compute the hashes of the first file_size bytes of the file, its handle
+ * must still be open */
+void phhash_final(const file_recovery_t *file_recovery);
+/* Hexadecimal hash computed by phhash_final() or NULL */
+const char *phhash_get(const file_recovery_t *file_recovery, const unsigned int hash);
+/* Name of the hash, as used by DFXML hashdigest */
+const char *phhash_name(const unsigned int hash);
+/* Write the hashes of the file to the CSV file and forget them */
+void phhash_log_file(const file_recovery_t *file_recovery);
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+#endif
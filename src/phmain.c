@@ -99,11 +99,12 @@ static void sighup_hdlr(int sig)
 
 static void display_help(void)
 {
-  printf("\nUsage: photorec [/log] [/debug] [/d recup_dir] [file.dd|file.e01|device]\n"\
+  printf("\nUsage: photorec [/log] [/debug] [/cache size] [/d recup_dir] [file.dd|file.e01|device]\n"\
       "       photorec /version\n" \
       "\n" \
       "/log          : create a photorec.log file\n" \
       "/debug        : add debug information\n" \
+      "/cache size   : size of the disk cache in MiB (default 4)\n" \
       "\n" \
       "PhotoRec searches various file formats (JPEG, Office...), it stores them\n" \
       "in recup_dir directory.\n");
@@ -138,6 +139,10 @@ int main( int argc, char **argv )
     .mode_ext2=0,
     .expert=0,
     .lowmem=0,
+    .container=0,
+    .metadata=0,
+    .hash=0,
+    .hash_csv=0,
     .verbose=0,
     .list_file_format=list_file_enable
   };
@@ -205,6 +210,13 @@ int main( int argc, char **argv )
     }
     else if((strcmp(argv[i],"/all")==0) || (strcmp(argv[i],"-all")==0))
       testdisk_mode|=TESTDISK_O_ALL;
+    else if(((strcmp(argv[i],"/cache")==0)||(strcmp(argv[i],"-cache")==0)) &&(i+1<argc))
+    {
+      /* Size of the disk cache in MiB */
+      const int size=atoi(argv[++i]);
+      if(size > 0 && size <= 2048)
+	diskcache_set_size((unsigned int)size*1024*1024);
+    }
     else if((strcmp(argv[i],"/direct")==0) || (strcmp(argv[i],"-direct")==0))
       testdisk_mode|=TESTDISK_O_DIRECT;
     else if((strcmp(argv[i],"/help")==0) || (strcmp(argv[i],"-help")==0) || (strcmp(argv[i],"--help")==0) ||
@@ -361,6 +373,7 @@ int main( int argc, char **argv )
 #ifdef HAVE_NCURSES
   end_ncurses();
 #endif
+  delete_list_disk(list_disk);
   log_info("PhotoRec exited normally.\n");
   if(log_close()!=0)
   {
@@ -382,7 +395,6 @@ int main( int argc, char **argv )
     run_sudo(argc, argv);
   }
 #endif
-  delete_list_disk(list_disk);
   free(params.recup_dir);
 #ifdef ENABLE_DFXML
   xml_clear_command_line();
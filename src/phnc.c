@@ -39,6 +39,7 @@
 #include "filegen.h"
 #include "photorec.h"
 #include "phnc.h"
+#include "profile.h"
 
 void photorec_info(WINDOW *window, const file_stat_t *file_stats)
 {
@@ -115,6 +116,13 @@ pstatus_t photorec_progressbar(WINDOW *window, const unsigned int pass, const st
     }
   }
   photorec_info(window, params->file_stats);
+  {
+    char summary[80];
+    prof_summary(summary, sizeof(summary));
+    wmove(window,22,10);
+    wclrtoeol(window);
+    wprintw(window, "%s", summary);
+  }
   wrefresh(window);
   return(check_enter_key_or_s(window)==0?PSTATUS_OK:PSTATUS_STOP);
 }
@@ -52,8 +52,13 @@
 #include "fatp.h"
 #include "ntfsp.h"
 #include "log.h"
-#include "setdate.h"
 #include "dfxml.h"
+#include "profile.h"
+#include "phwrite.h"
+#include "phcontainer.h"
+#include "rescuemap.h"
+#include "phpool.h"
+#include "phhash.h"
 
 /* #define DEBUG_FILE_FINISH */
 /* #define DEBUG_UPDATE_SEARCH_SPACE */
@@ -63,6 +68,139 @@ static void update_search_space_aux(alloc_data_t *list_search_space, uint64_t st
 static void file_block_truncate_zero(const file_recovery_t *file_recovery, alloc_data_t *list_search_space);
 static void file_block_truncate(const file_recovery_t *file_recovery, alloc_data_t *list_search_space, const unsigned int blocksize);
 
+/* The search space is a sorted list of disjoint ranges. A treap sharing the *
+ * same order is used to find the range containing an offset in O(log n).  *
+ * The list head is the tree sentinel: the root is list_search_space->left. *
+ * The tree is built on first use if the list has been filled directly.     */
+static unsigned int search_space_priority(void)
+{
+  static uint32_t seed=2463534242U;
+  seed^=seed<<13;
+  seed^=seed>>17;
+  seed^=seed<<5;
+  return seed;
+}
+
+static void search_space_rotate_up(alloc_data_t *node)
+{
+  alloc_data_t *parent=node->parent;
+  alloc_data_t *grand_parent=parent->parent;
+  if(parent->left==node)
+  {
+    parent->left=node->right;
+    if(node->right!=NULL)
+      node->right->parent=parent;
+    node->right=parent;
+  }
+  else
+  {
+    parent->right=node->left;
+    if(node->left!=NULL)
+      node->left->parent=parent;
+    node->left=parent;
+  }
+  parent->parent=node;
+  node->parent=grand_parent;
+  if(grand_parent->left==parent)
+    grand_parent->left=node;
+  else
+    grand_parent->right=node;
+}
+
+static void search_space_tree_insert(alloc_data_t *list_search_space, alloc_data_t *prev, alloc_data_t *new_sp)
+{
+  alloc_data_t *pos;
+  new_sp->left=NULL;
+  new_sp->right=NULL;
+  new_sp->priority=search_space_priority();
+  if(prev==list_search_space)
+  {
+    /* New first element */
+    for(pos=list_search_space; pos->left!=NULL; pos=pos->left);
+    pos->left=new_sp;
+  }
+  else if(prev->right==NULL)
+  {
+    pos=prev;
+    pos->right=new_sp;
+  }
+  else
+  {
+    for(pos=prev->right; pos->left!=NULL; pos=pos->left);
+    pos->left=new_sp;
+  }
+  new_sp->parent=pos;
+  while(new_sp->parent!=list_search_space && new_sp->priority > new_sp->parent->priority)
+    search_space_rotate_up(new_sp);
+}
+
+static void search_space_index(alloc_data_t *list_search_space)
+{
+  struct td_list_head *search_walker = NULL;
+  alloc_data_t *prev=list_search_space;
+  list_search_space->parent=NULL;
+  list_search_space->left=NULL;
+  list_search_space->right=NULL;
+  td_list_for_each(search_walker, &list_search_space->list)
+  {
+    alloc_data_t *current_search_space=td_list_entry(search_walker, alloc_data_t, list);
+    search_space_tree_insert(list_search_space, prev, current_search_space);
+    prev=current_search_space;
+  }
+}
+
+/* Return the last range starting at or before offset, NULL if there is none */
+static alloc_data_t *search_space_lookup(alloc_data_t *list_search_space, const uint64_t offset)
+{
+  alloc_data_t *node;
+  alloc_data_t *res=NULL;
+  if(list_search_space->left==NULL)
+  {
+    if(td_list_empty(&list_search_space->list))
+      return NULL;
+    search_space_index(list_search_space);
+  }
+  for(node=list_search_space->left; node!=NULL; )
+  {
+    if(node->start <= offset)
+    {
+      res=node;
+      node=node->right;
+    }
+    else
+      node=node->left;
+  }
+  return res;
+}
+
+void add_search_space_after(alloc_data_t *list_search_space, alloc_data_t *prev, alloc_data_t *new_sp)
+{
+  /* Keep the tree if it's up to date */
+  if(list_search_space->left!=NULL || td_list_empty(&list_search_space->list))
+    search_space_tree_insert(list_search_space, prev, new_sp);
+  td_list_add(&new_sp->list, &prev->list);
+}
+
+static void search_space_del(alloc_data_t *list_search_space, alloc_data_t *old_sp)
+{
+  td_list_del(&old_sp->list);
+  if(list_search_space->left==NULL)
+    return ;
+  /* Move the node down to a leaf, then unlink it */
+  while(old_sp->left!=NULL || old_sp->right!=NULL)
+  {
+    if(old_sp->right==NULL ||
+	(old_sp->left!=NULL && old_sp->left->priority > old_sp->right->priority))
+      search_space_rotate_up(old_sp->left);
+    else
+      search_space_rotate_up(old_sp->right);
+  }
+  if(old_sp->parent->left==old_sp)
+    old_sp->parent->left=NULL;
+  else
+    old_sp->parent->right=NULL;
+}
+
 void file_block_log(const file_recovery_t *file_recovery, const unsigned int sector_size)
 {
   struct td_list_head *tmp;
@@ -85,9 +223,75 @@ void del_search_space(alloc_data_t *list_search_space, const uint64_t start, con
   update_search_space_aux(list_search_space, start, end, NULL, NULL);
 }
 
+/* Number of trailing zero bits, value must not be 0 */
+static inline unsigned int bitmap_ctz64(uint64_t value)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(value);
+#else
+  unsigned int n=0;
+  if((value & 0xFFFFFFFF)==0)
+  {
+    value>>=32;
+    n+=32;
+  }
+  while((value&1)==0)
+  {
+    value>>=1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+void del_search_space_bitmap(alloc_data_t *list_search_space, const unsigned char *bitmap, const unsigned int nbr_bits, const uint64_t offset, const unsigned int block_size, uint64_t *start_free, uint64_t *end_free)
+{
+  unsigned int i;
+  for(i=0; i<nbr_bits; i+=64)
+  {
+    uint64_t bits;
+    if(nbr_bits - i >= 64)
+    {
+      memcpy(&bits, &bitmap[i/8], sizeof(bits));
+      bits=le64(bits);
+    }
+    else
+    {
+      const unsigned int nbr=nbr_bits - i;
+      unsigned int j;
+      bits=0;
+      for(j=0; j<(nbr+7)/8; j++)
+	bits|=(uint64_t)bitmap[i/8+j] << (8*j);
+      bits&=((uint64_t)1<<nbr)-1;
+    }
+    /* Extract the runs of bits set */
+    while(bits!=0)
+    {
+      const unsigned int first=bitmap_ctz64(bits);
+      const uint64_t inverted=~(bits >> first);
+      const unsigned int len=(inverted==0 ? 64 - first : bitmap_ctz64(inverted));
+      const uint64_t start=offset + (uint64_t)(i + first) * block_size;
+      const uint64_t size=(uint64_t)len * block_size;
+      if(*end_free+1==start)
+	*end_free+=size;
+      else
+      {
+	if(*start_free != *end_free)
+	  del_search_space(list_search_space, *start_free, *end_free);
+	*start_free=start;
+	*end_free=start + size - 1;
+      }
+      if(first + len >= 64)
+	bits=0;
+      else
+	bits&=~(((uint64_t)1 << (first + len)) - 1);
+    }
+  }
+}
+
 static void update_search_space_aux(alloc_data_t *list_search_space, const uint64_t start, const uint64_t end, alloc_data_t **new_current_search_space, uint64_t *offset)
 {
-  struct td_list_head *search_walker = NULL;
+  alloc_data_t *current_search_space;
 #ifdef DEBUG_UPDATE_SEARCH_SPACE
   log_trace("update_search_space_aux offset=%llu remove [%llu-%llu]\n",
       (long long unsigned)(offset==NULL?0:((*offset)/512)),
@@ -96,10 +300,11 @@ static void update_search_space_aux(alloc_data_t *list_search_space, const uint6
 #endif
   if(start > end)
     return ;
-  td_list_for_each_prev(search_walker, &list_search_space->list)
+  /* Only the last range starting before end may overlap [start-end] */
+  current_search_space=search_space_lookup(list_search_space, end);
+  if(current_search_space==NULL || current_search_space->end < start)
+    return ;
   {
-    alloc_data_t *current_search_space;
-    current_search_space=td_list_entry(search_walker, alloc_data_t, list);
 #ifdef DEBUG_UPDATE_SEARCH_SPACE
     log_trace("update_search_space_aux offset=%llu remove [%llu-%llu] in [%llu-%llu]\n",
 	(long long unsigned)(offset==NULL?0:((*offset)/512)),
@@ -130,8 +335,8 @@ static void update_search_space_aux(alloc_data_t *list_search_space, const uint6
         *new_current_search_space=td_list_entry(current_search_space->list.next, alloc_data_t, list);
         *offset=(*new_current_search_space)->start;
       }
-      td_list_del(search_walker);
-      free(current_search_space);
+      search_space_del(list_search_space, current_search_space);
+      search_space_node_free(current_search_space);
       update_search_space_aux(list_search_space, pivot, end, new_current_search_space, offset);
       return ;
     }
@@ -159,8 +364,8 @@ static void update_search_space_aux(alloc_data_t *list_search_space, const uint6
         *new_current_search_space=td_list_entry(current_search_space->list.next, alloc_data_t, list);
         *offset=(*new_current_search_space)->start;
       }
-      td_list_del(search_walker);
-      free(current_search_space);
+      search_space_del(list_search_space, current_search_space);
+      search_space_node_free(current_search_space);
       update_search_space_aux(list_search_space, start, pivot, new_current_search_space, offset);
       return ;
     }
@@ -181,13 +386,13 @@ static void update_search_space_aux(alloc_data_t *list_search_space, const uint6
     if(current_search_space->start < start && end < current_search_space->end)
     {
       alloc_data_t *new_free_space;
-      new_free_space=(alloc_data_t*)MALLOC(sizeof(*new_free_space));
+      new_free_space=search_space_node_new();
       new_free_space->start=start;
       new_free_space->end=current_search_space->end;
       new_free_space->file_stat=NULL;
       new_free_space->data=1;
       current_search_space->end=start-1;
-      td_list_add(&new_free_space->list,search_walker);
+      add_search_space_after(list_search_space, current_search_space, new_free_space);
       if(offset!=NULL && new_current_search_space!=NULL &&
           new_free_space->start<=*offset && *offset<=new_free_space->end)
       {
@@ -199,10 +404,36 @@ static void update_search_space_aux(alloc_data_t *list_search_space, const uint6
   }
 }
 
+/* Don't search the sectors that couldn't be read when the disk image was created */
+static void remove_unreadable_space(alloc_data_t *list_search_space, const disk_t *disk_car)
+{
+  char *map_name;
+  rescue_map_t *map;
+  unsigned int i;
+  if(disk_car->device==NULL)
+    return;
+  map_name=rescue_map_filename(disk_car->device);
+  map=rescue_map_load(map_name);
+  if(map==NULL)
+  {
+    free(map_name);
+    return;
+  }
+  log_info("Skip the unreadable areas listed in %s\n", map_name);
+  for(i=0; i<map->nbr; i++)
+  {
+    const rescue_extent_t *extent=&map->extents[i];
+    if(extent->status!=RESCUE_FINISHED)
+      del_search_space(list_search_space, extent->pos, extent->pos + extent->size - 1);
+  }
+  rescue_map_free(map);
+  free(map_name);
+}
+
 void init_search_space(alloc_data_t *list_search_space, const disk_t *disk_car, const partition_t *partition)
 {
   alloc_data_t *new_sp;
-  new_sp=(alloc_data_t*)MALLOC(sizeof(*new_sp));
+  new_sp=search_space_node_new();
   new_sp->start=partition->part_offset;
   new_sp->end=partition->part_offset+partition->part_size-1;
   if(new_sp->end > disk_car->disk_size-1)
@@ -211,9 +442,9 @@ void init_search_space(alloc_data_t *list_search_space, const disk_t *disk_car,
     new_sp->end = disk_car->disk_real_size-1;
   new_sp->file_stat=NULL;
   new_sp->data=1;
-  new_sp->list.prev=&new_sp->list;
-  new_sp->list.next=&new_sp->list;
-  td_list_add_tail(&new_sp->list, &list_search_space->list);
+  add_search_space_after(list_search_space,
+      td_list_entry(list_search_space->list.prev, alloc_data_t, list), new_sp);
+  remove_unreadable_space(list_search_space, disk_car);
 }
 
 void free_list_search_space(alloc_data_t *list_search_space)
@@ -225,8 +456,10 @@ void free_list_search_space(alloc_data_t *list_search_space)
     alloc_data_t *current_search_space;
     current_search_space=td_list_entry(search_walker, alloc_data_t, list);
     td_list_del(search_walker);
-    free(current_search_space);
+    search_space_node_free(current_search_space);
   }
+  list_search_space->left=NULL;
+  phpool_release();
 }
 
 /** 
@@ -334,8 +567,8 @@ void forget(alloc_data_t *list_search_space, alloc_data_t *current_search_space)
     {
       alloc_data_t *tmp;
       tmp=td_list_entry(search_walker, alloc_data_t, list);
-      td_list_del(&tmp->list);
-      free(tmp);
+      search_space_del(list_search_space, tmp);
+      search_space_node_free(tmp);
     }
     else
       nbr++;
@@ -415,6 +648,58 @@ void write_stats_log(const file_stat_t *file_stats)
   }
 }
 
+void reset_profile(file_stat_t *file_stats)
+{
+  unsigned int i;
+  prof_reset();
+  for(i=0; file_stats[i].file_hint!=NULL; i++)
+  {
+    file_stats[i].header_calls=0;
+    file_stats[i].header_hits=0;
+    file_stats[i].ticks=0;
+  }
+}
+
+static int sort_file_stat_ticks(const void *p1, const void *p2)
+{
+  const file_stat_t *f1=(const file_stat_t *)p1;
+  const file_stat_t *f2=(const file_stat_t *)p2;
+  if(f1->ticks < f2->ticks)
+    return 1;
+  if(f1->ticks > f2->ticks)
+    return -1;
+  return 0;
+}
+
+void write_profile_log(const file_stat_t *file_stats)
+{
+  const double ticks_per_second=prof_ticks_per_second();
+  unsigned int i;
+  unsigned int nbr;
+  file_stat_t *new_file_stats;
+  prof_log();
+  for(i=0;file_stats[i].file_hint!=NULL;i++);
+  if(i==0)
+    return ;
+  nbr=i;
+  new_file_stats=(file_stat_t*)MALLOC(nbr*sizeof(file_stat_t));
+  memcpy(new_file_stats, file_stats, nbr*sizeof(file_stat_t));
+  qsort(new_file_stats, nbr, sizeof(file_stat_t), sort_file_stat_ticks);
+  /* The 10 most expensive file formats */
+  for(i=0; i<10 && i<nbr && new_file_stats[i].ticks>0; i++)
+  {
+    log_info("%s: %u headers, %.3fs\n",
+	(new_file_stats[i].file_hint->extension!=NULL?
+	 new_file_stats[i].file_hint->extension:""),
+	new_file_stats[i].header_hits,
+	new_file_stats[i].ticks / ticks_per_second);
+  }
+  free(new_file_stats);
+#ifdef ENABLE_DFXML
+  xml_log_profile(file_stats, ticks_per_second);
+#endif
+}
+
 int sorfile_stat_ts(const void *p1, const void *p2)
 {
   const file_stat_t *f1=(const file_stat_t *)p1;
@@ -490,8 +775,8 @@ void update_blocksize(const unsigned int blocksize, alloc_data_t *list_search_sp
       {
 	/* merge with previous block */
 	prev_search_space->end = current_search_space->end;
-	td_list_del(search_walker);
-	free(current_search_space);
+	search_space_del(list_search_space, current_search_space);
+	search_space_node_free(current_search_space);
       }
       else
       {
@@ -500,8 +785,8 @@ void update_blocksize(const unsigned int blocksize, alloc_data_t *list_search_sp
 	if(current_search_space->start>=current_search_space->end)
 	{
 	  /* block too small - delete it */
-	  td_list_del(search_walker);
-	  free(current_search_space);
+	  search_space_del(list_search_space, current_search_space);
+	  search_space_node_free(current_search_space);
 	}
       }
     }
@@ -514,8 +799,8 @@ void update_blocksize(const unsigned int blocksize, alloc_data_t *list_search_sp
     if(current_search_space->start>=current_search_space->end)
     {
       /* block too small - delete it */
-      td_list_del(search_walker);
-      free(current_search_space);
+      search_space_del(list_search_space, current_search_space);
+      search_space_node_free(current_search_space);
     }
   }
 }
@@ -532,7 +817,7 @@ void file_block_free(alloc_list_t *list_allocation)
     allocated_space=td_list_entry(tmp, alloc_list_t, list);
     free_list_allocation_end=allocated_space->end;
     td_list_del(tmp);
-    free(allocated_space);
+    file_block_node_free(allocated_space);
   }
 }
 /* file_finish_aux()
@@ -546,7 +831,9 @@ static void file_finish_aux(file_recovery_t *file_recovery, struct ph_param *par
       params->status!=STATUS_EXT2_OFF_SAVE_EVERYTHING &&
       file_recovery->file_stat!=NULL && file_recovery->file_check!=NULL && paranoid>0)
     { /* Check if recovered file is valid */
+      const uint64_t prof_start=prof_ticks();
       file_recovery->file_check(file_recovery);
+      file_recovery->file_stat->ticks+=prof_add(PROF_FILE_CHECK, prof_start);
     }
   /* FIXME: need to adapt read_size to volume size to avoid this */
   if(file_recovery->file_size > params->disk->disk_size)
@@ -572,22 +859,33 @@ static void file_finish_aux(file_recovery_t *file_recovery, struct ph_param *par
     unlink(file_recovery->filename);
     return;
   }
-#ifdef HAVE_FTRUNCATE
-  fflush(file_recovery->handle);
-  if(ftruncate(fileno(file_recovery->handle), file_recovery->file_size)<0)
+  phhash_final(file_recovery);
+  if(phc_is_open())
   {
-    log_critical("ftruncate failed.\n");
+    /* The file is copied to the container once its location is known */
+    params->file_nbr++;
   }
-#endif
-  fclose(file_recovery->handle);
-  file_recovery->handle=NULL;
-  if(file_recovery->time!=0 && file_recovery->time!=(time_t)-1)
-    set_date(file_recovery->filename, file_recovery->time, file_recovery->time);
-  if(file_recovery->file_rename!=NULL)
-    file_recovery->file_rename(file_recovery->filename);
-  if((++params->file_nbr)%MAX_FILES_PER_DIR==0)
+  else
   {
-    params->dir_num=photorec_mkdir(params->recup_dir, params->dir_num+1);
+    {
+      const uint64_t prof_start=prof_ticks();
+      /* file_rename() reads the file, it must be closed first */
+      phwrite_close(file_recovery->handle, file_recovery->filename,
+	  file_recovery->file_size, file_recovery->time,
+	  (file_recovery->file_rename!=NULL));
+      prof_add(PROF_WRITE, prof_start);
+    }
+    file_recovery->handle=NULL;
+    if(file_recovery->file_rename!=NULL)
+    {
+      file_recovery->file_rename(file_recovery->filename);
+      /* The report and hashes.csv use the final name */
+      file_renamed_get(file_recovery->filename);
+    }
+    if((++params->file_nbr)%MAX_FILES_PER_DIR==0)
+    {
+      params->dir_num=photorec_mkdir(params->recup_dir, params->dir_num+1);
+    }
   }
   if(params->status!=STATUS_EXT2_ON_SAVE_EVERYTHING &&
       params->status!=STATUS_EXT2_OFF_SAVE_EVERYTHING &&
@@ -631,6 +929,9 @@ int file_finish_bf(file_recovery_t *file_recovery, struct ph_param *params,
 #ifdef ENABLE_DFXML
   xml_log_file_recovered(file_recovery);
 #endif
+  phhash_log_file(file_recovery);
+  if(file_recovery->handle!=NULL)
+    phc_add(file_recovery);
   file_block_free(&file_recovery->location);
   return 1;
 }
@@ -648,21 +949,32 @@ int file_finish_bf(file_recovery_t *file_recovery, struct ph_param *params,
  */
 int file_finish2(file_recovery_t *file_recovery, struct ph_param *params, const int paranoid, alloc_data_t *list_search_space)
 {
+  uint64_t prof_start;
   if(file_recovery->file_stat==NULL)
     return 0;
   if(file_recovery->handle)
     file_finish_aux(file_recovery, params, (paranoid==0?0:1));
+  prof_start=prof_start_sampled(PROF_SEARCH_SPACE);
   if(file_recovery->file_size==0)
   {
     file_block_truncate_zero(file_recovery, list_search_space);
+    prof_add_sampled(PROF_SEARCH_SPACE, prof_start);
     reset_file_recovery(file_recovery);
     return 0;
   }
   file_block_truncate(file_recovery, list_search_space, params->blocksize);
+  prof_add_sampled(PROF_SEARCH_SPACE, prof_start);
   file_block_log(file_recovery, params->disk->sector_size);
 #ifdef ENABLE_DFXML
   xml_log_file_recovered(file_recovery);
 #endif
+  phhash_log_file(file_recovery);
+  if(file_recovery->handle!=NULL)
+  {
+    prof_start=prof_ticks();
+    phc_add(file_recovery);
+    prof_add(PROF_WRITE, prof_start);
+  }
   file_block_free(&file_recovery->location);
   reset_file_recovery(file_recovery);
   return 1;
@@ -709,8 +1021,10 @@ void free_search_space(alloc_data_t *list_search_space)
     alloc_data_t *current_search_space;
     current_search_space=td_list_entry(search_walker, alloc_data_t, list);
     td_list_del(search_walker);
-    free(current_search_space);
+    search_space_node_free(current_search_space);
   }
+  list_search_space->left=NULL;
+  phpool_release();
 }
 
 void set_filename(file_recovery_t *file_recovery, struct ph_param *params)
@@ -735,20 +1049,14 @@ void set_filename(file_recovery_t *file_recovery, struct ph_param *params)
 
 static void set_search_start_aux(alloc_data_t **new_current_search_space, alloc_data_t *list_search_space, const uint64_t offset)
 {
-  struct td_list_head *search_walker = NULL;
-  td_list_for_each(search_walker, &list_search_space->list)
+  alloc_data_t *current_search_space=search_space_lookup(list_search_space, offset);
+  if(current_search_space!=NULL && offset<= current_search_space->end)
   {
-    alloc_data_t *current_search_space;
-    current_search_space=td_list_entry(search_walker, alloc_data_t, list);
-    if(current_search_space->start<=offset && offset<= current_search_space->end)
-    {
-      *new_current_search_space=current_search_space;
-      return;
-    }
+    *new_current_search_space=current_search_space;
+    return;
   }
   /* not found */
-  search_walker=list_search_space->list.next;
-  *new_current_search_space=td_list_entry(search_walker, alloc_data_t, list);
+  *new_current_search_space=td_list_entry(list_search_space->list.next, alloc_data_t, list);
 }
 
 uint64_t set_search_start(struct ph_param *params, alloc_data_t **new_current_search_space, alloc_data_t *list_search_space)
@@ -875,7 +1183,7 @@ list_part_t *init_list_part(disk_t *disk, const struct ph_options *options)
 }
 
 /* file_block_remove_from_sp: remove block from list_search_space, update offset and new_current_search_space in consequence */
-static inline void file_block_remove_from_sp_aux(alloc_data_t *tmp, alloc_data_t **new_current_search_space, uint64_t *offset, const unsigned int blocksize)
+static inline void file_block_remove_from_sp_aux(alloc_data_t *list_search_space, alloc_data_t *tmp, alloc_data_t **new_current_search_space, uint64_t *offset, const unsigned int blocksize)
 {
   if(tmp->start == *offset)
   {
@@ -886,8 +1194,8 @@ static inline void file_block_remove_from_sp_aux(alloc_data_t *tmp, alloc_data_t
       return ;
     *new_current_search_space=td_list_entry(tmp->list.next, alloc_data_t, list);
     *offset=(*new_current_search_space)->start;
-    td_list_del(&tmp->list);
-    free(tmp);
+    search_space_del(list_search_space, tmp);
+    search_space_node_free(tmp);
     return ;
   }
   if(*offset + blocksize == tmp->end + 1)
@@ -899,15 +1207,13 @@ static inline void file_block_remove_from_sp_aux(alloc_data_t *tmp, alloc_data_t
   }
   {
     alloc_data_t *new_sp;
-    new_sp=(alloc_data_t*)MALLOC(sizeof(*new_sp));
+    new_sp=search_space_node_new();
     new_sp->start=*offset + blocksize;
     new_sp->end=tmp->end;
     new_sp->file_stat=NULL;
     new_sp->data=tmp->data;
-    new_sp->list.prev=&new_sp->list;
-    new_sp->list.next=&new_sp->list;
     tmp->end=*offset - 1;
-    td_list_add(&new_sp->list, &tmp->list);
+    add_search_space_after(list_search_space, tmp, new_sp);
     *new_current_search_space=new_sp;
     *offset += blocksize;
   }
@@ -921,14 +1227,12 @@ static inline void file_block_remove_from_sp(alloc_data_t *list_search_space, al
     alloc_data_t *tmp;
     tmp=td_list_entry(search_walker, alloc_data_t, list);
     if(tmp->start <= *offset && *offset + blocksize <= tmp->end + 1)
-      return file_block_remove_from_sp_aux(tmp, new_current_search_space, offset, blocksize);
+      return file_block_remove_from_sp_aux(list_search_space, tmp, new_current_search_space, offset, blocksize);
   }
-  td_list_for_each(search_walker, &list_search_space->list)
   {
-    alloc_data_t *tmp;
-    tmp=td_list_entry(search_walker, alloc_data_t, list);
-    if(tmp->start <= *offset && *offset + blocksize <= tmp->end + 1)
-      return file_block_remove_from_sp_aux(tmp, new_current_search_space, offset, blocksize);
+    alloc_data_t *tmp=search_space_lookup(list_search_space, *offset);
+    if(tmp!=NULL && *offset + blocksize <= tmp->end + 1)
+      return file_block_remove_from_sp_aux(list_search_space, tmp, new_current_search_space, offset, blocksize);
   }
   log_critical("file_block_remove_from_sp(list_search_space, alloc_data_t **new_current_search_space, uint64_t *offset, const unsigned int blocksize) failed\n");
 }
@@ -945,7 +1249,7 @@ static inline void file_block_add_to_file(alloc_list_t *list, const uint64_t off
     }
   }
   {
-    alloc_list_t *new_list=(alloc_list_t *)MALLOC(sizeof(*new_list));
+    alloc_list_t *new_list=file_block_node_new();
     new_list->start=offset;
     new_list->end=offset+blocksize-1;
     new_list->data=data;
@@ -961,90 +1265,59 @@ void file_block_append(file_recovery_t *file_recovery, alloc_data_t *list_search
 
 static void file_block_truncate_aux(const uint64_t start, const uint64_t end, alloc_data_t *list_search_space)
 {
-  struct td_list_head *search_walker = NULL;
+  alloc_data_t *prev;
+  alloc_data_t *next;
+  alloc_data_t *new_sp;
   if(start >= end)
     return ;
-  td_list_for_each(search_walker, &list_search_space->list)
+  prev=search_space_lookup(list_search_space, start-1);
+  if(start > 0 && prev!=NULL && prev->end + 1 == start)
   {
-    alloc_data_t *tmp;
-    tmp=td_list_entry(search_walker, alloc_data_t, list);
-    if(tmp->start == end + 1 && tmp->file_stat==NULL)
-    {
-      tmp->start=start;
-      return;
-    }
-    if(tmp->end + 1 == start)
-    {
-      tmp->end=end;
-      return;
-    }
-    if(end < tmp->start)
-    {
-      alloc_data_t *new_sp;
-      new_sp=(alloc_data_t*)MALLOC(sizeof(*new_sp));
-      new_sp->start=start;
-      new_sp->end=end;
-      new_sp->file_stat=NULL;
-      new_sp->data=1;
-      new_sp->list.prev=&new_sp->list;
-      new_sp->list.next=&new_sp->list;
-      td_list_add(&new_sp->list, tmp->list.prev);
-      return;
-    }
+    prev->end=end;
+    return;
   }
+  /* Find the first range after end */
+  prev=search_space_lookup(list_search_space, end);
+  if(prev==NULL)
+    prev=list_search_space;
+  next=td_list_entry(prev->list.next, alloc_data_t, list);
+  if(next!=list_search_space && next->start == end + 1 && next->file_stat==NULL)
   {
-    alloc_data_t *new_sp;
-    new_sp=(alloc_data_t*)MALLOC(sizeof(*new_sp));
-    new_sp->start=start;
-    new_sp->end=end;
-    new_sp->file_stat=NULL;
-    new_sp->data=1;
-    new_sp->list.prev=&new_sp->list;
-    new_sp->list.next=&new_sp->list;
-    td_list_add_tail(&new_sp->list, &list_search_space->list);
+    next->start=start;
+    return;
   }
+  new_sp=search_space_node_new();
+  new_sp->start=start;
+  new_sp->end=end;
+  new_sp->file_stat=NULL;
+  new_sp->data=1;
+  add_search_space_after(list_search_space, prev, new_sp);
 }
 
 static void file_block_truncate_zero_aux(const uint64_t start, const uint64_t end, alloc_data_t *list_search_space, file_stat_t *file_stat)
 {
-  struct td_list_head *search_walker = NULL;
+  alloc_data_t *prev;
+  alloc_data_t *next;
+  alloc_data_t *new_sp;
   if(start >= end)
     return ;
-  td_list_for_each(search_walker, &list_search_space->list)
-  {
-    alloc_data_t *tmp;
-    tmp=td_list_entry(search_walker, alloc_data_t, list);
-    if(tmp->start == end + 1 && tmp->file_stat==NULL)
-    {
-      tmp->start=start;
-      tmp->file_stat=file_stat;
-      return;
-    }
-    if(end < tmp->start)
-    {
-      alloc_data_t *new_sp;
-      new_sp=(alloc_data_t*)MALLOC(sizeof(*new_sp));
-      new_sp->start=start;
-      new_sp->end=end;
-      new_sp->file_stat=file_stat;
-      new_sp->data=1;
-      new_sp->list.prev=&new_sp->list;
-      new_sp->list.next=&new_sp->list;
-      td_list_add(&new_sp->list, tmp->list.prev);
-      return;
-    }
-  }
+  /* Find the first range after end */
+  prev=search_space_lookup(list_search_space, end);
+  if(prev==NULL)
+    prev=list_search_space;
+  next=td_list_entry(prev->list.next, alloc_data_t, list);
+  if(next!=list_search_space && next->start == end + 1 && next->file_stat==NULL)
   {
-    alloc_data_t *new_sp;
-    new_sp=(alloc_data_t*)MALLOC(sizeof(*new_sp));
-    new_sp->start=start;
-    new_sp->end=end;
-    new_sp->file_stat=file_stat;
-    new_sp->data=1;
-    new_sp->list.prev=&new_sp->list;
-    new_sp->list.next=&new_sp->list;
-    td_list_add_tail(&new_sp->list, &list_search_space->list);
+    next->start=start;
+    next->file_stat=file_stat;
+    return;
   }
+  new_sp=search_space_node_new();
+  new_sp->start=start;
+  new_sp->end=end;
+  new_sp->file_stat=file_stat;
+  new_sp->data=1;
+  add_search_space_after(list_search_space, prev, new_sp);
 }
 
 static void file_block_truncate_zero(const file_recovery_t *file_recovery, alloc_data_t *list_search_space)
@@ -1063,7 +1336,7 @@ static void file_block_truncate_zero(const file_recovery_t *file_recovery, alloc
     else
       file_block_truncate_aux(element->start, element->end, list_search_space);
     td_list_del(tmp);
-    free(element);
+    file_block_node_free(element);
   }
 }
 
@@ -1079,7 +1352,7 @@ static void file_block_truncate(const file_recovery_t *file_recovery, alloc_data
     {
       file_block_truncate_aux(element->start, element->end, list_search_space);
       td_list_del(tmp);
-      free(element);
+      file_block_node_free(element);
     }
     else if(element->data>0)
     {
@@ -1106,16 +1379,16 @@ static uint64_t file_offset_end(const file_recovery_t *file_recovery)
 static void file_block_move(const file_recovery_t *file_recovery, alloc_data_t *list_search_space, alloc_data_t **new_current_search_space, uint64_t *offset)
 {
   const uint64_t end=file_offset_end(file_recovery);
-  struct td_list_head *tmp;
-  td_list_for_each(tmp, &list_search_space->list)
+  alloc_data_t *element=search_space_lookup(list_search_space, end);
+  /* Move to the first range after end */
+  if(element==NULL)
+    element=list_search_space;
+  element=td_list_entry(element->list.next, alloc_data_t, list);
+  if(element!=list_search_space)
   {
-    alloc_data_t *element=td_list_entry(tmp, alloc_data_t, list);
-    if(element->start > end)
-    {
-      *new_current_search_space=element;
-      *offset=element->start;
-      return;
-    }
+    *new_current_search_space=element;
+    *offset=element->start;
+    return;
   }
   *new_current_search_space=list_search_space;
 }
@@ -1134,26 +1407,18 @@ void file_block_truncate_and_move(file_recovery_t *file_recovery, alloc_data_t *
     uint64_t i;
     unsigned char *block_buffer;
     block_buffer=&buffer[blocksize];
-#ifdef HAVE_FSEEKO
-    if(fseeko(file_recovery->handle, 0, SEEK_SET) < 0)
-#else
-    if(fseek(file_recovery->handle, 0, SEEK_SET) < 0)
-#endif
-      return ;
     for(i=0; i< file_recovery->file_size; i+= blocksize)
     {
-      if(fread(block_buffer, blocksize, 1, file_recovery->handle) != 1)
-	return ;
+      if(file_data_read(file_recovery, block_buffer, blocksize, i) != (int)blocksize)
+	break;
       file_recovery->data_check(buffer, 2*blocksize, file_recovery);
       memcpy(buffer, block_buffer, blocksize);
     }
   }
-  else
-  {
+  /* The next block is written after the data kept */
 #ifdef HAVE_FSEEKO
-    fseeko(file_recovery->handle, file_recovery->file_size, SEEK_SET);
+  fseeko(file_recovery->handle, file_recovery->file_size, SEEK_SET);
 #else
-    fseek(file_recovery->handle, file_recovery->file_size, SEEK_SET);
+  fseek(file_recovery->handle, file_recovery->file_size, SEEK_SET);
 #endif
-  }
 }
@@ -40,6 +40,10 @@ struct ph_options
   unsigned int mode_ext2;
   unsigned int expert;
   unsigned int lowmem;
+  unsigned int container;
+  unsigned int metadata;
+  unsigned int hash;
+  unsigned int hash_csv;
   int verbose;
   file_enable_t *list_file_format;
 };
@@ -69,6 +73,8 @@ int file_finish_bf(file_recovery_t *file_recovery, struct ph_param *params,
     alloc_data_t *list_search_space);
 int file_finish2(file_recovery_t *file_recovery, struct ph_param *params, const int paranoid, alloc_data_t *list_search_space);
 void write_stats_log(const file_stat_t *file_stats);
+void reset_profile(file_stat_t *file_stats);
+void write_profile_log(const file_stat_t *file_stats);
 void update_stats(file_stat_t *file_stats, alloc_data_t *list_search_space);
 partition_t *new_whole_disk(const disk_t *disk_car);
 unsigned int find_blocksize(alloc_data_t *list_file, const unsigned int default_blocksize, uint64_t *offset);
@@ -0,0 +1,184 @@
+/*
+
+    File: phpool.c
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#if defined(HAVE_SYS_RESOURCE_H) && defined(HAVE_GETRUSAGE)
+#include <sys/resource.h>
+#endif
+#include "types.h"
+#include "common.h"
+#include "list.h"
+#include "filegen.h"
+#include "log.h"
+#include "phpool.h"
+
+/* The slab header is followed by the nodes */
+union phpool_slab
+{
+  union phpool_slab *next;
+  uint64_t align;
+};
+
+/* A free node holds the next free node */
+struct phpool_free
+{
+  struct phpool_free *next;
+};
+
+struct phpool
+{
+  const char *name;
+  const size_t size;
+  union phpool_slab *slabs;
+  struct phpool_free *free_nodes;
+  /* Nodes of the last slab never used */
+  unsigned char *unused;
+  unsigned int nbr_unused;
+  unsigned int nbr_slabs;
+  uint64_t nbr_alloc;
+  uint64_t nbr_slab_alloc;
+  uint64_t used;
+  uint64_t used_max;
+};
+
+static struct phpool search_space_pool={ "Search space", sizeof(alloc_data_t), NULL, NULL, NULL, 0, 0, 0, 0, 0, 0 };
+static struct phpool location_pool={ "File location", sizeof(alloc_list_t), NULL, NULL, NULL, 0, 0, 0, 0, 0, 0 };
+
+static void *phpool_alloc(struct phpool *pool)
+{
+  void *node;
+  pool->nbr_alloc++;
+  if(++pool->used > pool->used_max)
+    pool->used_max=pool->used;
+  if(pool->free_nodes!=NULL)
+  {
+    node=pool->free_nodes;
+    pool->free_nodes=pool->free_nodes->next;
+    return node;
+  }
+  if(pool->nbr_unused==0)
+  {
+    union phpool_slab *slab=(union phpool_slab *)MALLOC(sizeof(union phpool_slab) + PHPOOL_SLAB_NODES * pool->size);
+    slab->next=pool->slabs;
+    pool->slabs=slab;
+    pool->nbr_slabs++;
+    pool->nbr_slab_alloc++;
+    pool->unused=(unsigned char *)(slab + 1);
+    pool->nbr_unused=PHPOOL_SLAB_NODES;
+  }
+  /* Hand out the nodes in address order, consecutive nodes are close in memory */
+  node=pool->unused;
+  pool->unused+=pool->size;
+  pool->nbr_unused--;
+  return node;
+}
+
+static void phpool_free(struct phpool *pool, void *node)
+{
+  struct phpool_free *free_node=(struct phpool_free *)node;
+  free_node->next=pool->free_nodes;
+  pool->free_nodes=free_node;
+  pool->used--;
+}
+
+static void phpool_release_aux(struct phpool *pool)
+{
+  if(pool->used > 0)
+    return ;
+  while(pool->slabs!=NULL)
+  {
+    union phpool_slab *next=pool->slabs->next;
+    free(pool->slabs);
+    pool->slabs=next;
+  }
+  pool->free_nodes=NULL;
+  pool->unused=NULL;
+  pool->nbr_unused=0;
+  pool->nbr_slabs=0;
+}
+
+alloc_data_t *search_space_node_new(void)
+{
+  return (alloc_data_t *)phpool_alloc(&search_space_pool);
+}
+
+void search_space_node_free(alloc_data_t *node)
+{
+  phpool_free(&search_space_pool, node);
+}
+
+alloc_list_t *file_block_node_new(void)
+{
+  return (alloc_list_t *)phpool_alloc(&location_pool);
+}
+
+void file_block_node_free(alloc_list_t *node)
+{
+  phpool_free(&location_pool, node);
+}
+
+void phpool_release(void)
+{
+  phpool_release_aux(&search_space_pool);
+  phpool_release_aux(&location_pool);
+}
+
+static void phpool_log_aux(const struct phpool *pool)
+{
+  if(pool->nbr_alloc==0)
+    return ;
+  log_info("%s nodes: %llu allocations, %llu slab allocations, %llu in use, %llu max, %u slabs %lu KiB\n",
+      pool->name,
+      (long long unsigned)pool->nbr_alloc,
+      (long long unsigned)pool->nbr_slab_alloc,
+      (long long unsigned)pool->used,
+      (long long unsigned)pool->used_max,
+      pool->nbr_slabs,
+      (long unsigned)(pool->nbr_slabs * (sizeof(union phpool_slab) + PHPOOL_SLAB_NODES * pool->size) / 1024));
+}
+
+void phpool_log(void)
+{
+  phpool_log_aux(&search_space_pool);
+  phpool_log_aux(&location_pool);
+#if defined(HAVE_SYS_RESOURCE_H) && defined(HAVE_GETRUSAGE)
+  {
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage)==0)
+    {
+#ifdef __APPLE__
+      /* ru_maxrss is in bytes on Mac OS X, in KiB elsewhere */
+      log_info("Max RSS %ld KiB\n", (long)(usage.ru_maxrss / 1024));
+#else
+      log_info("Max RSS %ld KiB\n", (long)usage.ru_maxrss);
+#endif
+    }
+  }
+#endif
+}
@@ -0,0 +1,48 @@
+/*
+
+    File: phpool.h
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+#ifndef _PHPOOL_H
+#define _PHPOOL_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Nodes are carved from slabs of PHPOOL_SLAB_NODES nodes */
+#define PHPOOL_SLAB_NODES	1024
+
+/* Search space and file location nodes are allocated and freed for each
+ * block range split and each fragment. They come from pools of slabs,
+ * freed nodes are kept for reuse until phpool_release().
+ * Not thread-safe, only the search thread uses them. */
+alloc_data_t *search_space_node_new(void);
+void search_space_node_free(alloc_data_t *node);
+alloc_list_t *file_block_node_new(void);
+void file_block_node_free(alloc_list_t *node);
+
+/* Give the slabs of the pools without any node in use back to the system */
+void phpool_release(void);
+/* Log the number of allocations, the memory used by the pools and the RSS */
+void phpool_log(void);
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+#endif
@@ -77,8 +77,11 @@
 #include "phbs.h"
 #include "file_found.h"
 #include "dfxml.h"
+#include "phcontainer.h"
 #include "poptions.h"
 #include "psearchn.h"
+#include "phpool.h"
+#include "phhash.h"
 
 /* #define DEBUG */
 /* #define DEBUG_BF */
@@ -300,12 +303,16 @@ int photorec(struct ph_param *params, const struct ph_options *options, alloc_da
   xml_open(params->recup_dir, params->dir_num);
   xml_setup(params->disk, params->partition);
 #endif
+  if(options->container>0 || options->metadata>0)
+    phc_open(params->recup_dir, params->dir_num, options->metadata);
+  phhash_open(params->recup_dir, params->dir_num, options->hash, options->hash_csv);
   
   for(params->pass=0; params->status!=STATUS_QUIT; params->pass++)
   {
     const unsigned int old_file_nbr=params->file_nbr;
     log_info("Pass %u (blocksize=%u) ", params->pass, params->blocksize);
     log_info("%s\n", status_to_name(params->status));
+    reset_profile(params->file_stats);
 
 #ifdef HAVE_NCURSES
     aff_copy(stdscr);
@@ -385,6 +392,8 @@ int photorec(struct ph_param *params, const struct ph_options *options, alloc_da
 	    free(res);
 	    /* Create the directory */
 	    params->dir_num=photorec_mkdir(params->recup_dir,params->dir_num);
+	    if(phc_is_open())
+	      phc_open(params->recup_dir, params->dir_num, options->metadata);
 	  }
 #else
 	  params->status=STATUS_QUIT;
@@ -430,7 +439,11 @@ int photorec(struct ph_param *params, const struct ph_options *options, alloc_da
     {
       log_info("Pass %u +%u file%s\n",params->pass,params->file_nbr-old_file_nbr,(params->file_nbr-old_file_nbr<=1?"":"s"));
       write_stats_log(params->file_stats);
+      write_profile_log(params->file_stats);
+      phpool_log();
     }
+    /* The location of the files is freed once they are saved */
+    phpool_release();
     log_flush();
   }
 #ifdef HAVE_NCURSES
@@ -481,6 +494,8 @@ int photorec(struct ph_param *params, const struct ph_options *options, alloc_da
   free(params->file_stats);
   params->file_stats=NULL;
   free_header_check();
+  phc_close();
+  phhash_close();
 #ifdef ENABLE_DFXML
   xml_shutdown();
   xml_close();
@@ -491,7 +506,7 @@ int photorec(struct ph_param *params, const struct ph_options *options, alloc_da
 #ifdef HAVE_NCURSES
 void interface_options_photorec_ncurses(struct ph_options *options)
 {
-  unsigned int menu = 5;
+  unsigned int menu = 9;
   struct MenuItem menuOptions[]=
   {
     { 'P', NULL, "Check JPG files" },
@@ -499,6 +514,10 @@ void interface_options_photorec_ncurses(struct ph_options *options)
     { 'S',NULL,"Try to skip indirect block"},
     { 'E',NULL,"Provide additional controls"},
     { 'L',NULL,"Low memory"},
+    { 'C',NULL,"Write the recovered files to a single container file"},
+    { 'M',NULL,"Only record the location of the recovered files"},
+    { 'H',NULL,"Hash the recovered files, the hashes are written to report.xml"},
+    { 'V',NULL,"Also write the hashes to a CSV file"},
     { 'Q',"Quit","Return to main menu"},
     { 0, NULL, NULL }
   };
@@ -522,8 +541,32 @@ void interface_options_photorec_ncurses(struct ph_options *options)
     menuOptions[2].name=options->mode_ext2?"ext2/ext3 mode: Yes":"ext2/ext3 mode : No";
     menuOptions[3].name=options->expert?"Expert mode : Yes":"Expert mode : No";
     menuOptions[4].name=options->lowmem?"Low memory: Yes":"Low memory: No";
+    menuOptions[5].name=options->container?"Single container: Yes":"Single container: No";
+    menuOptions[6].name=options->metadata?"Metadata only: Yes":"Metadata only: No";
+    switch(options->hash)
+    {
+      case 0:
+	menuOptions[7].name="Hashes: None";
+	break;
+      case PHHASH_MD5:
+	menuOptions[7].name="Hashes: MD5";
+	break;
+      case PHHASH_SHA1:
+	menuOptions[7].name="Hashes: SHA-1";
+	break;
+      case PHHASH_SHA256:
+	menuOptions[7].name="Hashes: SHA-256";
+	break;
+      case PHHASH_ALL:
+	menuOptions[7].name="Hashes: MD5 SHA-1 SHA-256";
+	break;
+      default:
+	menuOptions[7].name="Hashes: Custom";
+	break;
+    }
+    menuOptions[8].name=options->hash_csv?"Hashes CSV file: Yes":"Hashes CSV file: No";
     aff_copy(stdscr);
-    car=wmenuSelect_ext(stdscr, 23, INTER_OPTION_Y, INTER_OPTION_X, menuOptions, 0, "PKELQ", MENU_VERT|MENU_VERT_ARROW2VALID, &menu,&real_key);
+    car=wmenuSelect_ext(stdscr, 23, INTER_OPTION_Y, INTER_OPTION_X, menuOptions, 0, "PKELCMHVQ", MENU_VERT|MENU_VERT_ARROW2VALID, &menu,&real_key);
     switch(car)
     {
       case 'p':
@@ -549,6 +592,32 @@ void interface_options_photorec_ncurses(struct ph_options *options)
       case 'L':
 	options->lowmem=!options->lowmem;
 	break;
+      case 'c':
+      case 'C':
+	options->container=!options->container;
+	break;
+      case 'm':
+      case 'M':
+	options->metadata=!options->metadata;
+	break;
+      case 'h':
+      case 'H':
+	/* None, MD5, SHA-1, SHA-256, all of them */
+	if(options->hash==0)
+	  options->hash=PHHASH_MD5;
+	else if(options->hash==PHHASH_MD5)
+	  options->hash=PHHASH_SHA1;
+	else if(options->hash==PHHASH_SHA1)
+	  options->hash=PHHASH_SHA256;
+	else if(options->hash==PHHASH_SHA256)
+	  options->hash=PHHASH_ALL;
+	else
+	  options->hash=0;
+	break;
+      case 'v':
+      case 'V':
+	options->hash_csv=!options->hash_csv;
+	break;
       case key_ESC:
       case 'q':
       case 'Q':
@@ -0,0 +1,223 @@
+/*
+
+    File: phwrite.c
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+#include <errno.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include "types.h"
+#include "common.h"
+#include "filegen.h"
+#include "log.h"
+#include "setdate.h"
+#include "phwrite.h"
+
+#if defined(HAVE_FALLOCATE) || defined(HAVE_POSIX_FALLOCATE)
+/* Cleared when the destination filesystem doesn't support preallocation */
+static int phwrite_prealloc=1;
+#endif
+
+void phwrite_open(file_recovery_t *file_recovery)
+{
+  FILE *handle=file_recovery->handle;
+  /* Fewer and larger writes, most files are written with a single write() */
+  setvbuf(handle, NULL, _IOFBF, PHWRITE_BUFFER_SIZE);
+#if defined(HAVE_FALLOCATE) || defined(HAVE_POSIX_FALLOCATE)
+  /* The size is known from the header for some formats, reserve the space *
+   * at once to limit the fragmentation of the destination filesystem      */
+  if(phwrite_prealloc!=0 &&
+      file_recovery->calculated_file_size >= PHWRITE_PREALLOC_MIN &&
+      (file_recovery->file_stat->file_hint->max_filesize==0 ||
+       file_recovery->calculated_file_size <= file_recovery->file_stat->file_hint->max_filesize))
+  {
+    const uint64_t size=(file_recovery->calculated_file_size < PHWRITE_PREALLOC_MAX ?
+	file_recovery->calculated_file_size : PHWRITE_PREALLOC_MAX);
+#ifdef HAVE_FALLOCATE
+    /* Unlike posix_fallocate(), fallocate() fails instead of writing zeroes *
+     * when the filesystem can't preallocate */
+    if(fallocate(fileno(handle), 0, 0, size) < 0)
+    {
+      if(errno==EOPNOTSUPP || errno==ENOSYS)
+	phwrite_prealloc=0;
+    }
+#else
+    const int res=posix_fallocate(fileno(handle), 0, size);
+    if(res==EINVAL || res==EOPNOTSUPP)
+      phwrite_prealloc=0;
+#endif
+  }
+#endif
+}
+
+static void phwrite_close_aux(FILE *handle, const char *filename, const uint64_t size, const time_t time)
+{
+#ifdef HAVE_FTRUNCATE
+  fflush(handle);
+  if(ftruncate(fileno(handle), size)<0)
+  {
+    log_critical("ftruncate failed.\n");
+  }
+#endif
+  fclose(handle);
+  if(time!=0 && time!=(time_t)-1)
+    set_date(filename, time, time);
+}
+
+#ifdef HAVE_PTHREAD
+struct phwrite_job
+{
+  FILE *handle;
+  char *filename;
+  uint64_t size;
+  time_t time;
+};
+
+static struct
+{
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  struct phwrite_job jobs[PHWRITE_QUEUE_SIZE];
+  unsigned int head;
+  unsigned int nbr;
+  unsigned int quit;
+  unsigned int running;
+} phwrite;
+
+static void *phwrite_thread(void *arg)
+{
+  pthread_mutex_lock(&phwrite.mutex);
+  while(1)
+  {
+    struct phwrite_job job;
+    while(phwrite.nbr==0 && phwrite.quit==0)
+      pthread_cond_wait(&phwrite.cond, &phwrite.mutex);
+    if(phwrite.nbr==0)
+      break;
+    job=phwrite.jobs[phwrite.head];
+    phwrite.head=(phwrite.head + 1) % PHWRITE_QUEUE_SIZE;
+    phwrite.nbr--;
+    pthread_cond_broadcast(&phwrite.cond);
+    pthread_mutex_unlock(&phwrite.mutex);
+    phwrite_close_aux(job.handle, job.filename, job.size, job.time);
+    free(job.filename);
+    pthread_mutex_lock(&phwrite.mutex);
+  }
+  pthread_mutex_unlock(&phwrite.mutex);
+  return arg;
+}
+
+void phwrite_start(void)
+{
+  if(phwrite.running)
+    return ;
+  phwrite.head=0;
+  phwrite.nbr=0;
+  phwrite.quit=0;
+  pthread_mutex_init(&phwrite.mutex, NULL);
+  pthread_cond_init(&phwrite.cond, NULL);
+  if(pthread_create(&phwrite.thread, NULL, phwrite_thread, NULL)!=0)
+  {
+    log_warning("Cannot create writer thread, closing the files synchronously\n");
+    pthread_cond_destroy(&phwrite.cond);
+    pthread_mutex_destroy(&phwrite.mutex);
+    return ;
+  }
+  phwrite.running=1;
+}
+
+void phwrite_stop(void)
+{
+  if(!phwrite.running)
+    return ;
+  pthread_mutex_lock(&phwrite.mutex);
+  phwrite.quit=1;
+  pthread_cond_broadcast(&phwrite.cond);
+  pthread_mutex_unlock(&phwrite.mutex);
+  pthread_join(phwrite.thread, NULL);
+  pthread_cond_destroy(&phwrite.cond);
+  pthread_mutex_destroy(&phwrite.mutex);
+  phwrite.running=0;
+}
+
+/* Queue the file for the writer thread, -1 if it isn't running */
+static int phwrite_queue(FILE *handle, const char *filename, const uint64_t size, const time_t time)
+{
+  char *filename_copy;
+  if(!phwrite.running || (filename_copy=strdup(filename))==NULL)
+    return -1;
+  pthread_mutex_lock(&phwrite.mutex);
+  while(phwrite.nbr >= PHWRITE_QUEUE_SIZE)
+    pthread_cond_wait(&phwrite.cond, &phwrite.mutex);
+  {
+    struct phwrite_job *job=&phwrite.jobs[(phwrite.head + phwrite.nbr) % PHWRITE_QUEUE_SIZE];
+    job->handle=handle;
+    job->filename=filename_copy;
+    job->size=size;
+    job->time=time;
+  }
+  phwrite.nbr++;
+  pthread_cond_broadcast(&phwrite.cond);
+  pthread_mutex_unlock(&phwrite.mutex);
+  return 0;
+}
+#else
+void phwrite_start(void)
+{
+}
+
+void phwrite_stop(void)
+{
+}
+
+static int phwrite_queue(FILE *handle, const char *filename, const uint64_t size, const time_t time)
+{
+  return -1;
+}
+#endif
+
+void phwrite_close(FILE *handle, const char *filename, const uint64_t size, const time_t time, const int wait)
+{
+  if(wait==0 && phwrite_queue(handle, filename, size, time)==0)
+    return ;
+  phwrite_close_aux(handle, filename, size, time);
+}
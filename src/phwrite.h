@@ -0,0 +1,53 @@
+/*
+
+    File: phwrite.h
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+#ifndef _PHWRITE_H
+#define _PHWRITE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Large stdio buffer for the recovered files */
+#define PHWRITE_BUFFER_SIZE	(256*1024)
+/* Files being closed in the background */
+#define PHWRITE_QUEUE_SIZE	32
+/* Smaller files are not preallocated */
+#define PHWRITE_PREALLOC_MIN	(1024*1024)
+/* A corrupted header may give any size, don't reserve more than this */
+#define PHWRITE_PREALLOC_MAX	(64*1024*1024)
+
+/* Set up the handle of a file that has just been created */
+void phwrite_open(file_recovery_t *file_recovery);
+
+/* Close the recovered files in a background thread until phwrite_stop() */
+void phwrite_start(void);
+/* Wait for the files being closed */
+void phwrite_stop(void);
+
+/* Flush, truncate to size, close and set the date of a recovered file.
+ * The handle is closed in the background unless wait is set or
+ * phwrite_start() hasn't been called. */
+void phwrite_close(FILE *handle, const char *filename, const uint64_t size, const time_t time, const int wait);
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+#endif
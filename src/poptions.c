@@ -32,6 +32,7 @@
 #include "filegen.h"
 #include "photorec.h"
 #include "log.h"
+#include "phhash.h"
 #include "poptions.h"
 
 void interface_options_photorec_cli(struct ph_options *options, char **current_cmd)
@@ -87,6 +88,39 @@ void interface_options_photorec_cli(struct ph_options *options, char **current_c
       (*current_cmd)+=6;
       options->lowmem=1;
     }
+    /* container */
+    else if(strncmp(*current_cmd,"container",9)==0)
+    {
+      (*current_cmd)+=9;
+      options->container=1;
+    }
+    /* metadata */
+    else if(strncmp(*current_cmd,"metadata",8)==0)
+    {
+      (*current_cmd)+=8;
+      options->metadata=1;
+    }
+    /* hashes */
+    else if(strncmp(*current_cmd,"hash_md5",8)==0)
+    {
+      (*current_cmd)+=8;
+      options->hash|=PHHASH_MD5;
+    }
+    else if(strncmp(*current_cmd,"hash_sha1",9)==0)
+    {
+      (*current_cmd)+=9;
+      options->hash|=PHHASH_SHA1;
+    }
+    else if(strncmp(*current_cmd,"hash_sha256",11)==0)
+    {
+      (*current_cmd)+=11;
+      options->hash|=PHHASH_SHA256;
+    }
+    else if(strncmp(*current_cmd,"hash_csv",8)==0)
+    {
+      (*current_cmd)+=8;
+      options->hash_csv=1;
+    }
     else
     {
       interface_options_photorec_log(options);
@@ -100,9 +134,17 @@ void interface_options_photorec_log(const struct ph_options *options)
   /* write new options to log file */
   log_info("New options :\n Paranoid : %s\n", options->paranoid?"Yes":"No");
   log_info(" Brute force : %s\n", ((options->paranoid)>1?"Yes":"No"));
-  log_info(" Keep corrupted files : %s\n ext2/ext3 mode : %s\n Expert mode : %s\n Low memory : %s\n",
+  log_info(" Keep corrupted files : %s\n ext2/ext3 mode : %s\n Expert mode : %s\n Low memory : %s\n Single container : %s\n Metadata only : %s\n",
       options->keep_corrupted_file?"Yes":"No",
       options->mode_ext2?"Yes":"No",
       options->expert?"Yes":"No",
-      options->lowmem?"Yes":"No");
+      options->lowmem?"Yes":"No",
+      options->container?"Yes":"No",
+      options->metadata?"Yes":"No");
+  log_info(" Hashes : %s%s%s%s\n Hashes CSV file : %s\n",
+      (options->hash==0?"None":""),
+      ((options->hash & PHHASH_MD5)!=0?" MD5":""),
+      ((options->hash & PHHASH_SHA1)!=0?" SHA-1":""),
+      ((options->hash & PHHASH_SHA256)!=0?" SHA-256":""),
+      options->hash_csv?"Yes":"No");
 }
@@ -0,0 +1,151 @@
+/*
+
+    File: profile.c
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include "types.h"
+#include "common.h"
+#include "log.h"
+#include "profile.h"
+
+struct prof_struct prof;
+
+static uint64_t prof_usec(void)
+{
+#ifdef HAVE_SYS_TIME_H
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#else
+  return (uint64_t)time(NULL) * 1000000;
+#endif
+}
+
+void prof_reset(void)
+{
+  memset(&prof, 0, sizeof(prof));
+  prof.start_ticks=prof_ticks();
+  prof.start_usec=prof_usec();
+}
+
+double prof_ticks_per_second(void)
+{
+  uint64_t usec=prof_usec();
+  /* Too short to get a reliable value, wait a little bit */
+  while(usec - prof.start_usec < 20000 && usec >= prof.start_usec)
+    usec=prof_usec();
+  if(usec <= prof.start_usec)
+    return 1000000.0;
+  return (double)(prof_ticks() - prof.start_ticks) * 1000000.0 / (usec - prof.start_usec);
+}
+
+const char *prof_stage_name(const prof_stage_t stage)
+{
+  switch(stage)
+  {
+    case PROF_READ:
+      return "read";
+    case PROF_HEADER_CHECK:
+      return "header_check";
+    case PROF_DATA_CHECK:
+      return "data_check";
+    case PROF_WRITE:
+      return "write";
+    case PROF_FILE_CHECK:
+      return "file_check";
+    case PROF_SEARCH_SPACE:
+      return "search_space";
+    case PROF_STAGES:
+    default:
+      return "";
+  }
+}
+
+static void prof_log_hist(const char *name, const uint64_t *hist, const double scale, const char *unit)
+{
+  unsigned int i;
+  log_info("%s:", name);
+  for(i=0; i<PROF_HIST_SIZE; i++)
+    if(hist[i]>0)
+      log_info(" <%.4g%s:%llu", (double)((uint64_t)2 << i) / scale, unit, (long long unsigned)hist[i]);
+  log_info("\n");
+}
+
+void prof_log(void)
+{
+  const double ticks_per_second=prof_ticks_per_second();
+  unsigned int i;
+  for(i=0; i<PROF_STAGES && prof.stage[i].calls==0; i++);
+  if(i<PROF_STAGES)
+  {
+    log_info("Profile:");
+    for(i=0; i<PROF_STAGES; i++)
+    {
+      if(prof.stage[i].calls > 0)
+	log_info(" %s %.3fs/%llu", prof_stage_name((prof_stage_t)i),
+	    prof.stage[i].ticks / ticks_per_second,
+	    (long long unsigned)prof.stage[i].calls);
+    }
+    log_info("\n");
+  }
+  if(prof.io.calls==0)
+    return ;
+  log_info("Device reads: %llu, %llu bytes, %.3fs\n",
+      (long long unsigned)prof.io.calls, (long long unsigned)prof.io_bytes,
+      prof.io.ticks / ticks_per_second);
+  prof_log_hist("Read size", prof.io_size, 1024.0, "KiB");
+  prof_log_hist("Read latency", prof.io_latency, ticks_per_second / 1000000.0, "us");
+}
+
+void prof_summary(char *buffer, const unsigned int size)
+{
+  static const char *short_names[PROF_STAGES]={ "read", "header", "data", "write", "check", "space" };
+  uint64_t total=0;
+  unsigned int i;
+  unsigned int pos=0;
+  buffer[0]='\0';
+  for(i=0; i<PROF_STAGES; i++)
+    total+=prof.stage[i].ticks;
+  if(total==0)
+    return ;
+  for(i=0; i<PROF_STAGES && pos < size; i++)
+  {
+    const int res=snprintf(buffer + pos, size - pos, "%s%s %u%%", (i>0?" ":""),
+	short_names[i],
+	(unsigned int)(prof.stage[i].ticks * 100 / total));
+    if(res < 0)
+      return ;
+    pos+=res;
+  }
+}
@@ -0,0 +1,144 @@
+/*
+
+    File: profile.h
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+#ifndef _PROFILE_H
+#define _PROFILE_H
+#if !(defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+#endif
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Where PhotoRec spends its time */
+typedef enum {
+  PROF_READ=0,		/* Waiting for the data to scan */
+  PROF_HEADER_CHECK,	/* Looking for a known header */
+  PROF_DATA_CHECK,	/* data_check() of the file being recovered */
+  PROF_WRITE,		/* Writing the recovered files */
+  PROF_FILE_CHECK,	/* file_check() once a file is complete */
+  PROF_SEARCH_SPACE,	/* Search space bookkeeping */
+  PROF_STAGES
+} prof_stage_t;
+
+#define PROF_SAMPLE	16
+
+/* Histogram buckets, bucket i counts the values in [2^i, 2^(i+1)[ */
+#define PROF_HIST_SIZE	48
+
+struct prof_counter
+{
+  uint64_t ticks;
+  uint64_t calls;
+};
+
+struct prof_struct
+{
+  struct prof_counter stage[PROF_STAGES];
+  /* Reads sent to the device, see hdcache.c */
+  struct prof_counter io;
+  uint64_t io_bytes;
+  uint64_t io_size[PROF_HIST_SIZE];
+  uint64_t io_latency[PROF_HIST_SIZE];
+  /* Used to convert the ticks to seconds */
+  uint64_t start_ticks;
+  uint64_t start_usec;
+};
+
+extern struct prof_struct prof;
+
+/* Time stamp counter when available, microseconds otherwise */
+static inline uint64_t prof_ticks(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  return __builtin_ia32_rdtsc();
+#elif defined(HAVE_SYS_TIME_H)
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#else
+  return (uint64_t)time(NULL) * 1000000;
+#endif
+}
+
+static inline unsigned int prof_log2(uint64_t value)
+{
+  unsigned int i;
+  for(i=0; value > 1 && i < PROF_HIST_SIZE - 1; i++)
+    value>>=1;
+  return i;
+}
+
+/* Account the time since start to stage, return the elapsed ticks */
+static inline uint64_t prof_add(const prof_stage_t stage, const uint64_t start)
+{
+  const uint64_t elapsed=prof_ticks() - start;
+  prof.stage[stage].ticks+=elapsed;
+  prof.stage[stage].calls++;
+  return elapsed;
+}
+
+/* Reading the clock twice per block is not cheap, the stages run for  *
+ * each block are timed once every PROF_SAMPLE calls. 0 means not timed */
+static inline uint64_t prof_start_sampled(const prof_stage_t stage)
+{
+  return ((prof.stage[stage].calls & (PROF_SAMPLE - 1))==0 ? prof_ticks() : 0);
+}
+
+/* Same as prof_add(), returns the estimated ticks */
+static inline uint64_t prof_add_sampled(const prof_stage_t stage, const uint64_t start)
+{
+  uint64_t elapsed;
+  prof.stage[stage].calls++;
+  if(start==0)
+    return 0;
+  elapsed=(prof_ticks() - start) * PROF_SAMPLE;
+  prof.stage[stage].ticks+=elapsed;
+  return elapsed;
+}
+
+static inline void prof_io(const unsigned int size, const uint64_t start)
+{
+  const uint64_t elapsed=prof_ticks() - start;
+  prof.io.ticks+=elapsed;
+  prof.io.calls++;
+  prof.io_bytes+=size;
+  prof.io_size[prof_log2(size)]++;
+  prof.io_latency[prof_log2(elapsed)]++;
+}
+
+void prof_reset(void);
+/* Ticks per second, measured since the last reset */
+double prof_ticks_per_second(void);
+const char *prof_stage_name(const prof_stage_t stage);
+void prof_log(void);
+/* Percentage of the time spent in each stage, for the progress screen */
+void prof_summary(char *buffer, const unsigned int size);
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+#endif
@@ -47,6 +47,9 @@
 #include <stdarg.h>
 #include <winbase.h>
 #endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include "types.h"
 #include "common.h"
 #include "intrf.h"
@@ -63,6 +66,9 @@
 #include "pnext.h"
 #include "file_found.h"
 #include "psearch.h"
+#include "profile.h"
+#include "phwrite.h"
+#include "phcontainer.h"
 #ifdef HAVE_NCURSES
 #include "intrfn.h"
 #include "phnc.h"
@@ -72,7 +78,6 @@
 #define READ_SIZE 1024*512
 extern const file_hint_t file_hint_tar;
 extern const file_hint_t file_hint_dir;
-extern file_check_list_t file_check_list;
 
 #if defined(__CYGWIN__) || defined(__MINGW32__)
 /* Live antivirus protection may open file as soon as they are created by *
@@ -107,6 +112,198 @@ static FILE *fopen_with_retry(const char *path, const char *mode)
 }
 #endif
 
+#ifdef HAVE_PTHREAD
+/* Reader stage: while the current window is searched for known headers  *
+ * and saved, a thread reads the next windows that will be needed if the *
+ * scan goes on sequentially, up to PREAD_AHEAD_DEPTH windows when it    *
+ * has been sequential for a while. A window read in advance             *
+ * is handed over by exchanging the buffers, the data isn't copied.      *
+ * Headers and data are still checked in the original order, so the     *
+ * results are identical to a serial scan.                               */
+#define PREAD_AHEAD_DEPTH 4
+
+struct pread_ahead
+{
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  disk_t *disk;
+  /* Windows requested, the first ones have been read (done) and one    *
+   * may be read by the thread (busy), buffer[] is blocksize+READ_SIZE  *
+   * bytes long, the data is read after the first blocksize bytes      */
+  unsigned char *buffer[PREAD_AHEAD_DEPTH];
+  uint64_t offset[PREAD_AHEAD_DEPTH];
+  int res[PREAD_AHEAD_DEPTH];
+  unsigned int first;
+  unsigned int nbr;
+  unsigned int done;
+  unsigned int busy;
+  /* Number of windows to request, it grows while the scan is sequential */
+  unsigned int depth;
+  /* Set by pread_ahead_wait(), no new read until the next photorec_pread() */
+  unsigned int hold;
+  unsigned int quit;
+  unsigned int blocksize;
+  unsigned int running;
+};
+
+static void *pread_ahead_thread(void *arg)
+{
+  struct pread_ahead *ra=(struct pread_ahead *)arg;
+  pthread_mutex_lock(&ra->mutex);
+  while(1)
+  {
+    unsigned int i;
+    int res;
+    while((ra->done==ra->nbr || ra->hold!=0) && ra->quit==0)
+      pthread_cond_wait(&ra->cond, &ra->mutex);
+    if(ra->quit!=0)
+      break;
+    i=(ra->first + ra->done) % PREAD_AHEAD_DEPTH;
+    ra->busy=1;
+    pthread_mutex_unlock(&ra->mutex);
+    res=ra->disk->pread(ra->disk, ra->buffer[i] + ra->blocksize, READ_SIZE, ra->offset[i]);
+    pthread_mutex_lock(&ra->mutex);
+    ra->res[i]=res;
+    ra->busy=0;
+    ra->done++;
+    pthread_cond_broadcast(&ra->cond);
+  }
+  pthread_mutex_unlock(&ra->mutex);
+  return NULL;
+}
+
+static void pread_ahead_start(struct pread_ahead *ra, disk_t *disk, const unsigned int blocksize)
+{
+  unsigned int i;
+  ra->disk=disk;
+  ra->first=0;
+  ra->nbr=0;
+  ra->done=0;
+  ra->busy=0;
+  ra->depth=1;
+  ra->hold=0;
+  ra->quit=0;
+  ra->blocksize=blocksize;
+  ra->running=0;
+  for(i=0; i<PREAD_AHEAD_DEPTH; i++)
+    ra->buffer[i]=(unsigned char *)MALLOC(blocksize + READ_SIZE);
+  pthread_mutex_init(&ra->mutex, NULL);
+  pthread_cond_init(&ra->cond, NULL);
+  if(pthread_create(&ra->thread, NULL, pread_ahead_thread, ra)!=0)
+  {
+    log_warning("Cannot create reader thread, reading without prefetch\n");
+    return ;
+  }
+  ra->running=1;
+}
+
+/* Wait for the reader thread to be idle, it must not use the disk *
+ * at the same time as the calling thread                          */
+static void pread_ahead_wait(struct pread_ahead *ra)
+{
+  pthread_mutex_lock(&ra->mutex);
+  ra->hold=1;
+  while(ra->busy!=0)
+    pthread_cond_wait(&ra->cond, &ra->mutex);
+  pthread_mutex_unlock(&ra->mutex);
+}
+
+/* When only the location of the files is recorded, *
+ * the file checks may read the disk                  */
+static void pread_ahead_disk_wait(void *arg)
+{
+  pread_ahead_wait((struct pread_ahead *)arg);
+}
+
+static void pread_ahead_stop(struct pread_ahead *ra)
+{
+  unsigned int i;
+  if(ra->running)
+  {
+    pthread_mutex_lock(&ra->mutex);
+    ra->quit=1;
+    pthread_cond_broadcast(&ra->cond);
+    pthread_mutex_unlock(&ra->mutex);
+    pthread_join(ra->thread, NULL);
+  }
+  pthread_cond_destroy(&ra->cond);
+  pthread_mutex_destroy(&ra->mutex);
+  for(i=0; i<PREAD_AHEAD_DEPTH; i++)
+    free(ra->buffer[i]);
+}
+
+/* Fill *buffer_start with the blocksize bytes at olddata (zeroes if NULL) *
+ * and the READ_SIZE bytes at offset, using a window read in advance if    *
+ * available, then ask the reader thread to get the next windows, stride  *
+ * bytes apart, up to end_offset                                           */
+static int photorec_pread(struct pread_ahead *ra, unsigned char **buffer_start, const unsigned char *olddata, const uint64_t offset, const unsigned int stride, const uint64_t end_offset)
+{
+  const unsigned int blocksize=ra->blocksize;
+  unsigned char *buffer=*buffer_start;
+  uint64_t next_offset;
+  int res;
+  if(ra->running==0)
+  {
+    if(olddata==NULL)
+      memset(buffer, 0, blocksize);
+    else
+      memmove(buffer, olddata, blocksize);
+    return ra->disk->pread(ra->disk, buffer + blocksize, READ_SIZE, offset);
+  }
+  pthread_mutex_lock(&ra->mutex);
+  if(ra->nbr > 0 && ra->offset[ra->first]==offset)
+  {
+    const unsigned int i=ra->first;
+    ra->hold=0;
+    pthread_cond_broadcast(&ra->cond);
+    while(ra->done==0)
+      pthread_cond_wait(&ra->cond, &ra->mutex);
+    /* olddata stays valid, the previous buffer isn't requested yet */
+    *buffer_start=ra->buffer[i];
+    ra->buffer[i]=buffer;
+    res=ra->res[i];
+    ra->first=(ra->first + 1) % PREAD_AHEAD_DEPTH;
+    ra->nbr--;
+    ra->done--;
+    if(ra->depth < PREAD_AHEAD_DEPTH)
+      ra->depth++;
+    if(olddata==NULL)
+      memset(*buffer_start, 0, blocksize);
+    else
+      memcpy(*buffer_start, olddata, blocksize);
+  }
+  else
+  {
+    /* The scan doesn't go on sequentially, drop the windows requested */
+    ra->hold=1;
+    while(ra->busy!=0)
+      pthread_cond_wait(&ra->cond, &ra->mutex);
+    ra->nbr=0;
+    ra->done=0;
+    ra->depth=1;
+    pthread_mutex_unlock(&ra->mutex);
+    if(olddata==NULL)
+      memset(buffer, 0, blocksize);
+    else
+      memmove(buffer, olddata, blocksize);
+    res=ra->disk->pread(ra->disk, buffer + blocksize, READ_SIZE, offset);
+    pthread_mutex_lock(&ra->mutex);
+  }
+  next_offset=(ra->nbr > 0 ? ra->offset[(ra->first + ra->nbr - 1) % PREAD_AHEAD_DEPTH] : offset) + stride;
+  while(ra->nbr < ra->depth && next_offset < end_offset)
+  {
+    ra->offset[(ra->first + ra->nbr) % PREAD_AHEAD_DEPTH]=next_offset;
+    ra->nbr++;
+    next_offset+=stride;
+  }
+  ra->hold=0;
+  pthread_cond_broadcast(&ra->cond);
+  pthread_mutex_unlock(&ra->mutex);
+  return res;
+}
+#endif
+
 static void photorec_dir_fat(const unsigned char *buffer, const unsigned int read_size, const unsigned long long sector)
 {
   file_info_t dir_list = {
@@ -127,10 +324,14 @@ static pstatus_t photorec_new_file(file_recovery_t *file_recovery, struct ph_par
   set_filename(file_recovery, params);
   if(file_recovery->file_stat->file_hint->recover==1)
   {
+    /* Written directly in the container, or only the location of the file */
+    file_recovery->handle=phc_fopen(file_recovery, params->disk);
+    if(file_recovery->handle!=NULL)
+      return PSTATUS_OK;
 #if defined(__CYGWIN__) || defined(__MINGW32__)
-    file_recovery->handle=fopen_with_retry(file_recovery->filename,"w+b");
+    file_recovery->handle=fopen_with_retry(phc_output_filename(file_recovery->filename),"w+b");
 #else
-    file_recovery->handle=fopen(file_recovery->filename,"w+b");
+    file_recovery->handle=fopen(phc_output_filename(file_recovery->filename),"w+b");
 #endif
     if(!file_recovery->handle)
     { 
@@ -138,6 +339,7 @@ static pstatus_t photorec_new_file(file_recovery_t *file_recovery, struct ph_par
       params->offset=offset;
       return PSTATUS_EACCES;
     }
+    phwrite_open(file_recovery);
   }
   return PSTATUS_OK;
 }
@@ -184,7 +386,6 @@ static pstatus_t photorec_header_found(file_recovery_t *file_recovery_new, file_
 
 inline static pstatus_t photorec_check_header(file_recovery_t *file_recovery, struct ph_param *params, const struct ph_options *options, alloc_data_t *list_search_space, const unsigned char *buffer, int *file_recovered, alloc_data_t **current_search_space, uint64_t *offset)
 {
-  const struct td_list_head *tmpl;
   const unsigned int blocksize=params->blocksize;
   const unsigned int read_size=(blocksize>65536?blocksize:65536);
   file_recovery_t file_recovery_new;
@@ -205,20 +406,12 @@ inline static pstatus_t photorec_check_header(file_recovery_t *file_recovery, st
   }
   file_recovery_new.file_stat=NULL;
   file_recovery_new.location.start=*offset;
-  td_list_for_each(tmpl, &file_check_list.list)
   {
-    const struct td_list_head *tmp;
-    const file_check_list_t *pos=td_list_entry_const(tmpl, const file_check_list_t, list);
-    td_list_for_each(tmp, &pos->file_checks[buffer[pos->offset]].list)
-    {
-      const file_check_t *file_check=td_list_entry_const(tmp, const file_check_t, list);
-      if((file_check->length==0 || memcmp(buffer + file_check->offset, file_check->value, file_check->length)==0) &&
-	  file_check->header_check(buffer, read_size, 0, file_recovery, &file_recovery_new)!=0)
-      {
-	file_recovery_new.file_stat=file_check->file_stat;
-	return photorec_header_found(&file_recovery_new, file_recovery, params, options, list_search_space, buffer, file_recovered, current_search_space, offset);
-      }
-    }
+    const uint64_t prof_start=prof_start_sampled(PROF_HEADER_CHECK);
+    const int found=header_check_find(buffer, read_size, 0, file_recovery, &file_recovery_new);
+    prof_add_sampled(PROF_HEADER_CHECK, prof_start);
+    if(found!=0)
+      return photorec_header_found(&file_recovery_new, file_recovery, params, options, list_search_space, buffer, file_recovered, current_search_space, offset);
   }
   return PSTATUS_OK;
 }
@@ -227,8 +420,9 @@ pstatus_t photorec_aux(struct ph_param *params, const struct ph_options *options
 {
   uint64_t offset;
   unsigned char *buffer_start;
-  unsigned char *buffer_olddata;
-  unsigned char *buffer;
+  const unsigned char *buffer_olddata;
+  const unsigned char *buffer;
+  const unsigned char *buffer_end;
   time_t start_time;
   time_t previous_time;
   time_t next_checkpoint;
@@ -240,6 +434,16 @@ pstatus_t photorec_aux(struct ph_param *params, const struct ph_options *options
   unsigned int back=0;
   alloc_data_t *current_search_space;
   file_recovery_t file_recovery;
+  /* The ext2/ext3 indirect block detection modifies the buffer */
+  const int use_view=(params->disk->pview!=NULL &&
+      params->status!=STATUS_EXT2_ON && params->status!=STATUS_EXT2_ON_SAVE_EVERYTHING);
+#ifdef HAVE_PTHREAD
+  struct pread_ahead ra;
+  /* Number of bytes consumed before the buffer needs to be refilled */
+  const unsigned int read_stride=(READ_SIZE > read_size ? ((READ_SIZE - read_size) / blocksize + 1) * blocksize : blocksize);
+  /* With a view, the data that follows is used in place, no need to read it */
+  const uint64_t end_offset=(use_view ? 0 : params->partition->part_offset + params->partition->part_size);
+#endif
   memset(&file_recovery, 0, sizeof(file_recovery));
   reset_file_recovery(&file_recovery);
   file_recovery.blocksize=blocksize;
@@ -247,10 +451,11 @@ pstatus_t photorec_aux(struct ph_param *params, const struct ph_options *options
   buffer_start=(unsigned char *)MALLOC(buffer_size);
   buffer_olddata=buffer_start;
   buffer=buffer_olddata+blocksize;
+  buffer_end=buffer_start+buffer_size;
   start_time=time(NULL);
   previous_time=start_time;
-  next_checkpoint=start_time+5*60;
-  memset(buffer_olddata,0,blocksize);
+  next_checkpoint=start_time+SESSION_CHECKPOINT_INTERVAL;
+  memset(buffer_start,0,blocksize);
   current_search_space=td_list_entry(list_search_space->list.next, alloc_data_t, list);
   offset=set_search_start(params, &current_search_space, list_search_space);
   if(options->verbose > 0)
@@ -261,7 +466,17 @@ pstatus_t photorec_aux(struct ph_param *params, const struct ph_options *options
 	(unsigned long long)((offset-params->partition->part_offset)/params->disk->sector_size),
 	(unsigned long long)((params->partition->part_size-1)/params->disk->sector_size));
   }
-  params->disk->pread(params->disk, buffer, READ_SIZE, offset);
+  phwrite_start();
+#ifdef HAVE_PTHREAD
+  pread_ahead_start(&ra, params->disk, blocksize);
+  phc_set_disk_wait(pread_ahead_disk_wait, &ra);
+  photorec_pread(&ra, &buffer_start, NULL, offset, read_stride, end_offset);
+  buffer_olddata=buffer_start;
+  buffer=buffer_olddata+blocksize;
+  buffer_end=buffer_start+buffer_size;
+#else
+  params->disk->pread(params->disk, buffer_start+blocksize, READ_SIZE, offset);
+#endif
   while(current_search_space!=list_search_space)
   {
     int file_recovered=0;
@@ -288,7 +503,9 @@ pstatus_t photorec_aux(struct ph_param *params, const struct ph_options *options
           file_recovery.file_size >= 12*blocksize &&
           ind_block(buffer,blocksize)!=0)
       {
+	const uint64_t prof_start=prof_start_sampled(PROF_SEARCH_SPACE);
 	file_block_append(&file_recovery, list_search_space, &current_search_space, &offset, blocksize, 0);
+	prof_add_sampled(PROF_SEARCH_SPACE, prof_start);
 	res=DC_CONTINUE;
         if(options->verbose > 1)
         {
@@ -296,13 +513,16 @@ pstatus_t photorec_aux(struct ph_param *params, const struct ph_options *options
               (unsigned long)((offset-params->partition->part_offset)/params->disk->sector_size),
               (unsigned long)((params->partition->part_size-1)/params->disk->sector_size));
         }
-        memcpy(buffer, buffer_olddata, blocksize);
+        memcpy(buffer_start+(buffer-buffer_start), buffer_olddata, blocksize);
       }
       else
       {
 	if(file_recovery.handle!=NULL)
 	{
-	  if(fwrite(buffer,blocksize,1,file_recovery.handle)<1)
+	  const uint64_t prof_start=prof_start_sampled(PROF_WRITE);
+	  const int res_write=file_data_write(&file_recovery, buffer, blocksize);
+	  prof_add_sampled(PROF_WRITE, prof_start);
+	  if(res_write<1)
 	  { 
 	    log_critical("Cannot write to file %s: %s\n", file_recovery.filename, strerror(errno));
 	    if(errno==EFBIG)
@@ -320,9 +540,15 @@ pstatus_t photorec_aux(struct ph_param *params, const struct ph_options *options
 	}
 	if(ind_stop==PSTATUS_OK)
 	{
+	  uint64_t prof_start=prof_start_sampled(PROF_SEARCH_SPACE);
 	  file_block_append(&file_recovery, list_search_space, &current_search_space, &offset, blocksize, 1);
+	  prof_add_sampled(PROF_SEARCH_SPACE, prof_start);
 	  if(file_recovery.data_check!=NULL)
+	  {
+	    prof_start=prof_start_sampled(PROF_DATA_CHECK);
 	    res=file_recovery.data_check(buffer_olddata,2*blocksize,&file_recovery);
+	    file_recovery.file_stat->ticks+=prof_add_sampled(PROF_DATA_CHECK, prof_start);
+	  }
 	  else
 	    res=DC_CONTINUE;
 	  file_recovery.file_size+=blocksize;
@@ -363,13 +589,16 @@ pstatus_t photorec_aux(struct ph_param *params, const struct ph_options *options
     {
       if(res==DC_SCAN)
       {
+	const uint64_t prof_start=prof_start_sampled(PROF_SEARCH_SPACE);
 	get_next_sector(list_search_space, &current_search_space,&offset,blocksize);
+	prof_add_sampled(PROF_SEARCH_SPACE, prof_start);
 	if(offset > offset_before_back)
 	  back=0;
       }
     }
     else if(file_recovered>0)
     {
+      const uint64_t prof_start=prof_start_sampled(PROF_SEARCH_SPACE);
       /* try to recover the previous file, otherwise stay at the current location */
       offset_before_back=offset;
       if(back < 5 &&
@@ -380,6 +609,7 @@ pstatus_t photorec_aux(struct ph_param *params, const struct ph_options *options
 	back=0;
 	get_prev_location(list_search_space, &current_search_space, &offset, file_recovery.location.start);
       }
+      prof_add_sampled(PROF_SEARCH_SPACE, prof_start);
     }
     if(current_search_space==list_search_space)
     {
@@ -398,29 +628,52 @@ pstatus_t photorec_aux(struct ph_param *params, const struct ph_options *options
     buffer+=blocksize;
     if(file_recovered==1 ||
         old_offset+blocksize!=offset ||
-        buffer+read_size>buffer_start+buffer_size)
+        buffer+read_size>buffer_end)
     {
-      if(file_recovered==1)
-        memset(buffer_start,0,blocksize);
-      else
-        memcpy(buffer_start,buffer_olddata,blocksize);
-      buffer_olddata=buffer_start;
-      buffer=buffer_olddata + blocksize;
+      const unsigned char *view=NULL;
+      const uint64_t prof_start=prof_ticks();
       if(options->verbose > 1)
       {
         log_verbose("Reading sector %10llu/%llu\n",
 	    (unsigned long long)((offset-params->partition->part_offset)/params->disk->sector_size),
 	    (unsigned long long)((params->partition->part_size-1)/params->disk->sector_size));
       }
-      if(params->disk->pread(params->disk, buffer, READ_SIZE, offset) != READ_SIZE)
+      /* When the scan goes on with the next block, the previous block is
+       * still the one before offset and the data can be used in place */
+      if(use_view && file_recovered!=1 && old_offset+blocksize==offset)
+	view=params->disk->pview(params->disk, buffer_size, offset-blocksize);
+      if(view!=NULL)
+      {
+	buffer_olddata=view;
+	buffer=buffer_olddata + blocksize;
+	buffer_end=view+buffer_size;
+      }
+      else
       {
+#ifdef HAVE_PTHREAD
+	const int res_read=photorec_pread(&ra, &buffer_start, (file_recovered==1 ? NULL : buffer_olddata), offset, read_stride, end_offset);
+#else
+	int res_read;
+	if(file_recovered==1)
+	  memset(buffer_start,0,blocksize);
+	else
+	  memcpy(buffer_start,buffer_olddata,blocksize);
+	res_read=params->disk->pread(params->disk, buffer_start+blocksize, READ_SIZE, offset);
+#endif
+	buffer_olddata=buffer_start;
+	buffer=buffer_olddata + blocksize;
+	buffer_end=buffer_start+buffer_size;
+	if(res_read != READ_SIZE)
+	{
 #ifdef HAVE_NCURSES
-	wmove(stdscr,11,0);
-	wclrtoeol(stdscr);
-	wprintw(stdscr,"Error reading sector %10lu\n",
-	    (unsigned long)((offset-params->partition->part_offset)/params->disk->sector_size));
+	  wmove(stdscr,11,0);
+	  wclrtoeol(stdscr);
+	  wprintw(stdscr,"Error reading sector %10lu\n",
+	      (unsigned long)((offset-params->partition->part_offset)/params->disk->sector_size));
 #endif
+	}
       }
+      prof_add(PROF_READ, prof_start);
       if(ind_stop==PSTATUS_OK)
       {
         const time_t current_time=time(NULL);
@@ -435,7 +688,7 @@ pstatus_t photorec_aux(struct ph_param *params, const struct ph_options *options
 	  {
 	    /* Save current progress */
 	    session_save(list_search_space, params, options);
-	    next_checkpoint=current_time+5*60;
+	    next_checkpoint=current_time+SESSION_CHECKPOINT_INTERVAL;
 	  }
 	  if(ind_stop!=PSTATUS_OK)
 	  {
@@ -446,6 +699,11 @@ pstatus_t photorec_aux(struct ph_param *params, const struct ph_options *options
       }
     }
   } /* end while(current_search_space!=list_search_space) */
+#ifdef HAVE_PTHREAD
+  phc_set_disk_wait(NULL, NULL);
+  pread_ahead_stop(&ra);
+#endif
+  phwrite_stop();
   free(buffer_start);
 #ifdef HAVE_NCURSES
   photorec_info(stdscr, params->file_stats);
@@ -51,7 +51,6 @@
 
 #define READ_SIZE 1024*512
 extern const file_hint_t file_hint_tar;
-extern file_check_list_t file_check_list;
 
 static inline void file_recovery_cpy(file_recovery_t *dst, file_recovery_t *src)
 {
@@ -108,29 +107,12 @@ pstatus_t QPhotorec::photorec_find_blocksize(alloc_data_t *list_search_space)
       }
       else
       {
-	const struct td_list_head *tmpl;
         file_recovery_new.file_stat=NULL;
-	td_list_for_each(tmpl, &file_check_list.list)
-	{
-	  const struct td_list_head *tmp;
-	  const file_check_list_t *tmp2=td_list_entry_const(tmpl, const file_check_list_t, list);
-	  td_list_for_each(tmp, &tmp2->file_checks[buffer[tmp2->offset]].list)
-	  {
-	    const file_check_t *file_check=td_list_entry_const(tmp, const file_check_t, list);
-	    if((file_check->length==0 || memcmp(buffer + file_check->offset, file_check->value, file_check->length)==0) &&
-		file_check->header_check(buffer, read_size, 1, &file_recovery, &file_recovery_new)!=0)
-	    {
-	      file_recovery_new.file_stat=file_check->file_stat;
-	      break;
-	    }
-	  }
-	  if(file_recovery_new.file_stat!=NULL)
-	    break;
-	}
+	header_check_find(buffer, read_size, 1, &file_recovery, &file_recovery_new);
         if(file_recovery_new.file_stat!=NULL && file_recovery_new.file_stat->file_hint!=NULL)
 	{
 	  /* A new file begins, backup file offset */
-	  current_search_space=file_found(current_search_space, offset, file_recovery_new.file_stat);
+	  current_search_space=file_found(list_search_space, current_search_space, offset, file_recovery_new.file_stat);
 	  params->file_nbr++;
 	  file_recovery_cpy(&file_recovery, &file_recovery_new);
 	}
@@ -69,7 +69,6 @@
 #define READ_SIZE 1024*512
 extern const file_hint_t file_hint_tar;
 extern const file_hint_t file_hint_dir;
-extern file_check_list_t file_check_list;
 
 #if defined(__CYGWIN__) || defined(__MINGW32__)
 /* Live antivirus protection may open file as soon as they are created by *
@@ -130,7 +129,7 @@ pstatus_t QPhotorec::photorec_aux(alloc_data_t *list_search_space)
   buffer=buffer_olddata+blocksize;
   start_time=time(NULL);
   previous_time=start_time;
-  next_checkpoint=start_time+5*60;
+  next_checkpoint=start_time+SESSION_CHECKPOINT_INTERVAL;
   memset(buffer_olddata,0,blocksize);
   current_search_space=td_list_entry(list_search_space->list.next, alloc_data_t, list);
   offset=set_search_start(params, &current_search_space, list_search_space);
@@ -180,25 +179,8 @@ pstatus_t QPhotorec::photorec_aux(alloc_data_t *list_search_space)
       }
       else
       {
-	struct td_list_head *tmpl;
         file_recovery_new.file_stat=NULL;
-	td_list_for_each(tmpl, &file_check_list.list)
-	{
-	  struct td_list_head *tmp;
-	  const file_check_list_t *tmp2=td_list_entry(tmpl, file_check_list_t, list);
-	  td_list_for_each(tmp, &tmp2->file_checks[buffer[tmp2->offset]].list)
-	  {
-	    const file_check_t *file_check=td_list_entry(tmp, file_check_t, list);
-	    if((file_check->length==0 || memcmp(buffer + file_check->offset, file_check->value, file_check->length)==0) &&
-		file_check->header_check(buffer, read_size, 0, &file_recovery, &file_recovery_new)!=0)
-	    {
-	      file_recovery_new.file_stat=file_check->file_stat;
-	      break;
-	    }
-	  }
-	  if(file_recovery_new.file_stat!=NULL)
-	    break;
-	}
+	header_check_find(buffer, read_size, 0, &file_recovery, &file_recovery_new);
         if(file_recovery_new.file_stat!=NULL && file_recovery_new.file_stat->file_hint!=NULL)
         {
 	  file_recovery_new.location.start=offset;
@@ -404,7 +386,7 @@ pstatus_t QPhotorec::photorec_aux(alloc_data_t *list_search_space)
 	  {
 	    /* Save current progress */
 	    session_save(list_search_space, params, options);
-	    next_checkpoint=current_time+5*60;
+	    next_checkpoint=current_time+SESSION_CHECKPOINT_INTERVAL;
 	  }
         }
       }
@@ -0,0 +1,268 @@
+/*
+
+    File: rescuemap.c
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <errno.h>
+#include "types.h"
+#include "common.h"
+#include "log.h"
+#include "rescuemap.h"
+
+static void rescue_map_insert(rescue_map_t *map, const unsigned int idx, const uint64_t pos, const uint64_t size, const char status)
+{
+  if(map->nbr >= map->alloc)
+  {
+    rescue_extent_t *new_extents;
+    map->alloc=(map->alloc < 16 ? 16 : map->alloc * 2);
+    new_extents=(rescue_extent_t *)MALLOC(map->alloc * sizeof(rescue_extent_t));
+    if(map->nbr > 0)
+      memcpy(new_extents, map->extents, map->nbr * sizeof(rescue_extent_t));
+    free(map->extents);
+    map->extents=new_extents;
+  }
+  if(idx < map->nbr)
+    memmove(&map->extents[idx+1], &map->extents[idx], (map->nbr - idx) * sizeof(rescue_extent_t));
+  map->extents[idx].pos=pos;
+  map->extents[idx].size=size;
+  map->extents[idx].status=status;
+  map->nbr++;
+}
+
+rescue_map_t *rescue_map_new(const uint64_t size)
+{
+  rescue_map_t *map=(rescue_map_t *)MALLOC(sizeof(*map));
+  map->extents=NULL;
+  map->nbr=0;
+  map->alloc=0;
+  map->current_pos=0;
+  map->current_status=RESCUE_NON_TRIED;
+  if(size > 0)
+    rescue_map_insert(map, 0, 0, size, RESCUE_NON_TRIED);
+  return map;
+}
+
+void rescue_map_free(rescue_map_t *map)
+{
+  if(map==NULL)
+    return;
+  free(map->extents);
+  free(map);
+}
+
+unsigned int rescue_map_find(const rescue_map_t *map, const uint64_t pos)
+{
+  unsigned int low=0;
+  unsigned int high=map->nbr;
+  while(low < high)
+  {
+    const unsigned int mid=low + (high - low) / 2;
+    const rescue_extent_t *extent=&map->extents[mid];
+    if(pos < extent->pos)
+      high=mid;
+    else if(pos >= extent->pos + extent->size)
+      low=mid + 1;
+    else
+      return mid;
+  }
+  return map->nbr;
+}
+
+/* Split the extent containing pos so that an extent starts at pos,
+ * return its index */
+static unsigned int rescue_map_split(rescue_map_t *map, const uint64_t pos)
+{
+  const unsigned int idx=rescue_map_find(map, pos);
+  rescue_extent_t *extent;
+  if(idx >= map->nbr)
+    return map->nbr;
+  extent=&map->extents[idx];
+  if(extent->pos == pos)
+    return idx;
+  rescue_map_insert(map, idx + 1, pos, extent->pos + extent->size - pos, extent->status);
+  map->extents[idx].size=pos - map->extents[idx].pos;
+  return idx + 1;
+}
+
+void rescue_map_set(rescue_map_t *map, const uint64_t pos, const uint64_t size, const char status)
+{
+  unsigned int first;
+  unsigned int last;
+  if(size==0)
+    return;
+  first=rescue_map_split(map, pos);
+  last=rescue_map_split(map, pos + size);
+  if(first >= last)
+    return;
+  /* Replace extents [first, last[ by a single one */
+  map->extents[first].size=map->extents[last-1].pos + map->extents[last-1].size - map->extents[first].pos;
+  map->extents[first].status=status;
+  if(last > first + 1)
+  {
+    memmove(&map->extents[first+1], &map->extents[last], (map->nbr - last) * sizeof(rescue_extent_t));
+    map->nbr-=last - first - 1;
+  }
+  /* Merge with the neighbours */
+  if(first + 1 < map->nbr && map->extents[first+1].status==status)
+  {
+    map->extents[first].size+=map->extents[first+1].size;
+    memmove(&map->extents[first+1], &map->extents[first+2], (map->nbr - first - 2) * sizeof(rescue_extent_t));
+    map->nbr--;
+  }
+  if(first > 0 && map->extents[first-1].status==status)
+  {
+    map->extents[first-1].size+=map->extents[first].size;
+    memmove(&map->extents[first], &map->extents[first+1], (map->nbr - first - 1) * sizeof(rescue_extent_t));
+    map->nbr--;
+  }
+}
+
+uint64_t rescue_map_size(const rescue_map_t *map, const char status)
+{
+  uint64_t size=0;
+  unsigned int i;
+  for(i=0; i<map->nbr; i++)
+    if(map->extents[i].status==status)
+      size+=map->extents[i].size;
+  return size;
+}
+
+char *rescue_map_filename(const char *image)
+{
+  char *filename=(char *)MALLOC(strlen(image) + 5);
+  strcpy(filename, image);
+  strcat(filename, ".map");
+  return filename;
+}
+
+rescue_map_t *rescue_map_load(const char *filename)
+{
+  FILE *f_map;
+  char line[256];
+  rescue_map_t *map;
+  int current_found=0;
+  f_map=fopen(filename, "r");
+  if(f_map==NULL)
+    return NULL;
+  map=rescue_map_new(0);
+  while(fgets(line, sizeof(line), f_map)!=NULL)
+  {
+    char *pos=line;
+    unsigned long long start;
+    unsigned long long size;
+    char status;
+    while(*pos==' ' || *pos=='\t')
+      pos++;
+    if(*pos=='#' || *pos=='\n' || *pos=='\r' || *pos=='\0')
+      continue;
+    if(current_found==0)
+    {
+      /* current_pos current_status [current_pass] */
+      if(sscanf(pos, "%llx %c", &start, &status)!=2)
+	break;
+      map->current_pos=start;
+      map->current_status=status;
+      current_found=1;
+      continue;
+    }
+    if(sscanf(pos, "%llx %llx %c", &start, &size, &status)!=3)
+      break;
+    if(size==0)
+      continue;
+    if(map->nbr > 0 &&
+	map->extents[map->nbr-1].pos + map->extents[map->nbr-1].size != start)
+    {
+      log_error("%s: extents are not contiguous\n", filename);
+      fclose(f_map);
+      rescue_map_free(map);
+      return NULL;
+    }
+    if(map->nbr > 0 && map->extents[map->nbr-1].status==status)
+      map->extents[map->nbr-1].size+=size;
+    else
+      rescue_map_insert(map, map->nbr, start, size, status);
+  }
+  fclose(f_map);
+  if(map->nbr==0)
+  {
+    rescue_map_free(map);
+    return NULL;
+  }
+  return map;
+}
+
+int rescue_map_save(const rescue_map_t *map, const char *filename)
+{
+  FILE *f_map;
+  char *tmp_name;
+  unsigned int i;
+  int res=0;
+  tmp_name=(char *)MALLOC(strlen(filename) + 2);
+  strcpy(tmp_name, filename);
+  strcat(tmp_name, "~");
+  f_map=fopen(tmp_name, "w");
+  if(f_map==NULL)
+  {
+    log_error("Can't create %s: %s\n", tmp_name, strerror(errno));
+    free(tmp_name);
+    return -1;
+  }
+  fprintf(f_map, "# Rescue map. Created by TestDisk %s\n", VERSION);
+  fprintf(f_map, "# current_pos  current_status\n");
+  fprintf(f_map, "0x%08llX     %c\n", (long long unsigned)map->current_pos, map->current_status);
+  fprintf(f_map, "#      pos        size  status\n");
+  for(i=0; i<map->nbr; i++)
+  {
+    fprintf(f_map, "0x%08llX  0x%08llX  %c\n",
+	(long long unsigned)map->extents[i].pos,
+	(long long unsigned)map->extents[i].size,
+	map->extents[i].status);
+  }
+  if(fclose(f_map)!=0)
+    res=-1;
+  /* Keep the previous map if the new one can't be written */
+  if(res==0 && rename(tmp_name, filename) < 0)
+  {
+    unlink(filename);
+    if(rename(tmp_name, filename) < 0)
+      res=-1;
+  }
+  if(res<0)
+  {
+    log_error("Can't write %s\n", filename);
+    unlink(tmp_name);
+  }
+  free(tmp_name);
+  return res;
+}
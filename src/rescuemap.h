@@ -0,0 +1,69 @@
+/*
+
+    File: rescuemap.h
+
+    Copyright (C) 2026 Christophe GRENIER <grenier@cgsecurity.org>
+
+    This software is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write the Free Software Foundation, Inc., 51
+    Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+#ifndef _RESCUEMAP_H
+#define _RESCUEMAP_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Block status, same letters as GNU ddrescue mapfiles */
+#define RESCUE_NON_TRIED	'?'
+#define RESCUE_NON_TRIMMED	'*'
+#define RESCUE_NON_SCRAPED	'/'
+#define RESCUE_BAD_SECTOR	'-'
+#define RESCUE_FINISHED		'+'
+
+typedef struct rescue_extent_struct rescue_extent_t;
+struct rescue_extent_struct
+{
+  uint64_t pos;
+  uint64_t size;
+  char status;
+};
+
+typedef struct rescue_map_struct rescue_map_t;
+struct rescue_map_struct
+{
+  rescue_extent_t *extents;
+  unsigned int nbr;
+  unsigned int alloc;
+  uint64_t current_pos;
+  char current_status;
+};
+
+/* Map of size bytes, all non-tried */
+rescue_map_t *rescue_map_new(const uint64_t size);
+rescue_map_t *rescue_map_load(const char *filename);
+int rescue_map_save(const rescue_map_t *map, const char *filename);
+void rescue_map_free(rescue_map_t *map);
+/* Set the status of [pos, pos+size[ */
+void rescue_map_set(rescue_map_t *map, const uint64_t pos, const uint64_t size, const char status);
+/* Index of the extent containing pos, map->nbr if none */
+unsigned int rescue_map_find(const rescue_map_t *map, const uint64_t pos);
+uint64_t rescue_map_size(const rescue_map_t *map, const char status);
+/* Name of the map associated to a disk image */
+char *rescue_map_filename(const char *image);
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+#endif
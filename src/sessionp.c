@@ -42,6 +42,10 @@
 #include <stdlib.h>
 #endif
 #include <errno.h>
+#include <stdarg.h>
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
 #include "types.h"
 #include "common.h"
 #include "intrf.h"
@@ -49,64 +53,102 @@
 #include "photorec.h"
 #include "sessionp.h"
 #include "log.h"
+#include "phpool.h"
+#include "phhash.h"
 
 #define SESSION_MAXSIZE 40960
 #define SESSION_FILENAME "photorec.ses"
+#define SESSION_TMPNAME "photorec.new"
 
-int session_load(char **cmd_device, char **current_cmd, alloc_data_t *list_free_space)
+/* photorec.ses is a journal of checkpoints. Each checkpoint is made of
+ * a SESSION_REC_CMD record (the "#time\ndevice cmd\n" header of the old
+ * text format), either a SESSION_REC_FULL record or a SESSION_REC_DEL and
+ * a SESSION_REC_ADD record holding the search space changes since the
+ * previous checkpoint, and a SESSION_REC_COMMIT record.
+ * Extents are stored in sectors as little-endian start/end pairs.
+ * Only committed checkpoints are used when loading the session, a record
+ * with a bad magic or checksum ends the journal. */
+#define SESSION_MAGIC		0x53455350	/* "PSES" */
+#define SESSION_REC_CMD		1
+#define SESSION_REC_FULL	2
+#define SESSION_REC_DEL		3
+#define SESSION_REC_ADD		4
+#define SESSION_REC_COMMIT	5
+
+struct session_record
 {
-  FILE *f_session;
-  char *buffer;
-  char *pos;
-  int taille;
-  struct stat stat_rec;
-  unsigned int buffer_size;
-//  time_t my_time;
-  char *info=NULL;
-  f_session=fopen(SESSION_FILENAME,"rb");
-  if(!f_session)
+  uint32_t magic;
+  uint32_t type;
+  uint32_t size;
+  uint32_t checksum;
+} __attribute__ ((__packed__));
+
+struct session_extent
+{
+  uint64_t start;
+  uint64_t end;
+};
+
+struct session_buffer
+{
+  char *data;
+  unsigned int size;
+  unsigned int alloc;
+};
+
+/* Search space saved by the last checkpoint, in sectors */
+static struct session_extent *session_snapshot=NULL;
+static unsigned int session_snapshot_nbr=0;
+static unsigned int session_snapshot_valid=0;
+/* Size of the committed journal and of its parts */
+static uint64_t session_journal_size=0;
+static uint64_t session_full_size=0;
+static uint64_t session_delta_size=0;
+
+static uint32_t session_checksum(uint32_t hash, const unsigned char *buffer, const unsigned int size)
+{
+  unsigned int i;
+  for(i=0; i<size; i++)
   {
-    log_info("Can't open photorec.ses file: %s\n",strerror(errno));
-    session_save(NULL, NULL, NULL);
-    return -1;
+    hash^=buffer[i];
+    hash*=16777619;
   }
-  if(fstat(fileno(f_session), &stat_rec)<0)
-    buffer_size=SESSION_MAXSIZE;
-  else
-    buffer_size=stat_rec.st_size;
-  buffer=(char *)MALLOC(buffer_size+1);
-  taille=fread(buffer,1,buffer_size,f_session);
-  buffer[taille]='\0';
-  fclose(f_session);
-  pos=buffer;
+  return hash;
+}
+
+static int session_extent_cmp(const struct session_extent *a, const struct session_extent *b)
+{
+  if(a->start != b->start)
+    return (a->start < b->start ? -1 : 1);
+  if(a->end != b->end)
+    return (a->end < b->end ? -1 : 1);
+  return 0;
+}
+
+static int session_extent_qsort_cmp(const void *a, const void *b)
+{
+  return session_extent_cmp((const struct session_extent *)a, (const struct session_extent *)b);
+}
+
+static char *session_load_header(char *pos, char **cmd_device, char **current_cmd)
+{
+  char *info;
   if(*pos!='#')
-  {
-    free(buffer);
-    return -1;
-  }
+    return NULL;
   pos++;
   /* load time */
   strtol(pos,&pos,10); 	// my_time=strtol(pos,&pos,10);
   if(pos==NULL)
-  {
-    free(buffer);
-    return 0;
-  }
+    return NULL;
   pos=strstr(pos,"\n");
   if(pos==NULL)
-  {
-    free(buffer);
-    return 0;
-  }
+    return NULL;
   pos++;
   /* get current disk */
   info=pos;
   pos=strstr(info," ");
   if(pos==NULL)
-  {
-    free(buffer);
-    return 0;
-  }
+    return NULL;
   *pos='\0';
   pos++;
   *cmd_device=strdup(info);
@@ -114,13 +156,36 @@ int session_load(char **cmd_device, char **current_cmd, alloc_data_t *list_free_
   info=pos;
   pos=strstr(pos,"\n");
   if(pos==NULL)
-  {
-    free(buffer);
-    return 0;
-  }
+    return NULL;
   *pos='\0';
   pos++;
   *current_cmd=strdup(info);
+  return pos;
+}
+
+static void session_add_extent(alloc_data_t *list_free_space, const uint64_t start, const uint64_t end)
+{
+  alloc_data_t *new_free_space;
+  if(start > end)
+    return;
+  new_free_space=search_space_node_new();
+  /* Temporary storage, values need to be multiplied by sector_size */
+  new_free_space->start=start;
+  new_free_space->end=end;
+  new_free_space->file_stat=NULL;
+  new_free_space->data=1;
+  td_list_add_tail(&new_free_space->list, &list_free_space->list);
+#ifdef DEBUG
+  log_trace(">%lu-%lu<\n", start, end);
+#endif
+}
+
+/* Text session file written by older versions */
+static int session_load_text(char *buffer, char **cmd_device, char **current_cmd, alloc_data_t *list_free_space)
+{
+  char *pos=session_load_header(buffer, cmd_device, current_cmd);
+  if(pos==NULL)
+    return (*cmd_device==NULL ? -1 : 0);
   while(1)
   {
     uint64_t start=0;
@@ -131,189 +196,606 @@ int session_load(char **cmd_device, char **current_cmd, alloc_data_t *list_free_
       pos++;
     }
     if(*pos++ != '-')
-    {
-      free(buffer);
       return 0;
-    }
     while(*pos >= '0' && *pos <= '9')
     {
       end=end*10+(*pos -'0');
       pos++;
     }
-    if(start <= end)
-    {
-      alloc_data_t *new_free_space;
-      new_free_space=(alloc_data_t*)MALLOC(sizeof(*new_free_space));
-      /* Temporary storage, values need to be multiplied by sector_size */
-      new_free_space->start=start;
-      new_free_space->end=end;
-      new_free_space->file_stat=NULL;
-      new_free_space->data=1;
-      td_list_add_tail(&new_free_space->list, &list_free_space->list);
-#ifdef DEBUG
-      log_trace(">%lu-%lu<\n", start, end);
-#endif
-    }
+    session_add_extent(list_free_space, start, end);
     while(*pos=='\n' || *pos=='\r')
       pos++;
   }
 }
 
-int session_save(alloc_data_t *list_free_space, struct ph_param *params,  const struct ph_options *options)
+static void session_read_extents(struct session_extent *dst, const unsigned char *src, const unsigned int nbr)
+{
+  unsigned int i;
+  for(i=0; i<nbr; i++)
+  {
+    uint64_t tmp[2];
+    memcpy(tmp, &src[i*sizeof(tmp)], sizeof(tmp));
+    dst[i].start=le64(tmp[0]);
+    dst[i].end=le64(tmp[1]);
+  }
+}
+
+/* Remove the extents of del from state and merge the extents of add,
+ * all three arrays being sorted */
+static struct session_extent *session_apply_delta(const struct session_extent *state, const unsigned int state_nbr,
+    const struct session_extent *del, const unsigned int del_nbr,
+    const struct session_extent *add, const unsigned int add_nbr,
+    unsigned int *res_nbr)
+{
+  struct session_extent *res;
+  unsigned int i=0;
+  unsigned int j=0;
+  unsigned int k=0;
+  unsigned int nbr=0;
+  res=(struct session_extent *)MALLOC((state_nbr+add_nbr+1)*sizeof(struct session_extent));
+  while(i<state_nbr || k<add_nbr)
+  {
+    if(i<state_nbr)
+    {
+      while(j<del_nbr && session_extent_cmp(&del[j], &state[i]) < 0)
+	j++;
+      if(j<del_nbr && session_extent_cmp(&del[j], &state[i]) == 0)
+      {
+	i++;
+	j++;
+	continue;
+      }
+    }
+    if(k>=add_nbr || (i<state_nbr && session_extent_cmp(&state[i], &add[k]) <= 0))
+      res[nbr++]=state[i++];
+    else
+      res[nbr++]=add[k++];
+  }
+  *res_nbr=nbr;
+  return res;
+}
+
+static int session_load_journal(const unsigned char *buffer, const uint64_t buffer_size, char **cmd_device, char **current_cmd, alloc_data_t *list_free_space)
+{
+  struct session_extent *state=NULL;
+  unsigned int state_nbr=0;
+  char *cmd=NULL;
+  const unsigned char *pending_cmd=NULL;
+  unsigned int pending_cmd_size=0;
+  const unsigned char *pending[SESSION_REC_ADD+1];
+  unsigned int pending_nbr[SESSION_REC_ADD+1];
+  uint64_t pos=0;
+  unsigned int i;
+  memset(pending, 0, sizeof(pending));
+  memset(pending_nbr, 0, sizeof(pending_nbr));
+  while(pos + sizeof(struct session_record) <= buffer_size)
+  {
+    struct session_record rec;
+    const unsigned char *payload=&buffer[pos + sizeof(struct session_record)];
+    unsigned int size;
+    memcpy(&rec, &buffer[pos], sizeof(rec));
+    if(le32(rec.magic)!=SESSION_MAGIC)
+      break;
+    size=le32(rec.size);
+    if(size > buffer_size - pos - sizeof(struct session_record) ||
+	le32(rec.checksum) != session_checksum(2166136261U, payload, size))
+      break;
+    switch(le32(rec.type))
+    {
+      case SESSION_REC_CMD:
+	pending_cmd=payload;
+	pending_cmd_size=size;
+	break;
+      case SESSION_REC_FULL:
+      case SESSION_REC_DEL:
+      case SESSION_REC_ADD:
+	pending[le32(rec.type)]=payload;
+	pending_nbr[le32(rec.type)]=size / sizeof(struct session_extent);
+	break;
+      case SESSION_REC_COMMIT:
+	{
+	  struct session_extent *tmp[SESSION_REC_ADD+1];
+	  struct session_extent *new_state;
+	  for(i=SESSION_REC_FULL; i<=SESSION_REC_ADD; i++)
+	  {
+	    tmp[i]=(struct session_extent *)MALLOC((pending_nbr[i]+1)*sizeof(struct session_extent));
+	    session_read_extents(tmp[i], pending[i], pending_nbr[i]);
+	  }
+	  if(pending[SESSION_REC_FULL]!=NULL)
+	  {
+	    free(state);
+	    state=tmp[SESSION_REC_FULL];
+	    state_nbr=pending_nbr[SESSION_REC_FULL];
+	    tmp[SESSION_REC_FULL]=NULL;
+	  }
+	  new_state=session_apply_delta(state, state_nbr,
+	      tmp[SESSION_REC_DEL], pending_nbr[SESSION_REC_DEL],
+	      tmp[SESSION_REC_ADD], pending_nbr[SESSION_REC_ADD], &state_nbr);
+	  free(state);
+	  state=new_state;
+	  for(i=SESSION_REC_FULL; i<=SESSION_REC_ADD; i++)
+	    free(tmp[i]);
+	  if(pending_cmd!=NULL)
+	  {
+	    free(cmd);
+	    cmd=(char *)MALLOC(pending_cmd_size+1);
+	    memcpy(cmd, pending_cmd, pending_cmd_size);
+	    cmd[pending_cmd_size]='\0';
+	  }
+	}
+	pending_cmd=NULL;
+	memset(pending, 0, sizeof(pending));
+	memset(pending_nbr, 0, sizeof(pending_nbr));
+	break;
+      default:
+	break;
+    }
+    pos+=sizeof(struct session_record) + size;
+  }
+  if(cmd==NULL || session_load_header(cmd, cmd_device, current_cmd)==NULL)
+  {
+    free(cmd);
+    free(state);
+    return (*cmd_device==NULL ? -1 : 0);
+  }
+  for(i=0; i<state_nbr; i++)
+    session_add_extent(list_free_space, state[i].start, state[i].end);
+  free(cmd);
+  free(state);
+  return 0;
+}
+
+int session_load(char **cmd_device, char **current_cmd, alloc_data_t *list_free_space)
 {
   FILE *f_session;
-  if(params!=NULL && params->status==STATUS_QUIT)
-    return 0;
-  f_session=fopen(SESSION_FILENAME,"wb");
+  char *buffer;
+  int taille;
+  struct stat stat_rec;
+  unsigned int buffer_size;
+  int res;
+  f_session=fopen(SESSION_FILENAME,"rb");
   if(!f_session)
   {
-    log_critical("Can't create photorec.ses file: %s\n",strerror(errno));
+    log_info("Can't open photorec.ses file: %s\n",strerror(errno));
+    session_save(NULL, NULL, NULL);
     return -1;
   }
-  if(params!=NULL)
+  if(fstat(fileno(f_session), &stat_rec)<0)
+    buffer_size=SESSION_MAXSIZE;
+  else
+    buffer_size=stat_rec.st_size;
+  if(fgetc(f_session)!='#')
   {
-    struct td_list_head *free_walker = NULL;
-    unsigned int i;
-    const file_enable_t *files_enable=options->list_file_format;
-    unsigned int disable=0;
-    unsigned int enable=0;
-    unsigned int enable_by_default=0;
-    if(options->verbose>1)
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    void *map=MAP_FAILED;
+    if(buffer_size>0)
+      map=mmap(NULL, buffer_size, PROT_READ, MAP_PRIVATE, fileno(f_session), 0);
+    if(map!=MAP_FAILED)
     {
-      log_trace("session_save\n");
+      res=session_load_journal((const unsigned char *)map, buffer_size, cmd_device, current_cmd, list_free_space);
+      munmap(map, buffer_size);
+      fclose(f_session);
+      return res;
     }
-    fprintf(f_session,"#%u\n%s %s,%u,",
+#endif
+    rewind(f_session);
+    buffer=(char *)MALLOC(buffer_size+1);
+    taille=fread(buffer,1,buffer_size,f_session);
+    fclose(f_session);
+    res=session_load_journal((const unsigned char *)buffer, (taille>0?taille:0), cmd_device, current_cmd, list_free_space);
+    free(buffer);
+    return res;
+  }
+  rewind(f_session);
+  buffer=(char *)MALLOC(buffer_size+1);
+  taille=fread(buffer,1,buffer_size,f_session);
+  buffer[(taille>0?taille:0)]='\0';
+  fclose(f_session);
+  res=session_load_text(buffer, cmd_device, current_cmd, list_free_space);
+  free(buffer);
+  return res;
+}
+
+static void session_printf(struct session_buffer *buf, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void session_printf(struct session_buffer *buf, const char *fmt, ...)
+{
+  va_list ap;
+  int len;
+  va_start(ap, fmt);
+  len=vsnprintf(buf->data + buf->size, buf->alloc - buf->size, fmt, ap);
+  va_end(ap);
+  if(len < 0)
+    return;
+  if(buf->size + len >= buf->alloc)
+  {
+    char *new_data;
+    buf->alloc=buf->size + len + 4096;
+    new_data=(char *)MALLOC(buf->alloc);
+    memcpy(new_data, buf->data, buf->size);
+    free(buf->data);
+    buf->data=new_data;
+    va_start(ap, fmt);
+    vsnprintf(buf->data + buf->size, buf->alloc - buf->size, fmt, ap);
+    va_end(ap);
+  }
+  buf->size+=len;
+}
+
+static void session_cmd(struct session_buffer *cmd, const struct ph_param *params, const struct ph_options *options)
+{
+  unsigned int i;
+  const file_enable_t *files_enable=options->list_file_format;
+  unsigned int disable=0;
+  unsigned int enable=0;
+  unsigned int enable_by_default=0;
+  session_printf(cmd,"#%u\n%s %s,%u,",
 	(unsigned int)time(NULL), params->disk->device, params->disk->arch->part_name_option, params->partition->order);
-    if(params->blocksize>0)
-      fprintf(f_session,"blocksize,%u,", params->blocksize);
-    fprintf(f_session,"fileopt,");
-    for(i=0;files_enable[i].file_hint!=NULL;i++)
-    {
-      if(files_enable[i].enable==0)
+  if(params->blocksize>0)
+    session_printf(cmd,"blocksize,%u,", params->blocksize);
+  session_printf(cmd,"fileopt,");
+  for(i=0;files_enable[i].file_hint!=NULL;i++)
+  {
+    if(files_enable[i].enable==0)
 	disable++;
-      else
+    else
 	enable++;
-      if(files_enable[i].enable==files_enable[i].file_hint->enable_by_default)
+    if(files_enable[i].enable==files_enable[i].file_hint->enable_by_default)
 	enable_by_default++;
-    }
-    if(enable_by_default >= disable && enable_by_default >= enable)
+  }
+  if(enable_by_default >= disable && enable_by_default >= enable)
+  {
+    for(i=0;files_enable[i].file_hint!=NULL;i++)
     {
-      for(i=0;files_enable[i].file_hint!=NULL;i++)
-      {
 	if(files_enable[i].enable!=files_enable[i].file_hint->enable_by_default &&
 	      files_enable[i].file_hint->extension!=NULL &&
 	      files_enable[i].file_hint->extension[0]!='\0')
 	{
-	  fprintf(f_session,"%s,%s,", files_enable[i].file_hint->extension,
+	  session_printf(cmd,"%s,%s,", files_enable[i].file_hint->extension,
 	      (files_enable[i].enable!=0?"enable":"disable"));
 	}
-      }
     }
-    else if(enable > disable)
+  }
+  else if(enable > disable)
+  {
+    session_printf(cmd,"everything,enable,");
+    for(i=0;files_enable[i].file_hint!=NULL;i++)
     {
-      fprintf(f_session,"everything,enable,");
-      for(i=0;files_enable[i].file_hint!=NULL;i++)
-      {
 	if(files_enable[i].enable==0 &&
 	      files_enable[i].file_hint->extension!=NULL &&
 	      files_enable[i].file_hint->extension[0]!='\0')
 	{
-	  fprintf(f_session,"%s,disable,", files_enable[i].file_hint->extension);
+	  session_printf(cmd,"%s,disable,", files_enable[i].file_hint->extension);
 	}
-      }
     }
-    else
+  }
+  else
+  {
+    session_printf(cmd,"everything,disable,");
+    for(i=0;files_enable[i].file_hint!=NULL;i++)
     {
-      fprintf(f_session,"everything,disable,");
-      for(i=0;files_enable[i].file_hint!=NULL;i++)
-      {
 	if(files_enable[i].enable!=0 &&
 	      files_enable[i].file_hint->extension!=NULL &&
 	      files_enable[i].file_hint->extension[0]!='\0')
 	{
-	  fprintf(f_session,"%s,enable,", files_enable[i].file_hint->extension);
+	  session_printf(cmd,"%s,enable,", files_enable[i].file_hint->extension);
 	}
-      }
     }
-    /* Save options */
-    fprintf(f_session, "options,");
-    if(options->paranoid==0)
-      fprintf(f_session, "paranoid_no,");
-    else if(options->paranoid==1)
-      fprintf(f_session, "paranoid,");
-    else
-      fprintf(f_session, "paranoid_bf,");
-    if(options->keep_corrupted_file>0)
-      fprintf(f_session, "keep_corrupted_file,");
-    else
-      fprintf(f_session, "keep_corrupted_file_no,");
-    if(options->mode_ext2>0)
-      fprintf(f_session, "mode_ext2,");
-    if(options->expert>0)
-      fprintf(f_session, "expert,");
-    if(options->lowmem>0)
-      fprintf(f_session, "lowmem,");
-    /* Save options - End */
-    if(params->carve_free_space_only>0)
-      fprintf(f_session,"freespace,");
-    else
-      fprintf(f_session,"wholespace,");
-    fprintf(f_session,"search,");
-    switch(params->status)
-    {
-      case STATUS_UNFORMAT:
-        fprintf(f_session, "status=unformat,");
+  }
+  /* Save options */
+  session_printf(cmd, "options,");
+  if(options->paranoid==0)
+    session_printf(cmd, "paranoid_no,");
+  else if(options->paranoid==1)
+    session_printf(cmd, "paranoid,");
+  else
+    session_printf(cmd, "paranoid_bf,");
+  if(options->keep_corrupted_file>0)
+    session_printf(cmd, "keep_corrupted_file,");
+  else
+    session_printf(cmd, "keep_corrupted_file_no,");
+  if(options->mode_ext2>0)
+    session_printf(cmd, "mode_ext2,");
+  if(options->expert>0)
+    session_printf(cmd, "expert,");
+  if(options->lowmem>0)
+    session_printf(cmd, "lowmem,");
+  if(options->container>0)
+    session_printf(cmd, "container,");
+  if(options->metadata>0)
+    session_printf(cmd, "metadata,");
+  if((options->hash & PHHASH_MD5)!=0)
+    session_printf(cmd, "hash_md5,");
+  if((options->hash & PHHASH_SHA1)!=0)
+    session_printf(cmd, "hash_sha1,");
+  if((options->hash & PHHASH_SHA256)!=0)
+    session_printf(cmd, "hash_sha256,");
+  if(options->hash_csv>0)
+    session_printf(cmd, "hash_csv,");
+  /* Save options - End */
+  if(params->carve_free_space_only>0)
+    session_printf(cmd,"freespace,");
+  else
+    session_printf(cmd,"wholespace,");
+  session_printf(cmd,"search,");
+  switch(params->status)
+  {
+    case STATUS_UNFORMAT:
+      session_printf(cmd, "status=unformat,");
 	break;
-      case STATUS_FIND_OFFSET:
-        fprintf(f_session, "status=find_offset,");
+    case STATUS_FIND_OFFSET:
+      session_printf(cmd, "status=find_offset,");
 	break;
-      case STATUS_EXT2_ON_BF:
-	fprintf(f_session, "status=ext2_on_bf,");
+    case STATUS_EXT2_ON_BF:
+	session_printf(cmd, "status=ext2_on_bf,");
 	break;
-      case STATUS_EXT2_ON_SAVE_EVERYTHING:
-	fprintf(f_session, "status=ext2_on_save_everything,");
+    case STATUS_EXT2_ON_SAVE_EVERYTHING:
+	session_printf(cmd, "status=ext2_on_save_everything,");
 	break;
-      case STATUS_EXT2_ON:
-	fprintf(f_session, "status=ext2_on,");
+    case STATUS_EXT2_ON:
+	session_printf(cmd, "status=ext2_on,");
 	break;
-      case STATUS_EXT2_OFF_SAVE_EVERYTHING:
-	fprintf(f_session, "status=ext2_off_save_everything,");
+    case STATUS_EXT2_OFF_SAVE_EVERYTHING:
+	session_printf(cmd, "status=ext2_off_save_everything,");
 	break;
-      case STATUS_EXT2_OFF_BF:
-	fprintf(f_session, "status=ext2_off_bf,");
+    case STATUS_EXT2_OFF_BF:
+	session_printf(cmd, "status=ext2_off_bf,");
 	break;
-      case STATUS_EXT2_OFF:
-	fprintf(f_session, "status=ext2_off,");
+    case STATUS_EXT2_OFF:
+	session_printf(cmd, "status=ext2_off,");
 	break;
-      case STATUS_QUIT:
-        break;
-    }
-    if(params->status!=STATUS_FIND_OFFSET && params->offset!=-1)
-      fprintf(f_session, "%llu,",
+    case STATUS_QUIT:
+      break;
+  }
+  if(params->status!=STATUS_FIND_OFFSET && params->offset!=-1)
+    session_printf(cmd, "%llu,",
 	  (long long unsigned)(params->offset/params->disk->sector_size));
-    fprintf(f_session,"inter\n");
-    td_list_for_each(free_walker, &list_free_space->list)
+  session_printf(cmd,"inter\n");
+}
+
+static int session_write_record(FILE *f_session, const unsigned int type, const void *payload, const unsigned int size)
+{
+  struct session_record rec;
+  rec.magic=le32(SESSION_MAGIC);
+  rec.type=le32(type);
+  rec.size=le32(size);
+  rec.checksum=le32(session_checksum(2166136261U, (const unsigned char *)payload, size));
+  if(fwrite(&rec, sizeof(rec), 1, f_session)!=1)
+    return -1;
+  if(size>0 && fwrite(payload, size, 1, f_session)!=1)
+    return -1;
+  return 0;
+}
+
+static int session_write_extents(FILE *f_session, const unsigned int type, const struct session_extent *extents, const unsigned int nbr)
+{
+#ifdef TESTDISK_LSB
+  return session_write_record(f_session, type, extents, nbr * sizeof(struct session_extent));
+#else
+  struct session_extent *tmp;
+  unsigned int i;
+  int res;
+  tmp=(struct session_extent *)MALLOC((nbr+1)*sizeof(struct session_extent));
+  for(i=0; i<nbr; i++)
+  {
+    tmp[i].start=le64(extents[i].start);
+    tmp[i].end=le64(extents[i].end);
+  }
+  res=session_write_record(f_session, type, tmp, nbr * sizeof(struct session_extent));
+  free(tmp);
+  return res;
+#endif
+}
+
+static int session_reserve(FILE *f_session)
+{ /* Reserve some space */
+  int res;
+  char *buffer;
+  buffer=(char *)MALLOC(SESSION_MAXSIZE);
+  memset(buffer,0,SESSION_MAXSIZE);
+  res=fwrite(buffer,1,SESSION_MAXSIZE,f_session);
+  free(buffer);
+  if(res<SESSION_MAXSIZE)
+    return -1;
+  return 0;
+}
+
+static int session_seek(FILE *f_session, const uint64_t offset)
+{
+#ifdef HAVE_FSEEKO
+  return fseeko(f_session, offset, SEEK_SET);
+#else
+  return fseek(f_session, offset, SEEK_SET);
+#endif
+}
+
+/* Make sure the records are on disk before they are relied upon */
+static int session_sync(FILE *f_session)
+{
+  if(fflush(f_session)!=0)
+    return -1;
+#ifdef HAVE_FSYNC
+  if(fsync(fileno(f_session))<0)
+    return -1;
+#endif
+  return 0;
+}
+
+/* Write a whole checkpoint in a new journal */
+static int session_write_full(const char *filename, const struct session_buffer *cmd, const struct session_extent *extents, const unsigned int nbr)
+{
+  FILE *f_session;
+  f_session=fopen(filename,"wb");
+  if(!f_session)
+  {
+    log_critical("Can't create %s file: %s\n", filename, strerror(errno));
+    return -1;
+  }
+  if(session_write_record(f_session, SESSION_REC_CMD, cmd->data, cmd->size) < 0 ||
+      session_write_extents(f_session, SESSION_REC_FULL, extents, nbr) < 0 ||
+      session_write_record(f_session, SESSION_REC_COMMIT, NULL, 0) < 0 ||
+      session_reserve(f_session) < 0 ||
+      session_sync(f_session) < 0)
+  {
+    fclose(f_session);
+    return -1;
+  }
+  if(fclose(f_session)!=0)
+    return -1;
+  session_full_size=3 * sizeof(struct session_record) + cmd->size + (uint64_t)nbr * sizeof(struct session_extent);
+  session_journal_size=session_full_size;
+  session_delta_size=0;
+  return 0;
+}
+
+/* Append the changes since the previous checkpoint to the journal */
+static int session_write_delta(const struct session_buffer *cmd, const struct session_extent *extents, const unsigned int nbr)
+{
+  FILE *f_session;
+  struct session_extent *del;
+  struct session_extent *add;
+  unsigned int del_nbr=0;
+  unsigned int add_nbr=0;
+  unsigned int i=0;
+  unsigned int j=0;
+  int res;
+  del=(struct session_extent *)MALLOC((session_snapshot_nbr+1)*sizeof(struct session_extent));
+  add=(struct session_extent *)MALLOC((nbr+1)*sizeof(struct session_extent));
+  while(i<session_snapshot_nbr || j<nbr)
+  {
+    const int cmp=(i>=session_snapshot_nbr ? 1 : (j>=nbr ? -1 :
+	  session_extent_cmp(&session_snapshot[i], &extents[j])));
+    if(cmp < 0)
+      del[del_nbr++]=session_snapshot[i++];
+    else if(cmp > 0)
+      add[add_nbr++]=extents[j++];
+    else
     {
-      alloc_data_t *current_free_space;
-      current_free_space=td_list_entry(free_walker, alloc_data_t, list);
-      fprintf(f_session,"%llu-%llu\n",
-	  (long long unsigned)(current_free_space->start/params->disk->sector_size),
-	  (long long unsigned)(current_free_space->end/params->disk->sector_size));
+      i++;
+      j++;
     }
   }
-  { /* Reserve some space */
-    int res;
-    char *buffer;
-    buffer=(char *)MALLOC(SESSION_MAXSIZE);
-    memset(buffer,0,SESSION_MAXSIZE);
-    res=fwrite(buffer,1,SESSION_MAXSIZE,f_session);
-    free(buffer);
-    if(res<SESSION_MAXSIZE)
+  f_session=fopen(SESSION_FILENAME,"r+b");
+  if(!f_session)
+  {
+    log_critical("Can't open photorec.ses file: %s\n",strerror(errno));
+    free(del);
+    free(add);
+    return -1;
+  }
+  res=0;
+  if(session_seek(f_session, session_journal_size) < 0 ||
+      session_write_record(f_session, SESSION_REC_CMD, cmd->data, cmd->size) < 0 ||
+      session_write_extents(f_session, SESSION_REC_DEL, del, del_nbr) < 0 ||
+      session_write_extents(f_session, SESSION_REC_ADD, add, add_nbr) < 0 ||
+      session_write_record(f_session, SESSION_REC_COMMIT, NULL, 0) < 0 ||
+      session_reserve(f_session) < 0 ||
+      session_sync(f_session) < 0)
+    res=-1;
+  if(fclose(f_session)!=0)
+    res=-1;
+  if(res==0)
+  {
+    const uint64_t size=4 * sizeof(struct session_record) + cmd->size +
+      (uint64_t)(del_nbr + add_nbr) * sizeof(struct session_extent);
+    session_journal_size+=size;
+    session_delta_size+=size;
+  }
+  free(del);
+  free(add);
+  return res;
+}
+
+int session_save(alloc_data_t *list_free_space, struct ph_param *params,  const struct ph_options *options)
+{
+  struct session_buffer cmd;
+  struct session_extent *extents=NULL;
+  struct td_list_head *free_walker = NULL;
+  unsigned int nbr=0;
+  unsigned int alloc=0;
+  unsigned int sorted=1;
+  int res=-1;
+  if(params!=NULL && params->status==STATUS_QUIT)
+    return 0;
+  if(params==NULL)
+  {
+    FILE *f_session;
+    free(session_snapshot);
+    session_snapshot=NULL;
+    session_snapshot_nbr=0;
+    session_snapshot_valid=0;
+    f_session=fopen(SESSION_FILENAME,"wb");
+    if(!f_session)
+    {
+      log_critical("Can't create photorec.ses file: %s\n",strerror(errno));
+      return -1;
+    }
+    if(session_reserve(f_session) < 0)
     {
       fclose(f_session);
       return -1;
     }
+    fclose(f_session);
+    return 0;
   }
-  fclose(f_session);
+  if(options->verbose>1)
+  {
+    log_trace("session_save\n");
+  }
+  cmd.size=0;
+  cmd.alloc=4096;
+  cmd.data=(char *)MALLOC(cmd.alloc);
+  session_cmd(&cmd, params, options);
+  td_list_for_each(free_walker, &list_free_space->list)
+  {
+    const alloc_data_t *current_free_space=td_list_entry_const(free_walker, const alloc_data_t, list);
+    if(nbr>=alloc)
+    {
+      struct session_extent *new_extents;
+      alloc=(alloc==0 ? 1024 : alloc * 2);
+      new_extents=(struct session_extent *)MALLOC(alloc*sizeof(struct session_extent));
+      if(nbr>0)
+	memcpy(new_extents, extents, nbr*sizeof(struct session_extent));
+      free(extents);
+      extents=new_extents;
+    }
+    extents[nbr].start=current_free_space->start/params->disk->sector_size;
+    extents[nbr].end=current_free_space->end/params->disk->sector_size;
+    if(nbr>0 && session_extent_cmp(&extents[nbr-1], &extents[nbr]) > 0)
+      sorted=0;
+    nbr++;
+  }
+  if(sorted==0)
+    qsort(extents, nbr, sizeof(struct session_extent), session_extent_qsort_cmp);
+  /* Compact the journal when the deltas outgrow the full checkpoint */
+  if(session_snapshot_valid>0 && session_delta_size <= session_full_size)
+    res=session_write_delta(&cmd, extents, nbr);
+  if(res<0)
+  {
+    res=session_write_full(SESSION_TMPNAME, &cmd, extents, nbr);
+    if(res==0 && rename(SESSION_TMPNAME, SESSION_FILENAME) < 0)
+    {
+      unlink(SESSION_FILENAME);
+      if(rename(SESSION_TMPNAME, SESSION_FILENAME) < 0)
+	res=-1;
+    }
+    if(res<0)
+    {
+      /* Not enough space for a copy, reuse the space reserved by photorec.ses */
+      unlink(SESSION_TMPNAME);
+      res=session_write_full(SESSION_FILENAME, &cmd, extents, nbr);
+    }
+  }
+  free(cmd.data);
+  if(res<0)
+  {
+    free(extents);
+    session_snapshot_valid=0;
+    return -1;
+  }
+  free(session_snapshot);
+  session_snapshot=extents;
+  session_snapshot_nbr=nbr;
+  session_snapshot_valid=1;
   return 0;
 }
@@ -23,6 +23,9 @@
 extern "C" {
 #endif
 
+/* Seconds between two checkpoints of the search space */
+#define SESSION_CHECKPOINT_INTERVAL 10
+
 int session_load(char **cmd_device, char **current_cmd, alloc_data_t *list_free_space);
 int session_save(alloc_data_t *list_free_space, struct ph_param *params, const struct ph_options *options);
 
@@ -67,6 +67,7 @@
 #include "tlog.h"
 #include "autoset.h"
 #include "hidden.h"
+#include "profile.h"
 
 #ifdef HAVE_SIGACTION
 static struct sigaction action;
@@ -88,12 +89,13 @@ static void sighup_hdlr(int sig)
 static void display_help(void)
 {
   printf("\n" \
-      "Usage: testdisk [/log] [/debug] [file.dd|file.e01|device]\n"\
+      "Usage: testdisk [/log] [/debug] [/cache size] [file.dd|file.e01|device]\n"\
       "       testdisk /list  [/log]   [file.dd|file.e01|device]\n" \
       "       testdisk /version\n" \
       "\n" \
       "/log          : create a testdisk.log file\n" \
       "/debug        : add debug information\n" \
+      "/cache size   : size of the disk cache in MiB (default 4)\n" \
       "/list         : display current partitions\n" \
       "\n" \
       "TestDisk checks and recovers lost partitions\n" \
@@ -272,6 +274,13 @@ int main( int argc, char **argv )
     }
     else if((strcmp(argv[i],"/all")==0) || (strcmp(argv[i],"-all")==0))
       testdisk_mode|=TESTDISK_O_ALL;
+    else if(((strcmp(argv[i],"/cache")==0)||(strcmp(argv[i],"-cache")==0)) &&(i+1<argc))
+    {
+      /* Size of the disk cache in MiB */
+      const int size=atoi(argv[++i]);
+      if(size > 0 && size <= 2048)
+	diskcache_set_size((unsigned int)size*1024*1024);
+    }
     else if((strcmp(argv[i],"/backup")==0) || (strcmp(argv[i],"-backup")==0))
       create_backup=1;
     else if((strcmp(argv[i],"/direct")==0) || (strcmp(argv[i],"-direct")==0))
@@ -429,6 +438,7 @@ int main( int argc, char **argv )
   /* Activate the cache */
   for(element_disk=list_disk;element_disk!=NULL;element_disk=element_disk->next)
     element_disk->disk=new_diskcache(element_disk->disk,testdisk_mode);
+  prof_reset();
 #ifdef HAVE_NCURSES
   wmove(stdscr,6,0);
   for(element_disk=list_disk;element_disk!=NULL;element_disk=element_disk->next)
@@ -490,6 +500,7 @@ int main( int argc, char **argv )
   }
   cmd_device=NULL;
   cmd_run=NULL;
+  prof_log();
   write_used=delete_list_disk(list_disk);
   log_info("TestDisk exited normally.\n");
   if(log_close()!=0)